@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+
+// Counts the allocations made through the global operator new, by every thread. The counting
+// replacements of operator new and delete live in allocationCounter.cpp, so only targets that
+// link it count; each allocation then costs one relaxed atomic increment more.
+class AllocationCounter
+{
+   public:
+    // Allocations since the program started.
+    static std::size_t total();
+
+    AllocationCounter() : start(total()) {}
+    // Allocations since this counter was made.
+    std::size_t count() const { return total() - start; }
+
+   private:
+    std::size_t start;
+};
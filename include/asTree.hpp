@@ -4,17 +4,20 @@
 #include <memory>
 #include <optional>
 #include "token.hpp"
+#include "lineIndex.hpp"
 #include "position.hpp"
+#include "symbolTable.hpp"
 #include "interpreter_exception.hpp"
+#include "astArena.hpp"
 #include "astVisitor.hpp"
 
 struct FuncDefArgument
 {
     bool modifier;
-    std::string id;
+    SymbolId id;
 };
 
-enum class BinOperator
+enum class BinOperator : std::uint8_t
 {
     Plus,
     Minus,
@@ -33,7 +36,7 @@ enum class BinOperator
     Unknown
 };
 
-enum class CastType
+enum class CastType : std::uint8_t
 {
     String,
     Float,
@@ -43,67 +46,132 @@ enum class CastType
 class ExpressionNode;
 class StatementNode;
 
+// One per concrete node class, so passes can switch on it instead of calling accept.
+enum class NodeKind : std::uint8_t
+{
+    NumberLiteral,
+    StringLiteral,
+    Identifier,
+    BinaryOp,
+    TypeCast,
+    FunctionCall,
+    ExpressionStatement,
+    StatementBlock,
+    FunctionDeclaration,
+    FunctionLiteral,
+    IfStatement,
+    Declaration,
+    ReturnStatement,
+    Assign,
+    WhileStatement,
+    Program
+};
+
+// Nodes live in the AstArena of their ProgramNode and are never deleted one at a time, hence
+// the protected, non-virtual destructor. Children are plain pointers into the same arena.
 class AstNode
 {
    public:
-    virtual ~AstNode() = default;
-    virtual Position getStartPosition() const = 0;
+    virtual SourceOffset getStartOffset() const = 0;
     virtual void accept(AstVisitor& visitor) = 0;
+    NodeKind getKind() const { return kind; }
+
+   protected:
+    explicit AstNode(NodeKind kind) : kind(kind) {}
+    ~AstNode() = default;
+
+   private:
+    // Node classes put their byte-sized fields first, so they share its word with it.
+    NodeKind kind;
 };
 
 class ExpressionNode : public AstNode
 {
+   protected:
+    using AstNode::AstNode;
 };
 
 class NumberLiteralNode : public ExpressionNode
 {
     std::variant<int, float> value;
-    Position pos;
+    SourceOffset offset;
 
    public:
-    NumberLiteralNode(std::variant<int, float> val, Position p) : value(val), pos(p) {}
-    Position getStartPosition() const override { return pos; }
+    NumberLiteralNode(std::variant<int, float> val, SourceOffset off)
+        : ExpressionNode(NodeKind::NumberLiteral), value(val), offset(off)
+    {
+    }
+    SourceOffset getStartOffset() const override { return offset; }
     void accept(AstVisitor& visitor) override;
     std::variant<int, float> getValue() const { return value; }
 };
 
 class StringLiteralNode : public ExpressionNode
 {
-    std::string val;
-    Position pos;
+    // Text copied into the arena as written. While it still has escapes they are decoded in
+    // place the first time the value is read, so a tree must not be read from several threads
+    // before that.
+    mutable bool escaped;
+    mutable std::uint32_t size;
+    char* text;
+    SourceOffset offset;
 
    public:
-    StringLiteralNode(std::string v, Position p) : val(v), pos(p) {}
-    Position getStartPosition() const override { return pos; }
+    StringLiteralNode(char* text, std::size_t size, bool escaped, SourceOffset off)
+        : ExpressionNode(NodeKind::StringLiteral),
+          escaped(escaped),
+          size(static_cast<std::uint32_t>(size)),
+          text(text),
+          offset(off)
+    {
+    }
+    SourceOffset getStartOffset() const override { return offset; }
     void accept(AstVisitor& visitor) override;
-    std::string getValue() const { return val; }
+    std::string_view getValue() const
+    {
+        if (escaped)
+        {
+            size = static_cast<std::uint32_t>(unescape(std::string_view(text, size), text));
+            escaped = false;
+        }
+        return std::string_view(text, size);
+    }
 };
 
 class IdentifierNode : public ExpressionNode
 {
-    std::string name;
-    Position pos;
+    SymbolId name;
+    SourceOffset offset;
 
    public:
-    IdentifierNode(std::string n, Position p) : name(n), pos(p) {}
-    Position getStartPosition() const override { return pos; }
+    IdentifierNode(SymbolId n, SourceOffset off)
+        : ExpressionNode(NodeKind::Identifier), name(n), offset(off)
+    {
+    }
+    SourceOffset getStartOffset() const override { return offset; }
     void accept(AstVisitor& visitor) override;
-    std::string getName() const { return name; }
+    SymbolId getSymbol() const { return name; }
+    const std::string& getName() const { return symbolName(name); }
 };
 
 class BinaryOpNode : public ExpressionNode
 {
     BinOperator binOp;
+    // Cached so long operator chains do not walk their left spine.
+    SourceOffset startOffset;
 
    public:
-    std::unique_ptr<ExpressionNode> left;
-    std::unique_ptr<ExpressionNode> right;
-    BinaryOpNode(std::unique_ptr<ExpressionNode> left, BinOperator op,
-                 std::unique_ptr<ExpressionNode> right)
-        : binOp(op), left(std::move(left)), right(std::move(right))
+    ExpressionNode* left;
+    ExpressionNode* right;
+    BinaryOpNode(ExpressionNode* left, BinOperator op, ExpressionNode* right)
+        : ExpressionNode(NodeKind::BinaryOp),
+          binOp(op),
+          startOffset(left ? left->getStartOffset() : right ? right->getStartOffset() : 0),
+          left(left),
+          right(right)
     {
     }
-    Position getStartPosition() const override { return left->getStartPosition(); }
+    SourceOffset getStartOffset() const override { return startOffset; }
     BinOperator getBinOp() const { return binOp; }
     void accept(AstVisitor& visitor) override;
 };
@@ -111,196 +179,221 @@ class BinaryOpNode : public ExpressionNode
 class TypeCastNode : public ExpressionNode
 {
     CastType type;
+    SourceOffset startOffset;
 
    public:
-    std::unique_ptr<ExpressionNode> expression;
-    TypeCastNode(std::unique_ptr<ExpressionNode> expression, CastType t)
-        : type(t), expression(std::move(expression))
+    ExpressionNode* expression;
+    TypeCastNode(ExpressionNode* expression, CastType t)
+        : ExpressionNode(NodeKind::TypeCast),
+          type(t),
+          startOffset(expression ? expression->getStartOffset() : 0),
+          expression(expression)
     {
     }
-    Position getStartPosition() const override { return expression->getStartPosition(); }
+    SourceOffset getStartOffset() const override { return startOffset; }
     void accept(AstVisitor& visitor) override;
     CastType getTargetType() const { return type; }
 };
 
 class FunctionCallNode : public ExpressionNode
 {
+    SourceOffset startOffset;
+
    public:
-    std::unique_ptr<ExpressionNode> callee;
-    std::vector<std::unique_ptr<ExpressionNode>> arguments;
-    FunctionCallNode(std::unique_ptr<ExpressionNode> callee,
-                     std::vector<std::unique_ptr<ExpressionNode>> arguments)
-        : callee(std::move(callee)), arguments(std::move(arguments))
+    ExpressionNode* callee;
+    NodeList<ExpressionNode> arguments;
+    FunctionCallNode(ExpressionNode* callee, NodeList<ExpressionNode> arguments)
+        : ExpressionNode(NodeKind::FunctionCall),
+          startOffset(callee->getStartOffset()),
+          callee(callee),
+          arguments(arguments)
     {
     }
-    Position getStartPosition() const override { return callee->getStartPosition(); }
+    SourceOffset getStartOffset() const override { return startOffset; }
     void accept(AstVisitor& visitor) override;
 };
 
 class StatementNode : public AstNode
 {
+   protected:
+    using AstNode::AstNode;
 };
 
 class ExpressionStatementNode : public StatementNode
 {
    public:
-    std::unique_ptr<ExpressionNode> expression;
+    ExpressionNode* expression;
 
-    ExpressionStatementNode(std::unique_ptr<ExpressionNode> expression)
-        : expression(std::move(expression))
+    ExpressionStatementNode(ExpressionNode* expression)
+        : StatementNode(NodeKind::ExpressionStatement), expression(expression)
     {
     }
 
-    Position getStartPosition() const override { return expression->getStartPosition(); }
+    SourceOffset getStartOffset() const override { return expression->getStartOffset(); }
     void accept(AstVisitor& visitor) override;
 };
 
 class StatementBlockNode : public StatementNode
 {
-    Position pos;
+    SourceOffset offset;
 
    public:
-    std::vector<std::unique_ptr<StatementNode>> statements;
-    StatementBlockNode(Position p, std::vector<std::unique_ptr<StatementNode>> statements)
-        : pos(p), statements(std::move(statements))
+    NodeList<StatementNode> statements;
+    StatementBlockNode(SourceOffset off, NodeList<StatementNode> statements)
+        : StatementNode(NodeKind::StatementBlock), offset(off), statements(statements)
     {
     }
-    Position getStartPosition() const override { return pos; }
+    SourceOffset getStartOffset() const override { return offset; }
     void accept(AstVisitor& visitor) override;
 };
 
 class FunctionDeclarationNode : public AstNode
 {
-    std::string name;
-    Position pos;
+    SymbolId name;
+    SourceOffset offset;
 
    public:
-    std::vector<std::unique_ptr<FuncDefArgument>> params;
-    std::unique_ptr<StatementBlockNode> body;
-    FunctionDeclarationNode(std::string n, Position p,
-                            std::vector<std::unique_ptr<FuncDefArgument>> param,
-                            std::unique_ptr<StatementBlockNode> bod)
-        : name(n), pos(p), params(std::move(param)), body(std::move(bod))
+    NodeList<FuncDefArgument> params;
+    StatementBlockNode* body;
+    FunctionDeclarationNode(SymbolId n, SourceOffset off, NodeList<FuncDefArgument> param,
+                            StatementBlockNode* bod)
+        : AstNode(NodeKind::FunctionDeclaration), name(n), offset(off), params(param), body(bod)
     {
     }
-    Position getStartPosition() const override { return pos; }
-    std::string getName() const { return name; }
+    SourceOffset getStartOffset() const override { return offset; }
+    SymbolId getSymbol() const { return name; }
+    const std::string& getName() const { return symbolName(name); }
     void accept(AstVisitor& visitor) override;
 };
 
 class FunctionLiteralNode : public ExpressionNode
 {
-    Position pos;
+    SourceOffset offset;
 
    public:
-    std::vector<std::unique_ptr<FuncDefArgument>> parameters;
-    std::unique_ptr<StatementBlockNode> body;
-    FunctionLiteralNode(Position p, std::vector<std::unique_ptr<FuncDefArgument>> parameters,
-                        std::unique_ptr<StatementBlockNode> body)
-        : pos(p), parameters(std::move(parameters)), body(std::move(body))
+    NodeList<FuncDefArgument> parameters;
+    StatementBlockNode* body;
+    FunctionLiteralNode(SourceOffset off, NodeList<FuncDefArgument> parameters,
+                        StatementBlockNode* body)
+        : ExpressionNode(NodeKind::FunctionLiteral),
+          offset(off),
+          parameters(parameters),
+          body(body)
     {
     }
-    Position getStartPosition() const override { return pos; }
+    SourceOffset getStartOffset() const override { return offset; }
     void accept(AstVisitor& visitor) override;
 };
 
 class IfStatementNode : public StatementNode
 {
-    Position pos;
+    SourceOffset offset;
 
    public:
-    std::unique_ptr<ExpressionNode> condition;
-    std::unique_ptr<StatementBlockNode> thenBlock;
-    std::unique_ptr<StatementBlockNode> elseBlock;
-    IfStatementNode(Position p, std::unique_ptr<ExpressionNode> condition,
-                    std::unique_ptr<StatementBlockNode> thenBlock,
-                    std::unique_ptr<StatementBlockNode> elseBlock = nullptr)
-        : pos(p),
-          condition(std::move(condition)),
-          thenBlock(std::move(thenBlock)),
-          elseBlock(std::move(elseBlock))
+    ExpressionNode* condition;
+    StatementBlockNode* thenBlock;
+    StatementBlockNode* elseBlock;
+    IfStatementNode(SourceOffset off, ExpressionNode* condition, StatementBlockNode* thenBlock,
+                    StatementBlockNode* elseBlock = nullptr)
+        : StatementNode(NodeKind::IfStatement),
+          offset(off),
+          condition(condition),
+          thenBlock(thenBlock),
+          elseBlock(elseBlock)
     {
     }
-    Position getStartPosition() const override { return pos; }
+    SourceOffset getStartOffset() const override { return offset; }
     void accept(AstVisitor& visitor) override;
 };
 
 class DeclarationNode : public StatementNode
 {
     bool modifier;
-    std::string identifier;
-    Position pos;
+    SymbolId identifier;
+    SourceOffset offset;
 
    public:
-    std::unique_ptr<ExpressionNode> initializer;
-    DeclarationNode(bool m, std::string i, Position p,
-                    std::unique_ptr<ExpressionNode> initializer = nullptr)
-        : modifier(m), identifier(i), pos(p), initializer(std::move(initializer))
+    ExpressionNode* initializer;
+    DeclarationNode(bool m, SymbolId i, SourceOffset off, ExpressionNode* initializer = nullptr)
+        : StatementNode(NodeKind::Declaration),
+          modifier(m),
+          identifier(i),
+          offset(off),
+          initializer(initializer)
     {
     }
-    Position getStartPosition() const override { return pos; }
-    std::string getIdentifierName() const { return identifier; }
+    SourceOffset getStartOffset() const override { return offset; }
+    SymbolId getIdentifier() const { return identifier; }
+    const std::string& getIdentifierName() const { return symbolName(identifier); }
     bool getModifier() { return modifier; }
     void accept(AstVisitor& visitor) override;
 };
 
 class ReturnStatementNode : public StatementNode
 {
-    Position pos;
+    SourceOffset offset;
 
    public:
-    std::unique_ptr<ExpressionNode> returnValue;
-    ReturnStatementNode(Position p, std::unique_ptr<ExpressionNode> returnValue = nullptr)
-        : pos(p), returnValue(std::move(returnValue))
+    ExpressionNode* returnValue;
+    ReturnStatementNode(SourceOffset off, ExpressionNode* returnValue = nullptr)
+        : StatementNode(NodeKind::ReturnStatement), offset(off), returnValue(returnValue)
     {
     }
-    Position getStartPosition() const override { return pos; }
+    SourceOffset getStartOffset() const override { return offset; }
     void accept(AstVisitor& visitor) override;
 };
 
 class AssignNode : public StatementNode
 {
-    std::string identifier;
-    Position pos;
+    SymbolId identifier;
+    SourceOffset offset;
 
    public:
-    std::unique_ptr<ExpressionNode> expression;
-    AssignNode(std::string i, Position p, std::unique_ptr<ExpressionNode> expression)
-        : identifier(i), pos(p), expression(std::move(expression))
+    ExpressionNode* expression;
+    AssignNode(SymbolId i, SourceOffset off, ExpressionNode* expression)
+        : StatementNode(NodeKind::Assign), identifier(i), offset(off), expression(expression)
     {
     }
-    Position getStartPosition() const override { return pos; }
+    SourceOffset getStartOffset() const override { return offset; }
     void accept(AstVisitor& visitor) override;
-    std::string getIdentifierName() const { return identifier; }
+    SymbolId getIdentifier() const { return identifier; }
+    const std::string& getIdentifierName() const { return symbolName(identifier); }
 };
 
 class WhileStatementNode : public StatementNode
 {
-    Position pos;
+    SourceOffset offset;
 
    public:
-    std::unique_ptr<ExpressionNode> condition;
-    std::unique_ptr<StatementBlockNode> body;
-    WhileStatementNode(Position p, std::unique_ptr<ExpressionNode> condition,
-                       std::unique_ptr<StatementBlockNode> body)
-        : pos(p), condition(std::move(condition)), body(std::move(body))
+    ExpressionNode* condition;
+    StatementBlockNode* body;
+    WhileStatementNode(SourceOffset off, ExpressionNode* condition, StatementBlockNode* body)
+        : StatementNode(NodeKind::WhileStatement), offset(off), condition(condition), body(body)
     {
     }
-    Position getStartPosition() const override { return pos; }
+    SourceOffset getStartOffset() const override { return offset; }
     void accept(AstVisitor& visitor) override;
 };
 
-class ProgramNode : public AstNode
+// The one node outside the arena: it owns the arena, so dropping the program frees the tree.
+class ProgramNode final : public AstNode
 {
    public:
-    std::vector<std::unique_ptr<AstNode>> declarations;
-    ProgramNode(std::vector<std::unique_ptr<AstNode>> declarations)
-        : declarations(std::move(declarations))
+    std::unique_ptr<AstArena> arena;
+    NodeList<AstNode> declarations;
+    // Resolves node offsets to line and column for diagnostics.
+    std::shared_ptr<const LineIndex> lines;
+    ProgramNode(std::unique_ptr<AstArena> arena, NodeList<AstNode> declarations)
+        : AstNode(NodeKind::Program), arena(std::move(arena)), declarations(declarations)
     {
     }
-    Position getStartPosition() const override
+    SourceOffset getStartOffset() const override
     {
-        return declarations.empty() ? Position() : declarations.front()->getStartPosition();
+        return declarations.empty() ? 0 : declarations.front()->getStartOffset();
     }
     void accept(AstVisitor& visitor) override;
 };
+
+// Names read or assigned anywhere in a function body, nested function literals included, sorted
+// and without repeats: what a literal in the body may capture from the function around it.
+std::vector<SymbolId> namesUsedIn(StatementBlockNode& body);
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Read-only run of node pointers living in an AstArena; stands in for the child vectors.
+template <typename T>
+class NodeList
+{
+   public:
+    NodeList() = default;
+    NodeList(T* const* items, std::size_t count) : items(items), count(count) {}
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* operator[](std::size_t index) const { return items[index]; }
+    T* front() const { return items[0]; }
+    T* back() const { return items[count - 1]; }
+    T* const* begin() const { return items; }
+    T* const* end() const { return items + count; }
+
+   private:
+    T* const* items = nullptr;
+    std::size_t count = 0;
+};
+
+// Bump allocator owning the nodes of one syntax tree. Blocks are released together when the
+// arena goes away and nothing in them is destroyed one by one, so only trivially destructible
+// types are allowed in.
+class AstArena
+{
+   public:
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+        void* place = allocate(sizeof(T), alignof(T));
+        if constexpr (std::is_aggregate_v<T>)
+            return new (place) T{std::forward<Args>(args)...};
+        else
+            return new (place) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    NodeList<T> makeList(T* const* first, T* const* last)
+    {
+        std::size_t count = static_cast<std::size_t>(last - first);
+        if (count == 0) return {};
+        auto* items = static_cast<T**>(allocate(count * sizeof(T*), alignof(T*)));
+        std::memcpy(items, first, count * sizeof(T*));
+        return NodeList<T>(items, count);
+    }
+
+    std::string_view copyString(std::string_view text);
+    // The same, for text that is to be changed in place afterwards.
+    char* copyChars(std::string_view text);
+    // Takes over the blocks of another arena, so whatever was built in it now lives as long as
+    // this one. New allocations keep going to this arena's current block.
+    void adopt(AstArena&& other);
+
+    void* allocate(std::size_t size, std::size_t alignment)
+    {
+        std::size_t start = (used + alignment - 1) & ~(alignment - 1);
+        if (start + size > capacity) return allocateBlock(size, alignment);
+        used = start + size;
+        return current + start;
+    }
+
+    std::size_t blockCount() const { return blocks.size(); }
+    std::size_t bytesReserved() const { return reserved; }
+
+   private:
+    // Blocks double from the first size up to the last, so small scripts stay small.
+    static constexpr std::size_t FIRST_BLOCK = std::size_t(4) << 10;
+    static constexpr std::size_t LAST_BLOCK = std::size_t(1) << 20;
+
+    void* allocateBlock(std::size_t size, std::size_t alignment);
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::byte* current = nullptr;
+    std::size_t used = 0;
+    std::size_t capacity = 0;
+    std::size_t reserved = 0;
+};
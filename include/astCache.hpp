@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "error.hpp"
+#include "flatAst.hpp"
+#include "sourceBuffer.hpp"
+
+// 64-bit hash of a run of bytes, eight at a time. Good enough to key cache entries, which
+// also compare lengths; not meant to resist anyone crafting collisions.
+std::uint64_t contentHash(std::string_view bytes);
+
+// A program put together from cached pieces, each a FlatAst of consecutive top-level
+// declarations.
+struct CachedProgram
+{
+    std::vector<FlatAst> pieces;
+    std::optional<Error> error;
+    std::shared_ptr<const LineIndex> lines;
+    // Declarations parsed on this load, and ones whose image came from the cache.
+    std::size_t parsed = 0;
+    std::size_t reused = 0;
+};
+
+// Parse results kept on disk between runs. A script is stored as a manifest: the FlatAst image
+// of each top-level declaration together with the hash of the declaration's source bytes. A
+// script seen whole before is loaded from its manifest without being lexed; after an edit the
+// last manifest written under the same name is searched by declaration hash, so only the
+// declarations whose text changed are parsed again. Images are memory-mapped and read in
+// place; nothing is rebuilt node by node. A file that is cut short or whose images no longer
+// match their hashes is a miss. Nothing is evicted either: removing the directory is how the
+// cache is emptied.
+class AstCache
+{
+   public:
+    // The directory is created if it does not exist yet.
+    explicit AstCache(std::string directory);
+
+    // Parses source like Parser::tryParseProgram, going to the cache where it can. The name
+    // ties versions of one script together, typically its path; without one only a script
+    // seen whole before is found. Scripts with errors are parsed in full and not stored.
+    CachedProgram load(const SourceBuffer& source, std::string_view name = {});
+
+   private:
+    std::optional<CachedProgram> loadManifest(std::uint64_t key, const SourceBuffer& source) const;
+    CachedProgram parseDeclarations(const SourceBuffer& source, std::uint64_t key,
+                                    const std::string& latest) const;
+    void store(const std::string& name, const std::string& bytes) const;
+    std::string path(std::uint64_t key, const char* extension) const;
+
+    std::string directory;
+};
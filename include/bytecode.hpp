@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "asTree.hpp"
+#include "outputSink.hpp"
+#include "value.hpp"
+
+// Instructions of the stack machine. Operands are `a` and `b` of the instruction; jumps are
+// relative to the instruction after them.
+enum class OpCode : std::uint8_t
+{
+    Integer,       // push the int b
+    Constant,      // push constants[b]
+    Nothing,       // push nothing
+    Pop,
+    LoadLocal,     // push slot a; b names it for errors
+    StoreLocal,    // pop into slot a
+    LoadGlobal,    // push global b
+    StoreGlobal,   // pop into global b
+    DefineGlobal,  // pop into a new global b, constant unless a is 0
+    // One per BinOperator up to Pipe and AtAt, in the same order.
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Equal,
+    NotEqual,
+    Greater,
+    GreaterEqual,
+    Less,
+    LessEqual,
+    Compose,
+    Decorate,
+    Cast,            // a is the CastType
+    Jump,            // by b
+    JumpIfFalse,     // pop the condition, jump by b when it is false
+    JumpIfFalseKeep, // &&: jump by b keeping the condition when it is false, else pop it
+    JumpIfTrueKeep,  // ||: the same when it is true
+    CheckBool,       // the right operand of && and || must be a boolean as well
+    Closure,         // push a new function running functions[b]
+    Call,            // callee and a arguments are on the stack; the result replaces them
+    Return,          // pop the result and leave the function
+    Raise,           // report MessageId a, naming symbol b when it is not NO_NAME
+};
+
+struct Instruction
+{
+    OpCode op;
+    std::uint16_t a;
+    std::int32_t b;
+};
+
+static_assert(sizeof(Instruction) == 8, "instructions are meant to stay one word");
+
+// A variable a function literal copies from the function it is made in.
+struct CaptureSlot
+{
+    SymbolId id;
+    bool constant;
+    // Slot of the variable in the enclosing function's frame.
+    std::uint16_t from;
+};
+
+// One compiled function. Its frame starts with the parameters, then the captured variables,
+// then the slots of its locals, which blocks reuse once they end; the temporaries of
+// expressions go on top of that.
+struct FunctionProto
+{
+    std::vector<Instruction> code;
+    // Where each instruction came from, for errors.
+    std::vector<SourceOffset> offsets;
+    std::vector<Value> constants;
+    std::vector<CaptureSlot> captures;
+    std::uint16_t parameterCount = 0;
+    std::uint16_t slotCount = 0;
+    // Most temporaries the function has on the stack at once.
+    std::uint32_t stackSize = 0;
+    const AstNode* node = nullptr;
+};
+
+struct CompiledProgram
+{
+    // The first runs the top-level declarations; it has no parameters or locals.
+    std::vector<std::unique_ptr<FunctionProto>> functions;
+    std::shared_ptr<const LineIndex> lines;
+};
+
+// Names used as `b` of Raise when the message names nothing.
+constexpr std::int32_t NO_NAME = -1;
+
+// Names are resolved here: locals to slots, the names a function literal uses from the
+// function around it to captures, and the rest to globals, which are looked up when they run.
+// What the tree walker reports while running still waits for the program to reach it, as Raise;
+// only nesting deeper than MAX_NESTING is reported up front.
+CompiledProgram compileBytecode(ProgramNode& program);
+
+// The part of a call the bytecode engines share, on a stack holding the callee at `callee` and
+// the `count` arguments above it, with `top` just past them. print runs here and leaves nothing
+// in the callee's place. Composition and decoration are unfolded on the stack, one entry more
+// each: a composition's first function is called right above its second, and `pending` counts
+// the functions waiting for a result that way. Returns the script function left to call, with
+// `callee` and `count` updated, or null once the call is done.
+FunctionObject* unfoldCall(std::vector<Value>& stack, std::size_t& top, std::size_t& callee,
+                           std::size_t& count, int& pending, OutputSink& out, SourceOffset at);
@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// What a byte can start, used by the lexer to jump straight to the right scanner.
+enum class CharKind : std::uint8_t
+{
+    Other,
+    Blank,
+    Newline,
+    Letter,
+    Digit,
+    Quote,
+    Symbol
+};
+
+constexpr std::array<CharKind, 256> CHAR_KINDS = []
+{
+    std::array<CharKind, 256> kinds{};
+    for (int c = 'a'; c <= 'z'; ++c) kinds[c] = CharKind::Letter;
+    for (int c = 'A'; c <= 'Z'; ++c) kinds[c] = CharKind::Letter;
+    for (int c = '0'; c <= '9'; ++c) kinds[c] = CharKind::Digit;
+    for (unsigned char c : {' ', '\t', '\r', '\v', '\f'}) kinds[c] = CharKind::Blank;
+    for (unsigned char c : {'+', '-', '*', '/', '=', '!', '>', '<', '|', '@', '&', '(', ')', '[',
+                            ']', ';', ','})
+        kinds[c] = CharKind::Symbol;
+    kinds['_'] = CharKind::Letter;
+    kinds['\n'] = CharKind::Newline;
+    kinds['"'] = CharKind::Quote;
+    return kinds;
+}();
+
+constexpr CharKind charKind(char c)
+{
+    return CHAR_KINDS[static_cast<unsigned char>(c)];
+}
+
+// Locale-independent ASCII classification used by the lexer.
+constexpr bool isAsciiBlank(char c)
+{
+    return charKind(c) == CharKind::Blank;
+}
+
+constexpr bool isAsciiSpace(char c)
+{
+    return isAsciiBlank(c) || c == '\n';
+}
+
+constexpr bool isAsciiDigit(char c)
+{
+    return charKind(c) == CharKind::Digit;
+}
+
+constexpr bool isAsciiAlpha(char c)
+{
+    return charKind(c) == CharKind::Letter && c != '_';
+}
+
+constexpr bool isIdentifierChar(char c)
+{
+    return charKind(c) == CharKind::Letter || charKind(c) == CharKind::Digit;
+}
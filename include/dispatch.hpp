@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+
+// The loops of the bytecode engines are written once over these macros, as
+//
+//     DISPATCH_LOOP
+//     {
+//         DISPATCH_CASE(OpCode, Integer)
+//             ...
+//             DISPATCH_NEXT;
+//         ...
+//     }
+//
+// in a function that defines `fetch`, moving to the next instruction and returning its opcode.
+//
+// Built with BIBL_COMPUTED_GOTO (BIBL_DISPATCH=goto in CMake, the default with GCC and Clang),
+// the code is threaded: each handler jumps straight to the next instruction's handler through a
+// table of label addresses, so every opcode has an indirect branch of its own for the predictor
+// to learn rather than all sharing the one at the top of a switch. The function then also defines
+// `handlers`, the address of each handler in opcode order, written DISPATCH_LABEL(Integer) and
+// so on. Otherwise the macros make the portable switch in a loop.
+#ifdef BIBL_COMPUTED_GOTO
+
+#define DISPATCH_JUMP                                                                  \
+    _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wpedantic\"") \
+    goto *handlers[static_cast<std::size_t>(fetch())];                              \
+    _Pragma("GCC diagnostic pop")
+#define DISPATCH_LOOP DISPATCH_JUMP
+#define DISPATCH_CASE(type, name) handle##name:
+#define DISPATCH_NEXT \
+    do                \
+    {                 \
+        DISPATCH_JUMP \
+    } while (false)
+#define DISPATCH_LABEL(name) __extension__ &&handle##name
+
+#else
+
+#define DISPATCH_LOOP \
+    for (;;)          \
+    switch (fetch())
+#define DISPATCH_CASE(type, name) case type::name:
+#define DISPATCH_NEXT continue
+
+#endif
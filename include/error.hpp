@@ -1,7 +1,10 @@
 #pragma once
+#include <cstdint>
+#include <memory>
 #include <string>
-#include <stdexcept>
+#include <string_view>
 
+#include "lineIndex.hpp"
 #include "position.hpp"
 
 enum class ErrorType
@@ -12,11 +15,201 @@ enum class ErrorType
     Runtime,
 };
 
+// Every message the front end and the interpreter can report. Errors carry the id; the text is
+// looked up only when an error is printed.
+enum class MessageId : std::uint8_t
+{
+    IdentifierTooLong,
+    InvalidFloat,
+    UnterminatedString,
+    InvalidUtf8,
+
+    ExpectedSemicolonAfterTopLevelDeclaration,
+    UnexpectedTokenBetweenDeclarations,
+    ExpectedFun,
+    ExpectedFunctionName,
+    ExpectedLParen,
+    ExpectedRParen,
+    ExpectedConstOrVar,
+    ExpectedParamName,
+    ExpectedLBracket,
+    ExpectedRBracket,
+    ExpectedSemicolonAfterReturn,
+    ExpectedSemicolonAfterDeclaration,
+    ExpectedSemicolon,
+    ExpectedIfCondition,
+    ExpectedWhileCondition,
+    ExpectedWhile,
+    ExpectedReturn,
+    ExpectedVariableName,
+    ExpectedInitializer,
+    ExpectedIdentifier,
+    MissingSemicolonAfterAssign,
+    MissingSemicolonAfterCall,
+    ExpectedType,
+    UnexpectedType,
+    ExpectedLogicalOperand,
+    ExpectedRelationalOperand,
+    ExpectedAdditiveOperand,
+    ExpectedMultiplicativeOperand,
+    ExpectedNumber,
+    ExpectedStringLiteral,
+    ExpectedIdentification,
+    ExpectedLParenInExpression,
+    ExpectedRParenInExpression,
+    ExpectedExpression,
+
+    UndefinedIdentifier,
+    AlreadyDeclared,
+    AssignToConstant,
+    NoValue,
+    InvalidOperands,
+    InvalidCast,
+    ConditionNotBoolean,
+    NotCallable,
+    WrongArgumentCount,
+    DivisionByZero,
+    IntegerOverflow,
+    StringTooLong,
+    RecursionTooDeep,
+    NestingTooDeep,
+    TooManyVariables,
+};
+
+constexpr std::string_view messageText(MessageId id)
+{
+    switch (id)
+    {
+        case MessageId::IdentifierTooLong:
+            return "Identifier is too long";
+        case MessageId::InvalidFloat:
+            return "Invalid float";
+        case MessageId::UnterminatedString:
+            return "Unterminated string literal";
+        case MessageId::InvalidUtf8:
+            return "Invalid UTF-8 sequence";
+        case MessageId::ExpectedSemicolonAfterTopLevelDeclaration:
+            return "Expected ';' after declaration while parsing program";
+        case MessageId::UnexpectedTokenBetweenDeclarations:
+            return "Unexpected token in between declarations";
+        case MessageId::ExpectedFun:
+            return "Expected 'fun'";
+        case MessageId::ExpectedFunctionName:
+            return "Expected function's name";
+        case MessageId::ExpectedLParen:
+            return "Expected '('";
+        case MessageId::ExpectedRParen:
+            return "Expected ')'";
+        case MessageId::ExpectedConstOrVar:
+            return "Expected 'const' or 'var'";
+        case MessageId::ExpectedParamName:
+            return "Expected param's name";
+        case MessageId::ExpectedLBracket:
+            return "Expected '['";
+        case MessageId::ExpectedRBracket:
+            return "Expected ']'";
+        case MessageId::ExpectedSemicolonAfterReturn:
+            return "Expected ';' after return";
+        case MessageId::ExpectedSemicolonAfterDeclaration:
+            return "Expected ';' after declaration";
+        case MessageId::ExpectedSemicolon:
+            return "Expected ';'";
+        case MessageId::ExpectedIfCondition:
+            return "Expected logical expression in if";
+        case MessageId::ExpectedWhileCondition:
+            return "Expected logical expression in while";
+        case MessageId::ExpectedWhile:
+            return "Expected 'while'";
+        case MessageId::ExpectedReturn:
+            return "Expected 'return'";
+        case MessageId::ExpectedVariableName:
+            return "Expected variable's name";
+        case MessageId::ExpectedInitializer:
+            return "Expected an expression after assign";
+        case MessageId::ExpectedIdentifier:
+            return "Expected identifier";
+        case MessageId::MissingSemicolonAfterAssign:
+            return "No semicolon after assign";
+        case MessageId::MissingSemicolonAfterCall:
+            return "No semicolon after call";
+        case MessageId::ExpectedType:
+            return "Expected a type";
+        case MessageId::UnexpectedType:
+            return "Unexpected token type";
+        case MessageId::ExpectedLogicalOperand:
+            return "Expected expression after operator while parsing logical expression";
+        case MessageId::ExpectedRelationalOperand:
+            return "Expected expression after operator while parsing relExpression";
+        case MessageId::ExpectedAdditiveOperand:
+            return "Expected expression after operator while parsing simpleExpression";
+        case MessageId::ExpectedMultiplicativeOperand:
+            return "Expected expression after operator while parsing term";
+        case MessageId::ExpectedNumber:
+            return "Expected a number";
+        case MessageId::ExpectedStringLiteral:
+            return "Expected string literal";
+        case MessageId::ExpectedIdentification:
+            return "Expected an identification";
+        case MessageId::ExpectedLParenInExpression:
+            return "Expected '(' while parsing expression";
+        case MessageId::ExpectedRParenInExpression:
+            return "Expected ')' while parsing expression";
+        case MessageId::ExpectedExpression:
+            return "Expected an expression";
+        case MessageId::UndefinedIdentifier:
+            return "Undefined identifier: ";
+        case MessageId::AlreadyDeclared:
+            return "Already declared in this scope: ";
+        case MessageId::AssignToConstant:
+            return "Cannot assign to a constant: ";
+        case MessageId::NoValue:
+            return "Variable has no value: ";
+        case MessageId::InvalidOperands:
+            return "Invalid operand types: ";
+        case MessageId::InvalidCast:
+            return "Invalid cast: ";
+        case MessageId::ConditionNotBoolean:
+            return "Condition is not a boolean: ";
+        case MessageId::NotCallable:
+            return "Not a function: ";
+        case MessageId::WrongArgumentCount:
+            return "Wrong number of arguments: ";
+        case MessageId::DivisionByZero:
+            return "Division by zero";
+        case MessageId::IntegerOverflow:
+            return "Integer overflow";
+        case MessageId::StringTooLong:
+            return "String is too long";
+        case MessageId::RecursionTooDeep:
+            return "Recursion is too deep";
+        case MessageId::NestingTooDeep:
+            return "Expression is nested too deeply";
+        case MessageId::TooManyVariables:
+            return "Too many variables in one function";
+    }
+    return "Unknown error";
+}
+
 struct Error
 {
     ErrorType type;
-    std::string message;
-    Position startPosition;
+    MessageId message;
+    SourceOffset offset;
+    // Script the offset points into; without one the offset is reported as a column of line 1.
+    std::shared_ptr<const LineIndex> lines;
+    // Appended to the message text, for the few messages that name something.
+    std::string detail;
+
+    Position position() const
+    {
+        return lines ? lines->position(offset) : Position(1, static_cast<int>(offset) + 1, offset);
+    }
+
+    std::string text() const
+    {
+        std::string_view base = messageText(message);
+        return std::string(base.begin(), base.end()) + detail;
+    }
 
     std::string toString() const
     {
@@ -37,7 +230,8 @@ struct Error
                 break;
         }
 
+        Position startPosition = position();
         return typeStr + " at " + std::to_string(startPosition.line) + ":" +
-               std::to_string(startPosition.column) + " → " + message;
+               std::to_string(startPosition.column) + " → " + text();
     }
 };
@@ -0,0 +1,166 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "asTree.hpp"
+#include "position.hpp"
+#include "sourceBuffer.hpp"
+#include "symbolTable.hpp"
+
+class FlatAstVisitor;
+
+// Index of a node in a FlatAst.
+using NodeIndex = std::uint32_t;
+constexpr NodeIndex NO_NODE = std::numeric_limits<NodeIndex>::max();
+
+enum class FlatKind : std::uint8_t
+{
+    Number,
+    String,
+    Identifier,
+    BinaryOp,
+    TypeCast,
+    FunctionCall,
+    ExpressionStatement,
+    StatementBlock,
+    FunctionDeclaration,
+    FunctionLiteral,
+    Parameter,
+    If,
+    Declaration,
+    Return,
+    Assign,
+    While,
+    Program
+};
+
+// Children of a node: a run of indices in FlatAst::lists.
+class FlatRange
+{
+   public:
+    FlatRange(const NodeIndex* items, std::uint32_t count) : items(items), count(count) {}
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    NodeIndex operator[](std::size_t index) const { return items[index]; }
+    const NodeIndex* begin() const { return items; }
+    const NodeIndex* end() const { return items + count; }
+
+   private:
+    const NodeIndex* items;
+    std::uint32_t count;
+};
+
+// The syntax tree laid out in a few flat arrays. Nodes are stored in pre-order, so a parent
+// comes right before its first child, and refer to each other by index. A node has three
+// 32-bit slots whose meaning depends on its kind; the accessors below name them:
+//
+//   first:  expression, left, callee, condition, initializer, return value, string start,
+//           number bits, or the list of parameters, statements or declarations
+//   second: right, arguments, body, then block, string length
+//   third:  else block or symbol
+//
+// Absent optional children read as NO_NODE. Symbols are numbered per tree and offsets are kept
+// relative to a base, so none of the arrays depend on the process or on where the tree sits in
+// its script: they can be written out as one image and used in place once mapped back.
+class FlatAst
+{
+   public:
+    struct Node
+    {
+        FlatKind kind;
+        // BinOperator, CastType, modifier, or whether a number is a float.
+        std::uint8_t tag;
+        // Always zero, so images carry no stray padding bytes.
+        std::uint16_t reserved;
+        SourceOffset offset;
+        std::uint32_t first;
+        std::uint32_t second;
+        std::uint32_t third;
+    };
+
+    FlatAst(FlatAst&&) = default;
+    FlatAst& operator=(FlatAst&&) = default;
+    FlatAst(const FlatAst&) = delete;
+    FlatAst& operator=(const FlatAst&) = delete;
+
+    // Lowers a parsed program; the pointer tree can be dropped afterwards. Offsets are stored
+    // relative to base, which must not be past the program's first node.
+    static FlatAst build(ProgramNode& program, SourceOffset base = 0);
+
+    // The arrays and symbol names as one position-independent block of bytes.
+    std::string image() const;
+    // Views the `bytes` of an image that start at byte `at` of storage, which must be 4-byte
+    // aligned there. Only the symbol names are copied out; the nodes, lists and strings are read
+    // in place. Returns nothing when the bytes are not an image this build wrote, including when
+    // any index or offset in them points outside the image.
+    static std::optional<FlatAst> fromImage(std::shared_ptr<const SourceBuffer> storage,
+                                            std::size_t at, std::size_t bytes, SourceOffset base);
+
+    NodeIndex root() const { return 0; }
+    std::size_t size() const { return nodeCount; }
+    // Bytes held by the arrays, for comparing with the pointer tree.
+    std::size_t memoryUsage() const;
+
+    FlatKind kind(NodeIndex node) const { return nodes[node].kind; }
+    SourceOffset offset(NodeIndex node) const { return base + nodes[node].offset; }
+    void accept(NodeIndex node, FlatAstVisitor& visitor) const;
+
+    std::variant<int, float> number(NodeIndex node) const;
+    std::string_view string(NodeIndex node) const
+    {
+        return std::string_view(text + nodes[node].first, nodes[node].second);
+    }
+    SymbolId symbol(NodeIndex node) const { return symbols[nodes[node].third]; }
+    BinOperator binaryOperator(NodeIndex node) const { return BinOperator(nodes[node].tag); }
+    CastType castType(NodeIndex node) const { return CastType(nodes[node].tag); }
+    bool modifier(NodeIndex node) const { return nodes[node].tag != 0; }
+
+    NodeIndex expression(NodeIndex node) const { return nodes[node].first; }
+    NodeIndex left(NodeIndex node) const { return nodes[node].first; }
+    NodeIndex right(NodeIndex node) const { return nodes[node].second; }
+    NodeIndex callee(NodeIndex node) const { return nodes[node].first; }
+    NodeIndex condition(NodeIndex node) const { return nodes[node].first; }
+    NodeIndex body(NodeIndex node) const { return nodes[node].second; }
+    NodeIndex thenBlock(NodeIndex node) const { return nodes[node].second; }
+    NodeIndex elseBlock(NodeIndex node) const { return nodes[node].third; }
+
+    FlatRange arguments(NodeIndex node) const { return list(nodes[node].second); }
+    FlatRange parameters(NodeIndex node) const { return list(nodes[node].first); }
+    FlatRange statements(NodeIndex node) const { return list(nodes[node].first); }
+    FlatRange declarations() const { return list(nodes[root()].first); }
+
+    std::shared_ptr<const LineIndex> lines;
+
+   private:
+    friend class FlatAstBuilder;
+
+    FlatAst() = default;
+    // Each list is its length followed by the entries.
+    FlatRange list(std::uint32_t at) const { return FlatRange(&lists[at + 1], lists[at]); }
+    // Whether every child, list, string and symbol a node refers to is inside the arrays, and
+    // every child comes after its parent, so that walking the tree ends.
+    bool inBounds(std::size_t symbolCount) const;
+
+    const Node* nodes = nullptr;
+    const NodeIndex* lists = nullptr;
+    const char* text = nullptr;
+    std::size_t nodeCount = 0;
+    std::size_t listCount = 0;
+    std::size_t textSize = 0;
+    SourceOffset base = 0;
+    // Node::third of identifiers, declarations and assignments indexes this.
+    std::vector<SymbolId> symbols;
+
+    // What the views point into: the arrays of a built tree or the storage of an image.
+    std::vector<Node> ownedNodes;
+    std::vector<NodeIndex> ownedLists;
+    std::vector<char> ownedText;
+    std::shared_ptr<const SourceBuffer> storage;
+};
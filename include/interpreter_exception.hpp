@@ -1,15 +1,29 @@
 #pragma once
+#include <exception>
+
 #include "error.hpp"
 
-class InterpreterException : public std::runtime_error
+// Thrown by the front end's exception-based entry points. The message is rendered the first
+// time what() is called, so code that only inspects `error` never formats it.
+class InterpreterException : public std::exception
 {
    public:
     Error error;
 
-    explicit InterpreterException(const Error& e) : std::runtime_error(e.toString()), error(e) {}
-    explicit InterpreterException(const ErrorType type, const std::string& message,
-                                  const Position pos)
-        : std::runtime_error(Error{type, message, pos}.toString()), error({type, message, pos})
+    explicit InterpreterException(Error e) : error(std::move(e)) {}
+    explicit InterpreterException(const ErrorType type, const MessageId message,
+                                  const SourceOffset offset,
+                                  std::shared_ptr<const LineIndex> lines = nullptr)
+        : InterpreterException(Error{type, message, offset, std::move(lines), {}})
     {
     }
-};
\ No newline at end of file
+
+    const char* what() const noexcept override
+    {
+        if (rendered.empty()) rendered = error.toString();
+        return rendered.c_str();
+    }
+
+   private:
+    mutable std::string rendered;
+};
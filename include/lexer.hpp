@@ -2,32 +2,90 @@
 #include <iostream>
 #include <vector>
 #include <limits>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
 
 #include "token.hpp"
 #include "interpreter_exception.hpp"
+#include "lineIndex.hpp"
 #include "position.hpp"
+#include "sourceBuffer.hpp"
+#include "sourceReader.hpp"
+#include "symbolTable.hpp"
+#include "utf8.hpp"
 
 class Lexer
 {
    public:
     explicit Lexer(std::istream& inputStream);
+    explicit Lexer(SourceReader& reader);
+    // Lexers started past the beginning only keep a partial line index.
+    explicit Lexer(const SourceBuffer& source, SourceOffset start = 0);
+    // Throws InterpreterException on a lexical error.
     Token scanToken();
+    // Returns an Error token instead, and keeps returning it; lexicalError() says what failed.
+    Token nextToken();
+    const std::optional<Error>& lexicalError() const { return failure; }
+    std::shared_ptr<const LineIndex> lineIndex() const { return lines; }
 
    private:
     static constexpr int MAXINT = std::numeric_limits<int>::max();
     static constexpr int MAX_IDENTIFIER_LEN = 50;
 
-    std::istream& input;
-    Position currentPosition;
+    // Chunked input is refilled once fewer bytes than this are left before a token, so that
+    // nearly every token can be scanned in place.
+    static constexpr std::ptrdiff_t REFILL_MARGIN = 256;
+    // Input is validated as UTF-8 this many bytes at a time, ahead of the lexer. A token is
+    // returned only once every sequence starting before its end has been checked.
+    static constexpr std::ptrdiff_t UTF8_BLOCK = 1 << 16;
+    static constexpr SourceOffset UTF8_MARGIN = 4;
+    static constexpr SourceOffset UTF8_DONE = std::numeric_limits<SourceOffset>::max();
+
+    SymbolTable& symbols;
+    std::unique_ptr<SourceReader> ownedReader;
+    SourceReader* reader;
+    const char* cursor;
+    const char* limit;
+    std::shared_ptr<LineIndex> lines;
+    SourceOffset currentOffset;
+    SourceOffset nextOffset;
     char currentChar;
+    bool endReached;
+    std::string lexeme;
+    // Identifiers from a SourceBuffer seen by this lexer, keyed by their bytes in the source; hits
+    // skip the shared table and its lock.
+    std::unordered_map<std::string_view, SymbolId> knownSymbols;
+    Utf8Validator utf8;
+    // Bytes before this offset have been validated; UTF8_DONE once the whole input has.
+    SourceOffset utf8CheckedTo;
+    std::optional<SourceOffset> invalidUtf8;
+    std::optional<Error> failure;
 
     char get();
+    int peek();
+    bool refillWindow(const char* keep);
+    // A scan that stopped at the window's end may only have hit the end of a chunk.
+    bool windowHolds(const char* stop) const
+    {
+        return stop != limit || reader == nullptr || reader->exhausted();
+    }
+    void skipTo(const char* target);
+    void feedUtf8(const char* to);
+    bool checkUtf8();
     void skipWhitespaceAndComments();
     Token consumeAndReturn(Token returned);
-    void throwError(ErrorType type, const std::string& msg, Position pos) const;
+    Token fail(ErrorType type, MessageId message, SourceOffset offset);
 
-    Token tryBuildIdentifier();
-    Token tryBuildNumber();
-    Token tryBuildString();
-    Token tryBuildSymbol();
+    SymbolId internSource(std::string_view name);
+    Token makeIdentifier(std::string_view ident, SourceOffset startOffset, bool inSource);
+    Token buildIdentifier();
+    Token numberToken(std::string_view spelling, bool isFloat, bool dotFollows,
+                      SourceOffset startOffset);
+    Token buildNumber();
+    Token buildString();
+    Token buildSymbol();
+    Token buildUnknown();
+    Token lexToken();
 };
@@ -0,0 +1,34 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+#include "position.hpp"
+
+// Offsets at which the lines of one script start, filled in as the lexer passes newlines, and
+// of the UTF-8 continuation bytes it has validated. Columns count code points, so positions
+// skip the continuation bytes; scripts that are pure ASCII have none to look at.
+class LineIndex
+{
+   public:
+    LineIndex() : lineStarts{0} {}
+    // starts[0] must be 0 and both lists ascending.
+    explicit LineIndex(std::vector<SourceOffset> starts,
+                       std::vector<SourceOffset> continuations = {})
+        : lineStarts(std::move(starts)), continuations(std::move(continuations))
+    {
+    }
+
+    // Indexes a script that is not going to be lexed, e.g. one whose tree came from a cache.
+    // The script must be valid UTF-8.
+    static LineIndex scan(std::string_view script);
+
+    void addLine(SourceOffset start) { lineStarts.push_back(start); }
+    std::size_t lineCount() const { return lineStarts.size(); }
+    std::vector<SourceOffset>& continuationBytes() { return continuations; }
+    const std::vector<SourceOffset>& continuationBytes() const { return continuations; }
+    Position position(SourceOffset offset) const;
+
+   private:
+    std::vector<SourceOffset> lineStarts;
+    std::vector<SourceOffset> continuations;
+};
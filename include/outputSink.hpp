@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Collects printed text in one chunk of reserved capacity and hands it to a file descriptor or
+// a stream whenever the chunk fills, so printing takes the same memory however long the output
+// gets. A sink made with nowhere to go keeps everything instead, for callers that want the text.
+class OutputSink
+{
+   public:
+    static constexpr std::size_t DEFAULT_CHUNK = 1 << 16;
+
+    static OutputSink toDescriptor(int fd, std::size_t chunkSize = DEFAULT_CHUNK);
+    static OutputSink toStream(std::ostream& stream, std::size_t chunkSize = DEFAULT_CHUNK);
+    OutputSink() : OutputSink(-1, nullptr, 0) {}
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+    ~OutputSink();
+
+    void write(std::string_view text)
+    {
+        if (buffer.size() + text.size() > chunkSize && drains()) flush();
+        buffer.append(text);
+    }
+    void write(char c)
+    {
+        if (buffer.size() == chunkSize && drains()) flush();
+        buffer.push_back(c);
+    }
+    // Spaces are copied from a run made once, not built per line.
+    void indent(int level);
+    // Hands over what is buffered; throws std::runtime_error if the descriptor refuses it.
+    void flush();
+
+    // Everything written so far, for a sink that keeps it; what is not flushed yet otherwise.
+    const std::string& text() const { return buffer; }
+
+   private:
+    OutputSink(int fd, std::ostream* stream, std::size_t chunkSize);
+    bool drains() const { return fd >= 0 || stream != nullptr; }
+
+    int fd;
+    std::ostream* stream;
+    std::size_t chunkSize;
+    std::string buffer;
+};
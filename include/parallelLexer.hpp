@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+
+#include "sourceBuffer.hpp"
+#include "tokenBuffer.hpp"
+
+// Lexes a whole buffer on several threads and returns exactly what TokenBuffer::tokenize gives.
+// The buffer is cut at line starts and every piece is lexed speculatively on its own thread.
+// Stitching walks the pieces in order: a piece that started inside a string literal is re-lexed
+// from the real token boundary until its tokens line up again.
+// threads == 0 uses every hardware thread; pieces are never shorter than minChunkBytes.
+TokenBuffer tokenizeParallel(const SourceBuffer& source, unsigned threads = 0,
+                             std::size_t minChunkBytes = 1 << 18);
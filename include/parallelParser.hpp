@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "parser.hpp"
+#include "tokenBuffer.hpp"
+#include "workStealingPool.hpp"
+
+// Token indices where a top-level declaration starts right after a finished one: a fun, var
+// or const outside any brackets that follows a ';' or ']' outside any brackets. Always starts
+// with 0.
+std::vector<std::size_t> topLevelDeclarationStarts(const TokenBuffer& tokens);
+
+// Parses a pre-lexed buffer and returns exactly what Parser::tryParseProgram would. Runs of
+// top-level declarations of at least minTaskTokens tokens are parsed on the pool, and the
+// program is put together in source order. If a run fails, the rest of the buffer is parsed
+// again in one piece, so the error reported is the first one in the source.
+ParseResult parseParallel(const TokenBuffer& tokens, WorkStealingPool& pool,
+                          std::size_t minTaskTokens = 1 << 14);
+// Builds a pool of up to `threads` only when the buffer splits into more than one run.
+ParseResult parseParallel(const TokenBuffer& tokens, unsigned threads = 0,
+                          std::size_t minTaskTokens = 1 << 14);
@@ -1,63 +1,124 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <optional>
 
 #include "lexer.hpp"
+#include "tokenBuffer.hpp"
+#include "tokenPipeline.hpp"
 #include "token.hpp"
 #include "position.hpp"
 #include "interpreter_exception.hpp"
 #include "asTree.hpp"
+#include "flatAst.hpp"
 #include "error.hpp"
 
+// Outcome of Parser::tryParseProgram: a program, or the first error met on the way.
+struct ParseResult
+{
+    std::unique_ptr<ProgramNode> program;
+    std::optional<Error> error;
+};
+
+// Continuation points of the parser's explicit-stack machine; defined in parser.cpp.
+enum class ParseStep : std::uint8_t;
+
+// Allocates nothing per node: nodes, their lists and literal text go into the arena, whose
+// blocks double up to 1 MiB, and the scratch and frame stacks grow with the nesting only. What
+// a parse does allocate is the lexer's one entry per distinct name, plus that growth.
 class Parser
 {
    public:
+    static constexpr std::size_t END = static_cast<std::size_t>(-1);
+
     explicit Parser(Lexer& lexer);
+    // Walks tokens [first, last) of a pre-lexed buffer; the range ends in EndOfFile.
+    explicit Parser(const TokenBuffer& tokens, std::size_t first = 0, std::size_t last = END);
+    explicit Parser(TokenPipeline& pipeline);
+    // Throws InterpreterException on the first error.
     std::unique_ptr<ProgramNode> parseProgram();
+    // Reports the first error in the result instead; nothing is thrown or formatted.
+    ParseResult tryParseProgram();
+    // Parses like parseProgram and hands back the flat form of the tree.
+    FlatAst parseFlatProgram();
 
    protected:
-    Lexer& lexer;
+    Lexer* lexer = nullptr;
+    const TokenBuffer* tokens = nullptr;
+    TokenPipeline* pipeline = nullptr;
+    std::size_t tokenIndex = 0;
+    std::size_t tokenEnd = 0;
+    std::shared_ptr<const LineIndex> lines;
     Token currentToken;
+    // First error met. After it every token reads as EndOfFile, which unwinds the parse.
+    std::optional<Error> failure;
+    // Nodes of the program being parsed; handed over to its ProgramNode at the end.
+    std::unique_ptr<AstArena> arena;
+    // Children of the lists still open, innermost last. A finished list is copied into the
+    // arena and popped, so the stacks stop growing once the deepest nesting has been seen.
+    std::vector<StatementNode*> scratchStatements;
+    std::vector<ExpressionNode*> scratchArguments;
+    std::vector<FuncDefArgument*> scratchParameters;
+
+    // A nonterminal the machine is in the middle of: where it continues once the child it is
+    // waiting for is parsed, and what it has collected so far. Nesting costs one frame on this
+    // stack, never native stack, so deeply nested input cannot overflow it.
+    struct Frame
+    {
+        ParseStep step;
+        bool modifier;
+        int precedence;
+        SourceOffset offset;
+        // Scratch stack mark, symbol or pending operator, depending on the step.
+        std::uint32_t value;
+        AstNode* first;
+        AstNode* second;
+        NodeList<FuncDefArgument> parameters;
+    };
+    std::vector<Frame> frames;
+    std::size_t depth = 0;
 
     Token advance();
+    void skip();
+    Token nextToken();
+    TokenType lookahead(std::size_t distance) const;
     bool check(TokenType type) const;
-    bool match(const std::vector<TokenType> types);
-    bool isIn(const std::vector<TokenType> types) const;
-    Token consume(TokenType type, const std::string& errorMessage);
-    InterpreterException error(const std::string& message) const;
+    bool match(TokenType type);
+    bool match(TokenSet types);
+    bool isIn(TokenSet types) const;
+    Token consume(TokenType type, MessageId message);
+    void expect(TokenType type, MessageId message);
+    bool failed() const { return failure.has_value(); }
+    void fail(Error error);
+    void error(MessageId message);
+    void error(MessageId message, SourceOffset offset, std::string detail = {});
 
     template <typename T>
-    T shall(T expected, const std::string& errMsg) const
+    NodeList<T> listOf(std::vector<T*>& scratch, std::size_t mark)
     {
-        if (!expected) throw error(errMsg);
-        return std::move(expected);
+        NodeList<T> list = arena->makeList(scratch.data() + mark, scratch.data() + scratch.size());
+        scratch.resize(mark);
+        return list;
     }
 
-    std::unique_ptr<FunctionDeclarationNode> parseFunctionDeclaration();
-    std::vector<std::unique_ptr<FuncDefArgument>> parseParameters();
-    std::unique_ptr<FuncDefArgument> parseParameter();
-    std::unique_ptr<StatementBlockNode> parseStatementBlock();
-    std::unique_ptr<StatementNode> parseStatement();
-    std::unique_ptr<IfStatementNode> parseIfStatement();
-    std::unique_ptr<WhileStatementNode> parseWhileStatement();
-    std::unique_ptr<ReturnStatementNode> parseReturnStatement();
-    std::unique_ptr<DeclarationNode> parseDeclaration();
-
-    std::unique_ptr<StatementNode> parseIdOrCallAssign();
-    std::unique_ptr<StatementNode> parsePossibleAssignOrCall(std::string id);
-    std::unique_ptr<ExpressionNode> parseFunctionCall(std::unique_ptr<ExpressionNode> callee);
-    std::unique_ptr<ExpressionNode> parseExpression();
-    std::unique_ptr<ExpressionNode> parseTypeCastExpression(std::unique_ptr<ExpressionNode> expr);
-    std::unique_ptr<ExpressionNode> parseLogicalExpr();
-    std::unique_ptr<ExpressionNode> parseRelExpression();
-    std::unique_ptr<ExpressionNode> parseSimpleExpression();
-    std::unique_ptr<ExpressionNode> parseTerm();
-    std::unique_ptr<ExpressionNode> parseFactor();
-    std::unique_ptr<ExpressionNode> parsePossibleCallArguments(
-        std::unique_ptr<ExpressionNode> expr);
-    std::vector<std::unique_ptr<ExpressionNode>> parseArgumentList();
-    std::unique_ptr<ExpressionNode> parseBaseFactor();
-    std::unique_ptr<FunctionLiteralNode> parseFunctionLiteral();
+    template <typename T>
+    T shall(T expected, MessageId message)
+    {
+        if (!expected) error(message);
+        return expected;
+    }
+
+    FunctionDeclarationNode* parseFunctionDeclaration();
+    NodeList<FuncDefArgument> parseParameters();
+    FuncDefArgument* parseParameter();
+    StatementBlockNode* parseStatementBlock();
+    DeclarationNode* parseDeclaration();
+    ExpressionNode* parseLeaf();
+    ExpressionNode* parseCasts(ExpressionNode* left);
+
+    // Runs the machine from `start` until that nonterminal is done and returns its node.
+    AstNode* run(ParseStep start);
+    Frame& push(ParseStep step, AstNode* first);
 };
\ No newline at end of file
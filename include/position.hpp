@@ -1,11 +1,21 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Byte offset into a script. Tokens, AST nodes and errors keep only this; line and column are
+// looked up in the script's LineIndex when a message needs them.
+using SourceOffset = std::uint32_t;
 
 class Position
 {
    public:
-    Position() : column(0), line(1) {}
-    Position(const int lin, const int col) : column(col), line(lin) {}
-    Position(const Position& p) : column(p.column), line(p.line) {}
+    Position() : column(0), line(1), offset(0) {}
+    Position(const int lin, const int col) : column(col), line(lin), offset(0) {}
+    Position(const int lin, const int col, const SourceOffset off)
+        : column(col), line(lin), offset(off)
+    {
+    }
+    Position(const Position& p) : column(p.column), line(p.line), offset(p.offset) {}
 
     bool operator==(const Position& other) const
     {
@@ -18,9 +28,12 @@ class Position
         {
             column = other.column;
             line = other.line;
+            offset = other.offset;
         }
         return *this;
     }
 
     int column, line;
+    // Byte offset of the position from the beginning of the source.
+    SourceOffset offset;
 };
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "asTree.hpp"
+#include "bytecode.hpp"
+#include "value.hpp"
+
+// Instructions of the register machine, three-address in the style of Lua 5: they name the
+// frame slots they read and write instead of going through a stack. An operand written RK is
+// a slot, or the constant `x & ~CONSTANT` when it has the CONSTANT bit set. Jumps take the
+// signed offset in b and c together, relative to the instruction after them.
+enum class RegisterOp : std::uint8_t
+{
+    Move,          // R[a] = R[b]
+    LoadConstant,  // R[a] = constants[b]
+    LoadNothing,   // R[a] = nothing
+    LoadGlobal,    // R[a] = global bc
+    StoreGlobal,   // global bc = RK[a]
+    DefineGlobal,  // new global bc = RK[a]
+    DefineConstant,
+    // R[a] = RK[b] op RK[c], one per BinOperator up to Pipe and AtAt, in the same order.
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Equal,
+    NotEqual,
+    Greater,
+    GreaterEqual,
+    Less,
+    LessEqual,
+    Compose,
+    Decorate,
+    Cast,         // R[a] = RK[b] as CastType c
+    Jump,         // by bc
+    JumpIfFalse,  // by bc when RK[a] is false
+    JumpIfTrue,   // by bc when RK[a] is true
+    CheckBool,    // RK[a] must be a boolean
+    Closure,      // R[a] = a new function running functions[bc]
+    Call,         // R[a] = R[a](R[a + 1], ..., R[a + b])
+    Return,       // return RK[a]
+    Raise,        // report MessageId a, naming symbol bc when it is not NO_NAME
+};
+
+struct RegisterInstruction
+{
+    RegisterOp op;
+    std::uint16_t a;
+    std::uint16_t b;
+    std::uint16_t c;
+
+    std::int32_t bc() const
+    {
+        return static_cast<std::int32_t>(std::uint32_t(b) | std::uint32_t(c) << 16);
+    }
+};
+
+static_assert(sizeof(RegisterInstruction) == 8, "instructions are meant to stay one word");
+
+// Marks an RK operand that is a constant.
+constexpr std::uint16_t CONSTANT = 0x8000;
+
+// An instruction reading a named variable's slot directly. Engines only look these up once a
+// slot turns out to hold nothing, to report the variable the way reading it would.
+struct NamedRead
+{
+    std::uint32_t instruction;
+    std::uint16_t slot;
+    SymbolId id;
+    SourceOffset at;
+};
+
+// One compiled function. Its slots start with the parameters, then the captured variables, then
+// the locals, which blocks reuse once they end; temporaries come above the locals in use, and a
+// call's callee and arguments above those.
+struct RegisterProto
+{
+    std::vector<RegisterInstruction> code;
+    // Where each instruction came from, for errors.
+    std::vector<SourceOffset> offsets;
+    std::vector<Value> constants;
+    std::vector<CaptureSlot> captures;
+    // In instruction order.
+    std::vector<NamedRead> reads;
+    std::uint16_t parameterCount = 0;
+    std::uint16_t slotCount = 0;
+    const AstNode* node = nullptr;
+
+    // The variable `instruction` reads from `slot`, if it reads one.
+    const NamedRead* readOf(std::size_t instruction, std::uint16_t slot) const;
+};
+
+struct RegisterProgram
+{
+    // The first runs the top-level declarations; it has no parameters or locals.
+    std::vector<std::unique_ptr<RegisterProto>> functions;
+    std::shared_ptr<const LineIndex> lines;
+};
+
+// Resolves names the way compileBytecode does. Expressions are computed straight into the slot
+// that wants them, and operands that are locals or literals are used where they are; what the
+// tree walker reports while running is still reported in the same order.
+RegisterProgram compileRegisters(ProgramNode& program);
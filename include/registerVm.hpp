@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "outputSink.hpp"
+#include "registerCode.hpp"
+#include "value.hpp"
+
+// Runs register code on one contiguous array of slots, each frame a window into it. A call's
+// callee and arguments sit in the caller's topmost slots; the callee's frame starts at the first
+// argument and its result is left where the callee was. Like StackVm, calls do not allocate
+// once the slots are there, and recursion is bounded by MAX_VM_STACK_BYTES, not by a depth.
+class RegisterVm
+{
+   public:
+    // print writes to `out`.
+    explicit RegisterVm(OutputSink& out) : out(out) {}
+
+    // Runs the top-level declarations, then main if the program has one, and returns what main
+    // returned. `program` must outlive the functions it returns.
+    Value run(const RegisterProgram& program);
+
+    // Instructions the last run got through.
+    std::uint64_t instructionCount() const { return executed; }
+
+   private:
+    struct Frame
+    {
+        const RegisterProto* proto;
+        const RegisterInstruction* ip;
+        // Index of the frame's first slot.
+        std::size_t base;
+        // Composed functions still to be called with the result, from the innermost out.
+        int pending;
+        SourceOffset at;
+    };
+
+    OutputSink& out;
+    const RegisterProgram* program = nullptr;
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    Globals globals;
+    // Index just past the last argument while a call is set up.
+    std::size_t top = 0;
+    std::uint64_t executed = 0;
+
+    // Runs until the frame count drops back to `depth`.
+    void execute(std::size_t depth);
+    // Calls the function at `callee` with the `count` values above it. Script functions get a
+    // frame; others finish here, leaving their result in place of the callee.
+    void call(std::size_t callee, std::size_t count, int pending, SourceOffset at);
+};
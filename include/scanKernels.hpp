@@ -0,0 +1,23 @@
+#pragma once
+#include "charClass.hpp"
+
+enum class ScanKernel
+{
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+// Run scanners over [p, end). Each returns the first byte that does not continue the run, or
+// end. None of them steps over '\n', so callers can keep line bookkeeping per stop.
+const char* skipBlanks(const char* p, const char* end);
+const char* skipIdentifierChars(const char* p, const char* end);
+const char* findLineEnd(const char* p, const char* end);
+const char* findStringStop(const char* p, const char* end);  // '"', '\\' or '\n'
+const char* skipAscii(const char* p, const char* end);
+
+// The best kernel the running CPU supports is picked on first use; tests and benchmarks may
+// force a specific one (falling back to scalar when it is unavailable).
+ScanKernel activeScanKernel();
+bool scanKernelSupported(ScanKernel kernel);
+void useScanKernel(ScanKernel kernel);
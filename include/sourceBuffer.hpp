@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Contiguous, read-only view of a whole script. Files are memory-mapped when possible and read
+// into an owned buffer otherwise.
+class SourceBuffer
+{
+   public:
+    static SourceBuffer fromFile(const std::string& path);
+    static SourceBuffer fromString(std::string text);
+
+    SourceBuffer(SourceBuffer&& other) noexcept;
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    ~SourceBuffer();
+
+    const char* begin() const { return bytes; }
+    const char* end() const { return bytes + byteCount; }
+    std::size_t size() const { return byteCount; }
+    std::string_view view() const { return std::string_view(bytes, byteCount); }
+    bool isMapped() const { return mapped; }
+
+   private:
+    SourceBuffer() = default;
+    void release();
+
+    const char* bytes = nullptr;
+    std::size_t byteCount = 0;
+    bool mapped = false;
+    std::string owned;
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <vector>
+
+// Pulls a script from a file descriptor or a stream in large chunks, for inputs that cannot be
+// mapped (stdin, pipes). Readers work over the window [begin(), end()) and refill it once it
+// runs dry.
+class SourceReader
+{
+   public:
+    static constexpr std::size_t DEFAULT_CHUNK = 1 << 16;
+
+    static SourceReader fromDescriptor(int fd, std::size_t chunkSize = DEFAULT_CHUNK);
+    static SourceReader fromStream(std::istream& stream, std::size_t chunkSize = DEFAULT_CHUNK);
+
+    const char* begin() const { return buffer.data(); }
+    const char* end() const { return buffer.data() + filled; }
+    bool exhausted() const { return atEnd; }
+
+    // Drops everything before keep, slides [keep, end()) to the front of the window and reads
+    // at least one more byte after it. Returns false once the input has ended.
+    bool refill(const char* keep);
+
+   private:
+    SourceReader(int fd, std::istream* stream, std::size_t chunkSize);
+    std::size_t readSome(char* into, std::size_t room);
+
+    int fd;
+    std::istream* stream;
+    std::size_t chunkSize;
+    std::vector<char> buffer;
+    std::size_t filled = 0;
+    bool atEnd = false;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+// Fixed-size lock-free queue for exactly one producer thread and one consumer thread.
+template <typename T, std::size_t Capacity>
+class SpscRing
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+   public:
+    bool tryPush(T&& value)
+    {
+        std::size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == Capacity) return false;
+        slots[tail & (Capacity - 1)] = std::move(value);
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> tryPop()
+    {
+        std::size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) return std::nullopt;
+        std::optional<T> value(std::move(slots[head & (Capacity - 1)]));
+        headIndex.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+   private:
+    std::array<T, Capacity> slots;
+    // Kept on separate cache lines so the two threads do not fight over one.
+    alignas(64) std::atomic<std::size_t> headIndex{0};
+    alignas(64) std::atomic<std::size_t> tailIndex{0};
+};
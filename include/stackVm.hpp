@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bytecode.hpp"
+#include "outputSink.hpp"
+#include "value.hpp"
+
+// Runs compiled programs on one contiguous value stack. A call's frame starts at its first
+// argument, right above the callee, and the result takes the callee's place when it returns.
+// The stack and the frame records are allocated up front and only grow for deeper programs,
+// so calls themselves do not allocate. Recursion is bounded by MAX_VM_STACK_BYTES: being off
+// the native stack, a call can go far deeper than in the tree walker.
+class StackVm
+{
+   public:
+    // print writes to `out`.
+    explicit StackVm(OutputSink& out) : out(out) {}
+
+    // Runs the top-level declarations, then main if the program has one, and returns what main
+    // returned. `program` must outlive the functions it returns.
+    Value run(const CompiledProgram& program);
+
+    // Instructions the last run got through.
+    std::uint64_t instructionCount() const { return executed; }
+
+   private:
+    struct Frame
+    {
+        const FunctionProto* proto;
+        const Instruction* ip;
+        // Index of the frame's first slot in the stack.
+        std::size_t base;
+        // Composed functions still to be called with the result, from the innermost out.
+        int pending;
+        SourceOffset at;
+    };
+
+    OutputSink& out;
+    const CompiledProgram* program = nullptr;
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    Globals globals;
+    // Index of the first free stack entry while no instruction is running.
+    std::size_t top = 0;
+    std::uint64_t executed = 0;
+
+    // Runs until the frame count drops back to `depth`.
+    void execute(std::size_t depth);
+    // Calls the function at `callee` with the `count` values above it. Script functions get a
+    // frame; others finish here, leaving their result in place of the callee.
+    void call(std::size_t callee, std::size_t count, int pending, SourceOffset at);
+    // Makes room for `count` more values above `top`.
+    void reserve(std::size_t count);
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// Compact handle of an interned identifier. Equal names always share the same id.
+enum class SymbolId : std::uint32_t
+{
+};
+
+// Safe to share between lexer threads. Names never move once interned, so the references
+// handed out stay valid while other threads keep adding, and looking a name up by id takes no
+// lock: only interning does.
+class SymbolTable
+{
+   public:
+    static SymbolTable& global();
+
+    SymbolId intern(std::string_view name);
+    const std::string& name(SymbolId id) const;
+    std::size_t size() const { return count.load(std::memory_order_acquire); }
+
+   private:
+    // Names live in blocks that double in size, the first holding FIRST_BLOCK of them, so a
+    // block is never moved once made and BLOCK_COUNT of them cover every id.
+    static constexpr int FIRST_BLOCK_BITS = 6;
+    static constexpr std::size_t FIRST_BLOCK = std::size_t{1} << FIRST_BLOCK_BITS;
+    static constexpr int BLOCK_COUNT = 33 - FIRST_BLOCK_BITS;
+
+    // The block that holds the name with this id, and its place there.
+    static std::pair<int, std::size_t> locate(std::uint32_t id);
+
+    mutable std::shared_mutex mutex;
+    std::unique_ptr<std::string[]> blocks[BLOCK_COUNT];
+    // Names interned so far. Stored with release once a name and its block are in place, so
+    // whoever has been given an id can read its name without the lock.
+    std::atomic<std::uint32_t> count{0};
+    std::unordered_map<std::string_view, SymbolId> ids;
+};
+
+inline SymbolId intern(std::string_view name)
+{
+    return SymbolTable::global().intern(name);
+}
+
+inline const std::string& symbolName(SymbolId id)
+{
+    return SymbolTable::global().name(id);
+}
@@ -1,7 +1,13 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <variant>
 #include "position.hpp"
+#include "symbolTable.hpp"
 
 enum class TokenType
 {
@@ -46,30 +52,84 @@ enum class TokenType
     Comma,
 
     EndOfFile,
-    Unknown
+    Unknown,
+    // A lexical error; the token source that produced it holds the details.
+    Error
 };
 
-struct Token
+// Set of token types as a bit mask, so membership tests are a shift and an and. Build them as
+// constexpr values.
+class TokenSet
 {
-    TokenType type;
-    std::variant<std::monostate, std::string, int, float> value;
-    Position startPosition;
+   public:
+    constexpr TokenSet() = default;
+    constexpr TokenSet(std::initializer_list<TokenType> types)
+    {
+        for (TokenType type : types) bits |= bit(type);
+    }
+
+    constexpr bool contains(TokenType type) const { return (bits & bit(type)) != 0; }
+    constexpr TokenSet operator|(TokenSet other) const { return TokenSet(bits | other.bits); }
+
+   private:
+    constexpr explicit TokenSet(std::uint64_t bits) : bits(bits) {}
+    static constexpr std::uint64_t bit(TokenType type)
+    {
+        return std::uint64_t(1) << static_cast<unsigned>(type);
+    }
+
+    std::uint64_t bits = 0;
+};
 
-    Token(TokenType type, Position pos) : type(type), value(std::monostate{}), startPosition(pos) {}
+static_assert(static_cast<unsigned>(TokenType::Error) < 64, "TokenSet holds 64 token types");
 
-    Token(TokenType type, const std::string& val, Position pos)
-        : type(type), value(val), startPosition(pos)
+// A string literal lexed from a SourceBuffer: its text between the quotes, viewed in place, and
+// whether that text has escapes still to be decoded.
+struct StringSpan
+{
+    std::string_view raw;
+    bool escaped;
+
+    bool operator==(const StringSpan& other) const
     {
+        return raw == other.raw && escaped == other.escaped;
     }
-    Token(TokenType type, int val, Position pos) : type(type), value(val), startPosition(pos) {}
+};
+
+// Decodes the escapes of a literal's raw text into `out`, which may be where the text already
+// is, since decoding never lengthens it. Returns the decoded length.
+std::size_t unescape(std::string_view raw, char* out);
+std::string unescape(std::string_view raw);
+
+struct Token
+{
+    TokenType type;
+    std::variant<std::monostate, std::string, int, float, SymbolId, StringSpan> value;
+    SourceOffset offset;
 
-    Token(TokenType type, float val, Position start) : type(type), value(val), startPosition(start)
+    Token(TokenType type, SourceOffset off) : type(type), value(std::monostate{}), offset(off) {}
+
+    Token(TokenType type, const std::string& val, SourceOffset off)
+        : type(type), value(val), offset(off)
     {
     }
+    Token(TokenType type, int val, SourceOffset off) : type(type), value(val), offset(off) {}
+
+    Token(TokenType type, float val, SourceOffset off) : type(type), value(val), offset(off) {}
+    Token(TokenType type, SymbolId val, SourceOffset off) : type(type), value(val), offset(off) {}
+    Token(TokenType type, StringSpan val, SourceOffset off) : type(type), value(val), offset(off) {}
 
+    // Identifiers and type names hold a SymbolId, and string literals may hold a StringSpan;
+    // asking for their std::string spells it out.
     template <typename T>
     T getValue() const
     {
+        if constexpr (std::is_same_v<T, std::string>)
+        {
+            if (auto symbol = std::get_if<SymbolId>(&value)) return symbolName(*symbol);
+            if (auto span = std::get_if<StringSpan>(&value))
+                return span->escaped ? unescape(span->raw) : std::string(span->raw);
+        }
         return std::get<T>(value);
     }
 };
\ No newline at end of file
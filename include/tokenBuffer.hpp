@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#include "error.hpp"
+#include "lexer.hpp"
+#include "lineIndex.hpp"
+#include "token.hpp"
+
+// Whole-input token stream in structure-of-arrays form. Every token costs a type byte, its
+// byte offset and one index: the SymbolId for identifiers and type names, a slot in the
+// literal side table for numbers, strings and unknown characters.
+class TokenBuffer
+{
+   public:
+    // Lexes everything up front. A lexical error ends the buffer and is kept so that a parser
+    // walking the buffer reports it only when it gets there.
+    static TokenBuffer tokenize(Lexer& lexer);
+
+    void push(const Token& token);
+    // Appends other's tokens from index `first` on.
+    void append(const TokenBuffer& other, std::size_t first);
+
+    std::size_t size() const { return types.size(); }
+    TokenType type(std::size_t index) const { return static_cast<TokenType>(types[index]); }
+    SourceOffset offset(std::size_t index) const { return offsets[index]; }
+    Position position(std::size_t index) const { return lines->position(offsets[index]); }
+    Token token(std::size_t index) const;
+
+    const std::shared_ptr<const LineIndex>& lineIndex() const { return lines; }
+    void setLineIndex(std::shared_ptr<const LineIndex> index) { lines = std::move(index); }
+    const std::optional<Error>& lexicalError() const { return lexError; }
+    void setLexicalError(const Error& error) { lexError = error; }
+
+   private:
+    using Literal = std::variant<std::monostate, std::string, int, float, StringSpan>;
+    static constexpr std::uint32_t NO_VALUE = UINT32_MAX;
+
+    std::vector<std::uint8_t> types;
+    std::vector<SourceOffset> offsets;
+    std::vector<std::uint32_t> values;
+    std::vector<Literal> literals;
+    std::shared_ptr<const LineIndex> lines = std::make_shared<LineIndex>();
+    std::optional<Error> lexError;
+};
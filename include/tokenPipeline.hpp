@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "error.hpp"
+#include "lexer.hpp"
+#include "spscRing.hpp"
+#include "token.hpp"
+
+// Runs a Lexer on its own thread and hands its tokens to one consumer in batches, so lexing
+// overlaps with parsing. A lexical error ends the stream with an Error token, as the Lexer's
+// nextToken() does; any other failure of the lexer thread is rethrown by next() in its place.
+class TokenPipeline
+{
+   public:
+    static constexpr std::size_t BATCH_SIZE = 512;
+
+    explicit TokenPipeline(Lexer& lexer);
+    ~TokenPipeline();
+    TokenPipeline(const TokenPipeline&) = delete;
+    TokenPipeline& operator=(const TokenPipeline&) = delete;
+
+    Token next();
+    // Set once next() has returned the Error token.
+    const std::optional<Error>& lexicalError() const { return current.error; }
+    // Stops and joins the lexer thread; afterwards the line index no longer changes.
+    void stop();
+    std::shared_ptr<const LineIndex> lineIndex() const { return lines; }
+
+   private:
+    struct Batch
+    {
+        std::vector<Token> tokens;
+        std::optional<Error> error;
+        std::exception_ptr failure;
+        bool last = false;
+    };
+
+    void produce(Lexer& lexer);
+    bool publish(Batch&& batch);
+
+    std::shared_ptr<const LineIndex> lines;
+    SpscRing<Batch, 64> ring;
+    std::atomic<bool> stopping{false};
+    Batch current;
+    std::size_t index = 0;
+    std::thread producer;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <optional>
+#include <vector>
+
+#include "position.hpp"
+
+// Number of bytes in the UTF-8 sequence a lead byte starts; 1 for ASCII and for bytes that
+// cannot start a sequence.
+constexpr int utf8SequenceLength(char lead)
+{
+    unsigned char byte = static_cast<unsigned char>(lead);
+    if (byte < 0xC2 || byte > 0xF4) return 1;
+    return byte < 0xE0 ? 2 : byte < 0xF0 ? 3 : 4;
+}
+
+constexpr bool isUtf8Continuation(char c)
+{
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+// Checks a byte stream for well-formed UTF-8, one piece at a time. Runs of ASCII are skipped
+// with the active scan kernel; only multi-byte sequences are decoded byte by byte.
+class Utf8Validator
+{
+   public:
+    // Checks [p, end), which starts at offset base, and appends the offset of every continuation
+    // byte to continuations. Returns the offset of the first invalid sequence; the validator
+    // must not be fed again after that.
+    std::optional<SourceOffset> feed(const char* p, const char* end, SourceOffset base,
+                                     std::vector<SourceOffset>& continuations);
+    // End of input: a sequence left unfinished is invalid.
+    std::optional<SourceOffset> finish() const;
+
+   private:
+    int remaining = 0;
+    // Range the next continuation byte must fall into; narrower right after some lead bytes.
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    SourceOffset sequenceStart = 0;
+};
@@ -0,0 +1,217 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "asTree.hpp"
+#include "error.hpp"
+
+class OutputSink;
+struct FunctionObject;
+struct FunctionProto;
+struct RegisterProto;
+
+// The tree walker recurses natively on each call, so calls deeper than this are taken for
+// runaway recursion there.
+constexpr int MAX_CALL_DEPTH = 1000;
+// The VMs keep their frames and values on the heap instead. For them runaway recursion is a
+// call that would take the two stacks past this many bytes.
+constexpr std::size_t MAX_VM_STACK_BYTES = std::size_t{64} << 20;
+// Bounds how deeply expressions and blocks may nest, as engines recurse on them natively.
+constexpr int MAX_NESTING = 10000;
+
+// What a script computes with: a type tag and an 8-byte payload, 16 bytes in all. Numbers and
+// booleans are held in place. Strings and functions point to a reference-counted object, so
+// copying a value never allocates; only making a new string or function does.
+class Value
+{
+   public:
+    enum class Type : std::uint8_t
+    {
+        Nothing,
+        Int,
+        Float,
+        Bool,
+        String,
+        Function
+    };
+
+    // Scripts cannot write strings longer than this; the lexer does not stop literals, so it is
+    // enforced where strings are made.
+    static constexpr std::size_t MAX_STRING_LENGTH = 200;
+
+    Value() { payload.object = nullptr; }
+    static Value integer(std::int32_t value)
+    {
+        Value result;
+        result.type = Type::Int;
+        result.payload.integer = value;
+        return result;
+    }
+    static Value real(float value)
+    {
+        Value result;
+        result.type = Type::Float;
+        result.payload.real = value;
+        return result;
+    }
+    static Value boolean(bool value)
+    {
+        Value result;
+        result.type = Type::Bool;
+        result.payload.boolean = value;
+        return result;
+    }
+    static Value string(std::string_view text);
+    // Takes over the one reference a new FunctionObject starts with.
+    static Value function(FunctionObject* function);
+
+    Value(const Value& other) : type(other.type), payload(other.payload) { retain(); }
+    Value(Value&& other) noexcept : type(other.type), payload(other.payload)
+    {
+        other.type = Type::Nothing;
+    }
+    Value& operator=(const Value& other)
+    {
+        other.retain();
+        release();
+        type = other.type;
+        payload = other.payload;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            type = other.type;
+            payload = other.payload;
+            other.type = Type::Nothing;
+        }
+        return *this;
+    }
+    ~Value() { release(); }
+
+    Type getType() const { return type; }
+    bool is(Type expected) const { return type == expected; }
+    std::int32_t asInt() const { return payload.integer; }
+    float asFloat() const { return payload.real; }
+    bool asBool() const { return payload.boolean; }
+    std::string_view asString() const;
+    FunctionObject* asFunction() const;
+
+    // The text print writes, and `as string` makes.
+    std::string toString() const;
+    std::string_view typeName() const { return typeName(type); }
+    static std::string_view typeName(Type type);
+
+   private:
+    // Header of a string's bytes, which follow it in the same block.
+    struct StringObject
+    {
+        std::uint32_t references;
+        std::uint32_t size;
+    };
+
+    union Payload
+    {
+        std::int32_t integer;
+        float real;
+        bool boolean;
+        StringObject* string;
+        FunctionObject* object;
+    };
+
+    Type type = Type::Nothing;
+    Payload payload;
+
+    bool counted() const { return type == Type::String || type == Type::Function; }
+    void retain() const
+    {
+        if (counted()) retainObject();
+    }
+    void retainObject() const;
+    void release()
+    {
+        if (counted()) releaseObject();
+    }
+    void releaseObject();
+};
+
+static_assert(sizeof(Value) == 16, "values are meant to fit in two words");
+
+// A variable a function literal copied from the function it was made in.
+struct Capture
+{
+    SymbolId id;
+    bool constant;
+    Value value;
+};
+
+// A function as scripts see it. Script functions run a body with their parameters bound;
+// composition (`f | g`) runs `first` and hands its result to `second`; decoration (`f @@ d`)
+// calls `second` with `first` in front of the arguments.
+struct FunctionObject
+{
+    enum class Kind : std::uint8_t
+    {
+        Script,
+        Composed,
+        Decorated,
+        Print
+    };
+
+    std::uint32_t references = 1;
+    Kind kind;
+    // Script functions: the declaration or literal, for offsets, and what it binds and runs.
+    const AstNode* node = nullptr;
+    NodeList<FuncDefArgument> parameters;
+    StatementBlockNode* body = nullptr;
+    // The same function compiled, for the stack and the register machine.
+    const FunctionProto* proto = nullptr;
+    const RegisterProto* registerProto = nullptr;
+    // Values of the enclosing function's variables the body uses, as they were when the
+    // literal was evaluated. Functions declared at the top level see globals instead.
+    std::vector<Capture> captures;
+    Value first;
+    Value second;
+};
+
+// Variables declared at the top level, by SymbolId.
+class Globals
+{
+   public:
+    struct Entry
+    {
+        Value value;
+        bool defined = false;
+        bool constant = false;
+    };
+
+    // Forgets every global but print, which runs start with.
+    void reset();
+    Entry& operator[](SymbolId id)
+    {
+        auto index = static_cast<std::size_t>(id);
+        if (index >= entries.size()) entries.resize(index + 1);
+        return entries[index];
+    }
+
+   private:
+    std::vector<Entry> entries;
+};
+
+// Thrown for every error a running script makes. Engines fill in the line index.
+[[noreturn]] void runtimeError(MessageId message, SourceOffset at, std::string detail = {});
+[[noreturn]] void wrongArgumentCount(std::size_t expected, std::size_t given, SourceOffset at);
+
+// Every binary operator but `&&` and `||`, whose right operand engines evaluate only when it
+// decides the result; on two booleans it works for those as well.
+Value binaryOperation(BinOperator op, const Value& left, const Value& right, SourceOffset at);
+Value castValue(const Value& value, CastType type, SourceOffset at);
+// Conditions must be booleans; there is no truthiness.
+bool isTrue(const Value& condition, SourceOffset at);
+// Writes a value as print shows it.
+void printValue(OutputSink& out, const Value& value);
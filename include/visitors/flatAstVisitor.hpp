@@ -0,0 +1,68 @@
+#pragma once
+
+#include "flatAst.hpp"
+
+// Counterpart of AstVisitor for the flat tree; nodes are passed as the tree and an index.
+class FlatAstVisitor
+{
+   public:
+    virtual ~FlatAstVisitor() = default;
+    virtual void visitNumberLiteral(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitStringLiteral(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitIdentifier(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitBinaryOp(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitTypeCast(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitFunctionCall(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitExpressionStatement(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitStatementBlock(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitFunctionDeclaration(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitFunctionLiteral(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitParameter(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitIfStatement(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitDeclaration(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitReturnStatement(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitAssign(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitWhileStatement(const FlatAst& ast, NodeIndex node) = 0;
+    virtual void visitProgram(const FlatAst& ast, NodeIndex node) = 0;
+};
+
+inline void FlatAst::accept(NodeIndex node, FlatAstVisitor& visitor) const
+{
+    switch (nodes[node].kind)
+    {
+        case FlatKind::Number:
+            return visitor.visitNumberLiteral(*this, node);
+        case FlatKind::String:
+            return visitor.visitStringLiteral(*this, node);
+        case FlatKind::Identifier:
+            return visitor.visitIdentifier(*this, node);
+        case FlatKind::BinaryOp:
+            return visitor.visitBinaryOp(*this, node);
+        case FlatKind::TypeCast:
+            return visitor.visitTypeCast(*this, node);
+        case FlatKind::FunctionCall:
+            return visitor.visitFunctionCall(*this, node);
+        case FlatKind::ExpressionStatement:
+            return visitor.visitExpressionStatement(*this, node);
+        case FlatKind::StatementBlock:
+            return visitor.visitStatementBlock(*this, node);
+        case FlatKind::FunctionDeclaration:
+            return visitor.visitFunctionDeclaration(*this, node);
+        case FlatKind::FunctionLiteral:
+            return visitor.visitFunctionLiteral(*this, node);
+        case FlatKind::Parameter:
+            return visitor.visitParameter(*this, node);
+        case FlatKind::If:
+            return visitor.visitIfStatement(*this, node);
+        case FlatKind::Declaration:
+            return visitor.visitDeclaration(*this, node);
+        case FlatKind::Return:
+            return visitor.visitReturnStatement(*this, node);
+        case FlatKind::Assign:
+            return visitor.visitAssign(*this, node);
+        case FlatKind::While:
+            return visitor.visitWhileStatement(*this, node);
+        case FlatKind::Program:
+            return visitor.visitProgram(*this, node);
+    }
+}
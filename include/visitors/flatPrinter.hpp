@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+
+#include "flatAstVisitor.hpp"
+#include "outputSink.hpp"
+#include "traversal.hpp"
+
+// Prints a flat tree in ParserVisitor's format. Several trees printed one after another read
+// as one program, which is how cached pieces of a script are shown.
+class FlatPrinter : public FlatAstVisitor
+{
+   public:
+    // Keeps the printed text for getParsedString.
+    FlatPrinter() = default;
+    // Streams the printed text into `sink` as it goes instead.
+    explicit FlatPrinter(OutputSink& sink) : sink(&sink) {}
+
+    void print(const FlatAst& ast);
+    // What was printed, unless it went to a sink of the caller's.
+    const std::string& getParsedString() const { return kept.text(); }
+
+    void visitNumberLiteral(const FlatAst& ast, NodeIndex node) override;
+    void visitStringLiteral(const FlatAst& ast, NodeIndex node) override;
+    void visitIdentifier(const FlatAst& ast, NodeIndex node) override;
+    void visitBinaryOp(const FlatAst& ast, NodeIndex node) override;
+    void visitTypeCast(const FlatAst& ast, NodeIndex node) override;
+    void visitFunctionCall(const FlatAst& ast, NodeIndex node) override;
+    void visitExpressionStatement(const FlatAst& ast, NodeIndex node) override;
+    void visitStatementBlock(const FlatAst& ast, NodeIndex node) override;
+    void visitFunctionDeclaration(const FlatAst& ast, NodeIndex node) override;
+    void visitFunctionLiteral(const FlatAst& ast, NodeIndex node) override;
+    void visitParameter(const FlatAst& ast, NodeIndex node) override;
+    void visitIfStatement(const FlatAst& ast, NodeIndex node) override;
+    void visitDeclaration(const FlatAst& ast, NodeIndex node) override;
+    void visitReturnStatement(const FlatAst& ast, NodeIndex node) override;
+    void visitAssign(const FlatAst& ast, NodeIndex node) override;
+    void visitWhileStatement(const FlatAst& ast, NodeIndex node) override;
+    void visitProgram(const FlatAst& ast, NodeIndex node) override;
+
+   private:
+    // Queued between the children of a node, as in ParserVisitor. Text made up while visiting
+    // goes straight to the sink, ahead of the first child.
+    struct Output
+    {
+        enum class Kind
+        {
+            Text,
+            Indented,
+            Deeper,
+            Shallower
+        };
+        Kind kind;
+        const char* text;
+    };
+
+    OutputSink kept;
+    OutputSink* sink = &kept;
+    int indentation = 0;
+    Traversal<NodeIndex, Output> traversal;
+
+    void visitChild(const FlatAst& ast, NodeIndex node);
+    void emit(const char* text);
+    void output(Output output);
+    void write(const Output& output);
+    void printFunction(const FlatAst& ast, NodeIndex node);
+    void printBody(const FlatAst& ast, NodeIndex block);
+};
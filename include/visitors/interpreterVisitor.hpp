@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "asTree.hpp"
+#include "outputSink.hpp"
+#include "staticVisitor.hpp"
+#include "value.hpp"
+
+// Runs a program by walking its tree. Expressions evaluate to a Value; statements evaluate to
+// nothing, and a return is handed up as `returning` rather than thrown, so blocks and loops
+// stop at it. Runtime errors are thrown as InterpreterException.
+//
+// Variables of every active call live on one stack, innermost last: a call's arguments become
+// its parameters where they were pushed, blocks pop what they declared, and a name is looked up
+// from the top down to the start of the current call, then among the globals.
+class InterpreterVisitor : public StaticVisitor<InterpreterVisitor, Value>
+{
+   public:
+    // print writes to `out`.
+    explicit InterpreterVisitor(OutputSink& out) : out(out) {}
+
+    // Declares the functions and runs the top-level declarations in order, then calls main if
+    // the program has one. Returns what main returned.
+    Value run(ProgramNode& program);
+
+   private:
+    friend class StaticVisitor<InterpreterVisitor, Value>;
+
+    struct Binding
+    {
+        SymbolId id;
+        bool constant;
+        Value value;
+    };
+
+    OutputSink& out;
+    Globals globals;
+    std::vector<Binding> locals;
+    // Where the current call's variables and the current block's declarations start.
+    std::size_t frameStart = 0;
+    std::size_t blockStart = 0;
+    int callDepth = 0;
+    int nesting = 0;
+    bool returning = false;
+    Value returned;
+    // Names each function literal's body uses, found the first time it is evaluated.
+    std::unordered_map<const FunctionLiteralNode*, std::vector<SymbolId>> literalNames;
+
+    Value evaluate(ExpressionNode& node);
+    // An absent initializer or return value is nothing.
+    Value evaluate(ExpressionNode* node);
+    // Calls `function` with the arguments pushed on `locals` from `start` on, and pops them.
+    Value invoke(FunctionObject& function, std::size_t start, SourceOffset at);
+    Binding* findLocal(SymbolId id);
+    void declare(SymbolId id, bool constant, Value value, SourceOffset at);
+    const std::vector<SymbolId>& namesUsedBy(FunctionLiteralNode& node);
+
+    Value visit(NumberLiteralNode& node);
+    Value visit(StringLiteralNode& node);
+    Value visit(IdentifierNode& node);
+    Value visit(BinaryOpNode& node);
+    Value visit(TypeCastNode& node);
+    Value visit(FunctionCallNode& node);
+    Value visit(ExpressionStatementNode& node);
+    Value visit(StatementBlockNode& node);
+    Value visit(FunctionDeclarationNode& node);
+    Value visit(FunctionLiteralNode& node);
+    Value visit(IfStatementNode& node);
+    Value visit(DeclarationNode& node);
+    Value visit(ReturnStatementNode& node);
+    Value visit(AssignNode& node);
+    Value visit(WhileStatementNode& node);
+    Value visit(ProgramNode& node);
+};
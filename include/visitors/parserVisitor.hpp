@@ -1,18 +1,62 @@
 #pragma once
 #include "astVisitor.hpp"
 #include "asTree.hpp"
+#include "outputSink.hpp"
+#include "staticVisitor.hpp"
+#include "traversal.hpp"
 #include <string>
+#include <string_view>
 #include <variant>
 
-class ParserVisitor : public AstVisitor
+// Still an AstVisitor, so programs accept it, but it reaches the nodes below the program
+// through StaticVisitor's switch on their kind.
+class ParserVisitor final : public AstVisitor, public StaticVisitor<ParserVisitor>
 {
 public:
+    // Keeps the printed program for getParsedString.
+    ParserVisitor() = default;
+    // Streams the printed program into `sink` as it goes instead.
+    explicit ParserVisitor(OutputSink& sink) : sink(&sink) {}
+
     void visit(ProgramNode& node) override;
+    // What was printed, unless it went to a sink of the caller's.
     std::string getParsedString() const;
 
-protected:
-    std::vector<std::string> outcome;
+private:
+    friend class StaticVisitor<ParserVisitor>;
+
+    // Output a visit queues to be written between its children: text, text after the current
+    // indentation, or a change of indentation. Queued text is always a literal.
+    struct Output
+    {
+        enum class Kind
+        {
+            Text,
+            Indented,
+            Deeper,
+            Shallower
+        };
+        Kind kind;
+        const char* text;
+    };
+
+    OutputSink kept;
+    OutputSink* sink = &kept;
     int indentation = 0;
+    Traversal<AstNode*, Output> traversal;
+
+    void visitChild(AstNode* node);
+    // Text made up while visiting, such as names, is written right away, so it has to come
+    // before the first child the visit queues. Pieces are emitted one by one rather than
+    // concatenated first, which would make a temporary string per node.
+    void emit(std::string_view text);
+    void emit(const char* text);
+    void emitIndented(const char* text = "");
+    void emitParameters(NodeList<FuncDefArgument> parameters);
+    void deeper();
+    void shallower();
+    void output(Output output);
+    void write(const Output& output);
 
     void visit(NumberLiteralNode& node) override;
     void visit(StringLiteralNode& node) override;
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "asTree.hpp"
+
+// Dispatches on the node's kind tag instead of through accept and AstVisitor, which costs two
+// virtual calls per node. Derived defines visit() for the node classes, by reference, and
+// reaches children through dispatch(); the compiler sees which visit each kind takes and can
+// inline it. A Derived that also implements AstVisitor should be final, so that its visits are
+// called directly here.
+template <typename Derived, typename Result = void>
+class StaticVisitor
+{
+   public:
+    Result dispatch(AstNode& node)
+    {
+        Derived& self = static_cast<Derived&>(*this);
+        switch (node.getKind())
+        {
+            case NodeKind::NumberLiteral:
+                return self.visit(static_cast<NumberLiteralNode&>(node));
+            case NodeKind::StringLiteral:
+                return self.visit(static_cast<StringLiteralNode&>(node));
+            case NodeKind::Identifier:
+                return self.visit(static_cast<IdentifierNode&>(node));
+            case NodeKind::BinaryOp:
+                return self.visit(static_cast<BinaryOpNode&>(node));
+            case NodeKind::TypeCast:
+                return self.visit(static_cast<TypeCastNode&>(node));
+            case NodeKind::FunctionCall:
+                return self.visit(static_cast<FunctionCallNode&>(node));
+            case NodeKind::ExpressionStatement:
+                return self.visit(static_cast<ExpressionStatementNode&>(node));
+            case NodeKind::StatementBlock:
+                return self.visit(static_cast<StatementBlockNode&>(node));
+            case NodeKind::FunctionDeclaration:
+                return self.visit(static_cast<FunctionDeclarationNode&>(node));
+            case NodeKind::FunctionLiteral:
+                return self.visit(static_cast<FunctionLiteralNode&>(node));
+            case NodeKind::IfStatement:
+                return self.visit(static_cast<IfStatementNode&>(node));
+            case NodeKind::Declaration:
+                return self.visit(static_cast<DeclarationNode&>(node));
+            case NodeKind::ReturnStatement:
+                return self.visit(static_cast<ReturnStatementNode&>(node));
+            case NodeKind::Assign:
+                return self.visit(static_cast<AssignNode&>(node));
+            case NodeKind::WhileStatement:
+                return self.visit(static_cast<WhileStatementNode&>(node));
+            case NodeKind::Program:
+                break;
+        }
+        return self.visit(static_cast<ProgramNode&>(node));
+    }
+
+   protected:
+    StaticVisitor() = default;
+    ~StaticVisitor() = default;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Depth-first walk of a tree whose depth is not bounded by the native stack. A visit hands its
+// children to visit(), and whatever is to happen between and after them to doLater. Children
+// are visited on the spot while that keeps the order and the nesting is shallow; past that they
+// are queued on an explicit stack, so deep nesting costs heap memory instead. The work a visit
+// queues runs in the order it was queued, ahead of everything queued before that visit.
+template <typename Node, typename Action>
+class Traversal
+{
+   public:
+    // Native nesting allowed before children are queued instead.
+    static constexpr int MAX_NATIVE_DEPTH = 64;
+
+    template <typename Visit>
+    void visit(Node node, Visit&& visit)
+    {
+        if (hasQueued() || depth == MAX_NATIVE_DEPTH)
+        {
+            visitLater(node);
+            return;
+        }
+        ++depth;
+        visit(node);
+        --depth;
+    }
+    void visitLater(Node node) { items.push_back(Item{node, Action{}, true}); }
+    void doLater(Action action) { items.push_back(Item{Node{}, std::move(action), false}); }
+    // Whether anything is queued ahead of the current visit's next step. Until it is, that
+    // step may as well be done on the spot, since nothing else is due in between.
+    bool hasQueued() const { return items.size() > mark; }
+
+    // Runs the queued work, and the work that queues in turn, until none is left.
+    template <typename Visit, typename Act>
+    void run(Visit&& visit, Act&& act)
+    {
+        schedule();
+        while (!items.empty())
+        {
+            Item item = std::move(items.back());
+            items.pop_back();
+            mark = items.size();
+            if (item.isNode)
+                visit(item.node);
+            else
+                act(item.action);
+            schedule();
+        }
+        mark = 0;
+    }
+
+   private:
+    struct Item
+    {
+        Node node;
+        Action action;
+        bool isNode;
+    };
+    // Pending work, next item last. The items from `mark` on were queued by the visit in
+    // progress, or by the children it visited on the spot, and are still in queue order.
+    std::vector<Item> items;
+    std::size_t mark = 0;
+    int depth = 0;
+
+    void schedule() { std::reverse(items.begin() + mark, items.end()); }
+};
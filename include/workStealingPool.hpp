@@ -0,0 +1,56 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that runs numbered tasks. Every thread starts with an even, contiguous
+// share of the tasks and takes them from the front, so work roughly follows task order; once
+// its share is used up it steals from the back of the others.
+class WorkStealingPool
+{
+   public:
+    // threads == 0 uses every hardware thread. The calling thread counts as one of them.
+    explicit WorkStealingPool(unsigned threads = 0);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+    // Calls task(i) once for every i in [0, count) and returns when all calls are done. The
+    // first exception a task throws is rethrown here after the others finish.
+    void run(std::size_t count, const std::function<void(std::size_t)>& task);
+
+   private:
+    using Task = std::function<void(std::size_t)>;
+
+    struct alignas(64) Queue
+    {
+        std::mutex mutex;
+        std::deque<std::size_t> tasks;
+    };
+
+    bool next(unsigned self, std::size_t& task);
+    void work(unsigned self, const Task& task);
+    void workerLoop(unsigned self);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const Task* job = nullptr;
+    std::uint64_t generation = 0;
+    // Workers that have not finished the current job yet.
+    unsigned busy = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+};
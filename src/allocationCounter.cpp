@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "allocationCounter.hpp"
+
+namespace
+{
+std::atomic<std::size_t> allocations{0};
+
+void* allocate(std::size_t size) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+// aligned_alloc wants the size to be a multiple of the alignment.
+void* allocate(std::size_t size, std::align_val_t alignment) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    std::size_t rounded = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+    return std::aligned_alloc(align, rounded);
+}
+
+template <typename... Alignment>
+void* allocateOrThrow(std::size_t size, Alignment... alignment)
+{
+    for (;;)
+    {
+        if (void* place = allocate(size, alignment...)) return place;
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) throw std::bad_alloc();
+        handler();
+    }
+}
+
+}  // namespace
+
+std::size_t AllocationCounter::total()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+// Over-aligned types, such as the work-stealing pool's queues, come through the align_val_t
+// overloads and are counted as well.
+void* operator new(std::size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void* place) noexcept
+{
+    std::free(place);
+}
+
+void operator delete[](void* place) noexcept
+{
+    std::free(place);
+}
+
+void operator delete(void* place, std::size_t) noexcept
+{
+    std::free(place);
+}
+
+void operator delete[](void* place, std::size_t) noexcept
+{
+    std::free(place);
+}
+
+void operator delete(void* place, const std::nothrow_t&) noexcept
+{
+    std::free(place);
+}
+
+void operator delete[](void* place, const std::nothrow_t&) noexcept
+{
+    std::free(place);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocateOrThrow(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return allocateOrThrow(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocate(size, alignment);
+}
+
+void operator delete(void* place, std::align_val_t) noexcept
+{
+    std::free(place);
+}
+
+void operator delete[](void* place, std::align_val_t) noexcept
+{
+    std::free(place);
+}
+
+void operator delete(void* place, std::size_t, std::align_val_t) noexcept
+{
+    std::free(place);
+}
+
+void operator delete[](void* place, std::size_t, std::align_val_t) noexcept
+{
+    std::free(place);
+}
+
+void operator delete(void* place, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(place);
+}
+
+void operator delete[](void* place, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(place);
+}
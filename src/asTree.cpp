@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <unordered_map>
 #include "asTree.hpp"
@@ -81,3 +82,79 @@ void ProgramNode::accept(AstVisitor& visitor)
 {
     return visitor.visit(*this);
 }
+
+// Walks with its own stack, as the trees may be deep.
+std::vector<SymbolId> namesUsedIn(StatementBlockNode& body)
+{
+    std::vector<SymbolId> names;
+    std::vector<AstNode*> pending{&body};
+    auto push = [&](AstNode* node)
+    {
+        if (node) pending.push_back(node);
+    };
+    while (!pending.empty())
+    {
+        AstNode* node = pending.back();
+        pending.pop_back();
+        switch (node->getKind())
+        {
+            case NodeKind::Identifier:
+                names.push_back(static_cast<IdentifierNode*>(node)->getSymbol());
+                break;
+            case NodeKind::Assign:
+            {
+                auto* assign = static_cast<AssignNode*>(node);
+                names.push_back(assign->getIdentifier());
+                push(assign->expression);
+                break;
+            }
+            case NodeKind::BinaryOp:
+                push(static_cast<BinaryOpNode*>(node)->left);
+                push(static_cast<BinaryOpNode*>(node)->right);
+                break;
+            case NodeKind::TypeCast:
+                push(static_cast<TypeCastNode*>(node)->expression);
+                break;
+            case NodeKind::FunctionCall:
+            {
+                auto* call = static_cast<FunctionCallNode*>(node);
+                push(call->callee);
+                for (ExpressionNode* argument : call->arguments) push(argument);
+                break;
+            }
+            case NodeKind::ExpressionStatement:
+                push(static_cast<ExpressionStatementNode*>(node)->expression);
+                break;
+            case NodeKind::StatementBlock:
+                for (StatementNode* statement : static_cast<StatementBlockNode*>(node)->statements)
+                    push(statement);
+                break;
+            case NodeKind::FunctionLiteral:
+                push(static_cast<FunctionLiteralNode*>(node)->body);
+                break;
+            case NodeKind::IfStatement:
+            {
+                auto* statement = static_cast<IfStatementNode*>(node);
+                push(statement->condition);
+                push(statement->thenBlock);
+                push(statement->elseBlock);
+                break;
+            }
+            case NodeKind::Declaration:
+                push(static_cast<DeclarationNode*>(node)->initializer);
+                break;
+            case NodeKind::ReturnStatement:
+                push(static_cast<ReturnStatementNode*>(node)->returnValue);
+                break;
+            case NodeKind::WhileStatement:
+                push(static_cast<WhileStatementNode*>(node)->condition);
+                push(static_cast<WhileStatementNode*>(node)->body);
+                break;
+            default:
+                break;
+        }
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return names;
+}
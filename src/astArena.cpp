@@ -0,0 +1,42 @@
+#include <algorithm>
+#include <cassert>
+
+#include "astArena.hpp"
+
+std::string_view AstArena::copyString(std::string_view text)
+{
+    if (text.empty()) return {};
+    return std::string_view(copyChars(text), text.size());
+}
+
+char* AstArena::copyChars(std::string_view text)
+{
+    if (text.empty()) return nullptr;
+    char* copy = static_cast<char*>(allocate(text.size(), 1));
+    std::memcpy(copy, text.data(), text.size());
+    return copy;
+}
+
+void AstArena::adopt(AstArena&& other)
+{
+    for (auto& block : other.blocks) blocks.push_back(std::move(block));
+    reserved += other.reserved;
+    other.blocks.clear();
+    other.current = nullptr;
+    other.used = other.capacity = other.reserved = 0;
+}
+
+void* AstArena::allocateBlock(std::size_t size, std::size_t alignment)
+{
+    // operator new[] hands out storage aligned for any fundamental type.
+    assert(alignment <= alignof(std::max_align_t));
+    std::size_t blockSize = capacity == 0 ? FIRST_BLOCK : std::min(capacity * 2, LAST_BLOCK);
+    blockSize = std::max(blockSize, size);
+    blocks.emplace_back(new std::byte[blockSize]);
+    current = blocks.back().get();
+    capacity = blockSize;
+    reserved += blockSize;
+    used = size;
+    (void)alignment;
+    return current;
+}
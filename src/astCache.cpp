@@ -0,0 +1,294 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include <unistd.h>
+
+#include "astCache.hpp"
+#include "parallelLexer.hpp"
+#include "parallelParser.hpp"
+#include "parser.hpp"
+
+namespace
+{
+// Bumped whenever the manifest layout changes; images carry their own version.
+constexpr std::uint32_t MANIFEST_VERSION = 2;
+constexpr char MANIFEST_MAGIC[8] = {'B', 'I', 'B', 'L', 'P', 'R', 'O', 'G'};
+
+// A manifest is this header, one entry per piece and the images of the pieces, each starting
+// at a multiple of 8 bytes.
+struct ManifestHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t pieceCount;
+    std::uint64_t scriptBytes;
+};
+
+struct ManifestEntry
+{
+    std::uint64_t imageAt;
+    std::uint64_t imageBytes;
+    // Hash of the image bytes, checked before any of them is read as an image.
+    std::uint64_t imageKey;
+    // Hash and length of the source bytes the piece was parsed from.
+    std::uint64_t spanKey;
+    std::uint32_t spanBytes;
+    SourceOffset base;
+};
+
+struct Manifest
+{
+    std::shared_ptr<const SourceBuffer> file;
+    std::uint64_t scriptBytes;
+    std::vector<ManifestEntry> entries;
+};
+
+std::shared_ptr<const SourceBuffer> mapFile(const std::string& path)
+{
+    try
+    {
+        return std::make_shared<const SourceBuffer>(SourceBuffer::fromFile(path));
+    }
+    catch (const std::runtime_error&)
+    {
+        return nullptr;
+    }
+}
+
+std::optional<Manifest> readManifest(const std::string& path)
+{
+    std::shared_ptr<const SourceBuffer> file = mapFile(path);
+    if (!file || file->size() < sizeof(ManifestHeader)) return {};
+    ManifestHeader header;
+    std::memcpy(&header, file->begin(), sizeof(header));
+    std::size_t entryBytes = std::size_t(header.pieceCount) * sizeof(ManifestEntry);
+    if (std::memcmp(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0 ||
+        header.version != MANIFEST_VERSION || file->size() < sizeof(header) + entryBytes)
+        return {};
+    Manifest manifest{file, header.scriptBytes, std::vector<ManifestEntry>(header.pieceCount)};
+    std::memcpy(manifest.entries.data(), file->begin() + sizeof(header), entryBytes);
+    return manifest;
+}
+
+// The image an entry points to, or nothing when the file does not hold all of its bytes or
+// they changed since they were written: a damaged file is a miss like any other.
+std::optional<FlatAst> openImage(const Manifest& manifest, const ManifestEntry& entry,
+                                 SourceOffset base)
+{
+    std::size_t size = manifest.file->size();
+    if (entry.imageAt > size || entry.imageBytes > size - entry.imageAt ||
+        contentHash(manifest.file->view().substr(entry.imageAt, entry.imageBytes)) !=
+            entry.imageKey)
+        return {};
+    return FlatAst::fromImage(manifest.file, entry.imageAt, entry.imageBytes, base);
+}
+
+template <typename T>
+void appendBytes(std::string& out, const T& value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+std::uint64_t rotateLeft(std::uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+}  // namespace
+
+std::uint64_t contentHash(std::string_view bytes)
+{
+    constexpr std::uint64_t K1 = 0x9E3779B97F4A7C15ull;
+    constexpr std::uint64_t K2 = 0xC2B2AE3D27D4EB4Full;
+    std::uint64_t hash = K2 ^ (bytes.size() * K1);
+    const char* p = bytes.data();
+    const char* end = p + bytes.size();
+    for (; end - p >= 8; p += 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        hash = (rotateLeft(hash, 27) ^ (word * K2)) * K1;
+    }
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, p, static_cast<std::size_t>(end - p));
+    hash = (rotateLeft(hash, 27) ^ (tail * K2)) * K1;
+
+    // Final avalanche, so that every input bit reaches every bit of the file name.
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    return hash ^ (hash >> 33);
+}
+
+AstCache::AstCache(std::string directory) : directory(std::move(directory))
+{
+    std::error_code ignored;
+    std::filesystem::create_directories(this->directory, ignored);
+}
+
+CachedProgram AstCache::load(const SourceBuffer& source, std::string_view name)
+{
+    std::uint64_t key = contentHash(source.view());
+    if (std::optional<CachedProgram> program = loadManifest(key, source))
+        return std::move(*program);
+    std::string latest = name.empty() ? std::string() : path(contentHash(name), ".latest");
+    return parseDeclarations(source, key, latest);
+}
+
+std::optional<CachedProgram> AstCache::loadManifest(std::uint64_t key,
+                                                    const SourceBuffer& source) const
+{
+    std::optional<Manifest> manifest = readManifest(path(key, ".program"));
+    if (!manifest || manifest->scriptBytes != source.size()) return {};
+
+    CachedProgram program;
+    program.lines = std::make_shared<const LineIndex>(LineIndex::scan(source.view()));
+    for (const ManifestEntry& entry : manifest->entries)
+    {
+        std::optional<FlatAst> piece = openImage(*manifest, entry, entry.base);
+        if (!piece) return {};
+        piece->lines = program.lines;
+        program.reused += piece->declarations().size();
+        program.pieces.push_back(std::move(*piece));
+    }
+    return program;
+}
+
+CachedProgram AstCache::parseDeclarations(const SourceBuffer& source, std::uint64_t key,
+                                          const std::string& latest) const
+{
+    // Declarations left unchanged since the last version of the script can be taken from its
+    // manifest, which the .latest file names.
+    std::optional<Manifest> previous;
+    std::uint64_t previousKey;
+    if (!latest.empty() && std::ifstream(latest, std::ios::binary)
+                               .read(reinterpret_cast<char*>(&previousKey), sizeof(previousKey)))
+        previous = readManifest(path(previousKey, ".program"));
+    std::unordered_map<std::uint64_t, const ManifestEntry*> unchanged;
+    if (previous)
+    {
+        for (const ManifestEntry& entry : previous->entries) unchanged[entry.spanKey] = &entry;
+    }
+
+    TokenBuffer tokens = tokenizeParallel(source);
+    std::vector<std::size_t> starts = topLevelDeclarationStarts(tokens);
+    auto offsetOf = [&](std::size_t index)
+    { return index < tokens.size() ? tokens.offset(index) : SourceOffset(source.size()); };
+
+    CachedProgram program;
+    program.lines = tokens.lineIndex();
+    // Entries and image bytes of the new manifest. Images are views into the previous
+    // manifest or into the ones made here.
+    std::vector<ManifestEntry> entries;
+    std::vector<std::string_view> images;
+    std::vector<std::string> made;
+    made.reserve(starts.size());
+    for (std::size_t i = 0; i < starts.size(); ++i)
+    {
+        // A declaration's text runs up to the next one, so comments and blanks after it count
+        // as its own; only bytes before the first token are left out, and they hold no tokens.
+        std::size_t first = starts[i];
+        std::size_t last = i + 1 < starts.size() ? starts[i + 1] : tokens.size();
+        SourceOffset begin = offsetOf(first);
+        std::string_view span(source.begin() + begin, offsetOf(last) - begin);
+        ManifestEntry entry = {0, 0, 0, contentHash(span),
+                               static_cast<std::uint32_t>(span.size()), begin};
+
+        auto found = unchanged.find(entry.spanKey);
+        if (found != unchanged.end() && found->second->spanBytes == entry.spanBytes)
+        {
+            const ManifestEntry& old = *found->second;
+            std::optional<FlatAst> piece = openImage(*previous, old, begin);
+            if (piece)
+            {
+                piece->lines = program.lines;
+                program.reused += piece->declarations().size();
+                program.pieces.push_back(std::move(*piece));
+                entries.push_back(entry);
+                images.push_back(previous->file->view().substr(old.imageAt, old.imageBytes));
+                continue;
+            }
+        }
+
+        ParseResult result = Parser(tokens, first, last).tryParseProgram();
+        bool complete = !result.error;
+        if (!complete)
+        {
+            // As in parseParallel: the declaration may only have failed because it was cut
+            // off, so the rest of the script is parsed the way the sequential parser would.
+            result = Parser(tokens, first).tryParseProgram();
+            if (result.error) return {{}, std::move(result.error), program.lines, 0, 0};
+            // The piece now covers the rest of the script, so no later edit matches it.
+            entry.spanBytes = static_cast<std::uint32_t>(source.size() - begin);
+        }
+        FlatAst piece = FlatAst::build(*result.program, begin);
+        piece.lines = program.lines;
+        program.parsed += piece.declarations().size();
+        made.push_back(piece.image());
+        entries.push_back(entry);
+        images.push_back(made.back());
+        program.pieces.push_back(std::move(piece));
+        if (!complete) break;
+    }
+
+    ManifestHeader header = {};
+    std::memcpy(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+    header.version = MANIFEST_VERSION;
+    header.pieceCount = static_cast<std::uint32_t>(entries.size());
+    header.scriptBytes = source.size();
+    std::string manifest;
+    appendBytes(manifest, header);
+    std::size_t imageAt = sizeof(header) + entries.size() * sizeof(ManifestEntry);
+    for (std::size_t i = 0; i < entries.size(); ++i)
+    {
+        imageAt = (imageAt + 7) & ~std::size_t(7);
+        entries[i].imageAt = imageAt;
+        entries[i].imageBytes = images[i].size();
+        entries[i].imageKey = contentHash(images[i]);
+        appendBytes(manifest, entries[i]);
+        imageAt += images[i].size();
+    }
+    for (std::string_view image : images)
+    {
+        manifest.resize((manifest.size() + 7) & ~std::size_t(7), '\0');
+        manifest += image;
+    }
+    store(path(key, ".program"), manifest);
+    if (!latest.empty())
+    {
+        std::string pointer;
+        appendBytes(pointer, key);
+        store(latest, pointer);
+    }
+    return program;
+}
+
+void AstCache::store(const std::string& name, const std::string& bytes) const
+{
+    // Written under a temporary name and renamed, so no reader ever maps half a file. The
+    // cache is only an accelerator: a file that cannot be written is simply not cached.
+    std::string temporary = name + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!out)
+        {
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary.c_str(), name.c_str()) != 0) std::remove(temporary.c_str());
+}
+
+std::string AstCache::path(std::uint64_t key, const char* extension) const
+{
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return directory + "/" + name + extension;
+}
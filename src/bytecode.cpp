@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <string>
+
+#include "bytecode.hpp"
+
+FunctionObject* unfoldCall(std::vector<Value>& stack, std::size_t& top, std::size_t& callee,
+                           std::size_t& count, int& pending, OutputSink& out, SourceOffset at)
+{
+    for (;;)
+    {
+        const Value& function = stack[callee];
+        if (!function.is(Value::Type::Function))
+            runtimeError(MessageId::NotCallable, at, std::string(function.typeName()));
+        FunctionObject& object = *function.asFunction();
+
+        switch (object.kind)
+        {
+            case FunctionObject::Kind::Script:
+                return &object;
+            case FunctionObject::Kind::Print:
+                for (std::size_t i = 1; i <= count; ++i)
+                {
+                    if (i != 1) out.write(' ');
+                    printValue(out, stack[callee + i]);
+                    stack[callee + i] = Value();
+                }
+                out.write('\n');
+                stack[callee] = Value();
+                top = callee + 1;
+                if (pending == 0) return nullptr;
+                // Nothing is handed on to the next function of the composition.
+                --pending;
+                --callee;
+                count = 1;
+                break;
+            case FunctionObject::Kind::Composed:
+            case FunctionObject::Kind::Decorated:
+            {
+                bool composed = object.kind == FunctionObject::Kind::Composed;
+                Value first = object.first;
+                Value second = object.second;
+                if (top + 1 > stack.size()) stack.resize(std::max(stack.size() * 2, top + 1));
+                std::move_backward(stack.begin() + static_cast<std::ptrdiff_t>(callee) + 1,
+                                   stack.begin() + static_cast<std::ptrdiff_t>(top),
+                                   stack.begin() + static_cast<std::ptrdiff_t>(top) + 1);
+                ++top;
+                stack[callee] = std::move(second);
+                stack[callee + 1] = std::move(first);
+                if (composed)
+                {
+                    ++callee;
+                    ++pending;
+                }
+                else
+                {
+                    ++count;
+                }
+                break;
+            }
+        }
+    }
+}
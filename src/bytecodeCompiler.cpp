@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <limits>
+#include <variant>
+
+#include "bytecode.hpp"
+#include "staticVisitor.hpp"
+
+namespace
+{
+class Compiler : public StaticVisitor<Compiler>
+{
+   public:
+    explicit Compiler(CompiledProgram& program) : program(program) {}
+
+    void compile(ProgramNode& node)
+    {
+        program.lines = node.lines;
+        Function script;
+        script.proto = addFunction(&node);
+        current = &script;
+        dispatch(node);
+        emit(OpCode::Nothing, 0, 0, node.getStartOffset(), 1);
+        emit(OpCode::Return, 0, 0, node.getStartOffset(), -1);
+    }
+
+   private:
+    friend class StaticVisitor<Compiler>;
+
+    struct Local
+    {
+        SymbolId id;
+        bool constant;
+        std::uint16_t slot;
+        int scope;
+    };
+    struct Function
+    {
+        FunctionProto* proto = nullptr;
+        std::vector<Local> locals;
+        int scope = 0;
+        int nextSlot = 0;
+        int temporaries = 0;
+    };
+
+    CompiledProgram& program;
+    Function* current = nullptr;
+    int nesting = 0;
+
+    bool atTopLevel() const { return current->proto == program.functions.front().get(); }
+
+    FunctionProto* addFunction(const AstNode* node)
+    {
+        program.functions.push_back(std::make_unique<FunctionProto>());
+        program.functions.back()->node = node;
+        return program.functions.back().get();
+    }
+
+    std::size_t emit(OpCode op, std::uint16_t a, std::int32_t b, SourceOffset at, int pushed)
+    {
+        FunctionProto& proto = *current->proto;
+        proto.code.push_back(Instruction{op, a, b});
+        proto.offsets.push_back(at);
+        current->temporaries += pushed;
+        proto.stackSize =
+            std::max(proto.stackSize, static_cast<std::uint32_t>(current->temporaries));
+        return proto.code.size() - 1;
+    }
+
+    // Points the jump at `from` to the next instruction.
+    void patch(std::size_t from)
+    {
+        FunctionProto& proto = *current->proto;
+        proto.code[from].b = static_cast<std::int32_t>(proto.code.size() - from - 1);
+    }
+
+    void enter(SourceOffset at)
+    {
+        if (++nesting > MAX_NESTING) runtimeError(MessageId::NestingTooDeep, at);
+    }
+
+    const Local* resolve(SymbolId id) const
+    {
+        for (auto local = current->locals.rbegin(); local != current->locals.rend(); ++local)
+        {
+            if (local->id == id) return &*local;
+        }
+        return nullptr;
+    }
+
+    std::uint16_t addLocal(SymbolId id, bool constant, SourceOffset at)
+    {
+        if (current->nextSlot > std::numeric_limits<std::uint16_t>::max())
+            runtimeError(MessageId::TooManyVariables, at);
+        auto slot = static_cast<std::uint16_t>(current->nextSlot++);
+        current->locals.push_back(Local{id, constant, slot, current->scope});
+        current->proto->slotCount =
+            static_cast<std::uint16_t>(std::max<int>(current->proto->slotCount, current->nextSlot));
+        return slot;
+    }
+
+    void expression(ExpressionNode& node)
+    {
+        enter(node.getStartOffset());
+        dispatch(node);
+        --nesting;
+    }
+
+    // An absent initializer or return value is nothing.
+    void expression(ExpressionNode* node, SourceOffset at)
+    {
+        if (!node)
+        {
+            emit(OpCode::Nothing, 0, 0, at, 1);
+            return;
+        }
+        expression(*node);
+    }
+
+    std::int32_t addConstant(Value value)
+    {
+        current->proto->constants.push_back(std::move(value));
+        return static_cast<std::int32_t>(current->proto->constants.size() - 1);
+    }
+
+    std::int32_t compileFunction(const AstNode& node, NodeList<FuncDefArgument> parameters,
+                                 StatementBlockNode* body, std::vector<CaptureSlot> captures)
+    {
+        auto index = static_cast<std::int32_t>(program.functions.size());
+        Function function;
+        function.proto = addFunction(&node);
+        function.proto->parameterCount = static_cast<std::uint16_t>(parameters.size());
+        function.proto->captures = std::move(captures);
+
+        Function* enclosing = current;
+        current = &function;
+        for (FuncDefArgument* parameter : parameters)
+            addLocal(parameter->id, !parameter->modifier, node.getStartOffset());
+        for (const CaptureSlot& capture : function.proto->captures)
+            addLocal(capture.id, capture.constant, node.getStartOffset());
+        if (body) dispatch(*body);
+        emit(OpCode::Nothing, 0, 0, node.getStartOffset(), 1);
+        emit(OpCode::Return, 0, 0, node.getStartOffset(), -1);
+        current = enclosing;
+        return index;
+    }
+
+    void visit(NumberLiteralNode& node)
+    {
+        auto value = node.getValue();
+        if (auto* integer = std::get_if<int>(&value))
+            emit(OpCode::Integer, 0, *integer, node.getStartOffset(), 1);
+        else
+            emit(OpCode::Constant, 0, addConstant(Value::real(std::get<float>(value))),
+                 node.getStartOffset(), 1);
+    }
+
+    void visit(StringLiteralNode& node)
+    {
+        std::string_view text = node.getValue();
+        if (text.size() > Value::MAX_STRING_LENGTH)
+        {
+            emit(OpCode::Raise, static_cast<std::uint16_t>(MessageId::StringTooLong), NO_NAME,
+                 node.getStartOffset(), 1);
+            return;
+        }
+        emit(OpCode::Constant, 0, addConstant(Value::string(text)), node.getStartOffset(), 1);
+    }
+
+    void visit(IdentifierNode& node)
+    {
+        auto name = static_cast<std::int32_t>(node.getSymbol());
+        if (const Local* local = resolve(node.getSymbol()))
+            emit(OpCode::LoadLocal, local->slot, name, node.getStartOffset(), 1);
+        else
+            emit(OpCode::LoadGlobal, 0, name, node.getStartOffset(), 1);
+    }
+
+    void visit(BinaryOpNode& node)
+    {
+        BinOperator op = node.getBinOp();
+        expression(node.left, node.getStartOffset());
+        if (op == BinOperator::And || op == BinOperator::Or)
+        {
+            std::size_t skip = emit(op == BinOperator::And ? OpCode::JumpIfFalseKeep
+                                                           : OpCode::JumpIfTrueKeep,
+                                    0, 0, node.getStartOffset(), -1);
+            SourceOffset rightAt =
+                node.right ? node.right->getStartOffset() : node.getStartOffset();
+            expression(node.right, rightAt);
+            emit(OpCode::CheckBool, 0, 0, rightAt, 0);
+            patch(skip);
+            return;
+        }
+        expression(node.right, node.getStartOffset());
+        auto code = static_cast<OpCode>(static_cast<int>(OpCode::Add) + static_cast<int>(op));
+        emit(code, 0, 0, node.getStartOffset(), -1);
+    }
+
+    void visit(TypeCastNode& node)
+    {
+        expression(node.expression, node.getStartOffset());
+        emit(OpCode::Cast, static_cast<std::uint16_t>(node.getTargetType()), 0,
+             node.getStartOffset(), 0);
+    }
+
+    void visit(FunctionCallNode& node)
+    {
+        expression(node.callee, node.getStartOffset());
+        for (ExpressionNode* argument : node.arguments) expression(*argument);
+        auto count = static_cast<int>(node.arguments.size());
+        if (count > std::numeric_limits<std::uint16_t>::max())
+            runtimeError(MessageId::TooManyVariables, node.getStartOffset());
+        emit(OpCode::Call, static_cast<std::uint16_t>(count), 0, node.getStartOffset(), -count);
+    }
+
+    void visit(ExpressionStatementNode& node)
+    {
+        expression(node.expression, 0);
+        emit(OpCode::Pop, 0, 0, node.getStartOffset(), -1);
+    }
+
+    void visit(StatementBlockNode& node)
+    {
+        enter(node.getStartOffset());
+        ++current->scope;
+        int firstSlot = current->nextSlot;
+        for (StatementNode* statement : node.statements)
+        {
+            if (statement) dispatch(*statement);
+        }
+        while (!current->locals.empty() && current->locals.back().scope == current->scope)
+            current->locals.pop_back();
+        current->nextSlot = firstSlot;
+        --current->scope;
+        --nesting;
+    }
+
+    void visit(FunctionDeclarationNode& node)
+    {
+        std::int32_t function = compileFunction(node, node.params, node.body, {});
+        emit(OpCode::Closure, 0, function, node.getStartOffset(), 1);
+        emit(OpCode::DefineGlobal, 1, static_cast<std::int32_t>(node.getSymbol()),
+             node.getStartOffset(), -1);
+    }
+
+    void visit(FunctionLiteralNode& node)
+    {
+        std::vector<CaptureSlot> captures;
+        // Literals at the top level see the globals like declared functions do.
+        if (!atTopLevel() && node.body)
+        {
+            for (SymbolId id : namesUsedIn(*node.body))
+            {
+                bool parameter = std::any_of(node.parameters.begin(), node.parameters.end(),
+                                             [id](FuncDefArgument* p) { return p->id == id; });
+                const Local* local = resolve(id);
+                if (!parameter && local)
+                    captures.push_back(CaptureSlot{id, local->constant, local->slot});
+            }
+        }
+        std::int32_t function =
+            compileFunction(node, node.parameters, node.body, std::move(captures));
+        emit(OpCode::Closure, 0, function, node.getStartOffset(), 1);
+    }
+
+    void visit(IfStatementNode& node)
+    {
+        SourceOffset conditionAt =
+            node.condition ? node.condition->getStartOffset() : node.getStartOffset();
+        expression(node.condition, conditionAt);
+        std::size_t skipThen = emit(OpCode::JumpIfFalse, 0, 0, conditionAt, -1);
+        if (node.thenBlock) dispatch(*node.thenBlock);
+        if (!node.elseBlock)
+        {
+            patch(skipThen);
+            return;
+        }
+        std::size_t skipElse = emit(OpCode::Jump, 0, 0, node.getStartOffset(), 0);
+        patch(skipThen);
+        dispatch(*node.elseBlock);
+        patch(skipElse);
+    }
+
+    void visit(DeclarationNode& node)
+    {
+        SymbolId id = node.getIdentifier();
+        bool constant = !node.getModifier();
+        expression(node.initializer, node.getStartOffset());
+        if (atTopLevel())
+        {
+            emit(OpCode::DefineGlobal, constant, static_cast<std::int32_t>(id),
+                 node.getStartOffset(), -1);
+            return;
+        }
+        const Local* previous = resolve(id);
+        if (previous && previous->scope == current->scope)
+        {
+            emit(OpCode::Raise, static_cast<std::uint16_t>(MessageId::AlreadyDeclared),
+                 static_cast<std::int32_t>(id), node.getStartOffset(), 0);
+        }
+        std::uint16_t slot = addLocal(id, constant, node.getStartOffset());
+        emit(OpCode::StoreLocal, slot, 0, node.getStartOffset(), -1);
+    }
+
+    void visit(ReturnStatementNode& node)
+    {
+        expression(node.returnValue, node.getStartOffset());
+        emit(OpCode::Return, 0, 0, node.getStartOffset(), -1);
+    }
+
+    void visit(AssignNode& node)
+    {
+        SymbolId id = node.getIdentifier();
+        auto name = static_cast<std::int32_t>(id);
+        expression(node.expression, node.getStartOffset());
+        const Local* local = resolve(id);
+        if (!local)
+        {
+            emit(OpCode::StoreGlobal, 0, name, node.getStartOffset(), -1);
+            return;
+        }
+        if (local->constant)
+        {
+            emit(OpCode::Raise, static_cast<std::uint16_t>(MessageId::AssignToConstant), name,
+                 node.getStartOffset(), 0);
+        }
+        emit(OpCode::StoreLocal, local->slot, 0, node.getStartOffset(), -1);
+    }
+
+    void visit(WhileStatementNode& node)
+    {
+        SourceOffset conditionAt =
+            node.condition ? node.condition->getStartOffset() : node.getStartOffset();
+        std::size_t start = current->proto->code.size();
+        expression(node.condition, conditionAt);
+        std::size_t exit = emit(OpCode::JumpIfFalse, 0, 0, conditionAt, -1);
+        if (node.body) dispatch(*node.body);
+        std::size_t back = emit(OpCode::Jump, 0, 0, node.getStartOffset(), 0);
+        current->proto->code[back].b = static_cast<std::int32_t>(start) -
+                                       static_cast<std::int32_t>(back) - 1;
+        patch(exit);
+    }
+
+    void visit(ProgramNode& node)
+    {
+        // Functions first, so that initializers can call any of them.
+        for (AstNode* declaration : node.declarations)
+        {
+            if (declaration && declaration->getKind() == NodeKind::FunctionDeclaration)
+                dispatch(*declaration);
+        }
+        for (AstNode* declaration : node.declarations)
+        {
+            if (declaration && declaration->getKind() != NodeKind::FunctionDeclaration)
+                dispatch(*declaration);
+        }
+    }
+};
+
+}  // namespace
+
+CompiledProgram compileBytecode(ProgramNode& program)
+{
+    CompiledProgram compiled;
+    try
+    {
+        Compiler(compiled).compile(program);
+    }
+    catch (InterpreterException& e)
+    {
+        if (!e.error.lines) e.error.lines = program.lines;
+        throw;
+    }
+    return compiled;
+}
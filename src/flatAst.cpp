@@ -0,0 +1,491 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "flatAst.hpp"
+#include "flatAstVisitor.hpp"
+#include "traversal.hpp"
+
+// Lowers the pointer tree in pre-order: a node's slot is taken when it is visited, and filled
+// in by a Fill that follows its children, once their indices are on top of `results`.
+class FlatAstBuilder : public AstVisitor
+{
+   public:
+    FlatAstBuilder(FlatAst& ast, SourceOffset base) : ast(ast), base(base) {}
+
+    NodeIndex lower(AstNode* root)
+    {
+        visitChild(root);
+        traversal.run([this](AstNode* node) { node->accept(*this); },
+                      [this](const Fill& fill) { finish(fill); });
+        NodeIndex index = results.back();
+        results.pop_back();
+        return index;
+    }
+
+    void visit(NumberLiteralNode& node) override
+    {
+        NodeIndex index = add(FlatKind::Number, node.getStartOffset());
+        std::variant<int, float> value = node.getValue();
+        if (auto* real = std::get_if<float>(&value))
+        {
+            ast.ownedNodes[index].tag = 1;
+            std::memcpy(&ast.ownedNodes[index].first, real, sizeof(float));
+        }
+        else
+        {
+            ast.ownedNodes[index].first = static_cast<std::uint32_t>(std::get<int>(value));
+        }
+        results.push_back(index);
+    }
+
+    void visit(StringLiteralNode& node) override
+    {
+        NodeIndex index = add(FlatKind::String, node.getStartOffset());
+        std::string_view value = node.getValue();
+        ast.ownedNodes[index].first = static_cast<std::uint32_t>(ast.ownedText.size());
+        ast.ownedNodes[index].second = static_cast<std::uint32_t>(value.size());
+        ast.ownedText.insert(ast.ownedText.end(), value.begin(), value.end());
+        results.push_back(index);
+    }
+
+    void visit(IdentifierNode& node) override
+    {
+        NodeIndex index = add(FlatKind::Identifier, node.getStartOffset());
+        ast.ownedNodes[index].third = local(node.getSymbol());
+        results.push_back(index);
+    }
+
+    void visit(BinaryOpNode& node) override
+    {
+        NodeIndex index = add(FlatKind::BinaryOp, node.getStartOffset());
+        ast.ownedNodes[index].tag = static_cast<std::uint8_t>(node.getBinOp());
+        visitChild(node.left);
+        visitChild(node.right);
+        fill({index});
+    }
+
+    void visit(TypeCastNode& node) override
+    {
+        NodeIndex index = add(FlatKind::TypeCast, node.getStartOffset());
+        ast.ownedNodes[index].tag = static_cast<std::uint8_t>(node.getTargetType());
+        visitChild(node.expression);
+        fill({index});
+    }
+
+    void visit(FunctionCallNode& node) override
+    {
+        NodeIndex index = add(FlatKind::FunctionCall, node.getStartOffset());
+        visitChild(node.callee);
+        visitChildren(node.arguments);
+        fill({index, node.arguments.size()});
+    }
+
+    void visit(ExpressionStatementNode& node) override
+    {
+        NodeIndex index = add(FlatKind::ExpressionStatement, node.getStartOffset());
+        visitChild(node.expression);
+        fill({index});
+    }
+
+    void visit(StatementBlockNode& node) override
+    {
+        NodeIndex index = add(FlatKind::StatementBlock, node.getStartOffset());
+        visitChildren(node.statements);
+        fill({index, node.statements.size()});
+    }
+
+    void visit(FunctionDeclarationNode& node) override
+    {
+        NodeIndex index = add(FlatKind::FunctionDeclaration, node.getStartOffset());
+        ast.ownedNodes[index].first = lowerParameters(node.params, node.getStartOffset());
+        visitChild(node.body);
+        // Numbered after the body, as the symbols inside it are.
+        fill({index, 0, node.getSymbol()});
+    }
+
+    void visit(FunctionLiteralNode& node) override
+    {
+        NodeIndex index = add(FlatKind::FunctionLiteral, node.getStartOffset());
+        ast.ownedNodes[index].first = lowerParameters(node.parameters, node.getStartOffset());
+        visitChild(node.body);
+        fill({index});
+    }
+
+    void visit(IfStatementNode& node) override
+    {
+        NodeIndex index = add(FlatKind::If, node.getStartOffset());
+        visitChild(node.condition);
+        visitChild(node.thenBlock);
+        visitChild(node.elseBlock);
+        fill({index});
+    }
+
+    void visit(DeclarationNode& node) override
+    {
+        NodeIndex index = add(FlatKind::Declaration, node.getStartOffset());
+        ast.ownedNodes[index].tag = node.getModifier();
+        ast.ownedNodes[index].third = local(node.getIdentifier());
+        visitChild(node.initializer);
+        fill({index});
+    }
+
+    void visit(ReturnStatementNode& node) override
+    {
+        NodeIndex index = add(FlatKind::Return, node.getStartOffset());
+        visitChild(node.returnValue);
+        fill({index});
+    }
+
+    void visit(AssignNode& node) override
+    {
+        NodeIndex index = add(FlatKind::Assign, node.getStartOffset());
+        ast.ownedNodes[index].third = local(node.getIdentifier());
+        visitChild(node.expression);
+        fill({index});
+    }
+
+    void visit(WhileStatementNode& node) override
+    {
+        NodeIndex index = add(FlatKind::While, node.getStartOffset());
+        visitChild(node.condition);
+        visitChild(node.body);
+        fill({index});
+    }
+
+    void visit(ProgramNode& node) override
+    {
+        NodeIndex index = add(FlatKind::Program, node.getStartOffset());
+        visitChildren(node.declarations);
+        fill({index, node.declarations.size()});
+    }
+
+   private:
+    // Completes the node at `index` from the children lowered since it was visited; a node with
+    // a list has its `listSize` entries on top, above any other children.
+    struct Fill
+    {
+        NodeIndex index = NO_NODE;
+        std::size_t listSize = 0;
+        SymbolId symbol{};
+    };
+
+    FlatAst& ast;
+    SourceOffset base;
+    Traversal<AstNode*, Fill> traversal;
+    // Indices of the children lowered but not yet filled into their parent, last one on top.
+    std::vector<NodeIndex> results;
+    std::unordered_map<SymbolId, std::uint32_t> locals;
+
+    NodeIndex add(FlatKind kind, SourceOffset offset)
+    {
+        // An empty program sits at offset 0, which can come before the base.
+        ast.ownedNodes.push_back(
+            {kind, 0, 0, offset - std::min(offset, base), NO_NODE, NO_NODE, NO_NODE});
+        return static_cast<NodeIndex>(ast.ownedNodes.size() - 1);
+    }
+
+    std::uint32_t local(SymbolId symbol)
+    {
+        auto [entry, added] = locals.try_emplace(symbol, ast.symbols.size());
+        if (added) ast.symbols.push_back(symbol);
+        return entry->second;
+    }
+
+    // An absent child still takes its place among the results, as a Fill of NO_NODE.
+    void visitChild(AstNode* node)
+    {
+        if (node)
+            traversal.visit(node, [this](AstNode* child) { child->accept(*this); });
+        else
+            fill({});
+    }
+
+    void fill(const Fill& step)
+    {
+        if (traversal.hasQueued())
+            traversal.doLater(step);
+        else
+            finish(step);
+    }
+
+    template <typename T>
+    void visitChildren(const NodeList<T>& items)
+    {
+        for (T* item : items) visitChild(item);
+    }
+
+    NodeIndex pop()
+    {
+        NodeIndex index = results.back();
+        results.pop_back();
+        return index;
+    }
+
+    void finish(const Fill& fill)
+    {
+        if (fill.index == NO_NODE)
+        {
+            results.push_back(NO_NODE);
+            return;
+        }
+        FlatAst::Node& node = ast.ownedNodes[fill.index];
+        switch (node.kind)
+        {
+            case FlatKind::BinaryOp:
+            case FlatKind::While:
+                node.second = pop();
+                node.first = pop();
+                break;
+            case FlatKind::If:
+                node.third = pop();
+                node.second = pop();
+                node.first = pop();
+                break;
+            case FlatKind::FunctionCall:
+                node.second = appendList(results.size() - fill.listSize);
+                node.first = pop();
+                break;
+            case FlatKind::StatementBlock:
+            case FlatKind::Program:
+                node.first = appendList(results.size() - fill.listSize);
+                break;
+            case FlatKind::FunctionDeclaration:
+                node.second = pop();
+                node.third = local(fill.symbol);
+                break;
+            case FlatKind::FunctionLiteral:
+                node.second = pop();
+                break;
+            default:
+                node.first = pop();
+                break;
+        }
+        results.push_back(fill.index);
+    }
+
+    std::uint32_t appendList(std::size_t mark)
+    {
+        auto at = static_cast<std::uint32_t>(ast.ownedLists.size());
+        ast.ownedLists.push_back(static_cast<NodeIndex>(results.size() - mark));
+        ast.ownedLists.insert(ast.ownedLists.end(), results.begin() + mark, results.end());
+        results.resize(mark);
+        return at;
+    }
+
+    std::uint32_t lowerParameters(const NodeList<FuncDefArgument>& params, SourceOffset offset)
+    {
+        std::size_t mark = results.size();
+        for (FuncDefArgument* param : params)
+        {
+            NodeIndex index = add(FlatKind::Parameter, offset);
+            ast.ownedNodes[index].tag = param->modifier;
+            ast.ownedNodes[index].third = local(param->id);
+            results.push_back(index);
+        }
+        return appendList(mark);
+    }
+};
+
+namespace
+{
+constexpr char IMAGE_MAGIC[8] = {'B', 'I', 'B', 'L', 'F', 'L', 'A', 'T'};
+// Bumped whenever Node, FlatKind or the layout below changes.
+constexpr std::uint32_t IMAGE_VERSION = 1;
+
+// An image is this header, the nodes, the lists, one length per symbol name, the names back
+// to back and the string literal text.
+struct ImageHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t nodeCount;
+    std::uint32_t listCount;
+    std::uint32_t symbolCount;
+    std::uint32_t nameBytes;
+    std::uint32_t textBytes;
+};
+
+template <typename T>
+void appendBytes(std::string& out, const T* items, std::size_t count)
+{
+    out.append(reinterpret_cast<const char*>(items), count * sizeof(T));
+}
+
+}  // namespace
+
+FlatAst FlatAst::build(ProgramNode& program, SourceOffset base)
+{
+    FlatAst ast;
+    ast.lines = program.lines;
+    ast.base = base;
+    FlatAstBuilder builder(ast, base);
+    builder.lower(&program);
+    ast.ownedNodes.shrink_to_fit();
+    ast.ownedLists.shrink_to_fit();
+    ast.nodes = ast.ownedNodes.data();
+    ast.nodeCount = ast.ownedNodes.size();
+    ast.lists = ast.ownedLists.data();
+    ast.listCount = ast.ownedLists.size();
+    ast.text = ast.ownedText.data();
+    ast.textSize = ast.ownedText.size();
+    return ast;
+}
+
+std::string FlatAst::image() const
+{
+    std::vector<std::uint32_t> nameLengths;
+    std::string names;
+    for (SymbolId symbol : symbols)
+    {
+        const std::string& name = symbolName(symbol);
+        nameLengths.push_back(static_cast<std::uint32_t>(name.size()));
+        names += name;
+    }
+    ImageHeader header = {};
+    std::memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    header.version = IMAGE_VERSION;
+    header.nodeCount = static_cast<std::uint32_t>(nodeCount);
+    header.listCount = static_cast<std::uint32_t>(listCount);
+    header.symbolCount = static_cast<std::uint32_t>(symbols.size());
+    header.nameBytes = static_cast<std::uint32_t>(names.size());
+    header.textBytes = static_cast<std::uint32_t>(textSize);
+
+    std::string out;
+    appendBytes(out, &header, 1);
+    appendBytes(out, nodes, nodeCount);
+    appendBytes(out, lists, listCount);
+    appendBytes(out, nameLengths.data(), nameLengths.size());
+    out += names;
+    out.append(text, textSize);
+    return out;
+}
+
+std::optional<FlatAst> FlatAst::fromImage(std::shared_ptr<const SourceBuffer> storage,
+                                          std::size_t at, std::size_t size, SourceOffset base)
+{
+    if (at % alignof(Node) != 0 || at > storage->size() || size > storage->size() - at ||
+        size < sizeof(ImageHeader))
+        return {};
+    const char* bytes = storage->begin() + at;
+    std::size_t available = size;
+    ImageHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ||
+        header.version != IMAGE_VERSION || header.nodeCount == 0)
+        return {};
+    std::size_t lengthsAt = sizeof(ImageHeader) + std::size_t(header.nodeCount) * sizeof(Node) +
+                            std::size_t(header.listCount) * sizeof(NodeIndex);
+    std::size_t namesAt = lengthsAt + std::size_t(header.symbolCount) * sizeof(std::uint32_t);
+    std::size_t textAt = namesAt + header.nameBytes;
+    if (textAt + header.textBytes > available) return {};
+
+    FlatAst ast;
+    ast.base = base;
+    ast.nodes = reinterpret_cast<const Node*>(bytes + sizeof(ImageHeader));
+    ast.nodeCount = header.nodeCount;
+    ast.lists = reinterpret_cast<const NodeIndex*>(ast.nodes + header.nodeCount);
+    ast.listCount = header.listCount;
+    ast.text = bytes + textAt;
+    ast.textSize = header.textBytes;
+    if (ast.kind(ast.root()) != FlatKind::Program || !ast.inBounds(header.symbolCount)) return {};
+
+    // Interning is the only per-name work; nodes keep their local symbol numbers.
+    const char* name = bytes + namesAt;
+    ast.symbols.reserve(header.symbolCount);
+    for (std::uint32_t i = 0; i < header.symbolCount; ++i)
+    {
+        std::uint32_t length;
+        std::memcpy(&length, bytes + lengthsAt + i * sizeof(length), sizeof(length));
+        if (length > static_cast<std::size_t>(ast.text - name)) return {};
+        ast.symbols.push_back(intern(std::string_view(name, length)));
+        name += length;
+    }
+    ast.storage = std::move(storage);
+    return ast;
+}
+
+bool FlatAst::inBounds(std::size_t symbolCount) const
+{
+    auto child = [&](NodeIndex parent, std::uint32_t index)
+    { return index == NO_NODE || (index > parent && index < nodeCount); };
+    auto listOf = [&](NodeIndex parent, std::uint32_t at)
+    {
+        if (at >= listCount || lists[at] > listCount - at - 1) return false;
+        FlatRange items = list(at);
+        return std::all_of(items.begin(), items.end(),
+                           [&](NodeIndex item) { return child(parent, item); });
+    };
+    for (NodeIndex index = 0; index < nodeCount; ++index)
+    {
+        const Node& node = nodes[index];
+        bool valid = true;
+        switch (node.kind)
+        {
+            case FlatKind::Number:
+                break;
+            case FlatKind::String:
+                valid = node.first <= textSize && node.second <= textSize - node.first;
+                break;
+            case FlatKind::Identifier:
+            case FlatKind::Parameter:
+                valid = node.third < symbolCount;
+                break;
+            case FlatKind::BinaryOp:
+                valid = node.tag < static_cast<std::uint8_t>(BinOperator::Unknown) &&
+                        child(index, node.first) && child(index, node.second);
+                break;
+            case FlatKind::TypeCast:
+                valid = node.tag <= static_cast<std::uint8_t>(CastType::Int) &&
+                        child(index, node.first);
+                break;
+            case FlatKind::FunctionCall:
+                valid = child(index, node.first) && listOf(index, node.second);
+                break;
+            case FlatKind::ExpressionStatement:
+            case FlatKind::Return:
+                valid = child(index, node.first);
+                break;
+            case FlatKind::StatementBlock:
+            case FlatKind::Program:
+                valid = listOf(index, node.first);
+                break;
+            case FlatKind::FunctionDeclaration:
+                valid = node.third < symbolCount && listOf(index, node.first) &&
+                        child(index, node.second);
+                break;
+            case FlatKind::FunctionLiteral:
+                valid = listOf(index, node.first) && child(index, node.second);
+                break;
+            case FlatKind::If:
+                valid = child(index, node.first) && child(index, node.second) &&
+                        child(index, node.third);
+                break;
+            case FlatKind::Declaration:
+            case FlatKind::Assign:
+                valid = node.third < symbolCount && child(index, node.first);
+                break;
+            case FlatKind::While:
+                valid = child(index, node.first) && child(index, node.second);
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if (!valid) return false;
+    }
+    return true;
+}
+
+std::size_t FlatAst::memoryUsage() const
+{
+    return nodeCount * sizeof(Node) + listCount * sizeof(NodeIndex) + textSize +
+           symbols.capacity() * sizeof(SymbolId);
+}
+std::variant<int, float> FlatAst::number(NodeIndex node) const
+{
+    if (nodes[node].tag == 0) return static_cast<int>(nodes[node].first);
+    float value;
+    std::memcpy(&value, &nodes[node].first, sizeof(float));
+    return value;
+}
@@ -1,66 +1,252 @@
-#include <cctype>
-#include <unordered_map>
-#include <cmath>
-#include <optional>
+#include <array>
+#include <charconv>
+#include <string_view>
 
 #include "lexer.hpp"
+#include "scanKernels.hpp"
 
 namespace
 {
-const std::unordered_map<std::string, TokenType> keywords = {
+struct Keyword
+{
+    std::string_view text;
+    TokenType type;
+};
+
+constexpr Keyword KEYWORDS[] = {
     {"int", TokenType::Type},      {"float", TokenType::Type},  {"string", TokenType::Type},
     {"var", TokenType::Var},       {"const", TokenType::Const}, {"fun", TokenType::Fun},
     {"return", TokenType::Return}, {"if", TokenType::If},       {"else", TokenType::Else},
     {"while", TokenType::While},   {"as", TokenType::As}};
 
+// Perfect hash over the keyword set: length plus first and last byte pick a unique slot.
+constexpr std::size_t KEYWORD_SLOTS = 16;
+
+constexpr std::size_t keywordSlot(std::string_view text)
+{
+    return (text.size() + 5 * static_cast<unsigned char>(text.front()) +
+            static_cast<unsigned char>(text.back())) &
+           (KEYWORD_SLOTS - 1);
+}
+
+constexpr std::array<Keyword, KEYWORD_SLOTS> KEYWORD_TABLE = []
+{
+    std::array<Keyword, KEYWORD_SLOTS> table{};
+    for (const Keyword& keyword : KEYWORDS) table[keywordSlot(keyword.text)] = keyword;
+    return table;
+}();
+
+constexpr bool keywordTableIsPerfect()
+{
+    for (const Keyword& keyword : KEYWORDS)
+        if (KEYWORD_TABLE[keywordSlot(keyword.text)].text != keyword.text) return false;
+    return true;
+}
+static_assert(keywordTableIsPerfect(), "keyword hash has collisions");
+
+const Keyword* findKeyword(std::string_view text)
+{
+    const Keyword& candidate = KEYWORD_TABLE[keywordSlot(text)];
+    return candidate.text == text ? &candidate : nullptr;
+}
+
 int digit_to_int(char digit)
 {
     return static_cast<int>((digit) - '0');
 }
 
-bool token_known(Token t)
+// Values past INT_MAX keep the digits that still fit and drop the rest.
+int parseSaturatingInt(std::string_view digits, int maxInt)
+{
+    int value = 0;
+    for (char digit : digits)
+    {
+        int currentDigit = digit_to_int(digit);
+        if ((maxInt - currentDigit) / 10 >= value)
+        {
+            value *= 10;
+            value += currentDigit;
+        }
+    }
+    return value;
+}
+
+// What the character after a backslash stands for: \n and \t name a control character, any
+// other character stands for itself.
+char escapedChar(char escape)
 {
-    return t.type != TokenType::Unknown;
+    switch (escape)
+    {
+        case 'n':
+            return '\n';
+        case 't':
+            return '\t';
+        default:
+            return escape;
+    }
 }
 
 }  // namespace
 
-Lexer::Lexer(std::istream& inputStream) : input(inputStream), currentPosition(), currentChar()
+std::size_t unescape(std::string_view raw, char* out)
+{
+    char* end = out;
+    for (std::size_t i = 0; i < raw.size(); ++i)
+    {
+        char c = raw[i];
+        if (c == '\\' && i + 1 < raw.size()) c = escapedChar(raw[++i]);
+        *end++ = c;
+    }
+    return static_cast<std::size_t>(end - out);
+}
+
+std::string unescape(std::string_view raw)
+{
+    std::string text(raw.size(), '\0');
+    text.resize(unescape(raw, text.data()));
+    return text;
+}
+
+Lexer::Lexer(std::istream& inputStream)
+    : symbols(SymbolTable::global()),
+      ownedReader(std::make_unique<SourceReader>(SourceReader::fromStream(inputStream))),
+      reader(ownedReader.get()),
+      cursor(reader->begin()),
+      limit(reader->end()),
+      lines(std::make_shared<LineIndex>()),
+      currentOffset(0),
+      nextOffset(0),
+      currentChar(),
+      endReached(false),
+      utf8CheckedTo(0)
+{
+    get();
+}
+
+Lexer::Lexer(SourceReader& reader)
+    : symbols(SymbolTable::global()),
+      reader(&reader),
+      cursor(reader.begin()),
+      limit(reader.end()),
+      lines(std::make_shared<LineIndex>()),
+      currentOffset(0),
+      nextOffset(0),
+      currentChar(),
+      endReached(false),
+      utf8CheckedTo(0)
 {
     get();
 }
 
-void Lexer::throwError(ErrorType type, const std::string& msg, Position pos) const
+Lexer::Lexer(const SourceBuffer& source, SourceOffset start)
+    : symbols(SymbolTable::global()),
+      reader(nullptr),
+      cursor(source.begin() + start),
+      limit(source.end()),
+      lines(std::make_shared<LineIndex>()),
+      currentOffset(start),
+      nextOffset(start),
+      currentChar(),
+      endReached(false),
+      utf8CheckedTo(start)
 {
-    Error err = {type, msg, pos};
-    throw InterpreterException(err);
+    get();
+}
+
+Token Lexer::fail(ErrorType type, MessageId message, SourceOffset offset)
+{
+    failure = Error{type, message, offset, lines, {}};
+    return Token(TokenType::Error, offset);
+}
+
+// Slides the unread part of the window, starting at keep, to the front of a fresh chunk.
+bool Lexer::refillWindow(const char* keep)
+{
+    if (reader == nullptr || reader->exhausted()) return false;
+    // What has been read is about to leave the window.
+    feedUtf8(limit);
+    std::ptrdiff_t cursorOffset = cursor - keep;
+    bool grew = reader->refill(keep);
+    cursor = reader->begin() + cursorOffset;
+    limit = reader->end();
+    return grew;
 }
 
 char Lexer::get()
 {
-    if (input.eof())
+    if (endReached)
     {
         currentChar = EOF;
         return currentChar;
     }
-    if (currentChar == '\n')
+    if (currentChar == '\n') lines->addLine(nextOffset);
+    currentOffset = nextOffset;
+    if (cursor != limit || refillWindow(cursor))
     {
-        currentPosition.line++;
-        currentPosition.column = 1;
+        currentChar = *cursor++;
+        nextOffset++;
     }
     else
     {
-        currentPosition.column++;
+        currentChar = EOF;
+        endReached = true;
     }
-    currentChar = input.get();
     return currentChar;
 }
 
+void Lexer::skipTo(const char* target)
+{
+    // Nothing before target is a newline; get() then steps onto target itself.
+    nextOffset = currentOffset + static_cast<SourceOffset>(target - (cursor - 1));
+    cursor = target;
+    get();
+}
+
+void Lexer::feedUtf8(const char* to)
+{
+    if (invalidUtf8 || utf8CheckedTo == UTF8_DONE) return;
+    const char* from = cursor - (static_cast<std::ptrdiff_t>(nextOffset) - utf8CheckedTo);
+    if (from >= to) return;
+    invalidUtf8 = utf8.feed(from, to, utf8CheckedTo, lines->continuationBytes());
+    utf8CheckedTo = invalidUtf8 ? *invalidUtf8 + UTF8_MARGIN
+                                : utf8CheckedTo + static_cast<SourceOffset>(to - from);
+}
+
+// False once the lexer has passed an invalid sequence.
+bool Lexer::checkUtf8()
+{
+    SourceOffset wanted = currentOffset + UTF8_MARGIN;
+    while (!invalidUtf8 && utf8CheckedTo < wanted)
+    {
+        const char* from = cursor - (static_cast<std::ptrdiff_t>(nextOffset) - utf8CheckedTo);
+        if (from == limit)
+        {
+            // The rest of a chunked input is checked as it arrives.
+            if (reader != nullptr && !reader->exhausted()) break;
+            invalidUtf8 = utf8.finish();
+            utf8CheckedTo = invalidUtf8 ? *invalidUtf8 + UTF8_MARGIN : UTF8_DONE;
+            break;
+        }
+        feedUtf8(limit - from > UTF8_BLOCK ? from + UTF8_BLOCK : limit);
+    }
+    return !invalidUtf8 || *invalidUtf8 >= currentOffset;
+}
+
+int Lexer::peek()
+{
+    if (cursor == limit && !refillWindow(cursor - 1)) return EOF;
+    return static_cast<unsigned char>(*cursor);
+}
+
 void Lexer::skipWhitespaceAndComments()
 {
-    while (std::isspace(currentChar) || (currentChar == '/' && input.peek() == '/'))
+    while (isAsciiSpace(currentChar) || (currentChar == '/' && peek() == '/'))
     {
-        if (std::isspace(currentChar))
+        if (isAsciiBlank(currentChar))
+        {
+            skipTo(skipBlanks(cursor, limit));
+        }
+        else if (isAsciiSpace(currentChar))
         {
             get();
         }
@@ -68,7 +254,7 @@ void Lexer::skipWhitespaceAndComments()
         {
             get();
             get();
-            while (currentChar != '\n' && !input.eof()) get();
+            while (currentChar != '\n' && !endReached) skipTo(findLineEnd(cursor, limit));
         }
     }
 }
@@ -79,205 +265,288 @@ Token Lexer::consumeAndReturn(Token returned)
     return returned;
 }
 
-Token Lexer::tryBuildIdentifier()
+SymbolId Lexer::internSource(std::string_view name)
 {
-    if (!std::isalpha(currentChar) && currentChar != '_')
-        return Token(TokenType::Unknown, currentPosition);
+    auto found = knownSymbols.find(name);
+    if (found != knownSymbols.end()) return found->second;
+    SymbolId id = symbols.intern(name);
+    knownSymbols.emplace(name, id);
+    return id;
+}
 
-    Position startPos = currentPosition;
-    std::string ident;
-    int currentLen = 0;
+Token Lexer::makeIdentifier(std::string_view ident, SourceOffset startOffset, bool inSource)
+{
+    if (const Keyword* keyword = findKeyword(ident))
+    {
+        if (keyword->type == TokenType::Type)
+            return Token(TokenType::Type, symbols.intern(ident), startOffset);
+        return Token(keyword->type, startOffset);
+    }
+
+    SymbolId id = inSource ? internSource(ident) : symbols.intern(ident);
+    return Token(TokenType::Identifier, id, startOffset);
+}
+
+Token Lexer::buildIdentifier()
+{
+    SourceOffset startOffset = currentOffset;
+
+    // The spelling is used in place, before skipping past it can refill a chunked window.
+    const char* start = cursor - 1;
+    const char* stop = skipIdentifierChars(cursor, limit);
+    if (stop - start >= MAX_IDENTIFIER_LEN)
+        return fail(ErrorType::Lexical, MessageId::IdentifierTooLong, startOffset);
+    if (windowHolds(stop))
+    {
+        Token token =
+            makeIdentifier(std::string_view(start, stop - start), startOffset, reader == nullptr);
+        skipTo(stop);
+        return token;
+    }
 
-    while (std::isalnum(currentChar) || currentChar == '_')
+    lexeme.clear();
+    int currentLen = 0;
+    while (isIdentifierChar(currentChar))
     {
-        ident += currentChar;
+        lexeme += currentChar;
         get();
         if (++currentLen >= MAX_IDENTIFIER_LEN)
-            throwError(ErrorType::Lexical, "Identifier is too long", startPos);
+            return fail(ErrorType::Lexical, MessageId::IdentifierTooLong, startOffset);
     }
+    return makeIdentifier(lexeme, startOffset, false);
+}
 
-    auto found = keywords.find(ident);
-    if (found != keywords.end())
+Token Lexer::numberToken(std::string_view spelling, bool isFloat, bool dotFollows,
+                         SourceOffset startOffset)
+{
+    const char* first = spelling.data();
+    const char* last = first + spelling.size();
+    if (!isFloat)
     {
-        if (found->second == TokenType::Type) return Token(TokenType::Type, ident, startPos);
-        return Token(found->second, startPos);
+        int value = 0;
+        if (std::from_chars(first, last, value).ec != std::errc())
+            value = parseSaturatingInt(spelling, MAXINT);
+        return Token(TokenType::Number, value, startOffset);
     }
+    if (dotFollows) return fail(ErrorType::Syntax, MessageId::InvalidFloat, startOffset);
 
-    return Token(TokenType::Identifier, ident, startPos);
+    float value = 0.0f;
+    if (std::from_chars(first, last, value).ec != std::errc())
+        value = std::numeric_limits<float>::max();
+    return Token(TokenType::Number, value, startOffset);
 }
 
-Token Lexer::tryBuildNumber()
+Token Lexer::buildNumber()
 {
-    if (!std::isdigit(currentChar)) return Token(TokenType::Unknown, currentPosition);
-    Position startPos = currentPosition;
+    SourceOffset startOffset = currentOffset;
+
+    const char* start = cursor - 1;
+    const char* stop = start;
+    if (*stop == '0')
+        ++stop;
+    else
+        while (stop != limit && isAsciiDigit(*stop)) ++stop;
+    bool isFloat = stop != limit && *stop == '.';
+    if (isFloat)
+        for (++stop; stop != limit && isAsciiDigit(*stop);) ++stop;
+    if (windowHolds(stop))
+    {
+        bool dotFollows = stop != limit && *stop == '.';
+        Token token =
+            numberToken(std::string_view(start, stop - start), isFloat, dotFollows, startOffset);
+        skipTo(stop);
+        return token;
+    }
 
-    int intPart = 0;
-    bool firstZero = false;
+    lexeme.clear();
     if (currentChar == '0')
     {
+        lexeme += currentChar;
         get();
-        firstZero = true;
     }
-    if (!firstZero)
-        while (std::isdigit(currentChar))
+    else
+        while (isAsciiDigit(currentChar))
         {
-            int currentDigit = digit_to_int(currentChar);
-            if ((MAXINT - currentDigit) / 10 >= intPart)
-            {
-                intPart *= 10;
-                intPart += currentDigit;
-            }
+            lexeme += currentChar;
             get();
         }
-    if (currentChar != '.')
-    {
-        return Token(TokenType::Number, intPart, startPos);
-    }
-    get();
-    int fracDigits = 0;
-    int fracPart = 0;
-    while (std::isdigit(currentChar))
-    {
-        fracPart = fracPart * 10 + digit_to_int(currentChar);
-        fracDigits++;
-        get();
-    }
-    if (currentChar == '.') throwError(ErrorType::Syntax, "Invalid float", startPos);
-
-    float divisor = std::pow(10.0f, fracDigits);
-    float finalValue = static_cast<float>(intPart) + (fracPart / divisor);
-    return Token(TokenType::Number, finalValue, startPos);
+    isFloat = currentChar == '.';
+    if (isFloat)
+        do
+        {
+            lexeme += currentChar;
+            get();
+        } while (isAsciiDigit(currentChar));
+    return numberToken(lexeme, isFloat, currentChar == '.', startOffset);
 }
-Token Lexer::tryBuildString()
+
+Token Lexer::buildString()
 {
-    if (currentChar != '"') return Token(TokenType::Unknown, currentPosition);
-    Position startPos = currentPosition;
+    SourceOffset startOffset = currentOffset;
 
     get();
+    // A SourceBuffer outlives its tokens, so a literal lexed from one is only scanned and its
+    // text viewed in place. Chunked input moves on, and the text is decoded into a string.
+    const bool inSource = reader == nullptr;
+    const char* text = cursor - 1;
+    bool escaped = false;
     std::string strLiteral;
-    while (currentChar != '"' && currentChar != EOF)
+    // A 0xFF byte reads as EOF, so the end of input is told apart by endReached.
+    while (currentChar != '"' && !endReached)
     {
         if (currentChar == '\\')
         {
+            escaped = true;
             get();
 
-            if (currentChar == EOF) break;
-            switch (currentChar)
-            {
-                case 'n':
-                    strLiteral += '\n';
-                    break;
-                case 't':
-                    strLiteral += '\t';
-                    break;
-                case '"':
-                    strLiteral += '"';
-                    break;
-                case '\\':
-                    strLiteral += '\\';
-                    break;
-                default:
-                    strLiteral += currentChar;
-                    break;
-            }
+            if (endReached) break;
+            if (!inSource) strLiteral += escapedChar(currentChar);
             get();
         }
+        else if (currentChar != '\n')
+        {
+            const char* stop = findStringStop(cursor, limit);
+            if (!inSource) strLiteral.append(cursor - 1, stop);
+            skipTo(stop);
+        }
         else
         {
-            strLiteral += currentChar;
+            if (!inSource) strLiteral += currentChar;
             get();
         }
     }
-    if (currentChar == '"')
-        get();
-    else if (currentChar == EOF)
-        throwError(ErrorType::Lexical, "Unterminated string literal", startPos);
-    return Token(TokenType::StringLiteral, strLiteral, startPos);
+    if (currentChar != '"')
+        return fail(ErrorType::Lexical, MessageId::UnterminatedString, startOffset);
+    if (!inSource)
+        return consumeAndReturn(Token(TokenType::StringLiteral, strLiteral, startOffset));
+    // The closing quote is the current character.
+    std::string_view raw(text, static_cast<std::size_t>(cursor - 1 - text));
+    return consumeAndReturn(Token(TokenType::StringLiteral, StringSpan{raw, escaped}, startOffset));
 }
 
-Token Lexer::tryBuildSymbol()
+Token Lexer::buildSymbol()
 {
-    Position startPos = currentPosition;
+    SourceOffset startOffset = currentOffset;
 
     switch (currentChar)
     {
         case '+':
-            return consumeAndReturn(Token(TokenType::Plus, startPos));
+            return consumeAndReturn(Token(TokenType::Plus, startOffset));
         case '-':
-            return consumeAndReturn(Token(TokenType::Minus, startPos));
+            return consumeAndReturn(Token(TokenType::Minus, startOffset));
         case '*':
-            return consumeAndReturn(Token(TokenType::Star, startPos));
+            return consumeAndReturn(Token(TokenType::Star, startOffset));
         case '/':
-            return consumeAndReturn(Token(TokenType::Slash, startPos));
+            return consumeAndReturn(Token(TokenType::Slash, startOffset));
 
         case '=':
             get();
-            if (currentChar == '=') return consumeAndReturn(Token(TokenType::Equal, startPos));
-            return Token(TokenType::Assign, startPos);
+            if (currentChar == '=') return consumeAndReturn(Token(TokenType::Equal, startOffset));
+            return Token(TokenType::Assign, startOffset);
 
         case '!':
             get();
-            if (currentChar == '=') return consumeAndReturn(Token(TokenType::NotEqual, startPos));
-            break;
+            if (currentChar == '=')
+                return consumeAndReturn(Token(TokenType::NotEqual, startOffset));
+            return Token(TokenType::Unknown, std::string(1, '!'), startOffset);
 
         case '>':
             get();
             if (currentChar == '=')
-                return consumeAndReturn(Token(TokenType::GreaterEqual, startPos));
-            return Token(TokenType::Greater, startPos);
+                return consumeAndReturn(Token(TokenType::GreaterEqual, startOffset));
+            return Token(TokenType::Greater, startOffset);
 
         case '<':
             get();
-            if (currentChar == '=') return consumeAndReturn(Token(TokenType::LessEqual, startPos));
-            return Token(TokenType::Less, startPos);
+            if (currentChar == '=')
+                return consumeAndReturn(Token(TokenType::LessEqual, startOffset));
+            return Token(TokenType::Less, startOffset);
 
         case '|':
             get();
-            if (currentChar == '|') return consumeAndReturn(Token(TokenType::Or, startPos));
-            return Token(TokenType::Pipe, startPos);
+            if (currentChar == '|') return consumeAndReturn(Token(TokenType::Or, startOffset));
+            return Token(TokenType::Pipe, startOffset);
 
         case '@':
             get();
-            if (currentChar == '@') return consumeAndReturn(Token(TokenType::AtAt, startPos));
-            break;
+            if (currentChar == '@') return consumeAndReturn(Token(TokenType::AtAt, startOffset));
+            return Token(TokenType::Unknown, std::string(1, '@'), startOffset);
 
         case '(':
-            return consumeAndReturn(Token(TokenType::LParen, startPos));
+            return consumeAndReturn(Token(TokenType::LParen, startOffset));
         case ')':
-            return consumeAndReturn(Token(TokenType::RParen, startPos));
+            return consumeAndReturn(Token(TokenType::RParen, startOffset));
         case '[':
-            return consumeAndReturn(Token(TokenType::LBracket, startPos));
+            return consumeAndReturn(Token(TokenType::LBracket, startOffset));
         case ']':
-            return consumeAndReturn(Token(TokenType::RBracket, startPos));
+            return consumeAndReturn(Token(TokenType::RBracket, startOffset));
         case ';':
-            return consumeAndReturn(Token(TokenType::Semicolon, startPos));
+            return consumeAndReturn(Token(TokenType::Semicolon, startOffset));
         case ',':
-            return consumeAndReturn(Token(TokenType::Comma, startPos));
+            return consumeAndReturn(Token(TokenType::Comma, startOffset));
         case '&':
             get();
-            if (currentChar == '&') return consumeAndReturn(Token(TokenType::And, startPos));
-            break;
+            if (currentChar == '&') return consumeAndReturn(Token(TokenType::And, startOffset));
+            return Token(TokenType::Unknown, std::string(1, '&'), startOffset);
     }
-    return Token(TokenType::Unknown, currentPosition);
+    return Token(TokenType::Unknown, startOffset);
+}
+
+// A character outside the language is one unknown token, however many bytes it takes.
+Token Lexer::buildUnknown()
+{
+    SourceOffset startOffset = currentOffset;
+
+    std::string unexpected(1, currentChar);
+    int length = utf8SequenceLength(currentChar);
+    get();
+    while (--length > 0 && !endReached && isUtf8Continuation(currentChar))
+    {
+        unexpected += currentChar;
+        get();
+    }
+    return Token(TokenType::Unknown, unexpected, startOffset);
 }
 
 Token Lexer::scanToken()
+{
+    Token token = nextToken();
+    if (token.type == TokenType::Error) throw InterpreterException(*failure);
+    return token;
+}
+
+Token Lexer::nextToken()
+{
+    if (failure) return Token(TokenType::Error, failure->offset);
+    Token token = lexToken();
+    if (currentOffset + UTF8_MARGIN > utf8CheckedTo && token.type != TokenType::Error &&
+        !checkUtf8())
+        return fail(ErrorType::Lexical, MessageId::InvalidUtf8, *invalidUtf8);
+    return token;
+}
+
+Token Lexer::lexToken()
 {
     skipWhitespaceAndComments();
-    Position startPos = currentPosition;
+    if (reader != nullptr && !endReached && limit - cursor < REFILL_MARGIN)
+        refillWindow(cursor - 1);
+    SourceOffset startOffset = currentOffset;
 
-    if (currentChar == EOF) return Token(TokenType::EndOfFile, startPos);
+    if (endReached) return Token(TokenType::EndOfFile, startOffset);
 
-    Token token = tryBuildIdentifier();
-    if (token_known(token)) return token;
-    token = tryBuildNumber();
-    if (token_known(token)) return token;
-    token = tryBuildString();
-    if (token_known(token)) return token;
-    token = tryBuildSymbol();
-    if (token_known(token)) return token;
+    switch (charKind(currentChar))
+    {
+        case CharKind::Letter:
+            return buildIdentifier();
+        case CharKind::Digit:
+            return buildNumber();
+        case CharKind::Quote:
+            return buildString();
+        case CharKind::Symbol:
+            return buildSymbol();
+        default:
+            break;
+    }
 
-    char unexpected = currentChar;
-    get();
-    return Token(TokenType::Unknown, std::string(1, unexpected), startPos);
+    return buildUnknown();
 }
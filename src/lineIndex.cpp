@@ -0,0 +1,35 @@
+#include <algorithm>
+
+#include "lineIndex.hpp"
+#include "scanKernels.hpp"
+#include "utf8.hpp"
+
+LineIndex LineIndex::scan(std::string_view script)
+{
+    LineIndex index;
+    const char* begin = script.data();
+    const char* end = begin + script.size();
+    for (const char* p = findLineEnd(begin, end); p < end; p = findLineEnd(p + 1, end))
+        index.addLine(static_cast<SourceOffset>(p + 1 - begin));
+    for (const char* p = skipAscii(begin, end); p < end; p = skipAscii(p + 1, end))
+    {
+        if (isUtf8Continuation(*p))
+            index.continuations.push_back(static_cast<SourceOffset>(p - begin));
+    }
+    return index;
+}
+
+Position LineIndex::position(SourceOffset offset) const
+{
+    auto next = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+    std::size_t line = next - lineStarts.begin();
+    SourceOffset start = lineStarts[line - 1];
+    SourceOffset codePoints = offset - start;
+    if (!continuations.empty())
+    {
+        auto first = std::lower_bound(continuations.begin(), continuations.end(), start);
+        auto last = std::lower_bound(first, continuations.end(), offset);
+        codePoints -= static_cast<SourceOffset>(last - first);
+    }
+    return Position(static_cast<int>(line), static_cast<int>(codePoints) + 1, offset);
+}
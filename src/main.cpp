@@ -1,29 +1,190 @@
-#include <fstream>
 #include <iostream>
-#include <variant>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include "allocationCounter.hpp"
+#include "astCache.hpp"
+#include "bytecode.hpp"
+#include "outputSink.hpp"
+#include "parallelLexer.hpp"
+#include "parallelParser.hpp"
 #include "parser.hpp"
+#include "registerVm.hpp"
+#include "sourceBuffer.hpp"
+#include "sourceReader.hpp"
+#include "stackVm.hpp"
+#include "tokenPipeline.hpp"
+#include "flatPrinter.hpp"
+#include "interpreterVisitor.hpp"
 #include "parserVisitor.hpp"
 
+namespace
+{
+bool countAllocations = false;
+
+// Printed on stderr for --count-allocs, so the dump on stdout stays the same.
+void reportAllocations(std::size_t parsing, std::size_t printing)
+{
+    if (countAllocations)
+        std::cerr << "Allocations: " << parsing << " parsing, " << printing << " printing\n";
+}
+
+ParseResult parseFile(const char* path)
+{
+    SourceBuffer source = SourceBuffer::fromFile(path);
+    TokenBuffer tokens = tokenizeParallel(source);
+    return parseParallel(tokens);
+}
+
+// Pipes cannot be mapped, so "-" streams stdin through the chunked reader and lexes it on a
+// separate thread while the parser consumes the tokens.
+ParseResult parseStdin()
+{
+    SourceReader reader = SourceReader::fromDescriptor(STDIN_FILENO);
+    Lexer lexer(reader);
+    TokenPipeline pipeline(lexer);
+    Parser parser(pipeline);
+    return parser.tryParseProgram();
+}
+
+// Same output as the uncached path; declarations that were seen before are not parsed again.
+int printCached(const char* path, const std::string& directory)
+{
+    AllocationCounter parsing;
+    CachedProgram program;
+    try
+    {
+        SourceBuffer source = SourceBuffer::fromFile(path);
+        program = AstCache(directory).load(source, path);
+    }
+    catch (const std::runtime_error&)
+    {
+        std::cerr << "Failed to open file\n";
+        return 1;
+    }
+    if (program.error)
+    {
+        std::cerr << program.error->toString() << '\n';
+        return 1;
+    }
+
+    std::size_t parsed = parsing.count();
+    AllocationCounter printing;
+    OutputSink out = OutputSink::toDescriptor(STDOUT_FILENO);
+    FlatPrinter printer(out);
+    for (const FlatAst& piece : program.pieces) printer.print(piece);
+    out.write('\n');
+    out.flush();
+    reportAllocations(parsed, printing.count());
+    return 0;
+}
+
+// print goes to stdout; main's int result, if it returns one, becomes the exit status.
+int runProgram(ProgramNode& program, const std::string& engine)
+{
+    OutputSink out = OutputSink::toDescriptor(STDOUT_FILENO);
+    try
+    {
+        CompiledProgram compiled;
+        RegisterProgram registers;
+        Value result;
+        if (engine == "vm")
+        {
+            compiled = compileBytecode(program);
+            result = StackVm(out).run(compiled);
+        }
+        else if (engine == "register")
+        {
+            registers = compileRegisters(program);
+            result = RegisterVm(out).run(registers);
+        }
+        else
+        {
+            result = InterpreterVisitor(out).run(program);
+        }
+        out.flush();
+        return result.is(Value::Type::Int) ? result.asInt() : 0;
+    }
+    catch (const InterpreterException& e)
+    {
+        out.flush();
+        std::cerr << e.error.toString() << '\n';
+        return 1;
+    }
+}
+
+}  // namespace
+
 int main(int argc, char** argv)
 {
-    if (argc < 2)
+    const std::string cacheFlag = "--cache-dir=";
+    const std::string engineFlag = "--engine=";
+    std::string cacheDirectory;
+    std::string engine;
+    int input = 1;
+    for (; argc > input && std::string(argv[input]).rfind("--", 0) == 0; ++input)
     {
-        std::cerr << "Usage: ./bibl <filename>\n";
+        std::string flag = argv[input];
+        if (flag == "--count-allocs")
+            countAllocations = true;
+        else if (flag.rfind(cacheFlag, 0) == 0)
+            cacheDirectory = flag.substr(cacheFlag.size());
+        else if (flag.rfind(engineFlag, 0) == 0)
+            engine = flag.substr(engineFlag.size());
+        else
+            break;
+    }
+    // The cache holds the dump, so it does not go with an engine.
+    bool knownEngine = engine.empty() || engine == "tree" || engine == "vm" || engine == "register";
+    if (argc <= input || !knownEngine || (!engine.empty() && !cacheDirectory.empty()))
+    {
+        std::cerr << "Usage: ./bibl [--engine=tree|vm|register | --cache-dir=DIR] "
+                     "[--count-allocs] <filename | ->\n";
         return 1;
     }
 
-    std::ifstream file(argv[1], std::ios::binary);
-    if (!file.is_open())
+    AllocationCounter parsing;
+    ParseResult result;
+    if (std::string(argv[input]) == "-")
     {
-        std::cerr << "Failed to open file\n";
+        result = parseStdin();
+    }
+    else if (!cacheDirectory.empty())
+    {
+        return printCached(argv[input], cacheDirectory);
+    }
+    else
+    {
+        try
+        {
+            result = parseFile(argv[input]);
+        }
+        catch (const std::runtime_error&)
+        {
+            std::cerr << "Failed to open file\n";
+            return 1;
+        }
+    }
+    if (result.error)
+    {
+        std::cerr << result.error->toString() << '\n';
         return 1;
     }
-    Lexer lexer(file);
-    Parser parser(lexer);
 
-    std::unique_ptr<ProgramNode> program = parser.parseProgram();
-    ParserVisitor myVisitor;
-    program->accept(myVisitor);
-    std::cout << myVisitor.getParsedString() << std::endl;
+    // With an engine the program is run instead of dumped.
+    if (!engine.empty()) return runProgram(*result.program, engine);
+
+    std::size_t parsed = parsing.count();
+    AllocationCounter printing;
+    // The dump goes out in chunks while it is printed, so it is never held in memory whole.
+    OutputSink out = OutputSink::toDescriptor(STDOUT_FILENO);
+    ParserVisitor myVisitor(out);
+    result.program->accept(myVisitor);
+    out.write('\n');
+    out.flush();
+    reportAllocations(parsed, printing.count());
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "outputSink.hpp"
+
+namespace
+{
+constexpr int INDENT_RUN = 64;
+const char SPACES[INDENT_RUN + 1] = "                                                                ";
+}  // namespace
+
+OutputSink OutputSink::toDescriptor(int fd, std::size_t chunkSize)
+{
+    return OutputSink(fd, nullptr, chunkSize);
+}
+
+OutputSink OutputSink::toStream(std::ostream& stream, std::size_t chunkSize)
+{
+    return OutputSink(-1, &stream, chunkSize);
+}
+
+OutputSink::OutputSink(int fd, std::ostream* stream, std::size_t chunkSize)
+    : fd(fd), stream(stream), chunkSize(std::max<std::size_t>(chunkSize, 1))
+{
+    buffer.reserve(drains() ? this->chunkSize : 0);
+}
+
+OutputSink::~OutputSink()
+{
+    // Whoever cares whether the output arrived flushes first; a destructor cannot tell them.
+    try
+    {
+        flush();
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+}
+
+void OutputSink::indent(int level)
+{
+    for (; level > INDENT_RUN; level -= INDENT_RUN) write(std::string_view(SPACES, INDENT_RUN));
+    if (level > 0) write(std::string_view(SPACES, static_cast<std::size_t>(level)));
+}
+
+void OutputSink::flush()
+{
+    if (!drains() || buffer.empty()) return;
+    if (stream != nullptr)
+    {
+        stream->write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+        return;
+    }
+    const char* next = buffer.data();
+    const char* end = next + buffer.size();
+    while (next < end)
+    {
+        ssize_t written = ::write(fd, next, static_cast<std::size_t>(end - next));
+        if (written >= 0)
+            next += written;
+        else if (errno != EINTR)
+            throw std::runtime_error(std::string("Failed to write output: ") + std::strerror(errno));
+    }
+    buffer.clear();
+}
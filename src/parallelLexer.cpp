@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "parallelLexer.hpp"
+#include "scanKernels.hpp"
+#include "utf8.hpp"
+
+namespace
+{
+struct Chunk
+{
+    std::size_t begin;
+    std::size_t end;
+    // Tokens starting inside [begin, end).
+    TokenBuffer tokens;
+    // First token at or past end; unset when lexing failed first.
+    std::optional<Token> stop;
+    // Starts of the lines that begin after a newline inside [begin, end).
+    std::vector<SourceOffset> lineStarts;
+    // UTF-8 continuation bytes inside [begin, end); validity is left to the lexer.
+    std::vector<SourceOffset> continuationBytes;
+};
+
+void lexChunk(const SourceBuffer& source, Chunk& chunk)
+{
+    const char* end = source.begin() + chunk.end;
+    for (const char* p = source.begin() + chunk.begin; (p = findLineEnd(p, end)) != end; ++p)
+        chunk.lineStarts.push_back(static_cast<SourceOffset>(p - source.begin() + 1));
+    Utf8Validator().feed(source.begin() + chunk.begin, end, static_cast<SourceOffset>(chunk.begin),
+                         chunk.continuationBytes);
+    Lexer lexer(source, static_cast<SourceOffset>(chunk.begin));
+    Token token = lexer.nextToken();
+    while (token.offset < chunk.end && token.type != TokenType::Error)
+    {
+        chunk.tokens.push(token);
+        token = lexer.nextToken();
+    }
+    if (token.type == TokenType::Error)
+        chunk.tokens.setLexicalError(*lexer.lexicalError());
+    else
+        chunk.stop = token;
+}
+
+std::vector<std::size_t> lineStartCuts(const SourceBuffer& source, std::size_t pieces)
+{
+    std::size_t size = source.size();
+    std::vector<std::size_t> cuts = {0};
+    for (std::size_t i = 1; i < pieces; ++i)
+    {
+        std::size_t target = std::max(size * i / pieces, cuts.back() + 1);
+        if (target >= size) break;
+        const void* newline = std::memchr(source.begin() + target - 1, '\n', size - target + 1);
+        if (newline == nullptr) break;
+        std::size_t cut = static_cast<const char*>(newline) - source.begin() + 1;
+        if (cut >= size) break;
+        cuts.push_back(cut);
+    }
+    cuts.push_back(size);
+    return cuts;
+}
+
+class Stitcher
+{
+   public:
+    Stitcher(const SourceBuffer& source, std::shared_ptr<const LineIndex> lines)
+        : source(source), lines(std::move(lines))
+    {
+        result.setLineIndex(this->lines);
+    }
+
+    // Returns false once the stream has ended, in EndOfFile or a lexical error.
+    bool add(const Chunk& chunk)
+    {
+        if (!next) return adopt(chunk, 0);
+        if (next->type == TokenType::EndOfFile) return false;
+        std::size_t offset = next->offset;
+        if (offset >= chunk.end) return true;
+
+        std::size_t index = 0;
+        while (index < chunk.tokens.size() && chunk.tokens.offset(index) < offset) ++index;
+        if (index < chunk.tokens.size() && chunk.tokens.offset(index) == offset)
+            return adopt(chunk, index);
+        return relex(chunk, index);
+    }
+
+    TokenBuffer finish()
+    {
+        if (next) result.push(*next);
+        return std::move(result);
+    }
+
+   private:
+    // From a token that starts where the sequential lexer would, the rest of the piece agrees.
+    bool adopt(const Chunk& chunk, std::size_t index)
+    {
+        result.append(chunk.tokens, index);
+        if (const auto& error = chunk.tokens.lexicalError()) return fail(*error);
+        next.emplace(*chunk.stop);
+        return true;
+    }
+
+    bool relex(const Chunk& chunk, std::size_t index)
+    {
+        Lexer lexer(source, next->offset);
+        Token token = lexer.nextToken();
+        while (token.offset < chunk.end && token.type != TokenType::Error)
+        {
+            SourceOffset offset = token.offset;
+            while (index < chunk.tokens.size() && chunk.tokens.offset(index) < offset) ++index;
+            if (index < chunk.tokens.size() && chunk.tokens.offset(index) == offset)
+                return adopt(chunk, index);
+            result.push(token);
+            token = lexer.nextToken();
+        }
+        if (token.type == TokenType::Error) return fail(*lexer.lexicalError());
+        next.emplace(token);
+        return true;
+    }
+
+    // Piece lexers only saw part of the script; errors point into the whole-file index.
+    bool fail(Error error)
+    {
+        error.lines = lines;
+        result.setLexicalError(error);
+        next.reset();
+        return false;
+    }
+
+    const SourceBuffer& source;
+    std::shared_ptr<const LineIndex> lines;
+    TokenBuffer result;
+    // Where the sequential lexer continues; unset before the first piece.
+    std::optional<Token> next;
+};
+
+}  // namespace
+
+TokenBuffer tokenizeParallel(const SourceBuffer& source, unsigned threads,
+                             std::size_t minChunkBytes)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t pieces = source.size() / std::max<std::size_t>(minChunkBytes, 1);
+    pieces = std::clamp<std::size_t>(pieces, 1, threads);
+    std::vector<std::size_t> cuts = lineStartCuts(source, pieces);
+    if (cuts.size() <= 2)
+    {
+        Lexer lexer(source);
+        return TokenBuffer::tokenize(lexer);
+    }
+
+    std::vector<Chunk> chunks(cuts.size() - 1);
+    for (std::size_t i = 0; i < chunks.size(); ++i)
+    {
+        chunks[i].begin = cuts[i];
+        chunks[i].end = cuts[i + 1];
+    }
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < chunks.size(); ++i)
+        workers.emplace_back(lexChunk, std::cref(source), std::ref(chunks[i]));
+    lexChunk(source, chunks[0]);
+    for (std::thread& worker : workers) worker.join();
+
+    std::vector<SourceOffset> lineStarts = {0};
+    std::vector<SourceOffset> continuationBytes;
+    for (const Chunk& chunk : chunks)
+    {
+        lineStarts.insert(lineStarts.end(), chunk.lineStarts.begin(), chunk.lineStarts.end());
+        continuationBytes.insert(continuationBytes.end(), chunk.continuationBytes.begin(),
+                                 chunk.continuationBytes.end());
+    }
+
+    auto lines = std::make_shared<LineIndex>(std::move(lineStarts), std::move(continuationBytes));
+    Stitcher stitcher(source, std::move(lines));
+    for (const Chunk& chunk : chunks)
+        if (!stitcher.add(chunk)) break;
+    return stitcher.finish();
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include "parallelParser.hpp"
+
+namespace
+{
+constexpr TokenSet DECLARATION_START = {TokenType::Fun, TokenType::Var, TokenType::Const};
+
+// Groups the declaration starts into task boundaries; the last boundary is the buffer size.
+std::vector<std::size_t> taskCuts(const TokenBuffer& tokens, std::size_t minTaskTokens,
+                                  unsigned threads)
+{
+    // A few tasks per thread leave something to steal when declarations differ in size.
+    std::size_t target = std::max(minTaskTokens, tokens.size() / (std::size_t(threads) * 4));
+    std::vector<std::size_t> cuts = {0};
+    for (std::size_t start : topLevelDeclarationStarts(tokens))
+        if (start - cuts.back() >= target) cuts.push_back(start);
+    cuts.push_back(tokens.size());
+    return cuts;
+}
+
+ParseResult parsePieces(const TokenBuffer& tokens, const std::vector<std::size_t>& cuts,
+                        WorkStealingPool& pool)
+{
+    std::size_t taskCount = cuts.size() - 1;
+    // Tasks past the earliest failure are skipped: their results would be thrown away.
+    std::vector<ParseResult> parts(taskCount);
+    std::atomic<std::size_t> firstFailure{taskCount};
+    pool.run(taskCount,
+             [&](std::size_t task)
+             {
+                 if (task > firstFailure.load(std::memory_order_relaxed)) return;
+                 parts[task] = Parser(tokens, cuts[task], cuts[task + 1]).tryParseProgram();
+                 if (!parts[task].error) return;
+                 std::size_t seen = firstFailure.load(std::memory_order_relaxed);
+                 while (task < seen && !firstFailure.compare_exchange_weak(seen, task)) {}
+             });
+
+    // A piece that failed may only have failed because it ended early, and the error offset
+    // depends on what comes next. Everything before it parsed cleanly, so the sequential
+    // parser would be at the top level right there: parse the rest as it would.
+    std::size_t parsed = std::min(firstFailure.load(), taskCount);
+    if (parsed < taskCount)
+    {
+        ParseResult rest = Parser(tokens, cuts[parsed]).tryParseProgram();
+        if (rest.error) return rest;
+        parts.resize(parsed);
+        parts.push_back(std::move(rest));
+    }
+
+    auto arena = std::make_unique<AstArena>();
+    std::vector<AstNode*> declarations;
+    for (ParseResult& part : parts)
+    {
+        declarations.insert(declarations.end(), part.program->declarations.begin(),
+                            part.program->declarations.end());
+        arena->adopt(std::move(*part.program->arena));
+    }
+    NodeList<AstNode> list = arena->makeList(declarations.data(),
+                                             declarations.data() + declarations.size());
+    auto program = std::make_unique<ProgramNode>(std::move(arena), list);
+    program->lines = tokens.lineIndex();
+    return {std::move(program), std::nullopt};
+}
+
+}  // namespace
+
+std::vector<std::size_t> topLevelDeclarationStarts(const TokenBuffer& tokens)
+{
+    std::vector<std::size_t> starts = {0};
+    std::size_t depth = 0;
+    bool closed = false;
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        TokenType type = tokens.type(i);
+        if (closed && DECLARATION_START.contains(type)) starts.push_back(i);
+        if (type == TokenType::LBracket) ++depth;
+        if (type == TokenType::RBracket && depth > 0) --depth;
+        closed = depth == 0 && (type == TokenType::Semicolon || type == TokenType::RBracket);
+    }
+    return starts;
+}
+
+ParseResult parseParallel(const TokenBuffer& tokens, WorkStealingPool& pool,
+                          std::size_t minTaskTokens)
+{
+    std::vector<std::size_t> cuts = taskCuts(tokens, minTaskTokens, pool.size());
+    if (cuts.size() == 2) return Parser(tokens).tryParseProgram();
+    return parsePieces(tokens, cuts, pool);
+}
+
+ParseResult parseParallel(const TokenBuffer& tokens, unsigned threads, std::size_t minTaskTokens)
+{
+    // Most scripts are one piece: those never start the threads.
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::size_t> cuts = taskCuts(tokens, minTaskTokens, threads);
+    if (cuts.size() == 2) return Parser(tokens).tryParseProgram();
+    WorkStealingPool pool(static_cast<unsigned>(std::min<std::size_t>(threads, cuts.size() - 1)));
+    return parsePieces(tokens, cuts, pool);
+}
@@ -1,5 +1,7 @@
+#include <array>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <utility>
 #include <algorithm>
@@ -8,489 +10,784 @@
 
 namespace
 {
-BinOperator getOperator(TokenType operatorType)
-{
-    switch (operatorType)
-    {
-        case TokenType::Plus:
-            return BinOperator::Plus;
-        case TokenType::Minus:
-            return BinOperator::Minus;
-        case TokenType::Star:
-            return BinOperator::Star;
-        case TokenType::Slash:
-            return BinOperator::Slash;
-        case TokenType::Equal:
-            return BinOperator::Equal;
-        case TokenType::NotEqual:
-            return BinOperator::NotEqual;
-        case TokenType::Greater:
-            return BinOperator::Greater;
-        case TokenType::GreaterEqual:
-            return BinOperator::GreaterEqual;
-        case TokenType::Less:
-            return BinOperator::Less;
-        case TokenType::LessEqual:
-            return BinOperator::LessEqual;
-        case TokenType::Pipe:
-            return BinOperator::Pipe;
-        case TokenType::AtAt:
-            return BinOperator::AtAt;
-        case TokenType::And:
-            return BinOperator::And;
-        case TokenType::Or:
-            return BinOperator::Or;
-        default:
-            return BinOperator::Unknown;
-    }
+// Binding strength of the binary operators, loosest first. All of them are left-associative.
+enum Precedence : int
+{
+    NotAnOperator = 0,
+    Logical,
+    Relational,
+    Additive,
+    Multiplicative
+};
+
+struct InfixRule
+{
+    int precedence;
+    BinOperator op;
+    // Reported when the right operand is missing.
+    MessageId missingOperand;
+};
+
+constexpr std::size_t TOKEN_TYPE_COUNT = static_cast<std::size_t>(TokenType::Error) + 1;
+
+constexpr std::array<InfixRule, TOKEN_TYPE_COUNT> makeInfixRules()
+{
+    std::array<InfixRule, TOKEN_TYPE_COUNT> rules{};
+    auto set = [&rules](TokenType type, int precedence, BinOperator op, MessageId message)
+    { rules[static_cast<std::size_t>(type)] = {precedence, op, message}; };
+
+    set(TokenType::And, Logical, BinOperator::And, MessageId::ExpectedLogicalOperand);
+    set(TokenType::Or, Logical, BinOperator::Or, MessageId::ExpectedLogicalOperand);
+    MessageId relational = MessageId::ExpectedRelationalOperand;
+    set(TokenType::Equal, Relational, BinOperator::Equal, relational);
+    set(TokenType::NotEqual, Relational, BinOperator::NotEqual, relational);
+    set(TokenType::Greater, Relational, BinOperator::Greater, relational);
+    set(TokenType::GreaterEqual, Relational, BinOperator::GreaterEqual, relational);
+    set(TokenType::Less, Relational, BinOperator::Less, relational);
+    set(TokenType::LessEqual, Relational, BinOperator::LessEqual, relational);
+    MessageId additive = MessageId::ExpectedAdditiveOperand;
+    set(TokenType::Plus, Additive, BinOperator::Plus, additive);
+    set(TokenType::Minus, Additive, BinOperator::Minus, additive);
+    set(TokenType::Pipe, Additive, BinOperator::Pipe, additive);
+    set(TokenType::AtAt, Additive, BinOperator::AtAt, additive);
+    MessageId multiplicative = MessageId::ExpectedMultiplicativeOperand;
+    set(TokenType::Star, Multiplicative, BinOperator::Star, multiplicative);
+    set(TokenType::Slash, Multiplicative, BinOperator::Slash, multiplicative);
+    return rules;
 }
 
-CastType getCastType(Token typeToken)
+constexpr std::array<InfixRule, TOKEN_TYPE_COUNT> INFIX_RULES = makeInfixRules();
+
+const InfixRule& infixRule(TokenType type)
 {
-    std::string type = typeToken.getValue<std::string>();
-    if (type == "string") return CastType::String;
-    if (type == "float") return CastType::Float;
-    if (type == "int") return CastType::Int;
-    throw InterpreterException(ErrorType::Semantic, "Unexpected token type" + type,
-                               typeToken.startPosition);
+    return INFIX_RULES[static_cast<std::size_t>(type)];
 }
 
-}  // namespace
+constexpr TokenSet DECLARATION_START = {TokenType::Const, TokenType::Var};
 
-Parser::Parser(Lexer& lexer) : lexer(lexer), currentToken(TokenType::Unknown, Position())
+template <typename T>
+T* as(AstNode* node)
 {
-    advance();
+    return static_cast<T*>(node);
 }
 
-Token Parser::advance()
+std::optional<CastType> getCastType(const Token& typeToken)
 {
-    return std::exchange(currentToken, lexer.scanToken());
+    static const SymbolId stringType = intern("string");
+    static const SymbolId floatType = intern("float");
+    static const SymbolId intType = intern("int");
+
+    SymbolId type = typeToken.getValue<SymbolId>();
+    if (type == stringType) return CastType::String;
+    if (type == floatType) return CastType::Float;
+    if (type == intType) return CastType::Int;
+    return std::nullopt;
 }
 
-bool Parser::check(TokenType type) const
-{
-    return currentToken.type == type;
+}  // namespace
+
+// A step either finishes its nonterminal, leaving the node in `result` and popping its frame,
+// or calls a child and names the step that takes over once the child's node is in `result`.
+// Steps named after a nonterminal are where it starts; the others are the points where the
+// recursive descent would return from a call.
+enum class ParseStep : std::uint8_t
+{
+    Block,
+    BlockEnd,
+    Statement,
+    IfCondition,
+    IfThen,
+    IfElse,
+    WhileCondition,
+    WhileBody,
+    ReturnValue,
+    Declaration,
+    DeclarationInitializer,
+    DeclarationEnd,
+    AssignValue,
+    CallStatementEnd,
+    ExpressionStatementEnd,
+    BinaryLeft,
+    BinaryRight,
+    Factor,
+    FunctionLiteralBody,
+    ParenClose,
+    CallFirstArgument,
+    CallArguments,
+    CallArgument,
+};
+
+Parser::Parser(Lexer& lexer)
+    : lexer(&lexer), lines(lexer.lineIndex()), currentToken(TokenType::Unknown, 0)
+{
+    skip();
 }
 
-bool Parser::match(const std::vector<TokenType> types)
+Parser::Parser(const TokenBuffer& tokens, std::size_t first, std::size_t last)
+    : tokens(&tokens),
+      tokenIndex(first),
+      tokenEnd(std::min(last, tokens.size())),
+      lines(tokens.lineIndex()),
+      currentToken(TokenType::Unknown, 0)
 {
-    bool found = std::find(types.begin(), types.end(), currentToken.type) != types.end();
-    if (found) advance();
-    return found;
+    skip();
 }
 
-bool Parser::isIn(const std::vector<TokenType> types) const
+Parser::Parser(TokenPipeline& pipeline)
+    : pipeline(&pipeline), lines(pipeline.lineIndex()), currentToken(TokenType::Unknown, 0)
 {
-    return std::find(types.begin(), types.end(), currentToken.type) != types.end();
+    skip();
 }
 
-Token Parser::consume(TokenType type, const std::string& errorMessage)
+Token Parser::advance()
 {
-    if (check(type))
-    {
-        return advance();
-    }
-    throw error(errorMessage);
+    return std::exchange(currentToken, nextToken());
 }
 
-InterpreterException Parser::error(const std::string& message) const
+// advance() for when the token passed over is not needed; it is not copied out.
+void Parser::skip()
 {
-    return InterpreterException(ErrorType::Semantic, message, currentToken.startPosition);
+    currentToken = nextToken();
 }
 
-// Program         = { FunctionDeclaration | Declaration };
-std::unique_ptr<ProgramNode> Parser::parseProgram()
+Token Parser::nextToken()
 {
-    std::vector<std::unique_ptr<AstNode>> declarations;
-    std::unique_ptr<DeclarationNode> declaration;
-    std::unique_ptr<FunctionDeclarationNode> funcDeclaration;
-    while ((funcDeclaration = parseFunctionDeclaration()) || (declaration = parseDeclaration()))
+    if (failure) return Token(TokenType::EndOfFile, failure->offset);
+    if (lexer || pipeline)
     {
-        if (funcDeclaration != nullptr)
-        {
-            declarations.push_back(std::move(funcDeclaration));
-        }
-        else if (declaration != nullptr)
-        {
-            consume(TokenType::Semicolon, "Expected ';' after declaration while parsing program");
-            declarations.push_back(std::move(declaration));
-        }
-        declaration = nullptr;
-        funcDeclaration = nullptr;
+        Token token = lexer ? lexer->nextToken() : pipeline->next();
+        if (token.type != TokenType::Error) return token;
+        fail(lexer ? *lexer->lexicalError() : *pipeline->lexicalError());
+        return Token(TokenType::EndOfFile, token.offset);
+    }
+    if (tokenIndex < tokenEnd) return tokens->token(tokenIndex++);
+    // The buffer stops early only where the lexer failed; report it now, in parse order.
+    if (tokenEnd == tokens->size() && tokens->lexicalError())
+    {
+        fail(*tokens->lexicalError());
+        return Token(TokenType::EndOfFile, failure->offset);
     }
-    if (!check(TokenType::EndOfFile)) throw error("Unexpected token in between declarations");
-    return std::make_unique<ProgramNode>(std::move(declarations));
+    return Token(TokenType::EndOfFile, tokenEnd > 0 ? tokens->offset(tokenEnd - 1) : 0);
 }
 
-// FunctionDeclaration = “fun”, id, “(“, [ Parameters ], “)”, StatementBlock ;
-std::unique_ptr<FunctionDeclarationNode> Parser::parseFunctionDeclaration()
+// Type of the token `distance` places after the current one. The streaming lexer cannot look
+// ahead, nor can the pipeline, so there everything past the current token reads as Unknown.
+TokenType Parser::lookahead(std::size_t distance) const
 {
-    if (!check(TokenType::Fun)) return nullptr;
-    Position startPos = currentToken.startPosition;
-    consume(TokenType::Fun, "Expected 'fun'");
-    std::string name =
-        consume(TokenType::Identifier, "Expected function's name").getValue<std::string>();
-    consume(TokenType::LParen, "Expected '('");
-    std::vector<std::unique_ptr<FuncDefArgument>> params = parseParameters();
-    consume(TokenType::RParen, "Expected ')'");
-    std::unique_ptr<StatementBlockNode> body = parseStatementBlock();
-
-    return std::make_unique<FunctionDeclarationNode>(name, startPos, std::move(params),
-                                                     std::move(body));
+    if (distance == 0) return currentToken.type;
+    if (!tokens || currentToken.type == TokenType::EndOfFile) return TokenType::Unknown;
+    std::size_t index = tokenIndex + distance - 1;
+    return index < tokenEnd ? tokens->type(index) : TokenType::EndOfFile;
 }
 
-// Parameters = Parameter, {“,”, Parameter }
-std::vector<std::unique_ptr<FuncDefArgument>> Parser::parseParameters()
+bool Parser::check(TokenType type) const
 {
-    std::vector<std::unique_ptr<FuncDefArgument>> params;
-    auto param = parseParameter();
-    if (!param)
-    {
-        return {};
-    }
-    params.push_back(std::move(param));
-    while (match({TokenType::Comma}))
-    {
-        param = parseParameter();
-        if (!param)
-        {
-            throw error("Expected 'const' or 'var'");
-        }
-        params.push_back(std::move(param));
-    }
-    return params;
+    return currentToken.type == type;
 }
 
-// Parameter       = (“const” | “var”), id ;
-std::unique_ptr<FuncDefArgument> Parser::parseParameter()
+bool Parser::match(TokenType type)
 {
-    if (!check({TokenType::Const}) && !check({TokenType::Var})) return nullptr;
-    bool mod;
-    if (match({TokenType::Const}))
-    {
-        mod = false;
-    }
-    else if (match({TokenType::Var}))
-    {
-        mod = true;
-    }
-    std::string tmpId =
-        consume(TokenType::Identifier, "Expected param's name").getValue<std::string>();
-    return std::make_unique<FuncDefArgument>(FuncDefArgument{mod, tmpId});
+    if (!check(type)) return false;
+    skip();
+    return true;
 }
 
-// StatementBlock = “[“, { Statement }, “]” ;
-std::unique_ptr<StatementBlockNode> Parser::parseStatementBlock()
+bool Parser::match(TokenSet types)
 {
-    consume(TokenType::LBracket, "Expected '['");
-    Position startPos = currentToken.startPosition;
-    std::vector<std::unique_ptr<StatementNode>> statements;
-    while (auto statement = parseStatement())
-    {
-        statements.push_back(std::move(statement));
-    }
-    consume(TokenType::RBracket, "Expected ']'");
-    return std::make_unique<StatementBlockNode>(startPos, std::move(statements));
+    if (!isIn(types)) return false;
+    skip();
+    return true;
 }
 
-// Statement = IdOrCallAssign | IfStatement | Declaration, “;” | ReturnStatement, “;” |
-// WhileStatement; zwracanie nullptr
-std::unique_ptr<StatementNode> Parser::parseStatement()
+bool Parser::isIn(TokenSet types) const
 {
-    if (auto ifStatement = parseIfStatement())
-    {
-        return ifStatement;
-    }
-    if (auto whileStatement = parseWhileStatement())
-    {
-        return whileStatement;
-    }
-    if (auto returnStatement = parseReturnStatement())
-    {
-        consume(TokenType::Semicolon, "Expected ';' after return");
-        return returnStatement;
-    }
-    if (auto declaration = parseDeclaration())
-    {
-        consume(TokenType::Semicolon, "Expected ';' after declaration");
-        return declaration;
-    }
-    if (auto idOrCall = parseIdOrCallAssign())
-    {
-        return idOrCall;
-    }
-
-    if (auto expr = parseExpression())
-    {
-        consume(TokenType::Semicolon, "Expected ';'");
-        return std::make_unique<ExpressionStatementNode>(std::move(expr));
-    }
-    return nullptr;
+    return types.contains(currentToken.type);
 }
 
-// IfStatement = “if”, “(“, LogicalExpr, “)”, StatementBlock, [“else”, StatementBlock] ;
-std::unique_ptr<IfStatementNode> Parser::parseIfStatement()
+// A failed consume hands back the EndOfFile token the parser is left on.
+Token Parser::consume(TokenType type, MessageId message)
 {
-    if (!match({TokenType::If})) return nullptr;
-    const Position startPos = currentToken.startPosition;
-    consume(TokenType::LParen, "Expected '('");
-    std::unique_ptr<ExpressionNode> condition =
-        shall(parseLogicalExpr(), "Expected logical expression in if");
-    consume(TokenType::RParen, "Expected ')'");
-    std::unique_ptr<StatementBlockNode> thenBranch = parseStatementBlock();
-    std::unique_ptr<StatementBlockNode> elseBranch = nullptr;
-    if (match({TokenType::Else}))
+    if (check(type))
     {
-        elseBranch = parseStatementBlock();
+        return advance();
     }
-    return std::make_unique<IfStatementNode>(startPos, std::move(condition), std::move(thenBranch),
-                                             std::move(elseBranch));
+    error(message);
+    return currentToken;
 }
 
-// WhileStatement = “while”, “(“, LogicalExpr, “)”, StatementBlock ;
-std::unique_ptr<WhileStatementNode> Parser::parseWhileStatement()
+// consume() for a token whose value is not needed.
+void Parser::expect(TokenType type, MessageId message)
 {
-    if (!check(TokenType::While)) return nullptr;
-    Position startPos = currentToken.startPosition;
-    consume(TokenType::While, "Expected 'while'");
-    consume(TokenType::LParen, "Expected '('");
-    std::unique_ptr<ExpressionNode> condition =
-        shall(parseLogicalExpr(), "Expected logical expression in while");
-    consume(TokenType::RParen, "Expected ')'");
-    std::unique_ptr<StatementBlockNode> body = parseStatementBlock();
-    return std::make_unique<WhileStatementNode>(startPos, std::move(condition), std::move(body));
+    if (check(type))
+        skip();
+    else
+        error(message);
 }
 
-// ReturnStatement = “return”, [ Expression ];
-std::unique_ptr<ReturnStatementNode> Parser::parseReturnStatement()
+void Parser::fail(Error error)
 {
-    if (!check(TokenType::Return)) return nullptr;
-    Position startPos = currentToken.startPosition;
-    consume(TokenType::Return, "Expected 'return'");
-    std::unique_ptr<ExpressionNode> returnValue = parseExpression();
-    return std::make_unique<ReturnStatementNode>(startPos, std::move(returnValue));
+    if (failure) return;
+    // The lexer thread appends to the line index; halt it before anyone reads the error.
+    if (pipeline) pipeline->stop();
+    failure = std::move(error);
 }
 
-// Declaration = (“var” | “const var”), id, [“=”, Expression] ;
-std::unique_ptr<DeclarationNode> Parser::parseDeclaration()
+void Parser::error(MessageId message)
 {
-    if (!check(TokenType::Const) && !check(TokenType::Var)) return nullptr;
-    const Position pos = currentToken.startPosition;
-    const bool isVar = match({TokenType::Var});
-    const bool isConst = !isVar && match({TokenType::Const});
-    if (!isVar && !isConst)
-    {
-        throw error("Expected 'const' or 'var'");
-    }
-
-    std::string name =
-        consume(TokenType::Identifier, "Expected variable's name").getValue<std::string>();
-    std::unique_ptr<ExpressionNode> initializer = nullptr;
-    if (match({TokenType::Assign}))
-    {
-        initializer = shall(parseExpression(), "Expected an expression after assign");
-    }
-    return std::make_unique<DeclarationNode>(isVar, std::move(name), pos, std::move(initializer));
+    error(message, currentToken.offset);
 }
 
-// IdOrCallAssign = id, PossibleAssignOrCall ;
-std::unique_ptr<StatementNode> Parser::parseIdOrCallAssign()
+void Parser::error(MessageId message, SourceOffset offset, std::string detail)
 {
-    if (!check(TokenType::Identifier)) return nullptr;
-    std::string id = consume(TokenType::Identifier, "Expected identifier").getValue<std::string>();
-    return parsePossibleAssignOrCall(std::move(id));
+    fail(Error{ErrorType::Semantic, message, offset, lines, std::move(detail)});
+    currentToken = Token(TokenType::EndOfFile, failure->offset);
 }
 
-// PossibleAssignOrCall = "=" Expression ";" | [ CallArguments ] ";" ;
-std::unique_ptr<StatementNode> Parser::parsePossibleAssignOrCall(std::string id)
+std::unique_ptr<ProgramNode> Parser::parseProgram()
 {
-    Position startPos = currentToken.startPosition;
-    if (match({TokenType::Assign}))
-    {
-        std::unique_ptr<ExpressionNode> expr = parseExpression();
-        std::unique_ptr<AssignNode> assigned =
-            std::make_unique<AssignNode>(id, startPos, std::move(expr));
-        consume(TokenType::Semicolon, "No semicolon after assign");
-        return assigned;
-    }
-
-    std::unique_ptr<ExpressionNode> callee = std::make_unique<IdentifierNode>(id, startPos);
-    std::unique_ptr<ExpressionNode> call = parseFunctionCall(std::move(callee));
-    std::unique_ptr<ExpressionStatementNode> node =
-        std::make_unique<ExpressionStatementNode>(std::move(call));
-    consume(TokenType::Semicolon, "No semicolon after call");
-    return node;
+    ParseResult result = tryParseProgram();
+    if (result.error) throw InterpreterException(std::move(*result.error));
+    return std::move(result.program);
 }
 
-// CallArguments   = “(“, [ ArgumentList ], “)” ;
-std::unique_ptr<ExpressionNode> Parser::parseFunctionCall(std::unique_ptr<ExpressionNode> callee)
+FlatAst Parser::parseFlatProgram()
 {
-    consume(TokenType::LParen, "Expected '('");
-    std::vector<std::unique_ptr<ExpressionNode>> args = parseArgumentList();
-    consume(TokenType::RParen, "Expected ')'");
-    return std::make_unique<FunctionCallNode>(std::move(callee), std::move(args));
+    return FlatAst::build(*parseProgram());
 }
 
-// ArgumentList    = Expression, { “,”, Expression } ;
-std::vector<std::unique_ptr<ExpressionNode>> Parser::parseArgumentList()
+// Program         = { FunctionDeclaration | Declaration };
+ParseResult Parser::tryParseProgram()
 {
-    std::vector<std::unique_ptr<ExpressionNode>> args;
-    if (auto arg = parseExpression()) args.push_back(std::move(arg));
-    while (match({TokenType::Comma}))
+    arena = std::make_unique<AstArena>();
+    std::vector<AstNode*> declarations;
+    while (true)
+    {
+        AstNode* declaration = nullptr;
+        switch (currentToken.type)
+        {
+            case TokenType::Fun:
+                declaration = parseFunctionDeclaration();
+                break;
+            case TokenType::Const:
+            case TokenType::Var:
+                declaration = parseDeclaration();
+                if (declaration)
+                    expect(TokenType::Semicolon,
+                           MessageId::ExpectedSemicolonAfterTopLevelDeclaration);
+                break;
+            default:
+                break;
+        }
+        if (!declaration) break;
+        declarations.push_back(declaration);
+    }
+    if (!check(TokenType::EndOfFile)) error(MessageId::UnexpectedTokenBetweenDeclarations);
+    if (failure)
     {
-        args.push_back(std::move(parseExpression()));
+        arena.reset();
+        return {nullptr, failure};
     }
-    return args;
+    NodeList<AstNode> list = listOf(declarations, 0);
+    auto program = std::make_unique<ProgramNode>(std::move(arena), list);
+    program->lines = lines;
+    return {std::move(program), std::nullopt};
 }
 
-// Expression = TypeCastExpression ;
-// TypeCastExpression = SimpleExpression, { “as”, Type } ;
-std::unique_ptr<ExpressionNode> Parser::parseExpression()
+// FunctionDeclaration = “fun”, id, “(“, [ Parameters ], “)”, StatementBlock ;
+FunctionDeclarationNode* Parser::parseFunctionDeclaration()
 {
-    std::unique_ptr<ExpressionNode> left = parseSimpleExpression();
+    if (!check(TokenType::Fun)) return nullptr;
+    SourceOffset startOffset = currentToken.offset;
+    expect(TokenType::Fun, MessageId::ExpectedFun);
+    Token name = consume(TokenType::Identifier, MessageId::ExpectedFunctionName);
+    expect(TokenType::LParen, MessageId::ExpectedLParen);
+    NodeList<FuncDefArgument> params = parseParameters();
+    expect(TokenType::RParen, MessageId::ExpectedRParen);
+    StatementBlockNode* body = parseStatementBlock();
+    if (failed()) return nullptr;
+
+    return arena->make<FunctionDeclarationNode>(name.getValue<SymbolId>(), startOffset, params,
+                                                body);
+}
 
-    while (match({TokenType::As}))
+// Parameters = Parameter, {“,”, Parameter }
+NodeList<FuncDefArgument> Parser::parseParameters()
+{
+    auto param = parseParameter();
+    if (!param)
     {
-        Token typeToken = consume(TokenType::Type, "Expected a type");
-        CastType type = getCastType(typeToken);
-        left = std::make_unique<TypeCastNode>(std::move(left), type);
+        return {};
     }
+    std::size_t mark = scratchParameters.size();
+    scratchParameters.push_back(param);
+    while (match(TokenType::Comma))
+    {
+        param = parseParameter();
+        if (!param)
+        {
+            error(MessageId::ExpectedConstOrVar);
+            scratchParameters.resize(mark);
+            return {};
+        }
+        scratchParameters.push_back(param);
+    }
+    return listOf(scratchParameters, mark);
+}
 
-    return left;
+// Parameter       = (“const” | “var”), id ;
+FuncDefArgument* Parser::parseParameter()
+{
+    if (!isIn(DECLARATION_START)) return nullptr;
+    bool mod = advance().type == TokenType::Var;
+    Token name = consume(TokenType::Identifier, MessageId::ExpectedParamName);
+    if (failed()) return nullptr;
+    return arena->make<FuncDefArgument>(mod, name.getValue<SymbolId>());
 }
 
-// LogicalExpr   = RelExpression, { LogicalExpr, RelExpression } ;
-std::unique_ptr<ExpressionNode> Parser::parseLogicalExpr()
+StatementBlockNode* Parser::parseStatementBlock()
 {
-    std::unique_ptr<ExpressionNode> left = parseRelExpression();
-    while (isIn({TokenType::And, TokenType::Or}))
-    {
-        Token operatorToken = advance();
-        BinOperator op = getOperator(operatorToken.type);
-        std::unique_ptr<ExpressionNode> right =
-            shall(parseRelExpression(),
-                  "Expected expression after operator while parsing logical expression");
-        left = std::make_unique<BinaryOpNode>(std::move(left), op, std::move(right));
-    }
-    return left;
+    return as<StatementBlockNode>(run(ParseStep::Block));
 }
 
-// RelExpression   = Expression, { RelOperator, Expression } ;
-std::unique_ptr<ExpressionNode> Parser::parseRelExpression()
+DeclarationNode* Parser::parseDeclaration()
 {
-    std::unique_ptr<ExpressionNode> left = parseSimpleExpression();
-    while (isIn({TokenType::Equal, TokenType::NotEqual, TokenType::Greater, TokenType::GreaterEqual,
-                 TokenType::Less, TokenType::LessEqual}))
-    {
-        Token operatorToken = advance();
-        BinOperator op = getOperator(operatorToken.type);
-        std::unique_ptr<ExpressionNode> right =
-            shall(parseSimpleExpression(),
-                  "Expected expression after operator while parsing relExpression");
-        left = std::make_unique<BinaryOpNode>(std::move(left), op, std::move(right));
-    }
-    return left;
+    return as<DeclarationNode>(run(ParseStep::Declaration));
 }
 
-// SimpleExpression  = Term, {("+" | "-" | "|" | "@@"), Term ;
-std::unique_ptr<ExpressionNode> Parser::parseSimpleExpression()
+// Number | LiteralString | id ; nothing is consumed if the current token is none of them.
+ExpressionNode* Parser::parseLeaf()
 {
-    std::unique_ptr<ExpressionNode> left = parseTerm();
-    while (isIn({TokenType::Plus, TokenType::Minus, TokenType::Pipe, TokenType::AtAt}))
+    ExpressionNode* leaf;
+    switch (currentToken.type)
     {
-        Token operatorToken = advance();
-        BinOperator op = getOperator(operatorToken.type);
-        std::unique_ptr<ExpressionNode> right =
-            shall(parseTerm(), "Expected expression after operator while parsing simpleExpression");
-        left = std::make_unique<BinaryOpNode>(std::move(left), op, std::move(right));
+        case TokenType::Number:
+            if (auto* intValue = std::get_if<int>(&currentToken.value))
+                leaf = arena->make<NumberLiteralNode>(*intValue, currentToken.offset);
+            else
+                leaf = arena->make<NumberLiteralNode>(std::get<float>(currentToken.value),
+                                                      currentToken.offset);
+            break;
+        // Escapes are left for the node to decode once its value is read.
+        case TokenType::StringLiteral:
+        {
+            auto* span = std::get_if<StringSpan>(&currentToken.value);
+            std::string_view text = span ? span->raw : std::get<std::string>(currentToken.value);
+            leaf = arena->make<StringLiteralNode>(arena->copyChars(text), text.size(),
+                                                  span && span->escaped, currentToken.offset);
+            break;
+        }
+        case TokenType::Identifier:
+            leaf = arena->make<IdentifierNode>(std::get<SymbolId>(currentToken.value),
+                                               currentToken.offset);
+            break;
+        default:
+            return nullptr;
     }
-    return left;
+    skip();
+    return leaf;
 }
 
-// Term      = Factor, { (“*” | “/”) Factor }
-std::unique_ptr<ExpressionNode> Parser::parseTerm()
+// { “as”, Type } after a SimpleExpression.
+ExpressionNode* Parser::parseCasts(ExpressionNode* left)
 {
-    std::unique_ptr<ExpressionNode> left = parseFactor();
-    while (isIn({TokenType::Star, TokenType::Slash}))
+    while (match(TokenType::As))
     {
-        Token operatorToken = advance();
-        BinOperator op = getOperator(operatorToken.type);
-        std::unique_ptr<ExpressionNode> right =
-            shall(parseFactor(), "Expected expression after operator while parsing term");
-        left = std::make_unique<BinaryOpNode>(std::move(left), op, std::move(right));
+        Token typeToken = consume(TokenType::Type, MessageId::ExpectedType);
+        if (failed()) return nullptr;
+        std::optional<CastType> type = getCastType(typeToken);
+        if (!type)
+        {
+            error(MessageId::UnexpectedType, typeToken.offset,
+                  symbolName(typeToken.getValue<SymbolId>()));
+            return nullptr;
+        }
+        left = arena->make<TypeCastNode>(left, *type);
     }
     return left;
 }
 
-// Factor = BaseFactor PossibleCallArguments ;
-std::unique_ptr<ExpressionNode> Parser::parseFactor()
+inline Parser::Frame& Parser::push(ParseStep step, AstNode* first)
 {
-    std::unique_ptr<ExpressionNode> expr = parseBaseFactor();
-    expr = parsePossibleCallArguments(std::move(expr));
-    return expr;
+    // Frames above `depth` are kept for reuse, so the stack is only allocated for the deepest
+    // nesting seen.
+    if (depth == frames.size()) frames.emplace_back();
+    Frame& frame = frames[depth++];
+    frame = Frame{step, false, 0, 0, 0, first, nullptr, {}};
+    return frame;
 }
 
-// PossibleCallArguments = { CallArguments } ;
-std::unique_ptr<ExpressionNode> Parser::parsePossibleCallArguments(
-    std::unique_ptr<ExpressionNode> expr)
-{
-    while (check(TokenType::LParen))
+// The grammar below is parsed by one loop over an explicit stack of frames rather than by
+// recursive descent. Each case is the part of a rule up to its next nonterminal; a call
+// pushes the child's frame, so `frame` must not be touched after one. Where a child's first
+// part cannot lead back to its parent's, the lambdas below start it right away instead of
+// going round the loop.
+AstNode* Parser::run(ParseStep start)
+{
+    std::size_t base = depth;
+    push(start, nullptr);
+    AstNode* result = nullptr;
+    auto finish = [&](AstNode* node)
     {
-        expr = parseFunctionCall(std::move(expr));
-    }
-    return expr;
-}
+        result = node;
+        --depth;
+    };
 
-// BaseFactor = Number | LiteralString | id | “(“, Expression, “)” | FunctionLiteral;
-std::unique_ptr<ExpressionNode> Parser::parseBaseFactor()
-{
-    if (check(TokenType::Number))
+    // Whether an operand just taken is complete: no call, cast (when `casts` is set) or
+    // operator at or above `minPrecedence` follows it.
+    auto operandEnds = [&](int minPrecedence, bool casts)
     {
-        Token numToken = consume(TokenType::Number, "Expected a number");
-
-        if (auto intValue = std::get_if<int>(&numToken.value))
-            return std::make_unique<NumberLiteralNode>(*intValue, numToken.startPosition);
+        return !check(TokenType::LParen) && !(casts && check(TokenType::As)) &&
+               infixRule(currentToken.type).precedence < minPrecedence;
+    };
+    // Calls a binary expression climbing from `minPrecedence`, with the casts of an
+    // Expression after it when `casts` is set. `leaf` is its first operand if that has been
+    // taken already; a Factor is called for any other.
+    auto descend = [&](ParseStep next, int minPrecedence, bool casts, ExpressionNode* leaf)
+    {
+        frames[depth - 1].step = next;
+        Frame& child = push(ParseStep::BinaryLeft, nullptr);
+        child.precedence = minPrecedence;
+        child.modifier = casts;
+        result = leaf;
+        if (!leaf && (check(TokenType::LParen) || check(TokenType::Fun)))
+            child.step = ParseStep::Factor;
+    };
+    // LogicalExpr starts climbing at Logical and Expression at Additive:
+    //
+    // Expression         = TypeCastExpression ;
+    // TypeCastExpression = SimpleExpression, { “as”, Type } ;
+    //
+    // Most operands are a single token that nothing after it binds to; those are taken in
+    // place and go straight to `next`, without a frame. So is a missing one, which ends a
+    // block or leaves its parent to report it.
+    auto operand = [&](ParseStep next, int minPrecedence, bool casts)
+    {
+        ExpressionNode* leaf = parseLeaf();
+        if (operandEnds(minPrecedence, casts) && (leaf || !check(TokenType::Fun)))
+        {
+            frames[depth - 1].step = next;
+            result = leaf;
+            return;
+        }
+        descend(next, minPrecedence, casts, leaf);
+    };
+    // CallArguments = “(“, [ ArgumentList ], “)” ; for `callee`.
+    auto callArguments = [&](ParseStep next, AstNode* callee)
+    {
+        frames[depth - 1].step = next;
+        Frame& frame = push(ParseStep::CallArguments, callee);
+        expect(TokenType::LParen, MessageId::ExpectedLParen);
+        frame.value = static_cast<std::uint32_t>(scratchArguments.size());
+        operand(ParseStep::CallFirstArgument, Additive, true);
+    };
+    // Precedence climbing over the binary operator levels: takes the operators at or above
+    // the frame's precedence that follow `left`, each with its right side one level tighter.
+    //
+    // LogicalExpr      = RelExpression, { LogicalOperator, RelExpression } ;
+    // RelExpression    = SimpleExpression, { RelOperator, SimpleExpression } ;
+    // SimpleExpression = Term, { ("+" | "-" | "|" | "@@"), Term } ;
+    // Term             = Factor, { ("*" | "/"), Factor } ;
+    //
+    // Runs of single-token operands, as in `a + b - c`, are folded here; any other right side
+    // is climbed in a frame of its own, and this one resumes at BinaryRight.
+    auto climb = [&](Frame& frame, ExpressionNode* left)
+    {
+        while (true)
+        {
+            const InfixRule& rule = infixRule(currentToken.type);
+            if (rule.precedence == NotAnOperator || rule.precedence < frame.precedence)
+            {
+                finish(frame.modifier ? parseCasts(left) : left);
+                return;
+            }
+            frame.value = static_cast<std::uint32_t>(currentToken.type);
+            skip();
+            ExpressionNode* right = parseLeaf();
+            if (right && operandEnds(rule.precedence + 1, false))
+            {
+                left = arena->make<BinaryOpNode>(left, rule.op, right);
+                continue;
+            }
+            frame.first = left;
+            descend(ParseStep::BinaryRight, rule.precedence + 1, false, right);
+            return;
+        }
+    };
 
-        return std::make_unique<NumberLiteralNode>(std::get<float>(numToken.value),
-                                                   numToken.startPosition);
-    }
-    if (check(TokenType::StringLiteral))
+    // Declaration = (“var” | “const”), id, [“=”, Expression] ;
+    auto startDeclaration = [&](Frame& frame)
     {
-        Token str = consume(TokenType::StringLiteral, "Expected string literal");
-        std::string literal = str.getValue<std::string>();
-        return std::make_unique<StringLiteralNode>(literal, str.startPosition);
-    }
-    if (check(TokenType::Identifier))
+        frame.offset = currentToken.offset;
+        frame.modifier = currentToken.type == TokenType::Var;
+        skip();
+        Token name = consume(TokenType::Identifier, MessageId::ExpectedVariableName);
+        if (failed())
+        {
+            finish(nullptr);
+            return;
+        }
+        frame.value = static_cast<std::uint32_t>(name.getValue<SymbolId>());
+        if (match(TokenType::Assign))
+        {
+            operand(ParseStep::DeclarationInitializer, Additive, true);
+            return;
+        }
+        finish(arena->make<DeclarationNode>(frame.modifier, SymbolId(frame.value), frame.offset));
+    };
+    // Statement = IdOrCallAssign | IfStatement | Declaration, “;” | ReturnStatement, “;”
+    //           | WhileStatement | Expression, “;” ; a missing one ends the block.
+    //
+    // One frame serves all the statements of a block, one after the other.
+    auto startStatement = [&]()
     {
-        Position startPos = currentToken.startPosition;
-        std::string id =
-            consume(TokenType::Identifier, "Expected an identification").getValue<std::string>();
-        return std::make_unique<IdentifierNode>(id, startPos);
-    }
-    if (check(TokenType::LParen))
+        Frame& frame = frames[depth - 1];
+        switch (currentToken.type)
+        {
+            // IfStatement = “if”, “(“, LogicalExpr, “)”, StatementBlock,
+            //               [“else”, StatementBlock] ;
+            case TokenType::If:
+                skip();
+                frame.offset = currentToken.offset;
+                expect(TokenType::LParen, MessageId::ExpectedLParen);
+                operand(ParseStep::IfCondition, Logical, false);
+                break;
+            // WhileStatement = “while”, “(“, LogicalExpr, “)”, StatementBlock ;
+            case TokenType::While:
+                frame.offset = currentToken.offset;
+                skip();
+                expect(TokenType::LParen, MessageId::ExpectedLParen);
+                operand(ParseStep::WhileCondition, Logical, false);
+                break;
+            // ReturnStatement = “return”, [ Expression ];
+            case TokenType::Return:
+                frame.offset = currentToken.offset;
+                skip();
+                operand(ParseStep::ReturnValue, Additive, true);
+                break;
+            case TokenType::Const:
+            case TokenType::Var:
+                frame.step = ParseStep::DeclarationEnd;
+                startDeclaration(push(ParseStep::Declaration, nullptr));
+                break;
+            // IdOrCallAssign = id, ( "=" Expression | CallArguments ), ";" ;
+            case TokenType::Identifier:
+            {
+                frame.value = static_cast<std::uint32_t>(std::get<SymbolId>(currentToken.value));
+                frame.offset = currentToken.offset;
+                skip();
+                if (match(TokenType::Assign))
+                {
+                    operand(ParseStep::AssignValue, Additive, true);
+                    break;
+                }
+                IdentifierNode* callee =
+                    arena->make<IdentifierNode>(SymbolId(frame.value), frame.offset);
+                callArguments(ParseStep::CallStatementEnd, callee);
+                break;
+            }
+            default:
+                operand(ParseStep::ExpressionStatementEnd, Additive, true);
+                break;
+        }
+    };
+    // Statements only occur in blocks: a finished one goes straight onto the block's scratch
+    // list, and its frame starts on the next.
+    auto endStatement = [&](StatementNode* node)
     {
-        consume(TokenType::LParen, "Expected '(' while parsing expression");
-        std::unique_ptr<ExpressionNode> expr = parseExpression();
-        consume(TokenType::RParen, "Expected ')' while parsing expression");
-        return expr;
-    }
-    if (auto funcLiteral = parseFunctionLiteral())
+        scratchStatements.push_back(node);
+        startStatement();
+    };
+    // StatementBlock = “[“, { Statement }, “]” ;
+    auto startBlock = [&](Frame& frame)
     {
-        return funcLiteral;
+        frame.step = ParseStep::BlockEnd;
+        expect(TokenType::LBracket, MessageId::ExpectedLBracket);
+        frame.offset = currentToken.offset;
+        frame.value = static_cast<std::uint32_t>(scratchStatements.size());
+        push(ParseStep::Statement, nullptr);
+        startStatement();
+    };
+    auto callBlock = [&](ParseStep next)
+    {
+        frames[depth - 1].step = next;
+        startBlock(push(ParseStep::Block, nullptr));
+    };
+
+    while (depth > base)
+    {
+        Frame& frame = frames[depth - 1];
+        switch (frame.step)
+        {
+            case ParseStep::Block:
+                startBlock(frame);
+                break;
+            case ParseStep::BlockEnd:
+            {
+                NodeList<StatementNode> statements = listOf(scratchStatements, frame.value);
+                expect(TokenType::RBracket, MessageId::ExpectedRBracket);
+                finish(arena->make<StatementBlockNode>(frame.offset, statements));
+                break;
+            }
+
+            case ParseStep::Statement:
+                startStatement();
+                break;
+            case ParseStep::IfCondition:
+                frame.first = shall(result, MessageId::ExpectedIfCondition);
+                expect(TokenType::RParen, MessageId::ExpectedRParen);
+                callBlock(ParseStep::IfThen);
+                break;
+            case ParseStep::IfThen:
+                frame.second = result;
+                if (match(TokenType::Else))
+                {
+                    callBlock(ParseStep::IfElse);
+                    break;
+                }
+                endStatement(arena->make<IfStatementNode>(frame.offset,
+                                                          as<ExpressionNode>(frame.first),
+                                                          as<StatementBlockNode>(frame.second)));
+                break;
+            case ParseStep::IfElse:
+                endStatement(arena->make<IfStatementNode>(
+                    frame.offset, as<ExpressionNode>(frame.first),
+                    as<StatementBlockNode>(frame.second), as<StatementBlockNode>(result)));
+                break;
+            case ParseStep::WhileCondition:
+                frame.first = shall(result, MessageId::ExpectedWhileCondition);
+                expect(TokenType::RParen, MessageId::ExpectedRParen);
+                callBlock(ParseStep::WhileBody);
+                break;
+            case ParseStep::WhileBody:
+                endStatement(arena->make<WhileStatementNode>(
+                    frame.offset, as<ExpressionNode>(frame.first), as<StatementBlockNode>(result)));
+                break;
+            case ParseStep::ReturnValue:
+            {
+                auto* node =
+                    arena->make<ReturnStatementNode>(frame.offset, as<ExpressionNode>(result));
+                expect(TokenType::Semicolon, MessageId::ExpectedSemicolonAfterReturn);
+                endStatement(node);
+                break;
+            }
+            case ParseStep::DeclarationEnd:
+                if (!result)
+                {
+                    finish(nullptr);
+                    break;
+                }
+                expect(TokenType::Semicolon, MessageId::ExpectedSemicolonAfterDeclaration);
+                endStatement(as<StatementNode>(result));
+                break;
+            case ParseStep::AssignValue:
+            {
+                auto* node = arena->make<AssignNode>(SymbolId(frame.value), frame.offset,
+                                                     as<ExpressionNode>(result));
+                expect(TokenType::Semicolon, MessageId::MissingSemicolonAfterAssign);
+                endStatement(node);
+                break;
+            }
+            case ParseStep::CallStatementEnd:
+            {
+                auto* node = arena->make<ExpressionStatementNode>(as<ExpressionNode>(result));
+                expect(TokenType::Semicolon, MessageId::MissingSemicolonAfterCall);
+                endStatement(node);
+                break;
+            }
+            case ParseStep::ExpressionStatementEnd:
+                if (!result)
+                {
+                    finish(nullptr);
+                    break;
+                }
+                expect(TokenType::Semicolon, MessageId::ExpectedSemicolon);
+                endStatement(arena->make<ExpressionStatementNode>(as<ExpressionNode>(result)));
+                break;
+
+            case ParseStep::Declaration:
+                startDeclaration(frame);
+                break;
+            case ParseStep::DeclarationInitializer:
+                finish(arena->make<DeclarationNode>(
+                    frame.modifier, SymbolId(frame.value), frame.offset,
+                    shall(as<ExpressionNode>(result), MessageId::ExpectedInitializer)));
+                break;
+
+            // Factor     = BaseFactor, { CallArguments } ;
+            // BaseFactor = Number | LiteralString | id | “(“, Expression, “)” | FunctionLiteral ;
+            //
+            // `operand` and `climb` take the single-token factors in place; a binary frame
+            // starts here only when its first one is parenthesized or a function literal.
+            // Either way the calls after it are taken at BinaryLeft.
+            case ParseStep::Factor:
+                if (match(TokenType::LParen))
+                {
+                    operand(ParseStep::ParenClose, Additive, true);
+                    break;
+                }
+                // FunctionLiteral = "fun", "(", [ Parameters ], ")", StatementBlock ;
+                frame.offset = currentToken.offset;
+                skip();
+                expect(TokenType::LParen, MessageId::ExpectedLParen);
+                frame.parameters = parseParameters();
+                expect(TokenType::RParen, MessageId::ExpectedRParen);
+                callBlock(ParseStep::FunctionLiteralBody);
+                break;
+            case ParseStep::FunctionLiteralBody:
+                result = arena->make<FunctionLiteralNode>(frame.offset, frame.parameters,
+                                                          as<StatementBlockNode>(result));
+                frame.step = ParseStep::BinaryLeft;
+                break;
+            case ParseStep::ParenClose:
+                expect(TokenType::RParen, MessageId::ExpectedRParenInExpression);
+                [[fallthrough]];
+            case ParseStep::BinaryLeft:
+                if (check(TokenType::LParen))
+                {
+                    callArguments(ParseStep::BinaryLeft, result);
+                    break;
+                }
+                climb(frame, as<ExpressionNode>(result));
+                break;
+            case ParseStep::BinaryRight:
+            {
+                const InfixRule& rule = infixRule(static_cast<TokenType>(frame.value));
+                ExpressionNode* right = shall(as<ExpressionNode>(result), rule.missingOperand);
+                climb(frame, arena->make<BinaryOpNode>(as<ExpressionNode>(frame.first), rule.op,
+                                                       right));
+                break;
+            }
+
+            // ArgumentList = Expression, { “,”, Expression } ;
+            case ParseStep::CallFirstArgument:
+                // A missing first argument is an empty list, unless a comma follows it.
+                if (!result)
+                {
+                    if (check(TokenType::Comma)) error(MessageId::ExpectedExpression);
+                    frame.step = ParseStep::CallArguments;
+                    break;
+                }
+                [[fallthrough]];
+            case ParseStep::CallArgument:
+                if (result)
+                    scratchArguments.push_back(as<ExpressionNode>(result));
+                else
+                    error(MessageId::ExpectedExpression);
+                [[fallthrough]];
+            case ParseStep::CallArguments:
+                if (match(TokenType::Comma))
+                {
+                    operand(ParseStep::CallArgument, Additive, true);
+                    break;
+                }
+                {
+                    NodeList<ExpressionNode> arguments = listOf(scratchArguments, frame.value);
+                    expect(TokenType::RParen, MessageId::ExpectedRParen);
+                    finish(arena->make<FunctionCallNode>(as<ExpressionNode>(frame.first),
+                                                         arguments));
+                }
+                break;
+        }
     }
-    return nullptr;
+    return result;
 }
-
-// FunctionLiteral = "fun", "(", [ Parameters ], ")", StatementBlock ;
-std::unique_ptr<FunctionLiteralNode> Parser::parseFunctionLiteral()
-{
-    if (!check(TokenType::Fun)) return nullptr;
-    Position startPos = currentToken.startPosition;
-    Token funToken = consume(TokenType::Fun, "Expected 'fun'");
-    Token lParenToken = consume(TokenType::LParen, "Expected '('");
-    std::vector<std::unique_ptr<FuncDefArgument>> parameters = parseParameters();
-    Token rParenToken = consume(TokenType::RParen, "Expected ')'");
-    std::unique_ptr<StatementBlockNode> body = parseStatementBlock();
-
-    return std::make_unique<FunctionLiteralNode>(startPos, std::move(parameters), std::move(body));
-}
\ No newline at end of file
@@ -0,0 +1,548 @@
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <variant>
+
+#include "registerCode.hpp"
+#include "staticVisitor.hpp"
+
+namespace
+{
+class Compiler : public StaticVisitor<Compiler>
+{
+   public:
+    explicit Compiler(RegisterProgram& program) : program(program) {}
+
+    void compile(ProgramNode& node)
+    {
+        program.lines = node.lines;
+        Function script;
+        script.proto = addFunction(&node);
+        current = &script;
+        dispatch(node);
+        emit(RegisterOp::Return, nothing(), 0, 0, node.getStartOffset());
+    }
+
+   private:
+    friend class StaticVisitor<Compiler>;
+
+    struct Local
+    {
+        SymbolId id;
+        bool constant;
+        std::uint16_t slot;
+        int scope;
+    };
+    struct Function
+    {
+        RegisterProto* proto = nullptr;
+        std::vector<Local> locals;
+        std::unordered_map<std::int32_t, std::uint16_t> integers;
+        int nothing = -1;
+        int scope = 0;
+        // Slots below nextLocal hold locals; temporaries are taken from nextFree up.
+        int nextLocal = 0;
+        int nextFree = 0;
+    };
+    // An RK operand, and the variable it reads when it is a local's slot.
+    struct Operand
+    {
+        std::uint16_t rk;
+        const IdentifierNode* name = nullptr;
+    };
+
+    RegisterProgram& program;
+    Function* current = nullptr;
+    int nesting = 0;
+    // The slot the expression being compiled leaves its value in.
+    std::uint16_t destination = 0;
+
+    bool atTopLevel() const { return current->proto == program.functions.front().get(); }
+
+    RegisterProto* addFunction(const AstNode* node)
+    {
+        program.functions.push_back(std::make_unique<RegisterProto>());
+        program.functions.back()->node = node;
+        return program.functions.back().get();
+    }
+
+    std::size_t emit(RegisterOp op, std::uint16_t a, std::uint16_t b, std::uint16_t c,
+                     SourceOffset at)
+    {
+        RegisterProto& proto = *current->proto;
+        proto.code.push_back(RegisterInstruction{op, a, b, c});
+        proto.offsets.push_back(at);
+        return proto.code.size() - 1;
+    }
+
+    // For the instructions taking a jump offset, a function, a constant or a symbol as bc.
+    std::size_t emitWide(RegisterOp op, std::uint16_t a, std::int32_t bc, SourceOffset at)
+    {
+        auto wide = static_cast<std::uint32_t>(bc);
+        return emit(op, a, static_cast<std::uint16_t>(wide), static_cast<std::uint16_t>(wide >> 16),
+                    at);
+    }
+
+    // Points the jump at `from` to `to`.
+    void jump(std::size_t from, std::size_t to)
+    {
+        auto offset = static_cast<std::uint32_t>(static_cast<std::int32_t>(to) -
+                                                 static_cast<std::int32_t>(from) - 1);
+        RegisterInstruction& instruction = current->proto->code[from];
+        instruction.b = static_cast<std::uint16_t>(offset);
+        instruction.c = static_cast<std::uint16_t>(offset >> 16);
+    }
+
+    void patch(std::size_t from) { jump(from, current->proto->code.size()); }
+
+    // Records that the last instruction reads `operand`'s variable.
+    void note(const Operand& operand)
+    {
+        if (!operand.name) return;
+        RegisterProto& proto = *current->proto;
+        proto.reads.push_back(NamedRead{static_cast<std::uint32_t>(proto.code.size() - 1),
+                                        operand.rk, operand.name->getSymbol(),
+                                        operand.name->getStartOffset()});
+    }
+
+    void enter(SourceOffset at)
+    {
+        if (++nesting > MAX_NESTING) runtimeError(MessageId::NestingTooDeep, at);
+    }
+
+    const Local* resolve(SymbolId id) const
+    {
+        for (auto local = current->locals.rbegin(); local != current->locals.rend(); ++local)
+        {
+            if (local->id == id) return &*local;
+        }
+        return nullptr;
+    }
+
+    std::uint16_t reserve(SourceOffset at)
+    {
+        if (current->nextFree >= CONSTANT) runtimeError(MessageId::TooManyVariables, at);
+        auto slot = static_cast<std::uint16_t>(current->nextFree++);
+        current->proto->slotCount =
+            static_cast<std::uint16_t>(std::max<int>(current->proto->slotCount, current->nextFree));
+        return slot;
+    }
+
+    // Makes the next slot a local; declarations compile their initializer into it first.
+    std::uint16_t addLocal(SymbolId id, bool constant, SourceOffset at)
+    {
+        if (current->nextFree == current->nextLocal) reserve(at);
+        auto slot = static_cast<std::uint16_t>(current->nextLocal++);
+        current->locals.push_back(Local{id, constant, slot, current->scope});
+        return slot;
+    }
+
+    std::int32_t addConstant(Value value)
+    {
+        current->proto->constants.push_back(std::move(value));
+        return static_cast<std::int32_t>(current->proto->constants.size() - 1);
+    }
+
+    std::int32_t integer(std::int32_t value)
+    {
+        auto found = current->integers.find(value);
+        if (found != current->integers.end()) return found->second;
+        std::int32_t index = addConstant(Value::integer(value));
+        if (index < CONSTANT) current->integers.emplace(value, static_cast<std::uint16_t>(index));
+        return index;
+    }
+
+    std::uint16_t nothing()
+    {
+        if (current->nothing < 0) current->nothing = addConstant(Value());
+        if (current->nothing < CONSTANT)
+            return static_cast<std::uint16_t>(current->nothing | CONSTANT);
+        std::uint16_t slot = reserve(0);
+        emit(RegisterOp::LoadNothing, slot, 0, 0, 0);
+        return slot;
+    }
+
+    // The literal's constant, unless it has to be reported when it runs.
+    std::optional<std::int32_t> literal(const ExpressionNode& node)
+    {
+        if (node.getKind() == NodeKind::NumberLiteral)
+        {
+            auto value = static_cast<const NumberLiteralNode&>(node).getValue();
+            if (auto* whole = std::get_if<int>(&value)) return integer(*whole);
+            return addConstant(Value::real(std::get<float>(value)));
+        }
+        if (node.getKind() == NodeKind::StringLiteral)
+        {
+            std::string_view text = static_cast<const StringLiteralNode&>(node).getValue();
+            if (text.size() <= Value::MAX_STRING_LENGTH) return addConstant(Value::string(text));
+        }
+        return std::nullopt;
+    }
+
+    const Local* local(const ExpressionNode& node) const
+    {
+        if (node.getKind() != NodeKind::Identifier) return nullptr;
+        return resolve(static_cast<const IdentifierNode&>(node).getSymbol());
+    }
+
+    // Whether an operand can be used where it is, so evaluating it cannot report anything or
+    // run anything.
+    bool inPlace(const ExpressionNode* node) const
+    {
+        if (!node) return true;
+        if (local(*node)) return true;
+        if (node->getKind() == NodeKind::NumberLiteral) return true;
+        return node->getKind() == NodeKind::StringLiteral &&
+               static_cast<const StringLiteralNode*>(node)->getValue().size() <=
+                   Value::MAX_STRING_LENGTH;
+    }
+
+    void expressionInto(ExpressionNode& node, std::uint16_t slot)
+    {
+        enter(node.getStartOffset());
+        std::uint16_t enclosing = destination;
+        destination = slot;
+        dispatch(node);
+        destination = enclosing;
+        --nesting;
+    }
+
+    // An absent initializer or return value is nothing.
+    void expressionInto(ExpressionNode* node, std::uint16_t slot, SourceOffset at)
+    {
+        if (!node)
+        {
+            emit(RegisterOp::LoadNothing, slot, 0, 0, at);
+            return;
+        }
+        expressionInto(*node, slot);
+    }
+
+    // Locals and literals are used where they are; anything else is computed into a temporary,
+    // which stays taken until the caller gives its temporaries back.
+    Operand operand(ExpressionNode* node, SourceOffset at)
+    {
+        if (!node) return Operand{nothing()};
+        if (inPlace(node))
+        {
+            enter(node->getStartOffset());
+            --nesting;
+            if (const Local* variable = local(*node))
+                return Operand{variable->slot, static_cast<const IdentifierNode*>(node)};
+            std::int32_t index = *literal(*node);
+            if (index < CONSTANT) return Operand{static_cast<std::uint16_t>(index | CONSTANT)};
+            std::uint16_t slot = reserve(at);
+            emitWide(RegisterOp::LoadConstant, slot, index, node->getStartOffset());
+            return Operand{slot};
+        }
+        std::uint16_t slot = reserve(at);
+        expressionInto(node, slot, at);
+        return Operand{slot};
+    }
+
+    std::int32_t compileFunction(const AstNode& node, NodeList<FuncDefArgument> parameters,
+                                 StatementBlockNode* body, std::vector<CaptureSlot> captures)
+    {
+        auto index = static_cast<std::int32_t>(program.functions.size());
+        Function function;
+        function.proto = addFunction(&node);
+        function.proto->parameterCount = static_cast<std::uint16_t>(parameters.size());
+        function.proto->captures = std::move(captures);
+
+        Function* enclosing = current;
+        current = &function;
+        for (FuncDefArgument* parameter : parameters)
+            addLocal(parameter->id, !parameter->modifier, node.getStartOffset());
+        for (const CaptureSlot& capture : function.proto->captures)
+            addLocal(capture.id, capture.constant, node.getStartOffset());
+        if (body) dispatch(*body);
+        emit(RegisterOp::Return, nothing(), 0, 0, node.getStartOffset());
+        current = enclosing;
+        return index;
+    }
+
+    void visit(NumberLiteralNode& node)
+    {
+        emitWide(RegisterOp::LoadConstant, destination, *literal(node), node.getStartOffset());
+    }
+
+    void visit(StringLiteralNode& node)
+    {
+        if (std::optional<std::int32_t> index = literal(node))
+        {
+            emitWide(RegisterOp::LoadConstant, destination, *index, node.getStartOffset());
+            return;
+        }
+        emitWide(RegisterOp::Raise, static_cast<std::uint16_t>(MessageId::StringTooLong), NO_NAME,
+                 node.getStartOffset());
+    }
+
+    void visit(IdentifierNode& node)
+    {
+        if (const Local* variable = resolve(node.getSymbol()))
+        {
+            emit(RegisterOp::Move, destination, variable->slot, 0, node.getStartOffset());
+            note(Operand{variable->slot, &node});
+            return;
+        }
+        emitWide(RegisterOp::LoadGlobal, destination, static_cast<std::int32_t>(node.getSymbol()),
+                 node.getStartOffset());
+    }
+
+    void visit(BinaryOpNode& node)
+    {
+        std::uint16_t target = destination;
+        int mark = current->nextFree;
+        BinOperator op = node.getBinOp();
+        if (op == BinOperator::And || op == BinOperator::Or)
+        {
+            // A local keeps its value until the result is known, as the right operand may read it.
+            std::uint16_t result = target < current->nextLocal ? reserve(node.getStartOffset())
+                                                               : target;
+            expressionInto(node.left, result, node.getStartOffset());
+            std::size_t skip = emitWide(op == BinOperator::And ? RegisterOp::JumpIfFalse
+                                                               : RegisterOp::JumpIfTrue,
+                                        result, 0, node.getStartOffset());
+            SourceOffset rightAt =
+                node.right ? node.right->getStartOffset() : node.getStartOffset();
+            expressionInto(node.right, result, rightAt);
+            emit(RegisterOp::CheckBool, result, 0, 0, rightAt);
+            patch(skip);
+            if (result != target) emit(RegisterOp::Move, target, result, 0, node.getStartOffset());
+            current->nextFree = mark;
+            return;
+        }
+
+        Operand left = operand(node.left, node.getStartOffset());
+        if (left.name && !inPlace(node.right))
+        {
+            // Reading the variable is reported before anything the right operand does.
+            std::uint16_t copy = reserve(node.getStartOffset());
+            emit(RegisterOp::Move, copy, left.rk, 0, node.getStartOffset());
+            note(left);
+            left = Operand{copy};
+        }
+        Operand right = operand(node.right, node.getStartOffset());
+        auto code =
+            static_cast<RegisterOp>(static_cast<int>(RegisterOp::Add) + static_cast<int>(op));
+        emit(code, target, left.rk, right.rk, node.getStartOffset());
+        note(left);
+        note(right);
+        current->nextFree = mark;
+    }
+
+    void visit(TypeCastNode& node)
+    {
+        std::uint16_t target = destination;
+        int mark = current->nextFree;
+        Operand value = operand(node.expression, node.getStartOffset());
+        emit(RegisterOp::Cast, target, value.rk, static_cast<std::uint16_t>(node.getTargetType()),
+             node.getStartOffset());
+        note(value);
+        current->nextFree = mark;
+    }
+
+    void visit(FunctionCallNode& node)
+    {
+        std::uint16_t target = destination;
+        int mark = current->nextFree;
+        // A temporary on top of the others can take the callee and the result itself.
+        std::uint16_t callee = target >= current->nextLocal && target + 1 == current->nextFree
+                                   ? target
+                                   : reserve(node.getStartOffset());
+        expressionInto(node.callee, callee, node.getStartOffset());
+        for (ExpressionNode* argument : node.arguments)
+            expressionInto(*argument, reserve(node.getStartOffset()));
+        emit(RegisterOp::Call, callee, static_cast<std::uint16_t>(node.arguments.size()), 0,
+             node.getStartOffset());
+        if (callee != target) emit(RegisterOp::Move, target, callee, 0, node.getStartOffset());
+        current->nextFree = mark;
+    }
+
+    void visit(ExpressionStatementNode& node)
+    {
+        expressionInto(node.expression, reserve(node.getStartOffset()), 0);
+    }
+
+    void visit(StatementBlockNode& node)
+    {
+        enter(node.getStartOffset());
+        ++current->scope;
+        int firstLocal = current->nextLocal;
+        for (StatementNode* statement : node.statements)
+        {
+            if (statement) dispatch(*statement);
+            current->nextFree = current->nextLocal;
+        }
+        while (!current->locals.empty() && current->locals.back().scope == current->scope)
+            current->locals.pop_back();
+        current->nextLocal = current->nextFree = firstLocal;
+        --current->scope;
+        --nesting;
+    }
+
+    void visit(FunctionDeclarationNode& node)
+    {
+        std::int32_t function = compileFunction(node, node.params, node.body, {});
+        std::uint16_t slot = reserve(node.getStartOffset());
+        emitWide(RegisterOp::Closure, slot, function, node.getStartOffset());
+        emitWide(RegisterOp::DefineConstant, slot, static_cast<std::int32_t>(node.getSymbol()),
+                 node.getStartOffset());
+    }
+
+    void visit(FunctionLiteralNode& node)
+    {
+        std::uint16_t target = destination;
+        std::vector<CaptureSlot> captures;
+        // Literals at the top level see the globals like declared functions do.
+        if (!atTopLevel() && node.body)
+        {
+            for (SymbolId id : namesUsedIn(*node.body))
+            {
+                bool parameter = std::any_of(node.parameters.begin(), node.parameters.end(),
+                                             [id](FuncDefArgument* p) { return p->id == id; });
+                const Local* variable = resolve(id);
+                if (!parameter && variable)
+                    captures.push_back(CaptureSlot{id, variable->constant, variable->slot});
+            }
+        }
+        std::int32_t function =
+            compileFunction(node, node.parameters, node.body, std::move(captures));
+        emitWide(RegisterOp::Closure, target, function, node.getStartOffset());
+    }
+
+    void visit(IfStatementNode& node)
+    {
+        SourceOffset conditionAt =
+            node.condition ? node.condition->getStartOffset() : node.getStartOffset();
+        Operand condition = operand(node.condition, conditionAt);
+        std::size_t skipThen = emitWide(RegisterOp::JumpIfFalse, condition.rk, 0, conditionAt);
+        note(condition);
+        current->nextFree = current->nextLocal;
+        if (node.thenBlock) dispatch(*node.thenBlock);
+        if (!node.elseBlock)
+        {
+            patch(skipThen);
+            return;
+        }
+        std::size_t skipElse = emitWide(RegisterOp::Jump, 0, 0, node.getStartOffset());
+        patch(skipThen);
+        dispatch(*node.elseBlock);
+        patch(skipElse);
+    }
+
+    void visit(DeclarationNode& node)
+    {
+        SymbolId id = node.getIdentifier();
+        bool constant = !node.getModifier();
+        if (atTopLevel())
+        {
+            Operand value = operand(node.initializer, node.getStartOffset());
+            emitWide(constant ? RegisterOp::DefineConstant : RegisterOp::DefineGlobal, value.rk,
+                     static_cast<std::int32_t>(id), node.getStartOffset());
+            note(value);
+            return;
+        }
+        const Local* previous = resolve(id);
+        bool redeclared = previous && previous->scope == current->scope;
+        // The initializer still sees what the name meant before.
+        std::uint16_t slot = reserve(node.getStartOffset());
+        expressionInto(node.initializer, slot, node.getStartOffset());
+        if (redeclared)
+        {
+            emitWide(RegisterOp::Raise, static_cast<std::uint16_t>(MessageId::AlreadyDeclared),
+                     static_cast<std::int32_t>(id), node.getStartOffset());
+        }
+        current->nextFree = slot + 1;
+        addLocal(id, constant, node.getStartOffset());
+    }
+
+    void visit(ReturnStatementNode& node)
+    {
+        Operand value = operand(node.returnValue, node.getStartOffset());
+        emit(RegisterOp::Return, value.rk, 0, 0, node.getStartOffset());
+        note(value);
+    }
+
+    void visit(AssignNode& node)
+    {
+        SymbolId id = node.getIdentifier();
+        auto name = static_cast<std::int32_t>(id);
+        const Local* variable = resolve(id);
+        if (!variable)
+        {
+            Operand value = operand(node.expression, node.getStartOffset());
+            emitWide(RegisterOp::StoreGlobal, value.rk, name, node.getStartOffset());
+            note(value);
+            return;
+        }
+        if (variable->constant)
+        {
+            expressionInto(node.expression, reserve(node.getStartOffset()), node.getStartOffset());
+            emitWide(RegisterOp::Raise, static_cast<std::uint16_t>(MessageId::AssignToConstant),
+                     name, node.getStartOffset());
+            return;
+        }
+        expressionInto(node.expression, variable->slot, node.getStartOffset());
+    }
+
+    void visit(WhileStatementNode& node)
+    {
+        SourceOffset conditionAt =
+            node.condition ? node.condition->getStartOffset() : node.getStartOffset();
+        std::size_t start = current->proto->code.size();
+        Operand condition = operand(node.condition, conditionAt);
+        std::size_t exit = emitWide(RegisterOp::JumpIfFalse, condition.rk, 0, conditionAt);
+        note(condition);
+        current->nextFree = current->nextLocal;
+        if (node.body) dispatch(*node.body);
+        jump(emitWide(RegisterOp::Jump, 0, 0, node.getStartOffset()), start);
+        patch(exit);
+    }
+
+    void visit(ProgramNode& node)
+    {
+        // Functions first, so that initializers can call any of them.
+        for (AstNode* declaration : node.declarations)
+        {
+            if (declaration && declaration->getKind() == NodeKind::FunctionDeclaration)
+                dispatch(*declaration);
+            current->nextFree = 0;
+        }
+        for (AstNode* declaration : node.declarations)
+        {
+            if (declaration && declaration->getKind() != NodeKind::FunctionDeclaration)
+                dispatch(*declaration);
+            current->nextFree = 0;
+        }
+    }
+};
+
+}  // namespace
+
+const NamedRead* RegisterProto::readOf(std::size_t instruction, std::uint16_t slot) const
+{
+    auto first = std::lower_bound(reads.begin(), reads.end(), instruction,
+                                  [](const NamedRead& read, std::size_t index)
+                                  { return read.instruction < index; });
+    for (auto read = first; read != reads.end() && read->instruction == instruction; ++read)
+    {
+        if (read->slot == slot) return &*read;
+    }
+    return nullptr;
+}
+
+RegisterProgram compileRegisters(ProgramNode& program)
+{
+    RegisterProgram compiled;
+    try
+    {
+        Compiler(compiled).compile(program);
+    }
+    catch (InterpreterException& e)
+    {
+        if (!e.error.lines) e.error.lines = program.lines;
+        throw;
+    }
+    return compiled;
+}
@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "dispatch.hpp"
+#include "interpreter_exception.hpp"
+#include "registerVm.hpp"
+
+namespace
+{
+// Slots and frames the stacks start with; deeper programs grow them.
+constexpr std::size_t INITIAL_STACK = 1 << 14;
+constexpr std::size_t INITIAL_FRAMES = 1 << 10;
+
+// The common case of arithmetic on two ints. Anything else, overflow included, is left to
+// binaryOperation.
+template <typename Compute>
+bool integers(Value& result, const Value& left, const Value& right, Compute compute)
+{
+    if (!left.is(Value::Type::Int) || !right.is(Value::Type::Int)) return false;
+    std::int64_t value = compute(left.asInt(), right.asInt());
+    if (value < INT32_MIN || value > INT32_MAX) return false;
+    result = Value::integer(static_cast<std::int32_t>(value));
+    return true;
+}
+
+template <typename Compare>
+bool comparison(Value& result, const Value& left, const Value& right, Compare compare)
+{
+    if (!left.is(Value::Type::Int) || !right.is(Value::Type::Int)) return false;
+    result = Value::boolean(compare(left.asInt(), right.asInt()));
+    return true;
+}
+
+}  // namespace
+
+Value RegisterVm::run(const RegisterProgram& compiled)
+{
+    program = &compiled;
+    executed = 0;
+    SymbolId mainName = intern("main");
+    stack.clear();
+    stack.resize(INITIAL_STACK);
+    frames.clear();
+    frames.reserve(INITIAL_FRAMES);
+
+    try
+    {
+        globals.reset();
+
+        // The top level runs as a call with no callee below it.
+        const RegisterProto& script = *compiled.functions.front();
+        stack.resize(std::max(stack.size(), std::size_t{1} + script.slotCount));
+        frames.push_back(Frame{&script, script.code.data(), 1, 0, 0});
+        execute(0);
+
+        Globals::Entry& entry = globals[mainName];
+        if (!entry.defined || !entry.value.is(Value::Type::Function))
+        {
+            stack[0] = Value();
+            return Value();
+        }
+        stack[0] = entry.value;
+        top = 1;
+        call(0, 0, 0, script.node->getStartOffset());
+        if (!frames.empty()) execute(0);
+        return std::move(stack[0]);
+    }
+    catch (InterpreterException& e)
+    {
+        if (!e.error.lines) e.error.lines = compiled.lines;
+        throw;
+    }
+}
+
+void RegisterVm::execute(std::size_t depth)
+{
+    Frame* frame = &frames.back();
+    const RegisterProto* proto = frame->proto;
+    const RegisterInstruction* ip = frame->ip;
+    Value* slots = stack.data() + frame->base;
+    const Value* constants = proto->constants.data();
+    std::uint64_t count = 0;
+
+    // Index of the instruction being run.
+    auto current = [&]() { return static_cast<std::size_t>(ip - 1 - proto->code.data()); };
+    auto at = [&]() { return proto->offsets[current()]; };
+    // Picks up the innermost frame again after a call or a return changed it.
+    auto resume = [&]()
+    {
+        frame = &frames.back();
+        proto = frame->proto;
+        ip = frame->ip;
+        slots = stack.data() + frame->base;
+        constants = proto->constants.data();
+    };
+    auto operand = [&](std::uint16_t rk) -> const Value&
+    { return rk & CONSTANT ? constants[rk & ~CONSTANT] : slots[rk]; };
+    // Nothing in a variable's slot means the variable has no value, which reading it reports.
+    auto value = [&](std::uint16_t rk) -> const Value&
+    {
+        const Value& read = operand(rk);
+        if (read.is(Value::Type::Nothing))
+        {
+            if (const NamedRead* variable = proto->readOf(current(), rk))
+                runtimeError(MessageId::NoValue, variable->at, symbolName(variable->id));
+        }
+        return read;
+    };
+    auto binary = [&](BinOperator op, const RegisterInstruction& instruction)
+    {
+        const Value& left = value(instruction.b);
+        const Value& right = value(instruction.c);
+        slots[instruction.a] = binaryOperation(op, left, right, at());
+    };
+    auto arithmetic = [&](BinOperator op, const RegisterInstruction& instruction, auto compute)
+    {
+        if (!integers(slots[instruction.a], operand(instruction.b), operand(instruction.c),
+                      compute))
+            binary(op, instruction);
+    };
+    auto compare = [&](BinOperator op, const RegisterInstruction& instruction, auto test)
+    {
+        if (!comparison(slots[instruction.a], operand(instruction.b), operand(instruction.c),
+                        test))
+            binary(op, instruction);
+    };
+    auto condition = [&](std::uint16_t rk)
+    {
+        const Value& read = value(rk);
+        if (!read.is(Value::Type::Bool)) isTrue(read, at());
+        return read.asBool();
+    };
+
+    const RegisterInstruction* instruction = ip;
+    auto fetch = [&]()
+    {
+        instruction = ip++;
+        ++count;
+        return instruction->op;
+    };
+#ifdef BIBL_COMPUTED_GOTO
+    static const void* const handlers[] = {
+        DISPATCH_LABEL(Move), DISPATCH_LABEL(LoadConstant), DISPATCH_LABEL(LoadNothing),
+        DISPATCH_LABEL(LoadGlobal), DISPATCH_LABEL(StoreGlobal), DISPATCH_LABEL(DefineGlobal),
+        DISPATCH_LABEL(DefineConstant), DISPATCH_LABEL(Add), DISPATCH_LABEL(Subtract),
+        DISPATCH_LABEL(Multiply), DISPATCH_LABEL(Divide), DISPATCH_LABEL(Equal),
+        DISPATCH_LABEL(NotEqual), DISPATCH_LABEL(Greater), DISPATCH_LABEL(GreaterEqual),
+        DISPATCH_LABEL(Less), DISPATCH_LABEL(LessEqual), DISPATCH_LABEL(Compose),
+        DISPATCH_LABEL(Decorate), DISPATCH_LABEL(Cast), DISPATCH_LABEL(Jump),
+        DISPATCH_LABEL(JumpIfFalse), DISPATCH_LABEL(JumpIfTrue), DISPATCH_LABEL(CheckBool),
+        DISPATCH_LABEL(Closure), DISPATCH_LABEL(Call), DISPATCH_LABEL(Return),
+        DISPATCH_LABEL(Raise)};
+    static_assert(sizeof(handlers) / sizeof(*handlers) ==
+                      static_cast<std::size_t>(RegisterOp::Raise) + 1,
+                  "every opcode needs a handler");
+#endif
+
+    DISPATCH_LOOP
+    {
+        DISPATCH_CASE(RegisterOp, Move)
+            slots[instruction->a] = value(instruction->b);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, LoadConstant)
+            slots[instruction->a] = constants[instruction->bc()];
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, LoadNothing)
+            slots[instruction->a] = Value();
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, LoadGlobal)
+        {
+            auto id = SymbolId(instruction->bc());
+            Globals::Entry& slot = globals[id];
+            if (!slot.defined)
+                runtimeError(MessageId::UndefinedIdentifier, at(), symbolName(id));
+            if (slot.value.is(Value::Type::Nothing))
+                runtimeError(MessageId::NoValue, at(), symbolName(id));
+            slots[instruction->a] = slot.value;
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(RegisterOp, StoreGlobal)
+        {
+            auto id = SymbolId(instruction->bc());
+            Globals::Entry& slot = globals[id];
+            const Value& stored = value(instruction->a);
+            if (!slot.defined)
+                runtimeError(MessageId::UndefinedIdentifier, at(), symbolName(id));
+            if (slot.constant) runtimeError(MessageId::AssignToConstant, at(), symbolName(id));
+            slot.value = stored;
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(RegisterOp, DefineGlobal)
+        DISPATCH_CASE(RegisterOp, DefineConstant)
+        {
+            auto id = SymbolId(instruction->bc());
+            Globals::Entry& slot = globals[id];
+            const Value& stored = value(instruction->a);
+            if (slot.defined) runtimeError(MessageId::AlreadyDeclared, at(), symbolName(id));
+            slot.value = stored;
+            slot.defined = true;
+            slot.constant = instruction->op == RegisterOp::DefineConstant;
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(RegisterOp, Add)
+            arithmetic(BinOperator::Plus, *instruction,
+                       [](std::int64_t l, std::int64_t r) { return l + r; });
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Subtract)
+            arithmetic(BinOperator::Minus, *instruction,
+                       [](std::int64_t l, std::int64_t r) { return l - r; });
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Multiply)
+            arithmetic(BinOperator::Star, *instruction,
+                       [](std::int64_t l, std::int64_t r) { return l * r; });
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Divide)
+        {
+            // A zero divisor goes the slow way, to be reported.
+            const Value& divisor = operand(instruction->c);
+            if (divisor.is(Value::Type::Int) && divisor.asInt() == 0)
+                binary(BinOperator::Slash, *instruction);
+            else
+                arithmetic(BinOperator::Slash, *instruction,
+                           [](std::int64_t l, std::int64_t r) { return l / r; });
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(RegisterOp, Equal)
+            compare(BinOperator::Equal, *instruction,
+                    [](std::int32_t l, std::int32_t r) { return l == r; });
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, NotEqual)
+            compare(BinOperator::NotEqual, *instruction,
+                    [](std::int32_t l, std::int32_t r) { return l != r; });
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Greater)
+            compare(BinOperator::Greater, *instruction,
+                    [](std::int32_t l, std::int32_t r) { return l > r; });
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, GreaterEqual)
+            compare(BinOperator::GreaterEqual, *instruction,
+                    [](std::int32_t l, std::int32_t r) { return l >= r; });
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Less)
+            compare(BinOperator::Less, *instruction,
+                    [](std::int32_t l, std::int32_t r) { return l < r; });
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, LessEqual)
+            compare(BinOperator::LessEqual, *instruction,
+                    [](std::int32_t l, std::int32_t r) { return l <= r; });
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Compose)
+            binary(BinOperator::Pipe, *instruction);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Decorate)
+            binary(BinOperator::AtAt, *instruction);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Cast)
+            slots[instruction->a] =
+                castValue(value(instruction->b), static_cast<CastType>(instruction->c), at());
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Jump)
+            ip += instruction->bc();
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, JumpIfFalse)
+            if (!condition(instruction->a)) ip += instruction->bc();
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, JumpIfTrue)
+            if (condition(instruction->a)) ip += instruction->bc();
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, CheckBool)
+            condition(instruction->a);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(RegisterOp, Closure)
+        {
+            const RegisterProto& function =
+                *program->functions[static_cast<std::size_t>(instruction->bc())];
+            auto* object = new FunctionObject{};
+            Value made = Value::function(object);
+            object->kind = FunctionObject::Kind::Script;
+            object->node = function.node;
+            object->registerProto = &function;
+            object->captures.reserve(function.captures.size());
+            for (const CaptureSlot& capture : function.captures)
+                object->captures.push_back(
+                    Capture{capture.id, capture.constant, slots[capture.from]});
+            slots[instruction->a] = std::move(made);
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(RegisterOp, Call)
+        {
+            frame->ip = ip;
+            std::size_t callee = frame->base + instruction->a;
+            top = callee + 1 + instruction->b;
+            call(callee, instruction->b, 0, at());
+            resume();
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(RegisterOp, Return)
+        {
+            Value returned = value(instruction->a);
+            for (Value* slot = slots; slot != slots + proto->slotCount; ++slot) *slot = Value();
+            std::size_t callee = frame->base - 1;
+            int pending = frame->pending;
+            SourceOffset callAt = frame->at;
+            frames.pop_back();
+            stack[callee] = std::move(returned);
+            top = callee + 1;
+            if (pending > 0) call(callee - 1, 1, pending - 1, callAt);
+            if (frames.size() == depth)
+            {
+                executed += count;
+                return;
+            }
+            resume();
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(RegisterOp, Raise)
+            runtimeError(static_cast<MessageId>(instruction->a), at(),
+                         instruction->bc() == NO_NAME
+                             ? std::string()
+                             : symbolName(SymbolId(instruction->bc())));
+    }
+}
+
+void RegisterVm::call(std::size_t callee, std::size_t count, int pending, SourceOffset at)
+{
+    FunctionObject* function = unfoldCall(stack, top, callee, count, pending, out, at);
+    if (!function) return;
+
+    const RegisterProto& proto = *function->registerProto;
+    if (count != proto.parameterCount) wrongArgumentCount(proto.parameterCount, count, at);
+    std::size_t base = callee + 1;
+    if ((frames.size() + 1) * sizeof(Frame) + (base + proto.slotCount) * sizeof(Value) >
+        MAX_VM_STACK_BYTES)
+        runtimeError(MessageId::RecursionTooDeep, at);
+    if (base + proto.slotCount > stack.size())
+        stack.resize(std::max(stack.size() * 2, base + proto.slotCount));
+    for (const Capture& capture : function->captures) stack[top++] = capture.value;
+    frames.push_back(Frame{&proto, proto.code.data(), base, pending, at});
+}
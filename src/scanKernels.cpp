@@ -0,0 +1,296 @@
+#include "scanKernels.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BIBL_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+using Scanner = const char* (*)(const char*, const char*);
+
+struct Kernels
+{
+    ScanKernel kind;
+    Scanner skipBlanks;
+    Scanner skipIdentifierChars;
+    Scanner findLineEnd;
+    Scanner findStringStop;
+    Scanner skipAscii;
+};
+
+const char* scalarSkipBlanks(const char* p, const char* end)
+{
+    while (p != end && isAsciiBlank(*p)) ++p;
+    return p;
+}
+
+const char* scalarSkipIdentifierChars(const char* p, const char* end)
+{
+    while (p != end && isIdentifierChar(*p)) ++p;
+    return p;
+}
+
+const char* scalarFindLineEnd(const char* p, const char* end)
+{
+    while (p != end && *p != '\n') ++p;
+    return p;
+}
+
+const char* scalarFindStringStop(const char* p, const char* end)
+{
+    while (p != end && *p != '"' && *p != '\\' && *p != '\n') ++p;
+    return p;
+}
+
+const char* scalarSkipAscii(const char* p, const char* end)
+{
+    while (p != end && static_cast<unsigned char>(*p) < 0x80) ++p;
+    return p;
+}
+
+#ifdef BIBL_X86_KERNELS
+
+// Byte lanes of x that fall into [low, low + span] as unsigned values.
+inline __m128i inRange(__m128i x, char low, char span)
+{
+    __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_subs_epu8(shifted, _mm_set1_epi8(span)), _mm_setzero_si128());
+}
+
+inline __m128i blankLanes(__m128i x)
+{
+    // '\t' .. '\r' without '\n', plus ' '.
+    __m128i control = _mm_andnot_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')),
+                                       inRange(x, '\t', '\r' - '\t'));
+    return _mm_or_si128(control, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+
+inline __m128i identifierLanes(__m128i x)
+{
+    __m128i alpha = inRange(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z' - 'a');
+    __m128i digit = inRange(x, '0', 9);
+    __m128i underscore = _mm_cmpeq_epi8(x, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), underscore);
+}
+
+inline __m128i newlineLanes(__m128i x)
+{
+    return _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'));
+}
+
+inline __m128i stringStopLanes(__m128i x)
+{
+    __m128i quote = _mm_cmpeq_epi8(x, _mm_set1_epi8('"'));
+    __m128i backslash = _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'));
+    return _mm_or_si128(_mm_or_si128(quote, backslash), newlineLanes(x));
+}
+
+// movemask already collects the top bit of every byte.
+inline __m128i nonAsciiLanes(__m128i x)
+{
+    return x;
+}
+
+// Advances 16 bytes at a time while every lane matches (or, with Stop, while none does).
+template <bool Stop, __m128i (*Lanes)(__m128i), Scanner Tail>
+const char* sse2Scan(const char* p, const char* end)
+{
+    while (end - p >= 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(Lanes(x)));
+        if (!Stop) mask = ~mask & 0xFFFFu;
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return Tail(p, end);
+}
+
+__attribute__((target("avx2"))) inline __m256i inRange256(__m256i x, char low, char span)
+{
+    __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_subs_epu8(shifted, _mm256_set1_epi8(span)),
+                             _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2"))) inline __m256i blankLanes256(__m256i x)
+{
+    __m256i control = _mm256_andnot_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')),
+                                          inRange256(x, '\t', '\r' - '\t'));
+    return _mm256_or_si256(control, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2"))) inline __m256i identifierLanes256(__m256i x)
+{
+    __m256i alpha = inRange256(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z' - 'a');
+    __m256i digit = inRange256(x, '0', 9);
+    __m256i underscore = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), underscore);
+}
+
+__attribute__((target("avx2"))) inline __m256i newlineLanes256(__m256i x)
+{
+    return _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n'));
+}
+
+__attribute__((target("avx2"))) inline __m256i stringStopLanes256(__m256i x)
+{
+    __m256i quote = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"'));
+    __m256i backslash = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'));
+    return _mm256_or_si256(_mm256_or_si256(quote, backslash), newlineLanes256(x));
+}
+
+__attribute__((target("avx2"))) inline __m256i nonAsciiLanes256(__m256i x)
+{
+    return x;
+}
+
+// 32-byte blocks first; the remainder goes through the 16-byte kernel.
+template <bool Stop, __m256i (*Lanes)(__m256i), Scanner Tail>
+__attribute__((target("avx2"))) const char* avx2Scan(const char* p, const char* end)
+{
+    while (end - p >= 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(Lanes(x)));
+        if (!Stop) mask = ~mask;
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return Tail(p, end);
+}
+
+const char* sse2SkipBlanks(const char* p, const char* end)
+{
+    return sse2Scan<false, blankLanes, scalarSkipBlanks>(p, end);
+}
+
+const char* sse2SkipIdentifierChars(const char* p, const char* end)
+{
+    return sse2Scan<false, identifierLanes, scalarSkipIdentifierChars>(p, end);
+}
+
+const char* sse2FindLineEnd(const char* p, const char* end)
+{
+    return sse2Scan<true, newlineLanes, scalarFindLineEnd>(p, end);
+}
+
+const char* sse2FindStringStop(const char* p, const char* end)
+{
+    return sse2Scan<true, stringStopLanes, scalarFindStringStop>(p, end);
+}
+
+const char* sse2SkipAscii(const char* p, const char* end)
+{
+    return sse2Scan<true, nonAsciiLanes, scalarSkipAscii>(p, end);
+}
+
+__attribute__((target("avx2"))) const char* avx2SkipBlanks(const char* p, const char* end)
+{
+    return avx2Scan<false, blankLanes256, sse2SkipBlanks>(p, end);
+}
+
+__attribute__((target("avx2"))) const char* avx2SkipIdentifierChars(const char* p,
+                                                                    const char* end)
+{
+    return avx2Scan<false, identifierLanes256, sse2SkipIdentifierChars>(p, end);
+}
+
+__attribute__((target("avx2"))) const char* avx2FindLineEnd(const char* p, const char* end)
+{
+    return avx2Scan<true, newlineLanes256, sse2FindLineEnd>(p, end);
+}
+
+__attribute__((target("avx2"))) const char* avx2FindStringStop(const char* p, const char* end)
+{
+    return avx2Scan<true, stringStopLanes256, sse2FindStringStop>(p, end);
+}
+
+__attribute__((target("avx2"))) const char* avx2SkipAscii(const char* p, const char* end)
+{
+    return avx2Scan<true, nonAsciiLanes256, sse2SkipAscii>(p, end);
+}
+
+#endif
+
+constexpr Kernels scalarKernels = {ScanKernel::Scalar,        scalarSkipBlanks,
+                                   scalarSkipIdentifierChars, scalarFindLineEnd,
+                                   scalarFindStringStop,      scalarSkipAscii};
+
+#ifdef BIBL_X86_KERNELS
+constexpr Kernels sse2Kernels = {ScanKernel::Sse2,   sse2SkipBlanks,     sse2SkipIdentifierChars,
+                                 sse2FindLineEnd,  sse2FindStringStop, sse2SkipAscii};
+constexpr Kernels avx2Kernels = {ScanKernel::Avx2,   avx2SkipBlanks,     avx2SkipIdentifierChars,
+                                 avx2FindLineEnd,  avx2FindStringStop, avx2SkipAscii};
+#endif
+
+const Kernels& kernelsFor(ScanKernel kernel)
+{
+#ifdef BIBL_X86_KERNELS
+    if (kernel == ScanKernel::Avx2 && scanKernelSupported(ScanKernel::Avx2)) return avx2Kernels;
+    if (kernel != ScanKernel::Scalar && scanKernelSupported(ScanKernel::Sse2)) return sse2Kernels;
+#endif
+    (void)kernel;
+    return scalarKernels;
+}
+
+const Kernels*& activeKernels()
+{
+    static const Kernels* active = &kernelsFor(ScanKernel::Avx2);
+    return active;
+}
+
+}  // namespace
+
+const char* skipBlanks(const char* p, const char* end)
+{
+    return activeKernels()->skipBlanks(p, end);
+}
+
+const char* skipIdentifierChars(const char* p, const char* end)
+{
+    return activeKernels()->skipIdentifierChars(p, end);
+}
+
+const char* findLineEnd(const char* p, const char* end)
+{
+    return activeKernels()->findLineEnd(p, end);
+}
+
+const char* findStringStop(const char* p, const char* end)
+{
+    return activeKernels()->findStringStop(p, end);
+}
+
+const char* skipAscii(const char* p, const char* end)
+{
+    return activeKernels()->skipAscii(p, end);
+}
+
+ScanKernel activeScanKernel()
+{
+    return activeKernels()->kind;
+}
+
+bool scanKernelSupported(ScanKernel kernel)
+{
+    switch (kernel)
+    {
+        case ScanKernel::Scalar:
+            return true;
+#ifdef BIBL_X86_KERNELS
+        case ScanKernel::Sse2:
+            return __builtin_cpu_supports("sse2");
+        case ScanKernel::Avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+void useScanKernel(ScanKernel kernel)
+{
+    activeKernels() = &kernelsFor(kernel);
+}
@@ -0,0 +1,131 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sourceBuffer.hpp"
+
+namespace
+{
+constexpr std::size_t READ_CHUNK = 1 << 16;
+
+class FileDescriptor
+{
+   public:
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    ~FileDescriptor()
+    {
+        if (fd >= 0) ::close(fd);
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int fd;
+};
+
+std::string readAll(int fd, std::size_t sizeHint)
+{
+    std::string text;
+    text.reserve(sizeHint);
+    std::size_t used = 0;
+    while (true)
+    {
+        if (text.size() - used < READ_CHUNK) text.resize(used + READ_CHUNK);
+        ssize_t got = ::read(fd, text.data() + used, text.size() - used);
+        if (got < 0)
+        {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Failed to read file: ") + std::strerror(errno));
+        }
+        if (got == 0) break;
+        used += static_cast<std::size_t>(got);
+    }
+    text.resize(used);
+    return text;
+}
+
+}  // namespace
+
+SourceBuffer SourceBuffer::fromFile(const std::string& path)
+{
+    FileDescriptor file(::open(path.c_str(), O_RDONLY));
+    if (file.fd < 0)
+        throw std::runtime_error("Failed to open file " + path + ": " + std::strerror(errno));
+
+    struct stat info;
+    std::size_t size = 0;
+    if (::fstat(file.fd, &info) == 0 && S_ISREG(info.st_mode))
+    {
+        size = static_cast<std::size_t>(info.st_size);
+        if (size > 0)
+        {
+            void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                ::madvise(mapping, size, MADV_SEQUENTIAL);
+                SourceBuffer buffer;
+                buffer.bytes = static_cast<const char*>(mapping);
+                buffer.byteCount = size;
+                buffer.mapped = true;
+                return buffer;
+            }
+        }
+    }
+    return fromString(readAll(file.fd, size));
+}
+
+SourceBuffer SourceBuffer::fromString(std::string text)
+{
+    SourceBuffer buffer;
+    buffer.owned = std::move(text);
+    buffer.bytes = buffer.owned.data();
+    buffer.byteCount = buffer.owned.size();
+    return buffer;
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept
+    : bytes(other.bytes),
+      byteCount(other.byteCount),
+      mapped(other.mapped),
+      owned(std::move(other.owned))
+{
+    if (!mapped) bytes = owned.data();
+    other.bytes = nullptr;
+    other.byteCount = 0;
+    other.mapped = false;
+}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        bytes = other.bytes;
+        byteCount = other.byteCount;
+        mapped = other.mapped;
+        owned = std::move(other.owned);
+        if (!mapped) bytes = owned.data();
+        other.bytes = nullptr;
+        other.byteCount = 0;
+        other.mapped = false;
+    }
+    return *this;
+}
+
+SourceBuffer::~SourceBuffer()
+{
+    release();
+}
+
+void SourceBuffer::release()
+{
+    if (mapped) ::munmap(const_cast<char*>(bytes), byteCount);
+    bytes = nullptr;
+    byteCount = 0;
+    mapped = false;
+}
@@ -0,0 +1,53 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include "sourceReader.hpp"
+
+SourceReader SourceReader::fromDescriptor(int fd, std::size_t chunkSize)
+{
+    return SourceReader(fd, nullptr, chunkSize);
+}
+
+SourceReader SourceReader::fromStream(std::istream& stream, std::size_t chunkSize)
+{
+    return SourceReader(-1, &stream, chunkSize);
+}
+
+SourceReader::SourceReader(int fd, std::istream* stream, std::size_t chunkSize)
+    : fd(fd), stream(stream), chunkSize(std::max<std::size_t>(chunkSize, 1))
+{
+}
+
+bool SourceReader::refill(const char* keep)
+{
+    if (atEnd) return false;
+    std::size_t kept = end() - keep;
+    if (kept > 0) std::memmove(buffer.data(), keep, kept);
+    if (buffer.size() < kept + chunkSize) buffer.resize(kept + chunkSize);
+
+    std::size_t got = readSome(buffer.data() + kept, chunkSize);
+    filled = kept + got;
+    atEnd = got == 0;
+    return !atEnd;
+}
+
+std::size_t SourceReader::readSome(char* into, std::size_t room)
+{
+    if (stream != nullptr)
+    {
+        stream->read(into, static_cast<std::streamsize>(room));
+        return static_cast<std::size_t>(stream->gcount());
+    }
+    while (true)
+    {
+        ssize_t got = ::read(fd, into, room);
+        if (got >= 0) return static_cast<std::size_t>(got);
+        if (errno != EINTR)
+            throw std::runtime_error(std::string("Failed to read input: ") + std::strerror(errno));
+    }
+}
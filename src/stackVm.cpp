@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "dispatch.hpp"
+#include "interpreter_exception.hpp"
+#include "stackVm.hpp"
+
+namespace
+{
+// Values and frames the stacks start with; deeper programs grow them.
+constexpr std::size_t INITIAL_STACK = 1 << 14;
+constexpr std::size_t INITIAL_FRAMES = 1 << 10;
+
+// The common case of arithmetic on two ints, done in place. Anything else, overflow included,
+// is left to binaryOperation.
+template <typename Compute>
+bool integers(Value*& sp, Compute compute)
+{
+    if (!sp[-2].is(Value::Type::Int) || !sp[-1].is(Value::Type::Int)) return false;
+    std::int64_t result = compute(sp[-2].asInt(), sp[-1].asInt());
+    if (result < INT32_MIN || result > INT32_MAX) return false;
+    sp[-2] = Value::integer(static_cast<std::int32_t>(result));
+    --sp;
+    return true;
+}
+
+template <typename Compare>
+bool comparison(Value*& sp, Compare compare)
+{
+    if (!sp[-2].is(Value::Type::Int) || !sp[-1].is(Value::Type::Int)) return false;
+    sp[-2] = Value::boolean(compare(sp[-2].asInt(), sp[-1].asInt()));
+    --sp;
+    return true;
+}
+
+}  // namespace
+
+Value StackVm::run(const CompiledProgram& compiled)
+{
+    program = &compiled;
+    executed = 0;
+    SymbolId mainName = intern("main");
+    stack.clear();
+    stack.resize(INITIAL_STACK);
+    frames.clear();
+    frames.reserve(INITIAL_FRAMES);
+
+    try
+    {
+        globals.reset();
+
+        // The top level runs as a call with no callee below it.
+        const FunctionProto& script = *compiled.functions.front();
+        top = 1;
+        reserve(script.slotCount + script.stackSize);
+        frames.push_back(Frame{&script, script.code.data(), 1, 0, 0});
+        top = 1 + script.slotCount;
+        execute(0);
+
+        Globals::Entry& entry = globals[mainName];
+        if (!entry.defined || !entry.value.is(Value::Type::Function))
+        {
+            stack[0] = Value();
+            return Value();
+        }
+        stack[0] = entry.value;
+        top = 1;
+        call(0, 0, 0, script.node->getStartOffset());
+        if (!frames.empty()) execute(0);
+        top = 0;
+        return std::move(stack[0]);
+    }
+    catch (InterpreterException& e)
+    {
+        if (!e.error.lines) e.error.lines = compiled.lines;
+        throw;
+    }
+}
+
+void StackVm::execute(std::size_t depth)
+{
+    Frame* frame = &frames.back();
+    const FunctionProto* proto = frame->proto;
+    const Instruction* ip = frame->ip;
+    Value* slots = stack.data() + frame->base;
+    Value* sp = stack.data() + top;
+    std::uint64_t count = 0;
+
+    // Offset of the instruction being run, for errors.
+    auto at = [&]()
+    { return proto->offsets[static_cast<std::size_t>(ip - 1 - proto->code.data())]; };
+    // Picks up the innermost frame again after a call or a return changed it.
+    auto resume = [&]()
+    {
+        frame = &frames.back();
+        proto = frame->proto;
+        ip = frame->ip;
+        slots = stack.data() + frame->base;
+        sp = stack.data() + top;
+    };
+    auto binary = [&](BinOperator op)
+    {
+        sp[-2] = binaryOperation(op, sp[-2], sp[-1], at());
+        *--sp = Value();
+    };
+    auto checkBool = [&](const Value& value)
+    {
+        if (!value.is(Value::Type::Bool)) isTrue(value, at());
+    };
+
+    const Instruction* instruction = ip;
+    auto fetch = [&]()
+    {
+        instruction = ip++;
+        ++count;
+        return instruction->op;
+    };
+#ifdef BIBL_COMPUTED_GOTO
+    static const void* const handlers[] = {
+        DISPATCH_LABEL(Integer), DISPATCH_LABEL(Constant), DISPATCH_LABEL(Nothing),
+        DISPATCH_LABEL(Pop), DISPATCH_LABEL(LoadLocal), DISPATCH_LABEL(StoreLocal),
+        DISPATCH_LABEL(LoadGlobal), DISPATCH_LABEL(StoreGlobal), DISPATCH_LABEL(DefineGlobal),
+        DISPATCH_LABEL(Add), DISPATCH_LABEL(Subtract), DISPATCH_LABEL(Multiply),
+        DISPATCH_LABEL(Divide), DISPATCH_LABEL(Equal), DISPATCH_LABEL(NotEqual),
+        DISPATCH_LABEL(Greater), DISPATCH_LABEL(GreaterEqual), DISPATCH_LABEL(Less),
+        DISPATCH_LABEL(LessEqual), DISPATCH_LABEL(Compose), DISPATCH_LABEL(Decorate),
+        DISPATCH_LABEL(Cast), DISPATCH_LABEL(Jump), DISPATCH_LABEL(JumpIfFalse),
+        DISPATCH_LABEL(JumpIfFalseKeep), DISPATCH_LABEL(JumpIfTrueKeep), DISPATCH_LABEL(CheckBool),
+        DISPATCH_LABEL(Closure), DISPATCH_LABEL(Call), DISPATCH_LABEL(Return),
+        DISPATCH_LABEL(Raise)};
+    static_assert(sizeof(handlers) / sizeof(*handlers) ==
+                      static_cast<std::size_t>(OpCode::Raise) + 1,
+                  "every opcode needs a handler");
+#endif
+
+    DISPATCH_LOOP
+    {
+        DISPATCH_CASE(OpCode, Integer)
+            *sp++ = Value::integer(instruction->b);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Constant)
+            *sp++ = proto->constants[static_cast<std::size_t>(instruction->b)];
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Nothing)
+            *sp++ = Value();
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Pop)
+            *--sp = Value();
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, LoadLocal)
+        {
+            const Value& value = slots[instruction->a];
+            if (value.is(Value::Type::Nothing))
+                runtimeError(MessageId::NoValue, at(), symbolName(SymbolId(instruction->b)));
+            *sp++ = value;
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(OpCode, StoreLocal)
+            slots[instruction->a] = std::move(*--sp);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, LoadGlobal)
+        {
+            auto id = SymbolId(instruction->b);
+            Globals::Entry& slot = globals[id];
+            if (!slot.defined)
+                runtimeError(MessageId::UndefinedIdentifier, at(), symbolName(id));
+            if (slot.value.is(Value::Type::Nothing))
+                runtimeError(MessageId::NoValue, at(), symbolName(id));
+            *sp++ = slot.value;
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(OpCode, StoreGlobal)
+        {
+            auto id = SymbolId(instruction->b);
+            Globals::Entry& slot = globals[id];
+            if (!slot.defined)
+                runtimeError(MessageId::UndefinedIdentifier, at(), symbolName(id));
+            if (slot.constant) runtimeError(MessageId::AssignToConstant, at(), symbolName(id));
+            slot.value = std::move(*--sp);
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(OpCode, DefineGlobal)
+        {
+            auto id = SymbolId(instruction->b);
+            Globals::Entry& slot = globals[id];
+            if (slot.defined) runtimeError(MessageId::AlreadyDeclared, at(), symbolName(id));
+            slot.value = std::move(*--sp);
+            slot.defined = true;
+            slot.constant = instruction->a != 0;
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(OpCode, Add)
+            if (!integers(sp, [](std::int64_t l, std::int64_t r) { return l + r; }))
+                binary(BinOperator::Plus);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Subtract)
+            if (!integers(sp, [](std::int64_t l, std::int64_t r) { return l - r; }))
+                binary(BinOperator::Minus);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Multiply)
+            if (!integers(sp, [](std::int64_t l, std::int64_t r) { return l * r; }))
+                binary(BinOperator::Star);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Divide)
+            // A zero divisor goes the slow way, to be reported.
+            if ((sp[-1].is(Value::Type::Int) && sp[-1].asInt() == 0) ||
+                !integers(sp, [](std::int64_t l, std::int64_t r) { return l / r; }))
+                binary(BinOperator::Slash);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Equal)
+            if (!comparison(sp, [](std::int32_t l, std::int32_t r) { return l == r; }))
+                binary(BinOperator::Equal);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, NotEqual)
+            if (!comparison(sp, [](std::int32_t l, std::int32_t r) { return l != r; }))
+                binary(BinOperator::NotEqual);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Greater)
+            if (!comparison(sp, [](std::int32_t l, std::int32_t r) { return l > r; }))
+                binary(BinOperator::Greater);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, GreaterEqual)
+            if (!comparison(sp, [](std::int32_t l, std::int32_t r) { return l >= r; }))
+                binary(BinOperator::GreaterEqual);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Less)
+            if (!comparison(sp, [](std::int32_t l, std::int32_t r) { return l < r; }))
+                binary(BinOperator::Less);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, LessEqual)
+            if (!comparison(sp, [](std::int32_t l, std::int32_t r) { return l <= r; }))
+                binary(BinOperator::LessEqual);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Compose)
+            binary(BinOperator::Pipe);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Decorate)
+            binary(BinOperator::AtAt);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Cast)
+            sp[-1] = castValue(sp[-1], static_cast<CastType>(instruction->a), at());
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Jump)
+            ip += instruction->b;
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, JumpIfFalse)
+            checkBool(sp[-1]);
+            if (!(--sp)->asBool()) ip += instruction->b;
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, JumpIfFalseKeep)
+            checkBool(sp[-1]);
+            if (!sp[-1].asBool())
+                ip += instruction->b;
+            else
+                --sp;
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, JumpIfTrueKeep)
+            checkBool(sp[-1]);
+            if (sp[-1].asBool())
+                ip += instruction->b;
+            else
+                --sp;
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, CheckBool)
+            checkBool(sp[-1]);
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Closure)
+        {
+            const FunctionProto& function =
+                *program->functions[static_cast<std::size_t>(instruction->b)];
+            auto* object = new FunctionObject{};
+            Value made = Value::function(object);
+            object->kind = FunctionObject::Kind::Script;
+            object->node = function.node;
+            object->proto = &function;
+            object->captures.reserve(function.captures.size());
+            for (const CaptureSlot& capture : function.captures)
+                object->captures.push_back(
+                    Capture{capture.id, capture.constant, slots[capture.from]});
+            *sp++ = std::move(made);
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(OpCode, Call)
+            frame->ip = ip;
+            top = static_cast<std::size_t>(sp - stack.data());
+            call(top - instruction->a - 1, instruction->a, 0, at());
+            resume();
+            DISPATCH_NEXT;
+        DISPATCH_CASE(OpCode, Return)
+        {
+            Value result = std::move(*--sp);
+            for (Value* slot = slots; slot != sp; ++slot) *slot = Value();
+            std::size_t callee = frame->base - 1;
+            int pending = frame->pending;
+            SourceOffset callAt = frame->at;
+            frames.pop_back();
+            stack[callee] = std::move(result);
+            top = callee + 1;
+            if (pending > 0) call(callee - 1, 1, pending - 1, callAt);
+            if (frames.size() == depth)
+            {
+                executed += count;
+                return;
+            }
+            resume();
+            DISPATCH_NEXT;
+        }
+        DISPATCH_CASE(OpCode, Raise)
+            runtimeError(static_cast<MessageId>(instruction->a), at(),
+                         instruction->b == NO_NAME ? std::string()
+                                                  : symbolName(SymbolId(instruction->b)));
+    }
+}
+
+void StackVm::call(std::size_t callee, std::size_t count, int pending, SourceOffset at)
+{
+    FunctionObject* function = unfoldCall(stack, top, callee, count, pending, out, at);
+    if (!function) return;
+
+    const FunctionProto& proto = *function->proto;
+    if (count != proto.parameterCount) wrongArgumentCount(proto.parameterCount, count, at);
+    std::size_t base = callee + 1;
+    if ((frames.size() + 1) * sizeof(Frame) +
+            (base + proto.slotCount + proto.stackSize) * sizeof(Value) >
+        MAX_VM_STACK_BYTES)
+        runtimeError(MessageId::RecursionTooDeep, at);
+    reserve(proto.slotCount - count + proto.stackSize);
+    for (const Capture& capture : function->captures) stack[top++] = capture.value;
+    top = base + proto.slotCount;
+    frames.push_back(Frame{&proto, proto.code.data(), base, pending, at});
+}
+
+void StackVm::reserve(std::size_t count)
+{
+    if (top + count > stack.size()) stack.resize(std::max(stack.size() * 2, top + count));
+}
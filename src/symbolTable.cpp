@@ -0,0 +1,47 @@
+#include <mutex>
+
+#include "symbolTable.hpp"
+
+SymbolTable& SymbolTable::global()
+{
+    static SymbolTable table;
+    return table;
+}
+
+// Block k starts at id (FIRST_BLOCK << k) - FIRST_BLOCK, so the top bit of the id plus
+// FIRST_BLOCK picks the block.
+std::pair<int, std::size_t> SymbolTable::locate(std::uint32_t id)
+{
+    std::uint64_t slot = std::uint64_t{id} + FIRST_BLOCK;
+    int block = 63 - __builtin_clzll(slot) - FIRST_BLOCK_BITS;
+    return {block, slot - (FIRST_BLOCK << block)};
+}
+
+SymbolId SymbolTable::intern(std::string_view name)
+{
+    {
+        std::shared_lock lock(mutex);
+        auto found = ids.find(name);
+        if (found != ids.end()) return found->second;
+    }
+
+    std::unique_lock lock(mutex);
+    auto found = ids.find(name);
+    if (found != ids.end()) return found->second;
+    std::uint32_t next = count.load(std::memory_order_relaxed);
+    auto [block, index] = locate(next);
+    if (!blocks[block]) blocks[block] = std::make_unique<std::string[]>(FIRST_BLOCK << block);
+    std::string& stored = blocks[block][index];
+    stored = name;
+    ids.emplace(std::string_view(stored), SymbolId(next));
+    count.store(next + 1, std::memory_order_release);
+    return SymbolId(next);
+}
+
+const std::string& SymbolTable::name(SymbolId id) const
+{
+    // Pairs with the store in intern, for ids handed over without other synchronization.
+    count.load(std::memory_order_acquire);
+    auto [block, index] = locate(static_cast<std::uint32_t>(id));
+    return blocks[block][index];
+}
@@ -0,0 +1,75 @@
+#include <type_traits>
+
+#include "tokenBuffer.hpp"
+
+TokenBuffer TokenBuffer::tokenize(Lexer& lexer)
+{
+    TokenBuffer buffer;
+    buffer.setLineIndex(lexer.lineIndex());
+    Token token = lexer.nextToken();
+    while (token.type != TokenType::EndOfFile && token.type != TokenType::Error)
+    {
+        buffer.push(token);
+        token = lexer.nextToken();
+    }
+    if (token.type == TokenType::Error)
+        buffer.setLexicalError(*lexer.lexicalError());
+    else
+        buffer.push(token);
+    return buffer;
+}
+
+void TokenBuffer::push(const Token& token)
+{
+    types.push_back(static_cast<std::uint8_t>(token.type));
+    offsets.push_back(token.offset);
+
+    if (auto symbol = std::get_if<SymbolId>(&token.value))
+    {
+        values.push_back(static_cast<std::uint32_t>(*symbol));
+        return;
+    }
+    if (std::holds_alternative<std::monostate>(token.value))
+    {
+        values.push_back(NO_VALUE);
+        return;
+    }
+    values.push_back(static_cast<std::uint32_t>(literals.size()));
+    std::visit(
+        [this](const auto& value)
+        {
+            if constexpr (!std::is_same_v<std::decay_t<decltype(value)>, SymbolId>)
+                literals.emplace_back(value);
+        },
+        token.value);
+}
+
+void TokenBuffer::append(const TokenBuffer& other, std::size_t first)
+{
+    std::uint32_t literalBase = static_cast<std::uint32_t>(literals.size());
+    literals.insert(literals.end(), other.literals.begin(), other.literals.end());
+    for (std::size_t i = first; i < other.size(); ++i)
+    {
+        TokenType tokenType = other.type(i);
+        std::uint32_t value = other.values[i];
+        bool isLiteral = value != NO_VALUE && tokenType != TokenType::Identifier &&
+                         tokenType != TokenType::Type;
+        types.push_back(other.types[i]);
+        offsets.push_back(other.offsets[i]);
+        values.push_back(isLiteral ? value + literalBase : value);
+    }
+}
+
+Token TokenBuffer::token(std::size_t index) const
+{
+    TokenType tokenType = type(index);
+    SourceOffset offset = offsets[index];
+    std::uint32_t value = values[index];
+    if (value == NO_VALUE) return Token(tokenType, offset);
+    if (tokenType == TokenType::Identifier || tokenType == TokenType::Type)
+        return Token(tokenType, static_cast<SymbolId>(value), offset);
+
+    Token token(tokenType, offset);
+    std::visit([&token](const auto& literal) { token.value = literal; }, literals[value]);
+    return token;
+}
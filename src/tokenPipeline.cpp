@@ -0,0 +1,84 @@
+#include "tokenPipeline.hpp"
+
+namespace
+{
+// Both sides spin briefly before giving up the core, which matters when they share one.
+template <typename Ready>
+bool waitUntil(Ready ready, const std::atomic<bool>& stopping)
+{
+    for (int spins = 0; !ready(); ++spins)
+    {
+        if (stopping.load(std::memory_order_relaxed)) return false;
+        if (spins >= 64) std::this_thread::yield();
+    }
+    return true;
+}
+
+}  // namespace
+
+TokenPipeline::TokenPipeline(Lexer& lexer) : lines(lexer.lineIndex())
+{
+    producer = std::thread(&TokenPipeline::produce, this, std::ref(lexer));
+}
+
+TokenPipeline::~TokenPipeline()
+{
+    stop();
+}
+
+void TokenPipeline::stop()
+{
+    stopping.store(true, std::memory_order_relaxed);
+    if (producer.joinable()) producer.join();
+}
+
+bool TokenPipeline::publish(Batch&& batch)
+{
+    return waitUntil([&] { return ring.tryPush(std::move(batch)); }, stopping);
+}
+
+void TokenPipeline::produce(Lexer& lexer)
+{
+    Batch batch;
+    batch.tokens.reserve(BATCH_SIZE);
+    try
+    {
+        while (true)
+        {
+            Token token = lexer.nextToken();
+            bool end = token.type == TokenType::EndOfFile || token.type == TokenType::Error;
+            batch.tokens.push_back(std::move(token));
+            if (end) break;
+            if (batch.tokens.size() == BATCH_SIZE)
+            {
+                if (!publish(std::move(batch))) return;
+                batch = Batch();
+                batch.tokens.reserve(BATCH_SIZE);
+            }
+        }
+    }
+    catch (...)
+    {
+        batch.failure = std::current_exception();
+    }
+    batch.error = lexer.lexicalError();
+    batch.last = true;
+    publish(std::move(batch));
+}
+
+Token TokenPipeline::next()
+{
+    while (index == current.tokens.size())
+    {
+        if (current.failure) std::rethrow_exception(current.failure);
+        // The final batch ends in EndOfFile or Error, handed out again on every later call.
+        if (current.last) return current.tokens.back();
+
+        std::optional<Batch> batch;
+        waitUntil([&] { return (batch = ring.tryPop()).has_value(); }, stopping);
+        if (!batch) return Token(TokenType::EndOfFile, 0);
+        current = std::move(*batch);
+        index = 0;
+    }
+    return current.tokens[index++];
+}
@@ -0,0 +1,40 @@
+#include "utf8.hpp"
+#include "scanKernels.hpp"
+
+std::optional<SourceOffset> Utf8Validator::feed(const char* p, const char* end, SourceOffset base,
+                                                std::vector<SourceOffset>& continuations)
+{
+    const char* start = p;
+    while (p != end)
+    {
+        if (remaining == 0)
+        {
+            p = skipAscii(p, end);
+            if (p == end) break;
+            unsigned char lead = static_cast<unsigned char>(*p);
+            sequenceStart = base + static_cast<SourceOffset>(p - start);
+            if (lead < 0xC2 || lead > 0xF4) return sequenceStart;
+            remaining = utf8SequenceLength(*p) - 1;
+            // Overlong forms, surrogates and code points past U+10FFFF.
+            low = lead == 0xE0 ? 0xA0 : lead == 0xF0 ? 0x90 : 0x80;
+            high = lead == 0xED ? 0x9F : lead == 0xF4 ? 0x8F : 0xBF;
+            ++p;
+            continue;
+        }
+
+        unsigned char byte = static_cast<unsigned char>(*p);
+        if (byte < low || byte > high) return sequenceStart;
+        continuations.push_back(base + static_cast<SourceOffset>(p - start));
+        low = 0x80;
+        high = 0xBF;
+        --remaining;
+        ++p;
+    }
+    return std::nullopt;
+}
+
+std::optional<SourceOffset> Utf8Validator::finish() const
+{
+    if (remaining != 0) return sequenceStart;
+    return std::nullopt;
+}
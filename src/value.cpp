@@ -0,0 +1,352 @@
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include "interpreter_exception.hpp"
+#include "outputSink.hpp"
+#include "value.hpp"
+
+namespace
+{
+// Indexed by BinOperator, as scripts write them.
+const char* const OPERATOR_SYMBOLS[] = {"+",  "-", "*",  "/",  "==", "!=", ">",
+                                        ">=", "<", "<=", "|", "@@", "&&", "||"};
+const char* const CAST_TYPE_NAMES[] = {"string", "float", "int"};
+
+[[noreturn]] void invalidOperands(BinOperator op, const Value& left, const Value& right,
+                                  SourceOffset at)
+{
+    std::string detail(left.typeName());
+    detail += ' ';
+    detail += OPERATOR_SYMBOLS[static_cast<int>(op)];
+    detail += ' ';
+    detail += right.typeName();
+    runtimeError(MessageId::InvalidOperands, at, detail);
+}
+
+// The whole of `text` read as a number of the cast's type, written as the lexer reads number
+// literals or with a sign and exponent. Anything else is an invalid cast.
+Value parseNumber(std::string_view text, CastType type, SourceOffset at)
+{
+    const char* end = text.data() + text.size();
+    if (type == CastType::Int)
+    {
+        std::int32_t number = 0;
+        auto [rest, status] = std::from_chars(text.data(), end, number);
+        if (status == std::errc::result_out_of_range) runtimeError(MessageId::IntegerOverflow, at);
+        if (status == std::errc() && rest == end) return Value::integer(number);
+    }
+    else
+    {
+        float number = 0;
+        auto [rest, status] = std::from_chars(text.data(), end, number);
+        if (status == std::errc() && rest == end && std::isfinite(number))
+            return Value::real(number);
+    }
+    std::string detail = "\"";
+    detail += text;
+    detail += "\" as ";
+    detail += CAST_TYPE_NAMES[static_cast<int>(type)];
+    runtimeError(MessageId::InvalidCast, at, detail);
+}
+
+Value checkedInt(std::int64_t result, SourceOffset at)
+{
+    if (result < std::numeric_limits<std::int32_t>::min() ||
+        result > std::numeric_limits<std::int32_t>::max())
+        runtimeError(MessageId::IntegerOverflow, at);
+    return Value::integer(static_cast<std::int32_t>(result));
+}
+
+Value integerArithmetic(BinOperator op, std::int64_t left, std::int64_t right, SourceOffset at)
+{
+    switch (op)
+    {
+        case BinOperator::Plus:
+            return checkedInt(left + right, at);
+        case BinOperator::Minus:
+            return checkedInt(left - right, at);
+        case BinOperator::Star:
+            return checkedInt(left * right, at);
+        case BinOperator::Slash:
+            if (right == 0) runtimeError(MessageId::DivisionByZero, at);
+            return checkedInt(left / right, at);
+        default:
+            return Value();
+    }
+}
+
+Value floatArithmetic(BinOperator op, float left, float right, SourceOffset at)
+{
+    switch (op)
+    {
+        case BinOperator::Plus:
+            return Value::real(left + right);
+        case BinOperator::Minus:
+            return Value::real(left - right);
+        case BinOperator::Star:
+            return Value::real(left * right);
+        case BinOperator::Slash:
+            if (right == 0) runtimeError(MessageId::DivisionByZero, at);
+            return Value::real(left / right);
+        default:
+            return Value();
+    }
+}
+
+template <typename T>
+Value compare(BinOperator op, T left, T right)
+{
+    switch (op)
+    {
+        case BinOperator::Equal:
+            return Value::boolean(left == right);
+        case BinOperator::NotEqual:
+            return Value::boolean(left != right);
+        case BinOperator::Greater:
+            return Value::boolean(left > right);
+        case BinOperator::GreaterEqual:
+            return Value::boolean(left >= right);
+        case BinOperator::Less:
+            return Value::boolean(left < right);
+        case BinOperator::LessEqual:
+            return Value::boolean(left <= right);
+        default:
+            return Value();
+    }
+}
+
+Value combine(FunctionObject::Kind kind, const Value& first, const Value& second)
+{
+    auto* function = new FunctionObject{};
+    function->kind = kind;
+    function->first = first;
+    function->second = second;
+    return Value::function(function);
+}
+
+std::string formatFloat(float value)
+{
+    char text[32];
+    char* end = std::to_chars(text, text + sizeof(text), value).ptr;
+    std::string result(text, end);
+    // Whole numbers keep a fraction so they still read as floats.
+    if (std::isfinite(value) && result.find_first_of(".e") == std::string::npos) result += ".0";
+    return result;
+}
+
+}  // namespace
+
+Value Value::string(std::string_view text)
+{
+    void* block = ::operator new(sizeof(StringObject) + text.size());
+    auto* string = new (block) StringObject{1, static_cast<std::uint32_t>(text.size())};
+    if (!text.empty()) std::memcpy(string + 1, text.data(), text.size());
+    Value result;
+    result.type = Type::String;
+    result.payload.string = string;
+    return result;
+}
+
+Value Value::function(FunctionObject* function)
+{
+    Value result;
+    result.type = Type::Function;
+    result.payload.object = function;
+    return result;
+}
+
+std::string_view Value::asString() const
+{
+    return std::string_view(reinterpret_cast<const char*>(payload.string + 1),
+                            payload.string->size);
+}
+
+FunctionObject* Value::asFunction() const
+{
+    return payload.object;
+}
+
+void Value::retainObject() const
+{
+    if (type == Type::String)
+        ++payload.string->references;
+    else if (type == Type::Function)
+        ++payload.object->references;
+}
+
+void Value::releaseObject()
+{
+    if (type == Type::String)
+    {
+        if (--payload.string->references == 0) ::operator delete(payload.string);
+    }
+    else if (--payload.object->references == 0)
+    {
+        delete payload.object;
+    }
+    type = Type::Nothing;
+}
+
+std::string Value::toString() const
+{
+    switch (type)
+    {
+        case Type::Int:
+            return std::to_string(payload.integer);
+        case Type::Float:
+            return formatFloat(payload.real);
+        case Type::Bool:
+            return payload.boolean ? "true" : "false";
+        case Type::String:
+            return std::string(asString());
+        case Type::Function:
+            return "<function>";
+        case Type::Nothing:
+            break;
+    }
+    return "nothing";
+}
+
+std::string_view Value::typeName(Type type)
+{
+    switch (type)
+    {
+        case Type::Int:
+            return "int";
+        case Type::Float:
+            return "float";
+        case Type::Bool:
+            return "bool";
+        case Type::String:
+            return "string";
+        case Type::Function:
+            return "function";
+        case Type::Nothing:
+            break;
+    }
+    return "nothing";
+}
+
+void Globals::reset()
+{
+    entries.clear();
+    entries.resize(SymbolTable::global().size());
+    auto* print = new FunctionObject{};
+    print->kind = FunctionObject::Kind::Print;
+    Entry& entry = (*this)[intern("print")];
+    entry.value = Value::function(print);
+    entry.defined = true;
+}
+
+void runtimeError(MessageId message, SourceOffset at, std::string detail)
+{
+    throw InterpreterException(Error{ErrorType::Runtime, message, at, nullptr, std::move(detail)});
+}
+
+void wrongArgumentCount(std::size_t expected, std::size_t given, SourceOffset at)
+{
+    runtimeError(MessageId::WrongArgumentCount, at,
+                 "expected " + std::to_string(expected) + ", got " + std::to_string(given));
+}
+
+Value binaryOperation(BinOperator op, const Value& left, const Value& right, SourceOffset at)
+{
+    if (op == BinOperator::Pipe || op == BinOperator::AtAt)
+    {
+        if (!left.is(Value::Type::Function) || !right.is(Value::Type::Function))
+            invalidOperands(op, left, right, at);
+        return combine(op == BinOperator::Pipe ? FunctionObject::Kind::Composed
+                                               : FunctionObject::Kind::Decorated,
+                       left, right);
+    }
+    if (left.getType() != right.getType()) invalidOperands(op, left, right, at);
+
+    switch (left.getType())
+    {
+        case Value::Type::Int:
+            if (op <= BinOperator::Slash)
+                return integerArithmetic(op, left.asInt(), right.asInt(), at);
+            if (op <= BinOperator::LessEqual) return compare(op, left.asInt(), right.asInt());
+            break;
+        case Value::Type::Float:
+            if (op <= BinOperator::Slash)
+                return floatArithmetic(op, left.asFloat(), right.asFloat(), at);
+            if (op <= BinOperator::LessEqual) return compare(op, left.asFloat(), right.asFloat());
+            break;
+        case Value::Type::String:
+            if (op == BinOperator::Plus)
+            {
+                std::string_view first = left.asString();
+                std::string_view second = right.asString();
+                if (first.size() + second.size() > Value::MAX_STRING_LENGTH)
+                    runtimeError(MessageId::StringTooLong, at);
+                std::string joined;
+                joined.reserve(first.size() + second.size());
+                joined.append(first).append(second);
+                return Value::string(joined);
+            }
+            if (op == BinOperator::Equal || op == BinOperator::NotEqual)
+                return compare(op, left.asString(), right.asString());
+            break;
+        case Value::Type::Bool:
+            if (op == BinOperator::And) return Value::boolean(left.asBool() && right.asBool());
+            if (op == BinOperator::Or) return Value::boolean(left.asBool() || right.asBool());
+            if (op == BinOperator::Equal || op == BinOperator::NotEqual)
+                return compare(op, left.asBool(), right.asBool());
+            break;
+        default:
+            break;
+    }
+    invalidOperands(op, left, right, at);
+}
+
+Value castValue(const Value& value, CastType type, SourceOffset at)
+{
+    switch (type)
+    {
+        case CastType::String:
+            if (value.is(Value::Type::String)) return value;
+            if (value.is(Value::Type::Int) || value.is(Value::Type::Float))
+                return Value::string(value.toString());
+            break;
+        case CastType::Float:
+            if (value.is(Value::Type::Float)) return value;
+            if (value.is(Value::Type::Int)) return Value::real(static_cast<float>(value.asInt()));
+            if (value.is(Value::Type::String)) return parseNumber(value.asString(), type, at);
+            break;
+        case CastType::Int:
+            if (value.is(Value::Type::Int)) return value;
+            if (value.is(Value::Type::Float))
+            {
+                float real = value.asFloat();
+                // Exactly representable bounds; anything outside them does not fit.
+                if (!(real >= -2147483648.0f && real < 2147483648.0f))
+                    runtimeError(MessageId::IntegerOverflow, at);
+                return Value::integer(static_cast<std::int32_t>(real));
+            }
+            if (value.is(Value::Type::String)) return parseNumber(value.asString(), type, at);
+            break;
+    }
+    std::string detail(value.typeName());
+    detail += " as ";
+    detail += CAST_TYPE_NAMES[static_cast<int>(type)];
+    runtimeError(MessageId::InvalidCast, at, detail);
+}
+
+bool isTrue(const Value& condition, SourceOffset at)
+{
+    if (!condition.is(Value::Type::Bool))
+        runtimeError(MessageId::ConditionNotBoolean, at, std::string(condition.typeName()));
+    return condition.asBool();
+}
+
+void printValue(OutputSink& out, const Value& value)
+{
+    if (value.is(Value::Type::String))
+        out.write(value.asString());
+    else
+        out.write(value.toString());
+}
@@ -0,0 +1,223 @@
+#include <variant>
+
+#include "flatPrinter.hpp"
+
+namespace
+{
+// Indexed by BinOperator and CastType, and spelled as printed.
+const char* const BIN_OPERATOR_TEXTS[] = {" Plus ", " Minus ", " Star ", " Slash ", " Equal ",
+                                          " NotEqual ", " Greater ", " GreaterEqual ", " Less ",
+                                          " LessEqual ", " Pipe ", " AtAt ", " And ", " Or "};
+const char* const CAST_TYPE_TEXTS[] = {" As string", " As float", " As int"};
+
+}  // namespace
+
+void FlatPrinter::print(const FlatAst& ast)
+{
+    visitChild(ast, ast.root());
+    traversal.run([&](NodeIndex node) { ast.accept(node, *this); },
+                  [this](const Output& output) { write(output); });
+}
+
+void FlatPrinter::visitNumberLiteral(const FlatAst& ast, NodeIndex node)
+{
+    sink->write(std::visit([](auto value) { return std::to_string(value); }, ast.number(node)));
+}
+
+void FlatPrinter::visitStringLiteral(const FlatAst& ast, NodeIndex node)
+{
+    sink->write('"');
+    sink->write(ast.string(node));
+    sink->write('"');
+}
+
+void FlatPrinter::visitIdentifier(const FlatAst& ast, NodeIndex node)
+{
+    sink->write(symbolName(ast.symbol(node)));
+}
+
+void FlatPrinter::visitBinaryOp(const FlatAst& ast, NodeIndex node)
+{
+    visitChild(ast, ast.left(node));
+    emit(BIN_OPERATOR_TEXTS[int(ast.binaryOperator(node))]);
+    visitChild(ast, ast.right(node));
+}
+
+void FlatPrinter::visitTypeCast(const FlatAst& ast, NodeIndex node)
+{
+    visitChild(ast, ast.expression(node));
+    emit(CAST_TYPE_TEXTS[int(ast.castType(node))]);
+}
+
+void FlatPrinter::visitFunctionCall(const FlatAst& ast, NodeIndex node)
+{
+    visitChild(ast, ast.callee(node));
+    emit("(");
+    FlatRange arguments = ast.arguments(node);
+    for (std::size_t i = 0; i < arguments.size(); ++i)
+    {
+        if (i > 0) emit(", ");
+        visitChild(ast, arguments[i]);
+    }
+    emit(")");
+}
+
+void FlatPrinter::visitExpressionStatement(const FlatAst& ast, NodeIndex node)
+{
+    visitChild(ast, ast.expression(node));
+    emit(";");
+}
+
+void FlatPrinter::visitStatementBlock(const FlatAst& ast, NodeIndex node)
+{
+    emit("[\n");
+    output({Output::Kind::Deeper, ""});
+    for (NodeIndex statement : ast.statements(node))
+    {
+        output({Output::Kind::Indented, ""});
+        visitChild(ast, statement);
+        emit("\n");
+    }
+    output({Output::Kind::Shallower, ""});
+    output({Output::Kind::Indented, "]"});
+}
+
+void FlatPrinter::visitFunctionDeclaration(const FlatAst& ast, NodeIndex node)
+{
+    sink->write("Fun ");
+    sink->write(symbolName(ast.symbol(node)));
+    printFunction(ast, node);
+}
+
+void FlatPrinter::visitFunctionLiteral(const FlatAst& ast, NodeIndex node)
+{
+    emit("Fun");
+    printFunction(ast, node);
+}
+
+void FlatPrinter::visitParameter(const FlatAst& ast, NodeIndex node)
+{
+    sink->write(ast.modifier(node) ? "Var " : "Const ");
+    sink->write(symbolName(ast.symbol(node)));
+}
+
+void FlatPrinter::visitIfStatement(const FlatAst& ast, NodeIndex node)
+{
+    emit("if (");
+    visitChild(ast, ast.condition(node));
+    emit(")\n");
+    printBody(ast, ast.thenBlock(node));
+    if (ast.elseBlock(node) == NO_NODE) return;
+    emit(" else\n");
+    printBody(ast, ast.elseBlock(node));
+}
+
+void FlatPrinter::visitDeclaration(const FlatAst& ast, NodeIndex node)
+{
+    sink->write(ast.modifier(node) ? "Var " : "Const ");
+    sink->write(symbolName(ast.symbol(node)));
+    if (ast.expression(node) != NO_NODE)
+    {
+        emit(" = ");
+        visitChild(ast, ast.expression(node));
+    }
+    emit(";");
+}
+
+void FlatPrinter::visitReturnStatement(const FlatAst& ast, NodeIndex node)
+{
+    emit("return");
+    if (ast.expression(node) != NO_NODE)
+    {
+        emit(" ");
+        visitChild(ast, ast.expression(node));
+    }
+    emit(";");
+}
+
+void FlatPrinter::visitAssign(const FlatAst& ast, NodeIndex node)
+{
+    sink->write(symbolName(ast.symbol(node)));
+    sink->write(" = ");
+    visitChild(ast, ast.expression(node));
+    emit(";");
+}
+
+void FlatPrinter::visitWhileStatement(const FlatAst& ast, NodeIndex node)
+{
+    emit("While (");
+    visitChild(ast, ast.condition(node));
+    emit(")\n");
+    printBody(ast, ast.body(node));
+}
+
+void FlatPrinter::visitProgram(const FlatAst& ast, NodeIndex)
+{
+    for (NodeIndex declaration : ast.declarations())
+    {
+        visitChild(ast, declaration);
+        emit("\n");
+    }
+}
+
+void FlatPrinter::printFunction(const FlatAst& ast, NodeIndex node)
+{
+    emit("(");
+    FlatRange parameters = ast.parameters(node);
+    for (std::size_t i = 0; i < parameters.size(); ++i)
+    {
+        if (i > 0) emit(", ");
+        visitChild(ast, parameters[i]);
+    }
+    emit(")\n");
+    printBody(ast, ast.body(node));
+}
+
+void FlatPrinter::printBody(const FlatAst& ast, NodeIndex block)
+{
+    output({Output::Kind::Deeper, ""});
+    output({Output::Kind::Indented, ""});
+    visitChild(ast, block);
+    output({Output::Kind::Shallower, ""});
+}
+
+// A missing operand, as in `x = ;`, prints as nothing.
+void FlatPrinter::visitChild(const FlatAst& ast, NodeIndex node)
+{
+    if (node != NO_NODE)
+        traversal.visit(node, [&](NodeIndex child) { ast.accept(child, *this); });
+}
+
+void FlatPrinter::emit(const char* text)
+{
+    output({Output::Kind::Text, text});
+}
+
+// What a visit outputs before its first child is written right away.
+void FlatPrinter::output(Output output)
+{
+    if (traversal.hasQueued())
+        traversal.doLater(output);
+    else
+        write(output);
+}
+
+void FlatPrinter::write(const Output& output)
+{
+    switch (output.kind)
+    {
+        case Output::Kind::Text:
+            sink->write(output.text);
+            break;
+        case Output::Kind::Indented:
+            sink->indent(indentation);
+            sink->write(output.text);
+            break;
+        case Output::Kind::Deeper:
+            ++indentation;
+            break;
+        case Output::Kind::Shallower:
+            --indentation;
+            break;
+    }
+}
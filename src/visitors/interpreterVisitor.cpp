@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <string>
+#include <variant>
+
+#include "interpreterVisitor.hpp"
+
+namespace
+{
+// Marks arguments that are not yet bound to a parameter; no name ever gets this id.
+constexpr SymbolId UNBOUND = SymbolId(~std::uint32_t(0));
+
+}  // namespace
+
+Value InterpreterVisitor::run(ProgramNode& program)
+{
+    SymbolId mainName = intern("main");
+    locals.clear();
+    locals.reserve(1024);
+    frameStart = blockStart = 0;
+    callDepth = nesting = 0;
+    returning = false;
+    returned = Value();
+
+    try
+    {
+        globals.reset();
+        dispatch(program);
+
+        Globals::Entry& entry = globals[mainName];
+        if (!entry.defined || !entry.value.is(Value::Type::Function)) return Value();
+        Value function = entry.value;
+        return invoke(*function.asFunction(), locals.size(), program.getStartOffset());
+    }
+    catch (InterpreterException& e)
+    {
+        if (!e.error.lines) e.error.lines = program.lines;
+        throw;
+    }
+}
+
+Value InterpreterVisitor::evaluate(ExpressionNode& node)
+{
+    if (++nesting > MAX_NESTING) runtimeError(MessageId::NestingTooDeep, node.getStartOffset());
+    Value result = dispatch(node);
+    --nesting;
+    return result;
+}
+
+Value InterpreterVisitor::evaluate(ExpressionNode* node)
+{
+    return node ? evaluate(*node) : Value();
+}
+
+Value InterpreterVisitor::invoke(FunctionObject& function, std::size_t start, SourceOffset at)
+{
+    std::size_t count = locals.size() - start;
+    switch (function.kind)
+    {
+        case FunctionObject::Kind::Print:
+            for (std::size_t i = start; i < locals.size(); ++i)
+            {
+                if (i != start) out.write(' ');
+                printValue(out, locals[i].value);
+            }
+            out.write('\n');
+            locals.erase(locals.begin() + static_cast<std::ptrdiff_t>(start), locals.end());
+            return Value();
+        case FunctionObject::Kind::Composed:
+        {
+            // Held here, in case the call drops the last other reference to this function.
+            Value first = function.first;
+            Value second = function.second;
+            Value result = invoke(*first.asFunction(), start, at);
+            locals.push_back(Binding{UNBOUND, false, std::move(result)});
+            return invoke(*second.asFunction(), start, at);
+        }
+        case FunctionObject::Kind::Decorated:
+        {
+            Value decorated = function.first;
+            Value decorator = function.second;
+            locals.insert(locals.begin() + static_cast<std::ptrdiff_t>(start),
+                          Binding{UNBOUND, false, decorated});
+            return invoke(*decorator.asFunction(), start, at);
+        }
+        case FunctionObject::Kind::Script:
+            break;
+    }
+
+    if (count != function.parameters.size())
+        wrongArgumentCount(function.parameters.size(), count, at);
+    if (callDepth == MAX_CALL_DEPTH) runtimeError(MessageId::RecursionTooDeep, at);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        locals[start + i].id = function.parameters[i]->id;
+        locals[start + i].constant = !function.parameters[i]->modifier;
+    }
+    for (const Capture& capture : function.captures)
+        locals.push_back(Binding{capture.id, capture.constant, capture.value});
+
+    std::size_t callerFrame = frameStart;
+    std::size_t callerBlock = blockStart;
+    frameStart = start;
+    blockStart = locals.size();
+    ++callDepth;
+    if (function.body) dispatch(*function.body);
+    --callDepth;
+    frameStart = callerFrame;
+    blockStart = callerBlock;
+    locals.erase(locals.begin() + static_cast<std::ptrdiff_t>(start), locals.end());
+
+    Value result = std::move(returned);
+    returning = false;
+    return result;
+}
+
+InterpreterVisitor::Binding* InterpreterVisitor::findLocal(SymbolId id)
+{
+    for (std::size_t i = locals.size(); i > frameStart; --i)
+    {
+        if (locals[i - 1].id == id) return &locals[i - 1];
+    }
+    return nullptr;
+}
+
+void InterpreterVisitor::declare(SymbolId id, bool constant, Value value, SourceOffset at)
+{
+    if (callDepth == 0)
+    {
+        Globals::Entry& slot = globals[id];
+        if (slot.defined) runtimeError(MessageId::AlreadyDeclared, at, symbolName(id));
+        slot.value = std::move(value);
+        slot.defined = true;
+        slot.constant = constant;
+        return;
+    }
+    for (std::size_t i = blockStart; i < locals.size(); ++i)
+    {
+        if (locals[i].id == id) runtimeError(MessageId::AlreadyDeclared, at, symbolName(id));
+    }
+    locals.push_back(Binding{id, constant, std::move(value)});
+}
+
+const std::vector<SymbolId>& InterpreterVisitor::namesUsedBy(FunctionLiteralNode& node)
+{
+    auto found = literalNames.find(&node);
+    if (found != literalNames.end()) return found->second;
+    std::vector<SymbolId> names;
+    if (node.body) names = namesUsedIn(*node.body);
+    // Parameters are bound by the call, not captured.
+    for (FuncDefArgument* parameter : node.parameters)
+        names.erase(std::remove(names.begin(), names.end(), parameter->id), names.end());
+    return literalNames.emplace(&node, std::move(names)).first->second;
+}
+
+Value InterpreterVisitor::visit(NumberLiteralNode& node)
+{
+    auto value = node.getValue();
+    if (auto* integer = std::get_if<int>(&value)) return Value::integer(*integer);
+    return Value::real(std::get<float>(value));
+}
+
+Value InterpreterVisitor::visit(StringLiteralNode& node)
+{
+    std::string_view text = node.getValue();
+    if (text.size() > Value::MAX_STRING_LENGTH)
+        runtimeError(MessageId::StringTooLong, node.getStartOffset());
+    return Value::string(text);
+}
+
+Value InterpreterVisitor::visit(IdentifierNode& node)
+{
+    SymbolId id = node.getSymbol();
+    const Value* value = nullptr;
+    if (Binding* binding = findLocal(id))
+    {
+        value = &binding->value;
+    }
+    else
+    {
+        Globals::Entry& slot = globals[id];
+        if (!slot.defined)
+            runtimeError(MessageId::UndefinedIdentifier, node.getStartOffset(), node.getName());
+        value = &slot.value;
+    }
+    if (value->is(Value::Type::Nothing))
+        runtimeError(MessageId::NoValue, node.getStartOffset(), node.getName());
+    return *value;
+}
+
+Value InterpreterVisitor::visit(BinaryOpNode& node)
+{
+    Value left = evaluate(node.left);
+    BinOperator op = node.getBinOp();
+    // The right operand of && and || only runs when it decides the result.
+    if (op == BinOperator::And || op == BinOperator::Or)
+    {
+        if (isTrue(left, node.getStartOffset()) == (op == BinOperator::Or)) return left;
+        Value right = evaluate(node.right);
+        isTrue(right, node.right ? node.right->getStartOffset() : node.getStartOffset());
+        return right;
+    }
+    Value right = evaluate(node.right);
+    return binaryOperation(op, left, right, node.getStartOffset());
+}
+
+Value InterpreterVisitor::visit(TypeCastNode& node)
+{
+    return castValue(evaluate(node.expression), node.getTargetType(), node.getStartOffset());
+}
+
+Value InterpreterVisitor::visit(FunctionCallNode& node)
+{
+    // Kept for the whole call, so reassigning the variable that held it cannot free it.
+    Value callee = evaluate(node.callee);
+    if (!callee.is(Value::Type::Function))
+    {
+        runtimeError(MessageId::NotCallable, node.getStartOffset(),
+                     std::string(callee.typeName()));
+    }
+    std::size_t start = locals.size();
+    for (ExpressionNode* argument : node.arguments)
+    {
+        Value value = evaluate(*argument);
+        locals.push_back(Binding{UNBOUND, false, std::move(value)});
+    }
+    return invoke(*callee.asFunction(), start, node.getStartOffset());
+}
+
+Value InterpreterVisitor::visit(ExpressionStatementNode& node)
+{
+    evaluate(node.expression);
+    return Value();
+}
+
+Value InterpreterVisitor::visit(StatementBlockNode& node)
+{
+    if (++nesting > MAX_NESTING) runtimeError(MessageId::NestingTooDeep, node.getStartOffset());
+    std::size_t enclosing = blockStart;
+    blockStart = locals.size();
+    for (StatementNode* statement : node.statements)
+    {
+        if (statement) dispatch(*statement);
+        if (returning) break;
+    }
+    locals.erase(locals.begin() + static_cast<std::ptrdiff_t>(blockStart), locals.end());
+    blockStart = enclosing;
+    --nesting;
+    return Value();
+}
+
+Value InterpreterVisitor::visit(FunctionDeclarationNode& node)
+{
+    auto* function = new FunctionObject{};
+    function->kind = FunctionObject::Kind::Script;
+    function->node = &node;
+    function->parameters = node.params;
+    function->body = node.body;
+    declare(node.getSymbol(), true, Value::function(function), node.getStartOffset());
+    return Value();
+}
+
+Value InterpreterVisitor::visit(FunctionLiteralNode& node)
+{
+    auto* function = new FunctionObject{};
+    Value result = Value::function(function);
+    function->kind = FunctionObject::Kind::Script;
+    function->node = &node;
+    function->parameters = node.parameters;
+    function->body = node.body;
+    // Literals at the top level see the globals like declared functions do.
+    if (callDepth > 0)
+    {
+        for (SymbolId id : namesUsedBy(node))
+        {
+            if (Binding* binding = findLocal(id))
+                function->captures.push_back(Capture{id, binding->constant, binding->value});
+        }
+    }
+    return result;
+}
+
+Value InterpreterVisitor::visit(IfStatementNode& node)
+{
+    Value condition = evaluate(node.condition);
+    if (isTrue(condition, node.condition->getStartOffset()))
+    {
+        if (node.thenBlock) dispatch(*node.thenBlock);
+    }
+    else if (node.elseBlock)
+    {
+        dispatch(*node.elseBlock);
+    }
+    return Value();
+}
+
+Value InterpreterVisitor::visit(DeclarationNode& node)
+{
+    declare(node.getIdentifier(), !node.getModifier(), evaluate(node.initializer),
+            node.getStartOffset());
+    return Value();
+}
+
+Value InterpreterVisitor::visit(ReturnStatementNode& node)
+{
+    returned = evaluate(node.returnValue);
+    returning = true;
+    return Value();
+}
+
+Value InterpreterVisitor::visit(AssignNode& node)
+{
+    Value value = evaluate(node.expression);
+    SymbolId id = node.getIdentifier();
+    bool constant;
+    Value* target;
+    if (Binding* binding = findLocal(id))
+    {
+        constant = binding->constant;
+        target = &binding->value;
+    }
+    else
+    {
+        Globals::Entry& slot = globals[id];
+        if (!slot.defined)
+        {
+            runtimeError(MessageId::UndefinedIdentifier, node.getStartOffset(),
+                         node.getIdentifierName());
+        }
+        constant = slot.constant;
+        target = &slot.value;
+    }
+    if (constant)
+        runtimeError(MessageId::AssignToConstant, node.getStartOffset(), node.getIdentifierName());
+    *target = std::move(value);
+    return Value();
+}
+
+Value InterpreterVisitor::visit(WhileStatementNode& node)
+{
+    while (!returning && isTrue(evaluate(node.condition), node.condition->getStartOffset()))
+    {
+        if (node.body) dispatch(*node.body);
+    }
+    return Value();
+}
+
+Value InterpreterVisitor::visit(ProgramNode& node)
+{
+    // Functions first, so that initializers can call any of them.
+    for (AstNode* declaration : node.declarations)
+    {
+        if (declaration && declaration->getKind() == NodeKind::FunctionDeclaration)
+            dispatch(*declaration);
+    }
+    for (AstNode* declaration : node.declarations)
+    {
+        if (declaration && declaration->getKind() != NodeKind::FunctionDeclaration)
+            dispatch(*declaration);
+    }
+    return Value();
+}
@@ -5,249 +5,300 @@
 
 namespace
 {
-std::string operatorToString(BinOperator op)
+// Both spelled with the spaces around them, as they are printed.
+const char* operatorText(BinOperator op)
 {
     switch (op)
     {
         case BinOperator::Plus:
-            return "Plus";
+            return " Plus ";
         case BinOperator::Minus:
-            return "Minus";
+            return " Minus ";
         case BinOperator::Star:
-            return "Star";
+            return " Star ";
         case BinOperator::Slash:
-            return "Slash";
+            return " Slash ";
         case BinOperator::Equal:
-            return "Equal";
+            return " Equal ";
         case BinOperator::NotEqual:
-            return "NotEqual";
+            return " NotEqual ";
         case BinOperator::Greater:
-            return "Greater";
+            return " Greater ";
         case BinOperator::GreaterEqual:
-            return "GreaterEqual";
+            return " GreaterEqual ";
         case BinOperator::Less:
-            return "Less";
+            return " Less ";
         case BinOperator::LessEqual:
-            return "LessEqual";
+            return " LessEqual ";
         case BinOperator::Pipe:
-            return "Pipe";
+            return " Pipe ";
         case BinOperator::AtAt:
-            return "AtAt";
+            return " AtAt ";
         case BinOperator::And:
-            return "And";
+            return " And ";
         case BinOperator::Or:
-            return "Or";
+            return " Or ";
         default:
-            return "Wrong TokenType";
+            return " Wrong TokenType ";
     }
 }
 
-std::string typeToString(CastType type)
+const char* castText(CastType type)
 {
     switch (type)
     {
         case CastType::String:
-            return "string";
+            return " As string";
         case CastType::Float:
-            return "float";
+            return " As float";
         case CastType::Int:
-            return "int";
+            return " As int";
         default:
-            return "Wrong Type";
+            return " As Wrong Type";
     }
 }
 
-std::string indent(int level)
-{
-    return std::string(level, ' ');
-}
-
 }  // namespace
 
 void ParserVisitor::visit(NumberLiteralNode& node)
 {
-    outcome.push_back(std::visit([](auto arg)
-                                { return std::to_string(arg); },
-                                node.getValue()));
+    emit(std::visit([](auto arg) { return std::to_string(arg); }, node.getValue()));
 }
 
 void ParserVisitor::visit(StringLiteralNode& node)
 {
-    outcome.push_back("\"" + node.getValue() + "\"");
+    emit("\"");
+    emit(node.getValue());
+    emit("\"");
 }
 
 void ParserVisitor::visit(IdentifierNode& node)
 {
-    outcome.push_back(node.getName());
+    emit(node.getName());
 }
 
 void ParserVisitor::visit(BinaryOpNode& node)
 {
-    node.left->accept(*this);
-    outcome.push_back(" " + operatorToString(node.getBinOp()) + " ");
-    node.right->accept(*this);
+    visitChild(node.left);
+    emit(operatorText(node.getBinOp()));
+    visitChild(node.right);
 }
 
 void ParserVisitor::visit(TypeCastNode& node)
 {
-    node.expression->accept(*this);
-    outcome.push_back(" As " + typeToString(node.getTargetType()));
+    visitChild(node.expression);
+    emit(castText(node.getTargetType()));
 }
 
 void ParserVisitor::visit(FunctionCallNode& node)
 {
-    node.callee->accept(*this);
-    outcome.push_back("(");
+    visitChild(node.callee);
+    emit("(");
     for (size_t i = 0; i < node.arguments.size(); ++i)
     {
-        node.arguments[i]->accept(*this);
+        visitChild(node.arguments[i]);
         if (i < node.arguments.size() - 1)
         {
-            outcome.push_back(", ");
+            emit(", ");
         }
     }
-    outcome.push_back(")");
+    emit(")");
 }
 
 void ParserVisitor::visit(ExpressionStatementNode& node)
 {
-    node.expression->accept(*this);
-    outcome.push_back(";");
+    visitChild(node.expression);
+    emit(";");
 }
 
 void ParserVisitor::visit(StatementBlockNode& node)
 {
-    outcome.push_back("[\n");
-    indentation++;
+    emit("[\n");
+    deeper();
     for (const auto& stmt : node.statements)
     {
-        outcome.push_back(indent(indentation));
-        stmt->accept(*this);
-        outcome.push_back("\n");
+        emitIndented();
+        visitChild(stmt);
+        emit("\n");
     }
-    indentation--;
-    outcome.push_back(indent(indentation) + "]");
+    shallower();
+    emitIndented("]");
 }
 
 void ParserVisitor::visit(FunctionDeclarationNode& node)
 {
-    outcome.push_back("Fun " + node.getName() + "(");
-    for (size_t i = 0; i < node.params.size(); ++i)
-    {
-        std::string paramBlock;
-        std::string mod = node.params[i]->modifier ? "Var" : "Const";
-        paramBlock += mod + " " + node.params[i]->id;
-        if (i < node.params.size() - 1)
-        {
-            paramBlock += ", ";
-        }
-        outcome.push_back(paramBlock);
-    }
-    outcome.push_back(")\n");
-    indentation++;
-    outcome.push_back(indent(indentation));
-    node.body->accept(*this);
-    indentation--;
+    emit("Fun ");
+    emit(node.getName());
+    emit("(");
+    emitParameters(node.params);
+    emit(")\n");
+    deeper();
+    emitIndented();
+    visitChild(node.body);
+    shallower();
 }
 
 void ParserVisitor::visit(FunctionLiteralNode& node)
 {
-    outcome.push_back("Fun(");
-    for (size_t i = 0; i < node.parameters.size(); ++i)
-    {
-        std::string paramBlock;
-        std::string mod = node.parameters[i]->modifier ? "Var" : "Const";
-        paramBlock += mod + " " + node.parameters[i]->id;
-        if (i < node.parameters.size() - 1)
-        {
-            paramBlock += ", ";
-        }
-        outcome.push_back(paramBlock);
-    }
-    outcome.push_back(")\n");
-    indentation++;
-    outcome.push_back(indent(indentation));
-    node.body->accept(*this);
-    indentation--;
+    emit("Fun(");
+    emitParameters(node.parameters);
+    emit(")\n");
+    deeper();
+    emitIndented();
+    visitChild(node.body);
+    shallower();
 }
 
 void ParserVisitor::visit(IfStatementNode& node)
 {
-    outcome.push_back("if (");
-    node.condition->accept(*this);
-    outcome.push_back(")\n");
-    indentation++;
-    outcome.push_back(indent(indentation));
-    node.thenBlock->accept(*this);
-    indentation--;
+    emit("if (");
+    visitChild(node.condition);
+    emit(")\n");
+    deeper();
+    emitIndented();
+    visitChild(node.thenBlock);
+    shallower();
 
     if (node.elseBlock)
     {
-        outcome.push_back(" else\n");
-        indentation++;
-        outcome.push_back(indent(indentation));
-        node.elseBlock->accept(*this);
-        indentation--;
+        emit(" else\n");
+        deeper();
+        emitIndented();
+        visitChild(node.elseBlock);
+        shallower();
     }
 }
 
 void ParserVisitor::visit(DeclarationNode& node)
 {
-    std::string mod = node.getModifier() ? "Var" : "Const";
-    std::string result = mod + " " + node.getIdentifierName();
-    outcome.push_back(result);
+    emit(node.getModifier() ? "Var " : "Const ");
+    emit(node.getIdentifierName());
     if (node.initializer)
     {
-        outcome.push_back(" = ");
-        node.initializer->accept(*this);
+        emit(" = ");
+        visitChild(node.initializer);
     }
-    outcome.push_back(";");
+    emit(";");
 }
 
 void ParserVisitor::visit(ReturnStatementNode& node)
 {
-    outcome.push_back("return");
+    emit("return");
     if (node.returnValue)
     {
-        outcome.push_back(" ");
-        node.returnValue->accept(*this);
+        emit(" ");
+        visitChild(node.returnValue);
     }
-    outcome.push_back(";");
+    emit(";");
 }
 
 void ParserVisitor::visit(AssignNode& node)
 {
-    outcome.push_back(node.getIdentifierName() + " = ");
-    node.expression->accept(*this);
-    outcome.push_back(";");
+    emit(node.getIdentifierName());
+    emit(" = ");
+    visitChild(node.expression);
+    emit(";");
 }
 
 void ParserVisitor::visit(WhileStatementNode& node)
 {
-    outcome.push_back("While (");
-    node.condition->accept(*this);
-    outcome.push_back(")\n");
-    indentation++;
-    outcome.push_back(indent(indentation));
-    node.body->accept(*this);
-    indentation--;
+    emit("While (");
+    visitChild(node.condition);
+    emit(")\n");
+    deeper();
+    emitIndented();
+    visitChild(node.body);
+    shallower();
 }
 
+// The entry point: the rest of the tree is walked from here by the traversal, not by nested
+// accept calls, so deeply nested programs print without deep native recursion.
 void ParserVisitor::visit(ProgramNode& node)
 {
     for (const auto& decl : node.declarations)
     {
-        decl->accept(*this);
-        outcome.push_back("\n");
+        visitChild(decl);
+        emit("\n");
     }
+    traversal.run([this](AstNode* child) { dispatch(*child); },
+                  [this](const Output& output) { write(output); });
 }
 
-std::string ParserVisitor::getParsedString() const
+void ParserVisitor::visitChild(AstNode* node)
+{
+    // The parser leaves out what an erroneous but accepted program is missing, such as the
+    // value of `x = ;`; it prints as nothing.
+    if (node) traversal.visit(node, [this](AstNode* child) { dispatch(*child); });
+}
+
+void ParserVisitor::emitParameters(NodeList<FuncDefArgument> parameters)
+{
+    for (size_t i = 0; i < parameters.size(); ++i)
+    {
+        emit(parameters[i]->modifier ? "Var " : "Const ");
+        emit(symbolName(parameters[i]->id));
+        if (i < parameters.size() - 1)
+        {
+            emit(", ");
+        }
+    }
+}
+
+void ParserVisitor::emit(std::string_view text)
 {
-    std::string parsedString = "";
-    for (const std::string& str : outcome)
+    sink->write(text);
+}
+
+void ParserVisitor::emit(const char* text)
+{
+    output({Output::Kind::Text, text});
+}
+
+void ParserVisitor::emitIndented(const char* text)
+{
+    output({Output::Kind::Indented, text});
+}
+
+void ParserVisitor::deeper()
+{
+    output({Output::Kind::Deeper, ""});
+}
+
+void ParserVisitor::shallower()
+{
+    output({Output::Kind::Shallower, ""});
+}
+
+void ParserVisitor::output(Output output)
+{
+    // What a visit outputs before its first child is written right away.
+    if (traversal.hasQueued())
+        traversal.doLater(output);
+    else
+        write(output);
+}
+
+void ParserVisitor::write(const Output& output)
+{
+    switch (output.kind)
     {
-        parsedString += str;
+        case Output::Kind::Text:
+            sink->write(output.text);
+            break;
+        case Output::Kind::Indented:
+            sink->indent(indentation);
+            sink->write(output.text);
+            break;
+        case Output::Kind::Deeper:
+            indentation++;
+            break;
+        case Output::Kind::Shallower:
+            indentation--;
+            break;
     }
-    return parsedString;
+}
+
+std::string ParserVisitor::getParsedString() const
+{
+    return kept.text();
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <utility>
+
+#include "workStealingPool.hpp"
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 1; i < threads; ++i)
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
+
+void WorkStealingPool::run(std::size_t count, const Task& task)
+{
+    if (count == 0) return;
+    // Workers are parked between jobs, so the queues can be refilled without racing them.
+    for (std::size_t i = 0; i < queues.size(); ++i)
+    {
+        std::size_t first = count * i / queues.size();
+        std::size_t last = count * (i + 1) / queues.size();
+        std::lock_guard<std::mutex> lock(queues[i]->mutex);
+        queues[i]->tasks.clear();
+        for (std::size_t index = first; index < last; ++index) queues[i]->tasks.push_back(index);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &task;
+        busy = static_cast<unsigned>(workers.size());
+        failure = nullptr;
+        ++generation;
+    }
+    wake.notify_all();
+    work(0, task);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    job = nullptr;
+    if (failure) std::rethrow_exception(std::exchange(failure, nullptr));
+}
+
+bool WorkStealingPool::next(unsigned self, std::size_t& task)
+{
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (std::size_t step = 1; step < queues.size(); ++step)
+    {
+        Queue& victim = *queues[(self + step) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::work(unsigned self, const Task& task)
+{
+    std::size_t index;
+    while (next(self, index))
+    {
+        try
+        {
+            task(index);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failure) failure = std::current_exception();
+        }
+    }
+}
+
+void WorkStealingPool::workerLoop(unsigned self)
+{
+    std::uint64_t seen = 0;
+    while (true)
+    {
+        const Task* task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            task = job;
+        }
+        work(self, *task);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0) done.notify_one();
+    }
+}
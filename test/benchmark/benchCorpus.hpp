@@ -0,0 +1,66 @@
+#pragma once
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Synthetic script shaped like our generated inputs: many small top-level functions with
+// declarations, loops, string literals and comments.
+inline std::string generateProgram(int functions)
+{
+    std::string program = "const limit = 100;\n";
+    for (int i = 0; i < functions; ++i)
+    {
+        std::string id = std::to_string(i);
+        program += "// helper number " + id + "\n";
+        program += "fun helper_" + id + "(var counter, const step)\n[\n";
+        program += "    var total = 0;\n";
+        program += "    var label = \"helper " + id + " says \\\"hi\\\"\";\n";
+        program += "    while (counter < limit && total >= 0)\n    [\n";
+        program += "        total = total + counter * step - 1;\n";
+        program += "        counter = counter + 1;\n    ]\n";
+        program += "    if (total != 0) [ return (total as float) / 2.5; ] else [ return label; ]\n";
+        program += "]\n\n";
+    }
+    return program;
+}
+
+// Functions that are mostly long arithmetic, comparison and cast chains, with calls and
+// parentheses mixed in.
+inline std::string generateExpressionProgram(int functions)
+{
+    std::string program;
+    for (int i = 0; i < functions; ++i)
+    {
+        std::string id = std::to_string(i);
+        program += "fun calc_" + id + "(const a, const b, var c)\n[\n";
+        program += "    var x = a * 2 + b / 3 - (a + b) * (c - 1) + f(a, b * 2, c) / 4;\n";
+        program += "    var y = (x + 1) * (x - 1) / (a | b) + g(x)(y) - " + id + " as float;\n";
+        program += "    while (x < y * 2 && a + b >= c || x != y - 1 && (c + 1) * 2 > b)\n";
+        program += "    [\n        c = c + a * b - x / (y + 1) + 0.5 * " + id + ";\n    ]\n";
+        program += "    return x * y + a * b * c - (x + y) / 2 as int as string;\n";
+        program += "]\n\n";
+    }
+    return program;
+}
+
+// Small scripts that each fail somewhere, lexically or in the parser, like the bulk of what
+// users submit for validation.
+inline std::vector<std::string> generateInvalidScripts(int count)
+{
+    const std::string breakages[] = {
+        "fun f(var x) [ return x + ; ]\n",     "fun f(var x) [ var y = x * 2 ]\n",
+        "var s = \"never closed;\n",            "fun f(x) [ return x; ]\n",
+        "fun f() [ while (x > ) [ x = 1; ] ]\n", "var too_long_" + std::string(50, 'x') + ";\n",
+        "fun f() [ return 1.5.; ]\n",           "fun f() [ if (x) [ ] else ]\n",
+    };
+    std::vector<std::string> scripts;
+    for (int i = 0; i < count; ++i)
+    {
+        std::string script;
+        for (int j = 0; j < i % 5; ++j)
+            script += "fun ok_" + std::to_string(j) + "(var a) [ return a * 2; ]\n";
+        script += breakages[i % std::size(breakages)];
+        scripts.push_back(script);
+    }
+    return scripts;
+}
@@ -0,0 +1,113 @@
+#include <string>
+
+#include <catch2/catch_all.hpp>
+
+#include "bytecode.hpp"
+#include "outputSink.hpp"
+#include "parser.hpp"
+#include "registerVm.hpp"
+#include "sourceBuffer.hpp"
+#include "stackVm.hpp"
+
+// Scripts that do little per instruction, so the time goes to dispatch. The strategy is picked
+// when building (BIBL_DISPATCH), so compare two builds: `just bench-dispatch` runs both.
+namespace
+{
+#ifdef BIBL_COMPUTED_GOTO
+const std::string DISPATCH = " (goto)";
+#else
+const std::string DISPATCH = " (switch)";
+#endif
+
+// One comparison, one jump back and one addition per round.
+const char* const EMPTY_LOOP = R"(
+fun main()
+[
+    var i = 0;
+    while (i < 300000) [ i = i + 1; ]
+    return i;
+]
+)";
+
+// Which branch runs changes every round, and with it the sequence of handlers.
+const char* const BRANCHES = R"(
+fun main()
+[
+    var i = 0;
+    var total = 0;
+    while (i < 100000)
+    [
+        var lane = i - (i / 4) * 4;
+        if (lane == 0) [ total = total + 1; ]
+        else [ if (lane == 1) [ total = total - i; ]
+        else [ if (lane == 2) [ total = total * 1; ] else [ total = total + i / 2; ] ] ]
+        i = i + 1;
+    ]
+    return total;
+]
+)";
+
+// Most opcodes once a round.
+const char* const OPERATOR_MIX = R"(
+fun main()
+[
+    var i = 0;
+    var count = 0;
+    var real = 0.5;
+    while (i < 50000)
+    [
+        if ((i * 3 - 1) / 2 >= i && i != 7 || i <= 0) [ count = count + 1; ]
+        real = real * 1.0 + (i as float) - (i as float);
+        i = i + 1;
+    ]
+    return count;
+]
+)";
+
+// A short function called every round.
+const char* const CALLS = R"(
+fun next(const x) [ return x + 1; ]
+
+fun main()
+[
+    var i = 0;
+    while (i < 50000) [ i = next(i); ]
+    return i;
+]
+)";
+
+std::unique_ptr<ProgramNode> parse(const char* script)
+{
+    SourceBuffer source = SourceBuffer::fromString(script);
+    Lexer lexer(source);
+    Parser parser(lexer);
+    return parser.parseProgram();
+}
+
+void benchmarkBoth(const std::string& name, const char* script)
+{
+    const auto program = parse(script);
+    const CompiledProgram stackCode = compileBytecode(*program);
+    const RegisterProgram registerCode = compileRegisters(*program);
+    OutputSink out;
+
+    BENCHMARK(name + ", stack VM" + DISPATCH)
+    {
+        return StackVm(out).run(stackCode).asInt();
+    };
+
+    BENCHMARK(name + ", register VM" + DISPATCH)
+    {
+        return RegisterVm(out).run(registerCode).asInt();
+    };
+}
+
+}  // namespace
+
+TEST_CASE("Bytecode dispatch", "[benchmark][dispatch]")
+{
+    benchmarkBoth("empty loop", EMPTY_LOOP);
+    benchmarkBoth("branches", BRANCHES);
+    benchmarkBoth("operator mix", OPERATOR_MIX);
+    benchmarkBoth("calls", CALLS);
+}
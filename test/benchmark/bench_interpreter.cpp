@@ -0,0 +1,135 @@
+#include <cstdio>
+
+#include <catch2/catch_all.hpp>
+
+#include "bytecode.hpp"
+#include "interpreterVisitor.hpp"
+#include "outputSink.hpp"
+#include "parser.hpp"
+#include "registerVm.hpp"
+#include "sourceBuffer.hpp"
+#include "stackVm.hpp"
+
+namespace
+{
+// A counting loop: variable reads, arithmetic and comparisons, no calls.
+const char* const LOOP_SCRIPT = R"(
+fun main()
+[
+    var i = 0;
+    var total = 0;
+    while (i < 200000)
+    [
+        total = total + i - (i / 3) * 3;
+        i = i + 1;
+    ]
+    return total;
+]
+)";
+
+// Calls dominate: plain recursion, then a closure called in a loop.
+const char* const CALL_SCRIPT = R"(
+fun fib(const n)
+[
+    if (n < 2) [ return n; ]
+    return fib(n - 1) + fib(n - 2);
+]
+
+fun main()
+[
+    var step = 3;
+    var add = fun(var x) [ return x + step; ];
+    var i = 0;
+    var total = fib(20);
+    while (i < 20000)
+    [
+        total = add(total) - step;
+        i = i + 1;
+    ]
+    return total;
+]
+)";
+
+std::unique_ptr<ProgramNode> parse(const char* script)
+{
+    SourceBuffer source = SourceBuffer::fromString(script);
+    Lexer lexer(source);
+    Parser parser(lexer);
+    return parser.parseProgram();
+}
+
+template <typename Program>
+std::size_t codeSize(const Program& program)
+{
+    std::size_t size = 0;
+    for (const auto& function : program.functions) size += function->code.size();
+    return size;
+}
+
+// Instructions compiled and instructions run, which the timings are easier to read with.
+void reportInstructions(const char* name, const char* script)
+{
+    const auto program = parse(script);
+    const CompiledProgram stackCode = compileBytecode(*program);
+    const RegisterProgram registerCode = compileRegisters(*program);
+    OutputSink out;
+    StackVm stackVm(out);
+    stackVm.run(stackCode);
+    RegisterVm registerVm(out);
+    registerVm.run(registerCode);
+    std::printf("%-6s stack VM: %5zu compiled, %9llu run; register VM: %5zu compiled, %9llu run\n",
+                name, codeSize(stackCode),
+                static_cast<unsigned long long>(stackVm.instructionCount()),
+                codeSize(registerCode),
+                static_cast<unsigned long long>(registerVm.instructionCount()));
+}
+
+}  // namespace
+
+TEST_CASE("Interpreter engines", "[benchmark][interpreter]")
+{
+    const auto loop = parse(LOOP_SCRIPT);
+    const auto calls = parse(CALL_SCRIPT);
+    OutputSink out;
+
+    BENCHMARK("tree walker, loop")
+    {
+        return InterpreterVisitor(out).run(*loop).asInt();
+    };
+
+    BENCHMARK("tree walker, calls")
+    {
+        return InterpreterVisitor(out).run(*calls).asInt();
+    };
+
+    const CompiledProgram loopCode = compileBytecode(*loop);
+    const CompiledProgram callCode = compileBytecode(*calls);
+
+    BENCHMARK("stack VM, loop")
+    {
+        return StackVm(out).run(loopCode).asInt();
+    };
+
+    BENCHMARK("stack VM, calls")
+    {
+        return StackVm(out).run(callCode).asInt();
+    };
+
+    const RegisterProgram loopRegisters = compileRegisters(*loop);
+    const RegisterProgram callRegisters = compileRegisters(*calls);
+    BENCHMARK("register VM, loop")
+    {
+        return RegisterVm(out).run(loopRegisters).asInt();
+    };
+
+    BENCHMARK("register VM, calls")
+    {
+        return RegisterVm(out).run(callRegisters).asInt();
+    };
+}
+
+TEST_CASE("Interpreter instruction counts", "[benchmark][interpreter]")
+{
+    reportInstructions("loop", LOOP_SCRIPT);
+    reportInstructions("calls", CALL_SCRIPT);
+}
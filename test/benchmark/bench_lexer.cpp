@@ -0,0 +1,227 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <catch2/catch_all.hpp>
+
+#include "benchCorpus.hpp"
+#include "lexer.hpp"
+#include "parallelLexer.hpp"
+#include "scanKernels.hpp"
+#include "sourceBuffer.hpp"
+#include "sourceReader.hpp"
+#include "utf8.hpp"
+
+namespace
+{
+std::size_t countTokens(Lexer& lexer)
+{
+    std::size_t count = 0;
+    while (lexer.scanToken().type != TokenType::EndOfFile) ++count;
+    return count;
+}
+
+std::string kernelName(ScanKernel kernel)
+{
+    switch (kernel)
+    {
+        case ScanKernel::Scalar:
+            return "scalar";
+        case ScanKernel::Sse2:
+            return "sse2";
+        case ScanKernel::Avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+}  // namespace
+
+TEST_CASE("Lexer input paths", "[benchmark][lexer]")
+{
+    const std::string program = generateProgram(20000);
+    const std::string path = "bench_lexer_input.txt";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << program;
+    }
+
+    BENCHMARK("istringstream")
+    {
+        std::istringstream input(program);
+        Lexer lexer(input);
+        return countTokens(lexer);
+    };
+
+    BENCHMARK("ifstream")
+    {
+        std::ifstream input(path, std::ios::binary);
+        Lexer lexer(input);
+        return countTokens(lexer);
+    };
+
+    BENCHMARK("source buffer (in memory)")
+    {
+        SourceBuffer source = SourceBuffer::fromString(program);
+        Lexer lexer(source);
+        return countTokens(lexer);
+    };
+
+    BENCHMARK("source buffer (mmap)")
+    {
+        SourceBuffer source = SourceBuffer::fromFile(path);
+        Lexer lexer(source);
+        return countTokens(lexer);
+    };
+
+    BENCHMARK("chunked reader (read(2))")
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        SourceReader reader = SourceReader::fromDescriptor(fd);
+        Lexer lexer(reader);
+        std::size_t count = countTokens(lexer);
+        ::close(fd);
+        return count;
+    };
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Scan kernel throughput", "[benchmark][lexer][simd]")
+{
+    // 64 MiB runs; divide the size by the reported time for GB/s.
+    const std::size_t size = std::size_t(64) << 20;
+    const std::string blanks(size, ' ');
+    const std::string identifier(size, 'x');
+    const std::string comment(size, '/');
+
+    ScanKernel original = activeScanKernel();
+    for (ScanKernel kernel : {ScanKernel::Scalar, ScanKernel::Sse2, ScanKernel::Avx2})
+    {
+        if (!scanKernelSupported(kernel)) continue;
+        useScanKernel(kernel);
+        const std::string name = kernelName(kernel);
+
+        BENCHMARK("skipBlanks 64 MiB " + name)
+        {
+            return skipBlanks(blanks.data(), blanks.data() + size);
+        };
+        BENCHMARK("skipIdentifierChars 64 MiB " + name)
+        {
+            return skipIdentifierChars(identifier.data(), identifier.data() + size);
+        };
+        BENCHMARK("findLineEnd 64 MiB " + name)
+        {
+            return findLineEnd(comment.data(), comment.data() + size);
+        };
+        BENCHMARK("findStringStop 64 MiB " + name)
+        {
+            return findStringStop(comment.data(), comment.data() + size);
+        };
+        BENCHMARK("skipAscii 64 MiB " + name)
+        {
+            return skipAscii(comment.data(), comment.data() + size);
+        };
+    }
+    useScanKernel(original);
+}
+
+TEST_CASE("UTF-8 validation", "[benchmark][lexer][utf8]")
+{
+    const std::size_t size = std::size_t(64) << 20;
+    const std::string ascii(size, 'x');
+    // Polish prose: mostly ASCII with a two-byte letter every few characters.
+    std::string polish;
+    polish.reserve(size);
+    while (polish.size() < size) polish += "Zażółć gęślą jaźń, ";
+
+    std::vector<SourceOffset> continuations;
+    BENCHMARK("validate 64 MiB ASCII")
+    {
+        continuations.clear();
+        return Utf8Validator().feed(ascii.data(), ascii.data() + ascii.size(), 0, continuations);
+    };
+    BENCHMARK("validate 64 MiB Polish")
+    {
+        continuations.clear();
+        return Utf8Validator().feed(polish.data(), polish.data() + polish.size(), 0,
+                                    continuations);
+    };
+}
+
+TEST_CASE("Lexer throughput per scan kernel", "[benchmark][lexer][simd]")
+{
+    SourceBuffer source = SourceBuffer::fromString(generateProgram(20000));
+
+    ScanKernel original = activeScanKernel();
+    for (ScanKernel kernel : {ScanKernel::Scalar, ScanKernel::Sse2, ScanKernel::Avx2})
+    {
+        if (!scanKernelSupported(kernel)) continue;
+        useScanKernel(kernel);
+        BENCHMARK("lex " + std::to_string(source.size() >> 20) + " MiB " + kernelName(kernel))
+        {
+            Lexer lexer(source);
+            return countTokens(lexer);
+        };
+    }
+    useScanKernel(original);
+}
+
+TEST_CASE("Lexer throughput per token type", "[benchmark][lexer][tokens]")
+{
+    const int count = 200000;
+    auto repeat = [count](const std::string& spelling)
+    {
+        std::string text;
+        text.reserve((spelling.size() + 1) * count);
+        for (int i = 0; i < count; ++i) text += spelling + ' ';
+        return SourceBuffer::fromString(text);
+    };
+    struct Sample
+    {
+        const char* name;
+        SourceBuffer source;
+    };
+    Sample samples[] = {
+        {"identifiers", repeat("counter_value")},
+        {"keywords", repeat("return")},
+        {"type names", repeat("string")},
+        {"integers", repeat("1234567")},
+        {"floats", repeat("3.14159")},
+        {"strings", repeat("\"a short literal\"")},
+        {"strings with escapes", repeat(R"("tab\there \"q\"")")},
+        {"one-char symbols", repeat("(")},
+        {"two-char symbols", repeat("<=")},
+    };
+
+    for (Sample& sample : samples)
+    {
+        BENCHMARK(std::string("200k ") + sample.name)
+        {
+            Lexer lexer(sample.source);
+            return countTokens(lexer);
+        };
+    }
+}
+
+TEST_CASE("Parallel lexing", "[benchmark][lexer][parallel]")
+{
+    const SourceBuffer source = SourceBuffer::fromString(generateProgram(40000));
+
+    BENCHMARK("sequential tokenize")
+    {
+        Lexer lexer(source);
+        return TokenBuffer::tokenize(lexer).size();
+    };
+
+    for (unsigned threads : {1u, 2u, 4u, 8u})
+    {
+        BENCHMARK(std::to_string(threads) + " thread(s)")
+        {
+            return tokenizeParallel(source, threads).size();
+        };
+    }
+}
@@ -0,0 +1,578 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <ostream>
+
+#include <catch2/catch_all.hpp>
+
+#include "astCache.hpp"
+#include "benchCorpus.hpp"
+#include "flatAstVisitor.hpp"
+#include "flatPrinter.hpp"
+#include "outputSink.hpp"
+#include "parallelLexer.hpp"
+#include "parallelParser.hpp"
+#include "parser.hpp"
+#include "parserVisitor.hpp"
+#include "sourceBuffer.hpp"
+#include "staticVisitor.hpp"
+#include "tokenBuffer.hpp"
+#include "tokenPipeline.hpp"
+
+TEST_CASE("Parser token sources", "[benchmark][parser]")
+{
+    const SourceBuffer source = SourceBuffer::fromString(generateProgram(20000));
+
+    BENCHMARK("streaming lexer")
+    {
+        Lexer lexer(source);
+        Parser parser(lexer);
+        return parser.parseProgram()->declarations.size();
+    };
+
+    BENCHMARK("tokenize + token buffer")
+    {
+        Lexer lexer(source);
+        TokenBuffer tokens = TokenBuffer::tokenize(lexer);
+        Parser parser(tokens);
+        return parser.parseProgram()->declarations.size();
+    };
+
+    BENCHMARK("pipelined lexer thread")
+    {
+        Lexer lexer(source);
+        TokenPipeline pipeline(lexer);
+        Parser parser(pipeline);
+        return parser.parseProgram()->declarations.size();
+    };
+
+    Lexer lexer(source);
+    const TokenBuffer tokens = TokenBuffer::tokenize(lexer);
+    BENCHMARK("re-parse token buffer")
+    {
+        Parser parser(tokens);
+        return parser.parseProgram()->declarations.size();
+    };
+}
+
+TEST_CASE("Parallel parse", "[benchmark][parser][parallel]")
+{
+    const SourceBuffer source = SourceBuffer::fromString(generateProgram(20000));
+    Lexer lexer(source);
+    const TokenBuffer tokens = TokenBuffer::tokenize(lexer);
+
+    BENCHMARK("sequential")
+    {
+        Parser parser(tokens);
+        return parser.tryParseProgram().program->declarations.size();
+    };
+
+    for (unsigned threads : {1u, 2u, 4u, 8u})
+    {
+        WorkStealingPool pool(threads);
+        BENCHMARK("parallel, " + std::to_string(threads) + " threads")
+        {
+            return parseParallel(tokens, pool).program->declarations.size();
+        };
+    }
+}
+
+TEST_CASE("AST cache", "[benchmark][parser][cache]")
+{
+    const std::string script = generateProgram(5000);
+    const SourceBuffer source = SourceBuffer::fromString(script);
+    const std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bibl-cache-benchmark";
+    std::filesystem::remove_all(directory);
+    AstCache cache(directory.string());
+
+    BENCHMARK("no cache")
+    {
+        TokenBuffer tokens = tokenizeParallel(source);
+        return parseParallel(tokens).program->declarations.size();
+    };
+
+    // Includes emptying the directory and writing the manifest.
+    BENCHMARK("cold cache")
+    {
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        return cache.load(source).parsed;
+    };
+
+    // A version of the script nobody has seen whole: one new declaration, everything else from
+    // the manifest of the version before. Older manifests are removed to keep the disk free.
+    int edits = 0;
+    std::filesystem::path previous;
+    BENCHMARK("one declaration changed")
+    {
+        const SourceBuffer edited =
+            SourceBuffer::fromString(script + "var edit" + std::to_string(edits++) + ";\n");
+        std::size_t reused = cache.load(edited, "script").reused;
+        char manifest[32];
+        std::snprintf(manifest, sizeof(manifest), "%016llx.program",
+                      static_cast<unsigned long long>(contentHash(edited.view())));
+        if (!previous.empty()) std::filesystem::remove(previous);
+        previous = directory / manifest;
+        return reused;
+    };
+
+    BENCHMARK("warm cache")
+    {
+        return cache.load(source).reused;
+    };
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Expression-heavy input", "[benchmark][parser][expression]")
+{
+    const SourceBuffer source = SourceBuffer::fromString(generateExpressionProgram(10000));
+    Lexer lexer(source);
+    const TokenBuffer tokens = TokenBuffer::tokenize(lexer);
+
+    BENCHMARK("parse token buffer")
+    {
+        Parser parser(tokens);
+        return parser.parseProgram()->declarations.size();
+    };
+}
+
+namespace
+{
+// Both walkers touch every node and sum the offsets, so neither can skip the loads.
+class PointerWalker : public AstVisitor
+{
+   public:
+    std::size_t sum = 0;
+
+    void walk(AstNode* node)
+    {
+        if (node) node->accept(*this);
+    }
+    void visit(NumberLiteralNode& node) override { sum += node.getStartOffset(); }
+    void visit(StringLiteralNode& node) override { sum += node.getStartOffset(); }
+    void visit(IdentifierNode& node) override { sum += node.getStartOffset(); }
+    void visit(BinaryOpNode& node) override
+    {
+        sum += node.getStartOffset();
+        walk(node.left);
+        walk(node.right);
+    }
+    void visit(TypeCastNode& node) override
+    {
+        sum += node.getStartOffset();
+        walk(node.expression);
+    }
+    void visit(FunctionCallNode& node) override
+    {
+        sum += node.getStartOffset();
+        walk(node.callee);
+        for (ExpressionNode* argument : node.arguments) walk(argument);
+    }
+    void visit(ExpressionStatementNode& node) override { walk(node.expression); }
+    void visit(StatementBlockNode& node) override
+    {
+        sum += node.getStartOffset();
+        for (StatementNode* statement : node.statements) walk(statement);
+    }
+    void visit(FunctionDeclarationNode& node) override
+    {
+        sum += node.getStartOffset() + node.params.size();
+        walk(node.body);
+    }
+    void visit(FunctionLiteralNode& node) override
+    {
+        sum += node.getStartOffset() + node.parameters.size();
+        walk(node.body);
+    }
+    void visit(IfStatementNode& node) override
+    {
+        sum += node.getStartOffset();
+        walk(node.condition);
+        walk(node.thenBlock);
+        walk(node.elseBlock);
+    }
+    void visit(DeclarationNode& node) override
+    {
+        sum += node.getStartOffset();
+        walk(node.initializer);
+    }
+    void visit(ReturnStatementNode& node) override
+    {
+        sum += node.getStartOffset();
+        walk(node.returnValue);
+    }
+    void visit(AssignNode& node) override
+    {
+        sum += node.getStartOffset();
+        walk(node.expression);
+    }
+    void visit(WhileStatementNode& node) override
+    {
+        sum += node.getStartOffset();
+        walk(node.condition);
+        walk(node.body);
+    }
+    void visit(ProgramNode& node) override
+    {
+        for (AstNode* declaration : node.declarations) walk(declaration);
+    }
+};
+
+// PointerWalker again, dispatching on the kind tag instead of through accept.
+class StaticWalker : public StaticVisitor<StaticWalker>
+{
+   public:
+    std::size_t sum = 0;
+
+    void walk(AstNode* node)
+    {
+        if (node) dispatch(*node);
+    }
+    void visit(NumberLiteralNode& node) { sum += node.getStartOffset(); }
+    void visit(StringLiteralNode& node) { sum += node.getStartOffset(); }
+    void visit(IdentifierNode& node) { sum += node.getStartOffset(); }
+    void visit(BinaryOpNode& node)
+    {
+        sum += node.getStartOffset();
+        walk(node.left);
+        walk(node.right);
+    }
+    void visit(TypeCastNode& node)
+    {
+        sum += node.getStartOffset();
+        walk(node.expression);
+    }
+    void visit(FunctionCallNode& node)
+    {
+        sum += node.getStartOffset();
+        walk(node.callee);
+        for (ExpressionNode* argument : node.arguments) walk(argument);
+    }
+    void visit(ExpressionStatementNode& node) { walk(node.expression); }
+    void visit(StatementBlockNode& node)
+    {
+        sum += node.getStartOffset();
+        for (StatementNode* statement : node.statements) walk(statement);
+    }
+    void visit(FunctionDeclarationNode& node)
+    {
+        sum += node.getStartOffset() + node.params.size();
+        walk(node.body);
+    }
+    void visit(FunctionLiteralNode& node)
+    {
+        sum += node.getStartOffset() + node.parameters.size();
+        walk(node.body);
+    }
+    void visit(IfStatementNode& node)
+    {
+        sum += node.getStartOffset();
+        walk(node.condition);
+        walk(node.thenBlock);
+        walk(node.elseBlock);
+    }
+    void visit(DeclarationNode& node)
+    {
+        sum += node.getStartOffset();
+        walk(node.initializer);
+    }
+    void visit(ReturnStatementNode& node)
+    {
+        sum += node.getStartOffset();
+        walk(node.returnValue);
+    }
+    void visit(AssignNode& node)
+    {
+        sum += node.getStartOffset();
+        walk(node.expression);
+    }
+    void visit(WhileStatementNode& node)
+    {
+        sum += node.getStartOffset();
+        walk(node.condition);
+        walk(node.body);
+    }
+    void visit(ProgramNode& node)
+    {
+        for (AstNode* declaration : node.declarations) walk(declaration);
+    }
+};
+
+class FlatWalker : public FlatAstVisitor
+{
+   public:
+    std::size_t sum = 0;
+
+    void walk(const FlatAst& ast, NodeIndex node)
+    {
+        if (node != NO_NODE) ast.accept(node, *this);
+    }
+    void visitNumberLiteral(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+    }
+    void visitStringLiteral(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+    }
+    void visitIdentifier(const FlatAst& ast, NodeIndex node) override { sum += ast.offset(node); }
+    void visitBinaryOp(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+        walk(ast, ast.left(node));
+        walk(ast, ast.right(node));
+    }
+    void visitTypeCast(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+        walk(ast, ast.expression(node));
+    }
+    void visitFunctionCall(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+        walk(ast, ast.callee(node));
+        for (NodeIndex argument : ast.arguments(node)) walk(ast, argument);
+    }
+    void visitExpressionStatement(const FlatAst& ast, NodeIndex node) override
+    {
+        walk(ast, ast.expression(node));
+    }
+    void visitStatementBlock(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+        for (NodeIndex statement : ast.statements(node)) walk(ast, statement);
+    }
+    void visitFunctionDeclaration(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node) + ast.parameters(node).size();
+        walk(ast, ast.body(node));
+    }
+    void visitFunctionLiteral(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node) + ast.parameters(node).size();
+        walk(ast, ast.body(node));
+    }
+    void visitParameter(const FlatAst&, NodeIndex) override {}
+    void visitIfStatement(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+        walk(ast, ast.condition(node));
+        walk(ast, ast.thenBlock(node));
+        walk(ast, ast.elseBlock(node));
+    }
+    void visitDeclaration(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+        walk(ast, ast.expression(node));
+    }
+    void visitReturnStatement(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+        walk(ast, ast.expression(node));
+    }
+    void visitAssign(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+        walk(ast, ast.expression(node));
+    }
+    void visitWhileStatement(const FlatAst& ast, NodeIndex node) override
+    {
+        sum += ast.offset(node);
+        walk(ast, ast.condition(node));
+        walk(ast, ast.body(node));
+    }
+    void visitProgram(const FlatAst& ast, NodeIndex) override
+    {
+        for (NodeIndex declaration : ast.declarations()) walk(ast, declaration);
+    }
+};
+}  // namespace
+
+TEST_CASE("AST traversal", "[benchmark][parser][flat]")
+{
+    const SourceBuffer source = SourceBuffer::fromString(generateProgram(20000));
+    Lexer lexer(source);
+    const TokenBuffer tokens = TokenBuffer::tokenize(lexer);
+    std::unique_ptr<ProgramNode> program = Parser(tokens).parseProgram();
+    const FlatAst flat = FlatAst::build(*program);
+    WARN("pointer tree: " << program->arena->bytesReserved() << " bytes, flat tree: "
+                          << flat.memoryUsage() << " bytes, " << flat.size() << " nodes");
+
+    BENCHMARK("walk pointer tree")
+    {
+        PointerWalker walker;
+        walker.walk(program.get());
+        return walker.sum;
+    };
+
+    BENCHMARK("walk pointer tree, static dispatch")
+    {
+        StaticWalker walker;
+        walker.walk(program.get());
+        return walker.sum;
+    };
+
+    BENCHMARK("walk flat tree")
+    {
+        FlatWalker walker;
+        walker.walk(flat, flat.root());
+        return walker.sum;
+    };
+
+    // Passes that do not care about nesting can sweep the array instead of recursing.
+    BENCHMARK("scan flat tree")
+    {
+        std::size_t sum = 0;
+        for (NodeIndex node = 0; node < flat.size(); ++node)
+            if (flat.kind(node) != FlatKind::Parameter) sum += flat.offset(node);
+        return sum;
+    };
+
+    BENCHMARK("lower to flat tree")
+    {
+        return FlatAst::build(*program).size();
+    };
+
+    BENCHMARK("print pointer tree")
+    {
+        ParserVisitor printer;
+        program->accept(printer);
+        return printer.getParsedString().size();
+    };
+
+    BENCHMARK("print flat tree")
+    {
+        FlatPrinter printer;
+        printer.print(flat);
+        return printer.getParsedString().size();
+    };
+
+    // As bibl prints: in chunks, here to a stream that drops them.
+    std::ostream discard(nullptr);
+    BENCHMARK("stream pointer tree")
+    {
+        OutputSink sink = OutputSink::toStream(discard);
+        ParserVisitor printer(sink);
+        program->accept(printer);
+        return sink.text().size();
+    };
+
+    BENCHMARK("stream flat tree")
+    {
+        OutputSink sink = OutputSink::toStream(discard);
+        FlatPrinter printer(sink);
+        printer.print(flat);
+        return sink.text().size();
+    };
+}
+
+TEST_CASE("Literal-heavy input", "[benchmark][parser][string]")
+{
+    std::string script = "fun f() [\n";
+    for (int i = 0; i < 50000; ++i)
+        script += R"(    log("a plain message", "one with \"escapes\"\n", "x");)" "\n";
+    script += "]\n";
+    const SourceBuffer source = SourceBuffer::fromString(script);
+
+    BENCHMARK("lex and parse 150k string literals")
+    {
+        Lexer lexer(source);
+        return Parser(lexer).parseProgram()->declarations.size();
+    };
+}
+
+TEST_CASE("Deeply nested input", "[benchmark][parser][nesting]")
+{
+    const int depth = 100000;
+    std::string parens = "fun f() [ x = ";
+    std::string chain = "fun f() [ x = a";
+    for (int i = 0; i < depth; ++i)
+    {
+        parens += "(a + ";
+        chain += " | a";
+    }
+    parens += "a" + std::string(depth, ')') + "; ]";
+    chain += "; ]";
+    const SourceBuffer nested = SourceBuffer::fromString(parens);
+    const SourceBuffer chained = SourceBuffer::fromString(chain);
+
+    BENCHMARK("parse 100k nested parentheses")
+    {
+        Lexer lexer(nested);
+        return Parser(lexer).parseProgram()->declarations.size();
+    };
+
+    BENCHMARK("parse and print 100k nested parentheses")
+    {
+        Lexer lexer(nested);
+        ParserVisitor printer;
+        Parser(lexer).parseProgram()->accept(printer);
+        return printer.getParsedString().size();
+    };
+
+    BENCHMARK("parse, lower and print a 100k operator chain")
+    {
+        Lexer lexer(chained);
+        FlatPrinter printer;
+        printer.print(Parser(lexer).parseFlatProgram());
+        return printer.getParsedString().size();
+    };
+}
+
+TEST_CASE("Invalid input corpus", "[benchmark][parser][error]")
+{
+    std::vector<SourceBuffer> sources;
+    for (const std::string& script : generateInvalidScripts(10000))
+        sources.push_back(SourceBuffer::fromString(script));
+
+    BENCHMARK("parseProgram, catch")
+    {
+        std::size_t failures = 0;
+        for (const SourceBuffer& source : sources)
+        {
+            Lexer lexer(source);
+            Parser parser(lexer);
+            try
+            {
+                parser.parseProgram();
+            }
+            catch (const InterpreterException& ex)
+            {
+                failures += ex.error.offset != 0;
+            }
+        }
+        return failures;
+    };
+
+    BENCHMARK("parseProgram, catch and print")
+    {
+        std::size_t length = 0;
+        for (const SourceBuffer& source : sources)
+        {
+            Lexer lexer(source);
+            Parser parser(lexer);
+            try
+            {
+                parser.parseProgram();
+            }
+            catch (const InterpreterException& ex)
+            {
+                length += std::strlen(ex.what());
+            }
+        }
+        return length;
+    };
+
+    BENCHMARK("tryParseProgram")
+    {
+        std::size_t failures = 0;
+        for (const SourceBuffer& source : sources)
+        {
+            Lexer lexer(source);
+            Parser parser(lexer);
+            failures += parser.tryParseProgram().error.has_value();
+        }
+        return failures;
+    };
+}
@@ -0,0 +1,11 @@
+# Runs BIBL with the arguments in ARGS and fails unless it exits with an error after printing
+# the usage line.
+execute_process(
+    COMMAND ${BIBL} ${ARGS}
+    RESULT_VARIABLE status
+    OUTPUT_QUIET
+    ERROR_VARIABLE errors
+)
+if(status EQUAL 0 OR NOT errors MATCHES "^Usage: ")
+    message(FATAL_ERROR "bibl ${ARGS} exited with ${status} and printed:\n${errors}")
+endif()
@@ -0,0 +1,295 @@
+#include <string>
+
+#include "catch2/catch_all.hpp"
+
+#include "allocationCounter.hpp"
+#include "bytecode.hpp"
+#include "interpreterVisitor.hpp"
+#include "outputSink.hpp"
+#include "parser.hpp"
+#include "registerVm.hpp"
+#include "stackVm.hpp"
+
+enum class Engine
+{
+    Tree,
+    StackVm,
+    RegisterVm,
+};
+
+// Every test runs on each engine; they must print and fail alike.
+class InterpreterTester
+{
+   public:
+    Engine engine;
+    std::istringstream stream;
+    Lexer lexer;
+    Parser parser;
+    OutputSink out;
+    CompiledProgram compiled;
+    RegisterProgram registers;
+    Value result;
+
+    InterpreterTester(Engine engine, const std::string& input)
+        : engine(engine), stream(input), lexer(stream), parser(lexer)
+    {
+    }
+
+    // Returns what the script printed; main's result is kept in `result`.
+    std::string run()
+    {
+        auto program = parser.parseProgram();
+        compile(*program);
+        execute(*program);
+        return out.text();
+    }
+
+    void compile(ProgramNode& program)
+    {
+        if (engine == Engine::StackVm) compiled = compileBytecode(program);
+        if (engine == Engine::RegisterVm) registers = compileRegisters(program);
+    }
+
+    void execute(ProgramNode& program)
+    {
+        if (engine == Engine::Tree)
+            result = InterpreterVisitor(out).run(program);
+        else if (engine == Engine::StackVm)
+            result = StackVm(out).run(compiled);
+        else
+            result = RegisterVm(out).run(registers);
+    }
+};
+
+TEST_CASE("Test interpreter arithmetic and operator order", "[interpreter]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "fun main() [ print(5 - 3 - 1); print(2 + 3 * 4); print(7 / 2); print(1.5 * 2.0); "
+        "return 2 * 21; ]");
+    REQUIRE(tester.run() == "1\n14\n3\n3.0\n");
+    REQUIRE(tester.result.is(Value::Type::Int));
+    REQUIRE(tester.result.asInt() == 42);
+}
+
+TEST_CASE("Test interpreter passes arguments as copies", "[interpreter]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "fun example(var a) [ a = a + 1; ]\n"
+        "fun main() [ var a = 1; var my_fun = example; my_fun(a); print(a); ]");
+    REQUIRE(tester.run() == "1\n");
+}
+
+TEST_CASE("Test interpreter concatenates strings", "[interpreter]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "fun greet(var a) [ return \"Cześć \" + a; ]\n"
+        "fun main() [ var s = \"Ania\"; s = s + \" i Basia\"; print(s); "
+        "print(greet(\"Krzyś\")); ]");
+    REQUIRE(tester.run() == "Ania i Basia\nCześć Krzyś\n");
+}
+
+TEST_CASE("Test interpreter rejects assigning to a constant", "[interpreter][error]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine, "fun main()\n[\n    const my_val = 10;\n    my_val = 11;\n]");
+    REQUIRE_THROWS_WITH(tester.run(), "RuntimeError at 4:5 → Cannot assign to a constant: my_val");
+}
+
+TEST_CASE("Test interpreter never runs a call with a missing argument", "[interpreter][error]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine, "fun main() [ print(\"x\",); ]");
+    REQUIRE_THROWS_WITH(tester.run(), "SemanticError at 1:24 → Expected an expression");
+    REQUIRE(tester.out.text().empty());
+}
+
+TEST_CASE("Test interpreter composes and decorates functions", "[interpreter]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "fun main() [\n"
+        "    var square = fun(var x) [ return x * x; ];\n"
+        "    var increment = fun(var x) [ return x + 1; ];\n"
+        "    var square_then_increment = square | increment;\n"
+        "    print(square_then_increment(3));\n"
+        "    var ident = fun(var x) [ return x; ];\n"
+        "    var decorated = ident @@ fun(var f, var arg) [ return f(arg + 1); ];\n"
+        "    print(decorated(1));\n"
+        "]");
+    REQUIRE(tester.run() == "10\n2\n");
+}
+
+TEST_CASE("Test interpreter closures capture by value", "[interpreter]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "fun adder(var n) [ return fun(var x) [ return x + n; ]; ]\n"
+        "fun main() [\n"
+        "    var base = 10;\n"
+        "    var addBase = fun(var x) [ return x + base; ];\n"
+        "    base = 20;\n"
+        "    print(addBase(1), adder(5)(1));\n"
+        "]");
+    REQUIRE(tester.run() == "11 6\n");
+}
+
+TEST_CASE("Test interpreter runs loops and conditions", "[interpreter]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "fun main() [\n"
+        "    var i = 1; var sum = 0;\n"
+        "    while (i <= 5) [ sum = sum + i; i = i + 1; ]\n"
+        "    if (sum == 15 && i != 5) [ print(\"yes\"); ] else [ print(\"no\"); ]\n"
+        "    if (sum < 0 || sum >= 100) [ print(\"no\"); ] else [ print(sum); ]\n"
+        "]");
+    REQUIRE(tester.run() == "yes\n15\n");
+}
+
+TEST_CASE("Test interpreter returns from inside loops", "[interpreter]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "fun find(var limit) [ var i = 0; while (i < 100) [ if (i * i > limit) [ return i; ] "
+        "i = i + 1; ] return 0 - 1; ]\n"
+        "fun factorial(var n) [ if (n <= 1) [ return 1; ] return n * factorial(n - 1); ]\n"
+        "fun main() [ print(find(50)); print(factorial(10)); ]");
+    REQUIRE(tester.run() == "8\n3628800\n");
+}
+
+TEST_CASE("Test interpreter stops runaway recursion", "[interpreter][error]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "fun recursive(var a)\n[\n\treturn recursive(a);\n]\nfun main() [ recursive(1); ]");
+    REQUIRE_THROWS_WITH(tester.run(), "RuntimeError at 3:9 → Recursion is too deep");
+}
+
+TEST_CASE("Test VMs recurse past the tree walker's depth", "[interpreter]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "fun depth(var n) [ if (n == 0) [ return 0; ] return 1 + depth(n - 1); ]\n"
+        "fun main() [ return depth(5000); ]");
+    if (engine == Engine::Tree)
+    {
+        REQUIRE_THROWS_WITH(tester.run(), "RuntimeError at 1:57 → Recursion is too deep");
+        return;
+    }
+    tester.run();
+    REQUIRE(tester.result.asInt() == 5000);
+}
+
+TEST_CASE("Test interpreter keeps types strict", "[interpreter][error]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester casts(engine,
+        "fun main() [ var f = 1.45; f = f + (1 as float); print(f); print(2.7 as int); "
+        "print((3 as string) + \"x\"); ]");
+    REQUIRE(casts.run() == "2.45\n2\n3x\n");
+
+    InterpreterTester mixed(engine, "fun main() [ var a = 1 + 1.5; ]");
+    REQUIRE_THROWS_WITH(mixed.run(), "RuntimeError at 1:22 → Invalid operand types: int + float");
+
+    InterpreterTester condition(engine, "fun main() [ if (1) [ ] ]");
+    REQUIRE_THROWS_WITH(condition.run(), "RuntimeError at 1:18 → Condition is not a boolean: int");
+}
+
+TEST_CASE("Test interpreter casts strings to numbers", "[interpreter][cast]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester casts(engine,
+        "fun main() [ print((\"12\" as int) + 1); print(\"-7\" as int); "
+        "print((\"1.5\" as float) * 2.0); print(\"3\" as float); ]");
+    REQUIRE(casts.run() == "13\n-7\n3.0\n3.0\n");
+
+    InterpreterTester malformed(engine, "fun main() [ var a = \"12x\" as int; ]");
+    REQUIRE_THROWS_WITH(malformed.run(), "RuntimeError at 1:22 → Invalid cast: \"12x\" as int");
+    InterpreterTester fraction(engine, "fun main() [ var a = \"1.5\" as int; ]");
+    REQUIRE_THROWS_WITH(fraction.run(), "RuntimeError at 1:22 → Invalid cast: \"1.5\" as int");
+    InterpreterTester empty(engine, "fun main() [ var a = \"\" as float; ]");
+    REQUIRE_THROWS_WITH(empty.run(), "RuntimeError at 1:22 → Invalid cast: \"\" as float");
+    InterpreterTester large(engine, "fun main() [ var a = \"2147483648\" as int; ]");
+    REQUIRE_THROWS_WITH(large.run(), "RuntimeError at 1:22 → Integer overflow");
+}
+
+TEST_CASE("Test interpreter reports overflow and division by zero", "[interpreter][error]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester overflow(engine, "fun main() [ var a = 2000000000; a = a + a; ]");
+    REQUIRE_THROWS_WITH(overflow.run(), "RuntimeError at 1:38 → Integer overflow");
+
+    InterpreterTester division(engine, "fun main() [ var a = 1 / 0; ]");
+    REQUIRE_THROWS_WITH(division.run(), "RuntimeError at 1:22 → Division by zero");
+}
+
+TEST_CASE("Test interpreter scopes globals and locals", "[interpreter]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    InterpreterTester tester(engine,
+        "const global_var = 10;\n"
+        "var counter = 0;\n"
+        "fun example() [ const global_var = \"abc\"; counter = counter + 1; return global_var; ]\n"
+        "fun main() [ print(example()); print(global_var, counter); ]");
+    REQUIRE(tester.run() == "abc\n10 1\n");
+
+    InterpreterTester undefined(engine, "fun main() [ print(missing); ]");
+    REQUIRE_THROWS_WITH(undefined.run(), "RuntimeError at 1:20 → Undefined identifier: missing");
+
+    InterpreterTester twice(engine, "fun main() [ var a = 1; var a = 2; ]");
+    REQUIRE_THROWS_WITH(twice.run(), "RuntimeError at 1:25 → Already declared in this scope: a");
+}
+
+TEST_CASE("Test interpreter bounds expression nesting", "[interpreter][error]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    std::string script = "fun main() [ return ";
+    for (int i = 0; i < 20000; ++i) script += "(1 + ";
+    script += "1";
+    script += std::string(20000, ')');
+    script += "; ]";
+    InterpreterTester tester(engine, script);
+    REQUIRE_THROWS_WITH(tester.run(), Catch::Matchers::EndsWith("Expression is nested too deeply"));
+}
+
+TEST_CASE("Test interpreter numbers do not allocate", "[interpreter][allocations]")
+{
+    Engine engine = GENERATE(Engine::Tree, Engine::StackVm, Engine::RegisterVm);
+    auto allocationsFor = [engine](int iterations)
+    {
+        InterpreterTester tester(engine,
+            "fun main() [ var i = 0; var f = 0.5; while (i < " + std::to_string(iterations) +
+                ") [ i = i + 1; f = f * 1.0; ] print(f); return i; ]");
+        auto program = tester.parser.parseProgram();
+        tester.compile(*program);
+        AllocationCounter running;
+        tester.execute(*program);
+        REQUIRE(tester.result.asInt() == iterations);
+        return running.count();
+    };
+    std::size_t few = allocationsFor(10);
+    std::size_t many = allocationsFor(10000);
+    REQUIRE(many == few);
+}
+
+TEST_CASE("Test VM calls do not allocate", "[interpreter][allocations]")
+{
+    Engine engine = GENERATE(Engine::StackVm, Engine::RegisterVm);
+    auto allocationsFor = [engine](int n)
+    {
+        InterpreterTester tester(engine,
+            "fun fib(const n) [ if (n < 2) [ return n; ] return fib(n - 1) + fib(n - 2); ]\n"
+            "fun main() [ print(fib(" + std::to_string(n) + ")); ]");
+        auto program = tester.parser.parseProgram();
+        tester.compile(*program);
+        AllocationCounter running;
+        tester.execute(*program);
+        return running.count();
+    };
+    std::size_t few = allocationsFor(2);
+    std::size_t many = allocationsFor(18);
+    REQUIRE(many == few);
+}
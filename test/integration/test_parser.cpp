@@ -1,11 +1,25 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <memory>
+#include <optional>
+#include <random>
 
 #include "catch2/catch_all.hpp"
 
+#include "allocationCounter.hpp"
 #include "asTree.hpp"
+#include "astCache.hpp"
 #include "parser.hpp"
+#include "parallelParser.hpp"
 #include "error.hpp"
 #include "parserVisitor.hpp"
+#include "flatPrinter.hpp"
+#include "staticVisitor.hpp"
+#include "outputSink.hpp"
 
 class ParserTester
 {
@@ -135,8 +149,8 @@ TEST_CASE("Test Minimal function Declaration with body and wrong arguments",
     catch (const InterpreterException& ex)
     {
         REQUIRE(ex.error.type == ErrorType::Semantic);
-        REQUIRE(ex.error.message == "Expected 'const' or 'var'");
-        REQUIRE(ex.error.startPosition == Position(1, 14));
+        REQUIRE(ex.error.message == MessageId::ExpectedConstOrVar);
+        REQUIRE(ex.error.position() == Position(1, 14));
     }
 }
 
@@ -151,8 +165,8 @@ TEST_CASE("Test Minimal function Declaration with body and comma after an argume
     catch (const InterpreterException& ex)
     {
         REQUIRE(ex.error.type == ErrorType::Semantic);
-        REQUIRE(ex.error.message == "Expected 'const' or 'var'");
-        REQUIRE(ex.error.startPosition == Position(1, 22));
+        REQUIRE(ex.error.message == MessageId::ExpectedConstOrVar);
+        REQUIRE(ex.error.position() == Position(1, 22));
     }
 }
 
@@ -166,8 +180,8 @@ TEST_CASE("Test Minimal function Declaration with no identifier (not lambda)", "
     catch (const InterpreterException& ex)
     {
         REQUIRE(ex.error.type == ErrorType::Semantic);
-        REQUIRE(ex.error.message == "Expected function's name");
-        REQUIRE(ex.error.startPosition == Position(1, 5));
+        REQUIRE(ex.error.message == MessageId::ExpectedFunctionName);
+        REQUIRE(ex.error.position() == Position(1, 5));
     }
 }
 
@@ -181,8 +195,8 @@ TEST_CASE("Test Minimal function Declaration with no body (no brackets)", "[pars
     catch (const InterpreterException& ex)
     {
         REQUIRE(ex.error.type == ErrorType::Semantic);
-        REQUIRE(ex.error.message == "Expected '['");
-        REQUIRE(ex.error.startPosition == Position(1, 20));
+        REQUIRE(ex.error.message == MessageId::ExpectedLBracket);
+        REQUIRE(ex.error.position() == Position(1, 20));
     }
 }
 
@@ -245,8 +259,8 @@ TEST_CASE("Test assign with nothing after =", "[parser][assign][error]")
     catch (const InterpreterException& ex)
     {
         REQUIRE(ex.error.type == ErrorType::Semantic);
-        REQUIRE(ex.error.message == "Expected an expression after assign");
-        REQUIRE(ex.error.startPosition == Position(1, 7));
+        REQUIRE(ex.error.message == MessageId::ExpectedInitializer);
+        REQUIRE(ex.error.position() == Position(1, 7));
     }
 }
 
@@ -1294,6 +1308,20 @@ TEST_CASE("Test invalid expression after operator", "[parser][error]")
                         "simpleExpression");
 }
 
+TEST_CASE("Test missing argument after comma in call", "[parser][error][call]")
+{
+    ParserTester parserTester("fun a() [f(1,);]");
+    REQUIRE_THROWS_WITH(parserTester.parser.parseProgram(),
+                        "SemanticError at 1:14 → Expected an expression");
+}
+
+TEST_CASE("Test missing argument before comma in call", "[parser][error][call]")
+{
+    ParserTester parserTester("fun a() [f(,1);]");
+    REQUIRE_THROWS_WITH(parserTester.parser.parseProgram(),
+                        "SemanticError at 1:12 → Expected an expression");
+}
+
 TEST_CASE("Test missing right bracket in statement block", "[parser][error]")
 {
     ParserTester parserTester("fun a() [var x = 1;");
@@ -1366,3 +1394,912 @@ Var x = factorial(5);
 // Funkcje protected -> dziedziczenie i konwersja na publiczne
 // Lub publiczne -> We wlasciwym dziedziczenie po publicznych zmiana na prywantne
 // Mozna wziac drzewo AST i konwersja na string po czym sprawdzac w testach
+
+TEST_CASE("Test identifiers carry symbol ids", "[parser][symbol]")
+{
+    ParserTester parserTester("fun f(var x) [ x = x; ]");
+    auto program = parserTester.parser.parseProgram();
+
+    auto* function = dynamic_cast<FunctionDeclarationNode*>(program->declarations[0]);
+    REQUIRE(function != nullptr);
+    REQUIRE(function->getSymbol() == intern("f"));
+    REQUIRE(function->params[0]->id == intern("x"));
+
+    auto* assign = dynamic_cast<AssignNode*>(function->body->statements[0]);
+    REQUIRE(assign != nullptr);
+    REQUIRE(assign->getIdentifier() == intern("x"));
+    auto* value = dynamic_cast<IdentifierNode*>(assign->expression);
+    REQUIRE(value != nullptr);
+    REQUIRE(value->getSymbol() == assign->getIdentifier());
+}
+
+class BufferedParserTester
+{
+   public:
+    std::istringstream stream;
+    Lexer lexer;
+    TokenBuffer tokens;
+    Parser parser;
+
+    BufferedParserTester(const std::string& input)
+        : stream(input), lexer(stream), tokens(TokenBuffer::tokenize(lexer)), parser(tokens)
+    {
+    }
+};
+
+class LookaheadParser : public Parser
+{
+   public:
+    using Parser::advance;
+    using Parser::lookahead;
+    using Parser::Parser;
+};
+
+namespace
+{
+std::string printProgram(Parser& parser)
+{
+    auto program = parser.parseProgram();
+    ParserVisitor visitor;
+    program->accept(visitor);
+    return visitor.getParsedString();
+}
+}  // namespace
+
+TEST_CASE("Test token buffer parse matches streaming parse", "[parser][tokenBuffer]")
+{
+    std::string input = R"(
+        // comment
+        const greeting = "hi \"there\"\n";
+        fun scale(var x, const y) [
+            var total = x * 2.5 + y;
+            while (total > 10 && total != 11 || x == y) [ total = total - 1; ]
+            if (x != y) [ return total as string; ] else [ return (x | y)(1); ]
+        ]
+        var f = scale @@ scale;
+        fun main() [ print(f(1, 2)); ]
+    )";
+    ParserTester streaming(input);
+    BufferedParserTester buffered(input);
+    REQUIRE(printProgram(buffered.parser) == printProgram(streaming.parser));
+}
+
+TEST_CASE("Test token buffer keeps values and positions", "[parser][tokenBuffer]")
+{
+    std::istringstream stream("var x = 12;\n\n  y = \"s\" + 1.5;");
+    Lexer lexer(stream);
+    TokenBuffer tokens = TokenBuffer::tokenize(lexer);
+
+    REQUIRE(tokens.size() == 12);
+    REQUIRE_FALSE(tokens.lexicalError());
+    REQUIRE(tokens.type(1) == TokenType::Identifier);
+    REQUIRE(tokens.token(1).getValue<SymbolId>() == intern("x"));
+    REQUIRE(tokens.token(3).getValue<int>() == 12);
+    REQUIRE(tokens.token(7).getValue<std::string>() == "s");
+    REQUIRE(tokens.token(9).getValue<float>() == 1.5f);
+    REQUIRE(tokens.position(5) == Position(3, 3));
+    REQUIRE(tokens.position(5).offset == 15);
+    REQUIRE(tokens.type(11) == TokenType::EndOfFile);
+}
+
+TEST_CASE("Test token buffer partial parse", "[parser][tokenBuffer]")
+{
+    std::istringstream stream("var a = 1; const b = 2; var c = 3;");
+    Lexer lexer(stream);
+    TokenBuffer tokens = TokenBuffer::tokenize(lexer);
+
+    Parser middle(tokens, 5, 10);
+    REQUIRE(printProgram(middle) == "Const b = 2;\n");
+    Parser tail(tokens, 10);
+    REQUIRE(printProgram(tail) == "Var c = 3;\n");
+}
+
+TEST_CASE("Test token buffer reports lexical error in parse order", "[parser][tokenBuffer]")
+{
+    BufferedParserTester syntaxFirst("fun a() var x = 1; $");
+    REQUIRE_THROWS_WITH(syntaxFirst.parser.parseProgram(), "SemanticError at 1:9 → Expected '['");
+
+    std::string input = "var x = 1; var y = 99999999999999999999.5.;";
+    ParserTester streaming(input);
+    BufferedParserTester buffered(input);
+    REQUIRE(buffered.tokens.lexicalError());
+    std::string expected;
+    try
+    {
+        streaming.parser.parseProgram();
+    }
+    catch (const InterpreterException& ex)
+    {
+        expected = ex.what();
+    }
+    REQUIRE_FALSE(expected.empty());
+    REQUIRE_THROWS_WITH(buffered.parser.parseProgram(), expected);
+}
+
+TEST_CASE("Test token buffer lookahead", "[parser][tokenBuffer]")
+{
+    std::istringstream stream("x = f(1);");
+    Lexer lexer(stream);
+    TokenBuffer tokens = TokenBuffer::tokenize(lexer);
+    LookaheadParser parser(tokens);
+
+    REQUIRE(parser.lookahead(0) == TokenType::Identifier);
+    REQUIRE(parser.lookahead(1) == TokenType::Assign);
+    REQUIRE(parser.lookahead(3) == TokenType::LParen);
+    REQUIRE(parser.lookahead(7) == TokenType::EndOfFile);
+    REQUIRE(parser.lookahead(20) == TokenType::EndOfFile);
+    parser.advance();
+    REQUIRE(parser.lookahead(0) == TokenType::Assign);
+    REQUIRE(parser.lookahead(1) == TokenType::Identifier);
+}
+
+TEST_CASE("Test node start offsets", "[parser][position]")
+{
+    ParserTester parserTester("fun f() [\n  x = 1;\n  g(a + b * c as int);\n]");
+    auto program = parserTester.parser.parseProgram();
+    auto* function = dynamic_cast<FunctionDeclarationNode*>(program->declarations[0]);
+    REQUIRE(function != nullptr);
+
+    auto* statement = dynamic_cast<ExpressionStatementNode*>(function->body->statements[1]);
+    REQUIRE(statement != nullptr);
+    REQUIRE(program->lines->position(statement->getStartOffset()) == Position(3, 3));
+    auto* call = dynamic_cast<FunctionCallNode*>(statement->expression);
+    REQUIRE(call != nullptr);
+    REQUIRE(program->lines->position(call->arguments[0]->getStartOffset()) == Position(3, 5));
+    REQUIRE(program->lines->position(function->body->getStartOffset()) == Position(2, 3));
+}
+
+class PipelinedParserTester
+{
+   public:
+    std::istringstream stream;
+    Lexer lexer;
+    TokenPipeline pipeline;
+    Parser parser;
+
+    PipelinedParserTester(const std::string& input)
+        : stream(input), lexer(stream), pipeline(lexer), parser(pipeline)
+    {
+    }
+};
+
+TEST_CASE("Test pipelined parse matches streaming parse", "[parser][pipeline]")
+{
+    std::string input;
+    for (int i = 0; i < 400; ++i)
+    {
+        std::string n = std::to_string(i);
+        input += "fun f" + n + "(var x) [ var y = x * " + n + " + 1.5; return y as string; ]\n";
+        input += "const s" + n + " = \"line\n" + n + "\";\n";
+    }
+    ParserTester streaming(input);
+    PipelinedParserTester pipelined(input);
+    REQUIRE(printProgram(pipelined.parser) == printProgram(streaming.parser));
+}
+
+TEST_CASE("Test pipelined parse reports lexical error in parse order", "[parser][pipeline]")
+{
+    PipelinedParserTester syntaxFirst("fun a() var x = 1; $");
+    REQUIRE_THROWS_WITH(syntaxFirst.parser.parseProgram(), "SemanticError at 1:9 → Expected '['");
+
+    std::string input;
+    for (int i = 0; i < 300; ++i) input += "var v" + std::to_string(i) + " = 1;\n";
+    input += "var y = 99999999999999999999.5.;";
+    ParserTester streaming(input);
+    PipelinedParserTester pipelined(input);
+    std::string expected;
+    try
+    {
+        streaming.parser.parseProgram();
+    }
+    catch (const InterpreterException& ex)
+    {
+        expected = ex.what();
+    }
+    REQUIRE_FALSE(expected.empty());
+    REQUIRE_THROWS_WITH(pipelined.parser.parseProgram(), expected);
+}
+
+TEST_CASE("Test pipelined parse stops the lexer on an early error", "[parser][pipeline]")
+{
+    std::string input = "var = 1;\n";
+    for (int i = 0; i < 20000; ++i) input += "var v" + std::to_string(i) + " = 1;\n";
+    PipelinedParserTester pipelined(input);
+    REQUIRE_THROWS_WITH(pipelined.parser.parseProgram(),
+                        "SemanticError at 1:5 → Expected variable's name");
+
+    // Only what was already queued is left; the lexer thread did not run to the end.
+    std::size_t remaining = 0;
+    while (pipelined.pipeline.next().type != TokenType::EndOfFile) ++remaining;
+    REQUIRE(remaining < 20000 * 5);
+}
+
+TEST_CASE("Test tryParseProgram reports errors as values", "[parser][error]")
+{
+    ParserTester valid("var x = 1; fun main() [ print(x); ]");
+    ParseResult parsed = valid.parser.tryParseProgram();
+    REQUIRE_FALSE(parsed.error);
+    REQUIRE(parsed.program->declarations.size() == 2);
+
+    ParserTester invalid("fun main() [ x = 1 ]");
+    ParseResult failed = invalid.parser.tryParseProgram();
+    REQUIRE(failed.program == nullptr);
+    REQUIRE(failed.error->type == ErrorType::Semantic);
+    REQUIRE(failed.error->message == MessageId::MissingSemicolonAfterAssign);
+    REQUIRE(failed.error->position() == Position(1, 20));
+
+    ParserTester throwing("fun main() [ x = 1 ]");
+    REQUIRE_THROWS_WITH(throwing.parser.parseProgram(), failed.error->toString());
+}
+
+TEST_CASE("Test tryParseProgram reports lexical errors in parse order", "[parser][error]")
+{
+    // The syntax error comes first in parse order, the lexical one first in the text.
+    const std::string syntaxFirst = "fun a() var x = 1; $";
+    const std::string lexicalOnly = "var a = 1;\nvar b = \"open;\n";
+    for (const std::string& input : {syntaxFirst, lexicalOnly})
+    {
+        ParserTester throwing(input);
+        std::string expected;
+        try
+        {
+            throwing.parser.parseProgram();
+        }
+        catch (const InterpreterException& ex)
+        {
+            expected = ex.what();
+        }
+        REQUIRE_FALSE(expected.empty());
+
+        ParserTester streaming(input);
+        BufferedParserTester buffered(input);
+        PipelinedParserTester pipelined(input);
+        for (Parser* parser : {&streaming.parser, &buffered.parser, &pipelined.parser})
+        {
+            ParseResult result = parser->tryParseProgram();
+            REQUIRE(result.error);
+            REQUIRE(result.error->toString() == expected);
+        }
+    }
+}
+
+TEST_CASE("Test AST arena", "[parser][arena]")
+{
+    AstArena arena;
+    auto* first = static_cast<char*>(arena.allocate(1, 1));
+    auto* aligned = arena.allocate(sizeof(double), alignof(double));
+    REQUIRE(reinterpret_cast<std::uintptr_t>(aligned) % alignof(double) == 0);
+    REQUIRE(static_cast<char*>(aligned) > first);
+    REQUIRE(arena.blockCount() == 1);
+
+    // Requests larger than any block get one of their own.
+    arena.allocate(std::size_t(4) << 20, 1);
+    REQUIRE(arena.blockCount() == 2);
+    REQUIRE(arena.bytesReserved() >= (std::size_t(4) << 20));
+
+    std::string text = "copied";
+    std::string_view copy = arena.copyString(text);
+    text[0] = 'C';
+    REQUIRE(copy == "copied");
+
+    ExpressionNode* items[] = {arena.make<IdentifierNode>(intern("a"), 0),
+                               arena.make<IdentifierNode>(intern("b"), 2)};
+    NodeList<ExpressionNode> list = arena.makeList(std::begin(items), std::end(items));
+    items[0] = nullptr;
+    REQUIRE(list.size() == 2);
+    REQUIRE(list.front()->getStartOffset() == 0);
+    REQUIRE(list.back()->getStartOffset() == 2);
+}
+
+TEST_CASE("Test program owns the arena of its nodes", "[parser][arena]")
+{
+    ParserTester tester("fun f(var a, const b) [ g(a, \"s\", fun() [ return b; ]); ]");
+    auto program = tester.parser.parseProgram();
+    REQUIRE(program->arena);
+    REQUIRE(program->arena->blockCount() == 1);
+
+    auto* function = dynamic_cast<FunctionDeclarationNode*>(program->declarations[0]);
+    REQUIRE(function != nullptr);
+    REQUIRE(function->params.size() == 2);
+    REQUIRE(function->params[1]->modifier == false);
+    auto* statement = dynamic_cast<ExpressionStatementNode*>(function->body->statements[0]);
+    REQUIRE(statement != nullptr);
+    auto* call = dynamic_cast<FunctionCallNode*>(statement->expression);
+    REQUIRE(call != nullptr);
+    REQUIRE(call->arguments.size() == 3);
+    auto* literal = dynamic_cast<StringLiteralNode*>(call->arguments[1]);
+    REQUIRE(literal != nullptr);
+    REQUIRE(literal->getValue() == "s");
+}
+
+TEST_CASE("Test string literals outlive their source", "[parser][arena][string]")
+{
+    std::string script = R"(var s = "tab\there \"q\" \\"; var t = "plain";)";
+    std::unique_ptr<ProgramNode> program;
+    {
+        SourceBuffer source = SourceBuffer::fromString(script);
+        Lexer lexer(source);
+        program = Parser(lexer).parseProgram();
+    }
+    auto* escaped = dynamic_cast<DeclarationNode*>(program->declarations[0]);
+    auto* plain = dynamic_cast<DeclarationNode*>(program->declarations[1]);
+    REQUIRE(escaped != nullptr);
+    REQUIRE(plain != nullptr);
+
+    auto* literal = dynamic_cast<StringLiteralNode*>(escaped->initializer);
+    REQUIRE(literal != nullptr);
+    // Decoded on the first read; later reads see the same text.
+    REQUIRE(literal->getValue() == "tab\there \"q\" \\");
+    REQUIRE(literal->getValue() == "tab\there \"q\" \\");
+    REQUIRE(dynamic_cast<StringLiteralNode*>(plain->initializer)->getValue() == "plain");
+
+    ParserVisitor visitor;
+    program->accept(visitor);
+    ParserTester streamed(script);
+    REQUIRE(visitor.getParsedString() == printProgram(streamed.parser));
+}
+
+TEST_CASE("Test flat AST prints like the pointer tree", "[parser][flat]")
+{
+    std::string input = R"(
+        const greeting = "hi \"there\"\n";
+        var big = 2147483647;
+        fun scale(var x, const y) [
+            var total = x * 2.5 + y;
+            while (total > 10 && total != 11 || x == y) [ total = total - 1; ]
+            if (x != y) [ return total as string; ] else [ return (x | y)(1); ]
+            if (x) [ ]
+            return;
+        ]
+        var f = scale @@ fun(const a) [ return a as float as int; ];
+        fun main() [ print(f(1, 2)(3)); var unset; ]
+    )";
+    ParserTester pointer(input);
+    ParserTester flat(input);
+    FlatAst ast = flat.parser.parseFlatProgram();
+    FlatPrinter printer;
+    printer.print(ast);
+    REQUIRE(printer.getParsedString() == printProgram(pointer.parser));
+}
+
+TEST_CASE("Test flat AST layout", "[parser][flat]")
+{
+    ParserTester tester("fun f(var a) [ g(a, 1.5); ]\nvar x = \"s\";");
+    FlatAst ast = tester.parser.parseFlatProgram();
+    REQUIRE(ast.kind(ast.root()) == FlatKind::Program);
+    REQUIRE(ast.declarations().size() == 2);
+
+    // Pre-order: every node sits before its children.
+    NodeIndex function = ast.declarations()[0];
+    REQUIRE(function == 1);
+    REQUIRE(ast.kind(function) == FlatKind::FunctionDeclaration);
+    REQUIRE(symbolName(ast.symbol(function)) == "f");
+    REQUIRE(ast.parameters(function).size() == 1);
+    NodeIndex parameter = ast.parameters(function)[0];
+    REQUIRE(parameter > function);
+    REQUIRE(ast.modifier(parameter));
+
+    NodeIndex call = ast.expression(ast.statements(ast.body(function))[0]);
+    REQUIRE(ast.kind(call) == FlatKind::FunctionCall);
+    REQUIRE(ast.offset(call) == 15);
+    REQUIRE(ast.arguments(call).size() == 2);
+    REQUIRE(std::get<float>(ast.number(ast.arguments(call)[1])) == 1.5f);
+
+    NodeIndex declaration = ast.declarations()[1];
+    REQUIRE(ast.kind(declaration) == FlatKind::Declaration);
+    REQUIRE(ast.string(ast.expression(declaration)) == "s");
+    REQUIRE(ast.lines->position(ast.offset(declaration)) == Position(2, 1));
+}
+
+TEST_CASE("Test deeply nested input does not exhaust the stack", "[parser][flat][nesting]")
+{
+    const int depth = 100000;
+    auto repeat = [](const std::string& text, int times)
+    {
+        std::string out;
+        for (int i = 0; i < times; ++i) out += text;
+        return out;
+    };
+    auto printFlat = [](const std::string& script)
+    {
+        ParserTester tester(script);
+        FlatPrinter printer;
+        printer.print(tester.parser.parseFlatProgram());
+        return printer.getParsedString();
+    };
+
+    // Parentheses leave no trace in the tree.
+    std::string parens = "fun f() [ x = " + repeat("(", depth) + "a" + repeat(")", depth) + "; ]";
+    ParserTester plain("fun f() [ x = a; ]");
+    std::string expected = printProgram(plain.parser);
+    ParserTester nested(parens);
+    REQUIRE(printProgram(nested.parser) == expected);
+    REQUIRE(printFlat(parens) == expected);
+
+    // Both chains print as one flat run of operators, whichever side they lean to.
+    std::string run = expected;
+    run.replace(run.find("a;"), 1, "a" + repeat(" Pipe a", depth));
+    const std::vector<std::string> chains = {
+        "fun f() [ x = a" + repeat(" | a", depth) + "; ]",
+        "fun f() [ x = " + repeat("a | (", depth) + "a" + repeat(")", depth) + "; ]",
+    };
+    for (const std::string& script : chains)
+    {
+        ParserTester tester(script);
+        REQUIRE(printProgram(tester.parser) == run);
+        REQUIRE(printFlat(script) == run);
+    }
+
+    std::string calls = "fun f() [ " + repeat("g(", depth) + "1" + repeat(")", depth) + "; ]";
+    ParserTester tester(calls);
+    std::string printed = printProgram(tester.parser);
+    REQUIRE(printed.find(repeat("g(", depth) + "1" + repeat(")", depth)) != std::string::npos);
+    REQUIRE(printFlat(calls) == printed);
+
+    // Printed blocks are indented by their depth, so only the parse goes all the way down.
+    auto blocks = [&](int times)
+    {
+        return std::vector<std::string>{
+            "fun f() [ " + repeat("if (a) [ ", times) + repeat("] ", times) + "]",
+            "var h = " + repeat("fun() [ return ", times) + "1" + repeat("; ]", times) + ";",
+        };
+    };
+    for (const std::string& script : blocks(depth))
+    {
+        ParserTester tester(script);
+        REQUIRE(tester.parser.parseFlatProgram().size() >= static_cast<std::size_t>(depth));
+    }
+    for (const std::string& script : blocks(1000))
+    {
+        ParserTester tester(script);
+        REQUIRE(printFlat(script) == printProgram(tester.parser));
+    }
+}
+
+TEST_CASE("Test work-stealing pool runs every task once", "[parser][parallel]")
+{
+    for (unsigned threads : {1u, 2u, 4u})
+    {
+        WorkStealingPool pool(threads);
+        REQUIRE(pool.size() == threads);
+        for (std::size_t count : {0, 1, 3, 1000})
+        {
+            std::vector<std::atomic<int>> runs(count);
+            pool.run(count, [&](std::size_t task) { runs[task]++; });
+            for (const std::atomic<int>& run : runs) REQUIRE(run == 1);
+        }
+        REQUIRE_THROWS_AS(pool.run(8,
+                                   [](std::size_t task)
+                                   {
+                                       if (task == 5) throw std::runtime_error("task");
+                                   }),
+                          std::runtime_error);
+    }
+}
+
+TEST_CASE("Test top-level declaration starts", "[parser][parallel]")
+{
+    BufferedParserTester tester(
+        "var a = 1;\nfun f() [ var b; ]\nvar g = fun() [ ];\nconst h = f fun k() [ ]");
+    // var(0) a = 1 ;(4) fun(5) f ( ) [ var b ; ](13) var(14) g = fun ( ) [ ] ;(22) const(23)
+    REQUIRE(topLevelDeclarationStarts(tester.tokens) == std::vector<std::size_t>{0, 5, 14, 23});
+}
+
+namespace
+{
+std::string parallelScript()
+{
+    std::string script = "const limit = 10;\n";
+    for (int i = 0; i < 40; ++i)
+    {
+        std::string id = std::to_string(i);
+        script += "fun f" + id + "(var a, const b) [ while (a < limit) [ a = a + b * " + id +
+                  "; ] return a as string; ]\n";
+        script += "var g" + id + " = fun(const x) [ if (x) [ return f" + id + "(x, 1); ] ];\n";
+    }
+    return script;
+}
+
+std::string errorText(ParseResult result)
+{
+    REQUIRE(result.error);
+    REQUIRE_FALSE(result.program);
+    return result.error->toString();
+}
+}  // namespace
+
+TEST_CASE("Test parallel parse matches sequential parse", "[parser][parallel]")
+{
+    std::string script = parallelScript();
+    BufferedParserTester sequential(script);
+    std::string expected = printProgram(sequential.parser);
+    for (unsigned threads : {1u, 2u, 4u})
+    {
+        for (std::size_t minTaskTokens : {std::size_t(1), std::size_t(100), std::size_t(1) << 20})
+        {
+            ParseResult result = parseParallel(sequential.tokens, threads, minTaskTokens);
+            REQUIRE_FALSE(result.error);
+            ParserVisitor visitor;
+            result.program->accept(visitor);
+            REQUIRE(visitor.getParsedString() == expected);
+            REQUIRE(result.program->lines == sequential.tokens.lineIndex());
+        }
+    }
+}
+
+TEST_CASE("Test parallel parse reports the earliest error", "[parser][parallel]")
+{
+    std::string script = parallelScript();
+    const std::vector<std::string> broken = {
+        // Two syntax errors in different pieces: the first one wins.
+        script + "fun bad() [ x = ; y ]\n" + script + "var late = ;\n",
+        // The piece ends right after a function literal; the error belongs on the next token.
+        script + "var h = fun() [ ]\nfun after() [ ]\n" + script,
+        // Stray tokens between declarations.
+        script + "] " + script,
+        // A lexical error after the last declaration, and one after a syntax error.
+        script + "var s = \"open;\n",
+        script + "fun f() [ return a + ; ]\n" + script + "var s = \"open;\n",
+    };
+    for (const std::string& input : broken)
+    {
+        BufferedParserTester sequential(input);
+        std::string expected = errorText(sequential.parser.tryParseProgram());
+        for (unsigned threads : {1u, 2u, 4u})
+            REQUIRE(errorText(parseParallel(sequential.tokens, threads, 1)) == expected);
+    }
+}
+
+TEST_CASE("Test over-aligned allocations are counted", "[allocations]")
+{
+    struct alignas(64) Line
+    {
+        char bytes[64];
+    };
+    AllocationCounter counter;
+    auto line = std::make_unique<Line>();
+    REQUIRE(counter.count() == 1);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(line.get()) % 64 == 0);
+}
+
+TEST_CASE("Test parallel parse of a small buffer starts no threads",
+          "[parser][parallel][allocations]")
+{
+    BufferedParserTester tester("var limit = 3;\nfun main() [ print(limit); ]");
+    // The first parse interns the names.
+    ParseResult warm = tester.parser.tryParseProgram();
+
+    AllocationCounter sequential;
+    ParseResult expected = Parser(tester.tokens).tryParseProgram();
+    std::size_t sequentialCount = sequential.count();
+
+    AllocationCounter pooling;
+    {
+        WorkStealingPool pool(8);
+    }
+    std::size_t poolCount = pooling.count();
+
+    // Finding the declarations costs a few allocations; a pool would cost all of its own.
+    AllocationCounter parallel;
+    ParseResult result = parseParallel(tester.tokens, 8);
+    REQUIRE(parallel.count() - sequentialCount < poolCount);
+    REQUIRE_FALSE(result.error);
+}
+
+TEST_CASE("Test flat AST image round trip", "[parser][flat][cache]")
+{
+    std::string input = "var pad;\nfun f(var a) [ g(a, 1.5, \"s\"); ]\nvar x = f as int;";
+    ParserTester tester(input);
+    FlatAst built = tester.parser.parseFlatProgram();
+    FlatPrinter expected;
+    expected.print(built);
+
+    auto storage = std::make_shared<const SourceBuffer>(SourceBuffer::fromString(built.image()));
+    std::optional<FlatAst> loaded = FlatAst::fromImage(storage, 0, storage->size(), 0);
+    REQUIRE(loaded);
+    REQUIRE(loaded->size() == built.size());
+    FlatPrinter printer;
+    printer.print(*loaded);
+    REQUIRE(printer.getParsedString() == expected.getParsedString());
+    for (NodeIndex node = 0; node < built.size(); ++node)
+        REQUIRE(loaded->offset(node) == built.offset(node));
+
+    // Offsets are relative to a base, so the image does not care where its text sits.
+    ParseResult later = BufferedParserTester(input.substr(9)).parser.tryParseProgram();
+    FlatAst relative = FlatAst::build(*later.program, 0);
+    std::string image = relative.image();
+    storage = std::make_shared<const SourceBuffer>(SourceBuffer::fromString(image));
+    std::optional<FlatAst> shifted = FlatAst::fromImage(storage, 0, image.size(), 9);
+    REQUIRE(shifted->offset(shifted->declarations()[0]) == built.offset(built.declarations()[1]));
+
+    REQUIRE_FALSE(FlatAst::fromImage(storage, 0, image.size() - 1, 9));
+    REQUIRE_FALSE(FlatAst::fromImage(storage, 8, image.size(), 9));
+    // The list of declarations of the root, which follows the 32-byte header, moved past the
+    // end of the lists.
+    std::string outOfBounds = image;
+    outOfBounds[32 + offsetof(FlatAst::Node, first) + 3] = 0x7F;
+    storage = std::make_shared<const SourceBuffer>(SourceBuffer::fromString(outOfBounds));
+    REQUIRE_FALSE(FlatAst::fromImage(storage, 0, outOfBounds.size(), 9));
+    image[0] = 'X';
+    storage = std::make_shared<const SourceBuffer>(SourceBuffer::fromString(image));
+    REQUIRE_FALSE(FlatAst::fromImage(storage, 0, image.size(), 0));
+    storage = std::make_shared<const SourceBuffer>(SourceBuffer::fromString("BIBLFLAT"));
+    REQUIRE_FALSE(FlatAst::fromImage(storage, 0, storage->size(), 0));
+}
+
+namespace
+{
+// Cache directory that is removed again when the test ends.
+class TemporaryDirectory
+{
+   public:
+    TemporaryDirectory()
+        : path(std::filesystem::temp_directory_path() /
+               ("bibl-cache-test-" + std::to_string(std::random_device()())))
+    {
+    }
+    ~TemporaryDirectory() { std::filesystem::remove_all(path); }
+
+    const std::filesystem::path path;
+};
+
+std::string printCached(const CachedProgram& program)
+{
+    REQUIRE_FALSE(program.error);
+    FlatPrinter printer;
+    for (const FlatAst& piece : program.pieces) printer.print(piece);
+    return printer.getParsedString();
+}
+
+std::string printScript(const std::string& script)
+{
+    BufferedParserTester tester(script);
+    return printProgram(tester.parser);
+}
+}  // namespace
+
+TEST_CASE("Test AST cache parses only changed declarations", "[parser][cache]")
+{
+    TemporaryDirectory directory;
+    AstCache cache(directory.path.string());
+    std::string script = "fun one() [ return 1; ]\n// note\nfun two(var a) [ return a; ]\n";
+    script += "var three = two(1);\n";
+
+    CachedProgram cold = cache.load(SourceBuffer::fromString(script), "script");
+    REQUIRE(cold.parsed == 3);
+    REQUIRE(cold.reused == 0);
+    REQUIRE(printCached(cold) == printScript(script));
+
+    // Seen before as a whole: every declaration comes back from its manifest.
+    CachedProgram warm = cache.load(SourceBuffer::fromString(script), "script");
+    REQUIRE(warm.parsed == 0);
+    REQUIRE(warm.reused == 3);
+    REQUIRE(printCached(warm) == printScript(script));
+    REQUIRE(warm.lines->position(warm.pieces.back().offset(1)) == Position(4, 1));
+
+    // Editing one declaration moves the others but only the edited one is parsed. Without the
+    // name the edited script is a stranger.
+    std::string edited = "fun one() [ return 1 + 41; ]\n" + script.substr(script.find("//"));
+    CachedProgram changed = cache.load(SourceBuffer::fromString(edited), "script");
+    REQUIRE(changed.parsed == 1);
+    REQUIRE(changed.reused == 2);
+    REQUIRE(printCached(changed) == printScript(edited));
+    REQUIRE(cache.load(SourceBuffer::fromString(edited + " ")).parsed == 3);
+    BufferedParserTester fresh(edited);
+    ParseResult expected = fresh.parser.tryParseProgram();
+    REQUIRE(changed.pieces.back().offset(1) ==
+            expected.program->declarations.back()->getStartOffset());
+
+    // A damaged cache is a miss, not an error.
+    for (const auto& entry : std::filesystem::directory_iterator(directory.path))
+        std::ofstream(entry.path(), std::ios::trunc) << "garbage";
+    CachedProgram damaged = cache.load(SourceBuffer::fromString(script), "script");
+    REQUIRE(damaged.parsed == 3);
+    REQUIRE(printCached(damaged) == printScript(script));
+}
+
+TEST_CASE("Test AST cache treats truncated and corrupted files as misses", "[parser][cache]")
+{
+    TemporaryDirectory directory;
+    AstCache cache(directory.path.string());
+    std::string script = "fun one() [ return \"one\"; ]\nvar two = one() as string;\n";
+    std::string expected = printScript(script);
+    REQUIRE(cache.load(SourceBuffer::fromString(script), "script").parsed == 2);
+
+    std::filesystem::path manifest;
+    for (const auto& entry : std::filesystem::directory_iterator(directory.path))
+        if (entry.path().extension() == ".program") manifest = entry.path();
+    std::ifstream in(manifest, std::ios::binary);
+    const std::string stored{std::istreambuf_iterator<char>(in), {}};
+
+    auto loadFrom = [&](const std::string& bytes)
+    {
+        std::ofstream(manifest, std::ios::binary | std::ios::trunc) << bytes;
+        return cache.load(SourceBuffer::fromString(script), "script");
+    };
+    for (std::size_t size = 0; size < stored.size(); ++size)
+    {
+        // Pieces wholly before the cut can still be taken by hash.
+        CachedProgram program = loadFrom(stored.substr(0, size));
+        REQUIRE(program.reused < 2);
+        REQUIRE(printCached(program) == expected);
+    }
+    for (std::size_t at = 0; at < stored.size(); ++at)
+    {
+        std::string flipped = stored;
+        flipped[at] = static_cast<char>(flipped[at] ^ 0x41);
+        REQUIRE(printCached(loadFrom(flipped)) == expected);
+    }
+    REQUIRE(loadFrom(stored).reused == 2);
+}
+
+TEST_CASE("Test AST cache reports errors like the parser", "[parser][cache]")
+{
+    TemporaryDirectory directory;
+    AstCache cache(directory.path.string());
+    const std::vector<std::string> broken = {
+        "fun a() [ return 1; ]\nfun b() [ return 2 ]\nvar c = 3;\n",
+        "fun a() [ return 1; ]\nvar h = fun() [ ]\nfun after() [ ]\n",
+        "fun a() [ return 1; ]\nvar s = \"open;\n",
+        "fun a() [ return 1; ] ] var b;",
+    };
+    for (const std::string& input : broken)
+    {
+        BufferedParserTester sequential(input);
+        std::string expected = errorText(sequential.parser.tryParseProgram());
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            CachedProgram program = cache.load(SourceBuffer::fromString(input), "broken");
+            REQUIRE(program.error);
+            REQUIRE(program.pieces.empty());
+            REQUIRE(program.error->toString() == expected);
+        }
+    }
+    // Nothing of the broken versions was stored.
+    REQUIRE(cache.load(SourceBuffer::fromString(broken[0].substr(0, 22)), "broken").parsed == 1);
+}
+
+TEST_CASE("Test allocations per node stay bounded", "[parser][allocations]")
+{
+    std::string script;
+    for (int i = 0; i < 400; ++i)
+    {
+        std::string id = std::to_string(i);
+        script += "fun handler_" + id + "(var request, const attempt_limit)\n[\n";
+        script += "    var message = \"request number " + id + " was \\\"handled\\\"\";\n";
+        script += "    while (attempt_limit > 0 && request != 0) [ request = request - 1; ]\n";
+        script += "    if (request == 0) [ return message; ] else [ return log(message, 2.5); ]\n";
+        script += "]\n";
+    }
+    SourceBuffer source = SourceBuffer::fromString(script);
+    Lexer counting(source);
+    std::size_t nodes = Parser(counting).parseFlatProgram().size();
+
+    AllocationCounter parsing;
+    Lexer lexer(source);
+    auto program = Parser(lexer).parseProgram();
+    std::size_t parsed = parsing.count();
+
+    AllocationCounter walking;
+    ParserVisitor visitor;
+    program->accept(visitor);
+    std::size_t walked = walking.count();
+    // Per node, parsing allocates nothing and printing only the pieces too long for the small
+    // string buffer, here the message literals. What parsing allocates at all is about one
+    // per distinct name and the growth of arena blocks and stacks.
+    REQUIRE(parsed < nodes / 16);
+    REQUIRE(walked < nodes / 8);
+}
+
+TEST_CASE("Test printers stream the same text they keep", "[parser][print]")
+{
+    std::string script = R"(
+        const greeting = "hi \"there\"";
+        fun scale(var x, const y) [
+            while (x > 10) [ if (y) [ x = x - 1; ] else [ x = x as float; ] ]
+            return fun(var z) [ return z | y; ];
+        ]
+    )";
+    // Nesting deeper than the run of spaces the sink copies indentation from.
+    script += "fun f() [ ";
+    for (int i = 0; i < 40; ++i) script += "if (a) [ ";
+    for (int i = 0; i < 40; ++i) script += "] ";
+    script += "]";
+
+    ParserTester keeping(script);
+    std::string expected = printProgram(keeping.parser);
+    REQUIRE(expected.find(std::string(80, ' ') + "if (a)") != std::string::npos);
+
+    // A chunk smaller than most lines makes every write a flush.
+    std::ostringstream streamed;
+    {
+        OutputSink sink = OutputSink::toStream(streamed, 7);
+        ParserTester tester(script);
+        ParserVisitor visitor(sink);
+        tester.parser.parseProgram()->accept(visitor);
+        REQUIRE(visitor.getParsedString().empty());
+        REQUIRE(sink.text().size() <= 7);
+    }
+    REQUIRE(streamed.str() == expected);
+
+    std::ostringstream flatStreamed;
+    OutputSink sink = OutputSink::toStream(flatStreamed, 7);
+    FlatPrinter printer(sink);
+    ParserTester tester(script);
+    printer.print(tester.parser.parseFlatProgram());
+    sink.flush();
+    REQUIRE(flatStreamed.str() == expected);
+}
+
+namespace
+{
+// Counts the nodes under each node it is handed, parameters aside.
+class NodeCounter : public StaticVisitor<NodeCounter, std::size_t>
+{
+   public:
+    std::size_t count(AstNode* node) { return node ? dispatch(*node) : 0; }
+    std::size_t visit(NumberLiteralNode&) { return 1; }
+    std::size_t visit(StringLiteralNode&) { return 1; }
+    std::size_t visit(IdentifierNode&) { return 1; }
+    std::size_t visit(BinaryOpNode& node) { return 1 + count(node.left) + count(node.right); }
+    std::size_t visit(TypeCastNode& node) { return 1 + count(node.expression); }
+    std::size_t visit(FunctionCallNode& node)
+    {
+        return 1 + count(node.callee) + countAll(node.arguments);
+    }
+    std::size_t visit(ExpressionStatementNode& node) { return 1 + count(node.expression); }
+    std::size_t visit(StatementBlockNode& node) { return 1 + countAll(node.statements); }
+    std::size_t visit(FunctionDeclarationNode& node) { return 1 + count(node.body); }
+    std::size_t visit(FunctionLiteralNode& node) { return 1 + count(node.body); }
+    std::size_t visit(IfStatementNode& node)
+    {
+        return 1 + count(node.condition) + count(node.thenBlock) + count(node.elseBlock);
+    }
+    std::size_t visit(DeclarationNode& node) { return 1 + count(node.initializer); }
+    std::size_t visit(ReturnStatementNode& node) { return 1 + count(node.returnValue); }
+    std::size_t visit(AssignNode& node) { return 1 + count(node.expression); }
+    std::size_t visit(WhileStatementNode& node)
+    {
+        return 1 + count(node.condition) + count(node.body);
+    }
+    std::size_t visit(ProgramNode& node) { return 1 + countAll(node.declarations); }
+
+   private:
+    template <typename T>
+    std::size_t countAll(NodeList<T> nodes)
+    {
+        std::size_t total = 0;
+        for (T* node : nodes) total += count(node);
+        return total;
+    }
+};
+}  // namespace
+
+TEST_CASE("Test static dispatch reaches every node kind", "[parser][visitor]")
+{
+    std::string script = R"(
+        const greeting = "hi";
+        fun scale(var x, const y) [
+            while (x > 10) [ if (y) [ x = x - 1; ] else [ log(x as float); ] ]
+            return fun(var z) [ return z | y; ];
+        ]
+        var n = 1.5;
+    )";
+    ParserTester tester(script);
+    auto program = tester.parser.parseProgram();
+    ParserTester flatTester(script);
+    FlatAst flat = flatTester.parser.parseFlatProgram();
+
+    std::size_t parameters = 0;
+    for (NodeIndex node = 0; node < flat.size(); ++node)
+        parameters += flat.kind(node) == FlatKind::Parameter;
+    REQUIRE(NodeCounter().count(program.get()) == flat.size() - parameters);
+
+    // Each kind tag is the one of the node's class.
+    REQUIRE(program->getKind() == NodeKind::Program);
+    auto* function = dynamic_cast<FunctionDeclarationNode*>(program->declarations[1]);
+    REQUIRE(function != nullptr);
+    REQUIRE(function->getKind() == NodeKind::FunctionDeclaration);
+    REQUIRE(function->body->statements[0]->getKind() == NodeKind::WhileStatement);
+    REQUIRE(function->body->statements[1]->getKind() == NodeKind::ReturnStatement);
+}
@@ -1,9 +1,16 @@
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch_all.hpp>
+#include <cstdio>
+#include <fstream>
 #include <sstream>
+#include <thread>
+#include <unistd.h>
 #include "lexer.hpp"
+#include "parallelLexer.hpp"
+#include "scanKernels.hpp"
 #include "interpreter_exception.hpp"
 #include "position.hpp"
+#include "utf8.hpp"
 
 std::vector<Token> tokenize(Lexer* lexer)
 {
@@ -20,6 +27,15 @@ std::vector<Token> tokenize(Lexer* lexer)
     return tokens;
 }
 
+// String literals from a SourceBuffer are views of their raw text, those from a stream are
+// decoded copies; either way they must spell the same value.
+bool sameValue(const Token& token, const Token& expected)
+{
+    if (token.type == TokenType::StringLiteral && expected.type == TokenType::StringLiteral)
+        return token.getValue<std::string>() == expected.getValue<std::string>();
+    return token.value == expected.value;
+}
+
 TEST_CASE("Basic identifier parsing", "[lexer][identifier]")
 {
     std::istringstream input("alpha");
@@ -98,9 +114,9 @@ TEST_CASE("Too long identifier parsing", "[lexer][identifier]")
     catch (const InterpreterException& ex)
     {
         REQUIRE(ex.error.type == ErrorType::Lexical);
-        REQUIRE(ex.error.message == "Identifier is too long");
-        REQUIRE(ex.error.startPosition.column == 1);
-        REQUIRE(ex.error.startPosition == Position(1, 1));
+        REQUIRE(ex.error.message == MessageId::IdentifierTooLong);
+        REQUIRE(ex.error.position().column == 1);
+        REQUIRE(ex.error.position() == Position(1, 1));
     }
 }
 
@@ -233,8 +249,8 @@ TEST_CASE("Number parsing with doubled dot", "[lexer][number]")
     catch (const InterpreterException& ex)
     {
         REQUIRE(ex.error.type == ErrorType::Syntax);
-        REQUIRE(ex.error.message == "Invalid float");
-        REQUIRE(ex.error.startPosition == Position(1, 1));
+        REQUIRE(ex.error.message == MessageId::InvalidFloat);
+        REQUIRE(ex.error.position() == Position(1, 1));
     }
 }
 
@@ -273,8 +289,8 @@ TEST_CASE("String parsing no end quote", "[lexer][string]")
     catch (const InterpreterException& ex)
     {
         REQUIRE(ex.error.type == ErrorType::Lexical);
-        REQUIRE(ex.error.message == "Unterminated string literal");
-        REQUIRE(ex.error.startPosition == Position(1, 1));
+        REQUIRE(ex.error.message == MessageId::UnterminatedString);
+        REQUIRE(ex.error.position() == Position(1, 1));
     }
 }
 
@@ -291,8 +307,8 @@ TEST_CASE("String parsing no end quote and last backslash", "[lexer][string]")
     catch (const InterpreterException& ex)
     {
         REQUIRE(ex.error.type == ErrorType::Lexical);
-        REQUIRE(ex.error.message == "Unterminated string literal");
-        REQUIRE(ex.error.startPosition == Position(1, 1));
+        REQUIRE(ex.error.message == MessageId::UnterminatedString);
+        REQUIRE(ex.error.position() == Position(1, 1));
     }
 }
 
@@ -365,7 +381,8 @@ TEST_CASE("Identifier: iff", "[lexer][keyword]")
     auto tokens = tokenize(&lexer);
 
     REQUIRE(tokens[0].type == TokenType::Identifier);
-    REQUIRE(std::holds_alternative<std::string>(tokens[0].value));
+    REQUIRE(std::holds_alternative<SymbolId>(tokens[0].value));
+    REQUIRE(tokens[0].getValue<std::string>() == "iff");
 }
 
 TEST_CASE("Keyword: else", "[lexer][keyword]")
@@ -1038,7 +1055,7 @@ TEST_CASE("Parentheses", "[lexer][symbols]")
     REQUIRE(tokens[3].type == TokenType::Semicolon);
 }
 
-TEST_CASE("Brackets", "[lexer][symbols]")
+TEST_CASE("Brackets around identifier", "[lexer][symbols]")
 {
     std::istringstream input("[a];");
     Lexer lexer(input);
@@ -1153,9 +1170,595 @@ TEST_CASE("Lexer handles CRLF line endings", "[lexer][crlf]")
         if (token.type == TokenType::Identifier && token.getValue<std::string>() == "b")
         {
             foundB = true;
-            REQUIRE(token.startPosition == Position(2, 5));
+            REQUIRE(lexer.lineIndex()->position(token.offset) == Position(2, 5));
         }
     }
 
     REQUIRE(foundB);
 }
+
+TEST_CASE("Source buffer lexing matches stream lexing", "[lexer][source]")
+{
+    const std::string program =
+        "fun main() [\n  var a = 12.5; // note\r\n  print(\"x\\ty\" + a as string);\n]";
+    std::istringstream input(program);
+    Lexer streamLexer(input);
+    SourceBuffer source = SourceBuffer::fromString(program);
+    Lexer bufferLexer(source);
+
+    auto expected = tokenize(&streamLexer);
+    auto tokens = tokenize(&bufferLexer);
+
+    REQUIRE(tokens.size() == expected.size());
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        REQUIRE(tokens[i].type == expected[i].type);
+        REQUIRE(sameValue(tokens[i], expected[i]));
+        REQUIRE(tokens[i].offset == expected[i].offset);
+    }
+}
+
+TEST_CASE("Source buffer positions refer back into the buffer", "[lexer][source]")
+{
+    SourceBuffer source = SourceBuffer::fromString("var ab = 1;\nab = 2;");
+    Lexer lexer(source);
+    auto tokens = tokenize(&lexer);
+
+    REQUIRE(lexer.lineIndex()->position(tokens[1].offset) == Position(1, 5));
+    REQUIRE(source.view().substr(tokens[1].offset, 2) == "ab");
+    REQUIRE(lexer.lineIndex()->position(tokens[5].offset) == Position(2, 1));
+    REQUIRE(source.view().substr(tokens[5].offset, 2) == "ab");
+    REQUIRE(tokens.back().offset == source.size());
+}
+
+TEST_CASE("Source buffer string literals are views of the source", "[lexer][source][string]")
+{
+    SourceBuffer source = SourceBuffer::fromString(R"(f("plain", "a\"b\\c\n\td", "", "line
+break");)");
+    Lexer lexer(source);
+    auto tokens = tokenize(&lexer);
+
+    const std::pair<std::size_t, const char*> literals[] = {
+        {2, "plain"}, {4, "a\"b\\c\n\td"}, {6, ""}, {8, "line\nbreak"}};
+    for (const auto& [index, value] : literals)
+    {
+        REQUIRE(tokens[index].type == TokenType::StringLiteral);
+        auto* span = std::get_if<StringSpan>(&tokens[index].value);
+        REQUIRE(span != nullptr);
+        REQUIRE(tokens[index].getValue<std::string>() == value);
+        if (span->raw.empty()) continue;
+        REQUIRE(span->raw.data() >= source.begin());
+        REQUIRE(span->raw.data() + span->raw.size() < source.end());
+    }
+    REQUIRE_FALSE(std::get<StringSpan>(tokens[2].value).escaped);
+    REQUIRE(std::get<StringSpan>(tokens[4].value).escaped);
+    REQUIRE(std::get<StringSpan>(tokens[4].value).raw == R"(a\"b\\c\n\td)");
+    REQUIRE(lexer.lineIndex()->position(tokens[9].offset) == Position(2, 7));
+}
+
+TEST_CASE("Source buffer reports errors at buffer positions", "[lexer][source]")
+{
+    SourceBuffer source = SourceBuffer::fromString("var s =\n  \"open");
+    Lexer lexer(source);
+
+    try
+    {
+        auto tokens = tokenize(&lexer);
+        FAIL("Expected InterpreterException not thrown");
+    }
+    catch (const InterpreterException& ex)
+    {
+        REQUIRE(ex.error.type == ErrorType::Lexical);
+        REQUIRE(ex.error.position() == Position(2, 3));
+        REQUIRE(ex.error.position().offset == 10);
+    }
+}
+
+TEST_CASE("Source buffer maps files", "[lexer][source]")
+{
+    const std::string path = "lexer_source_buffer_test.txt";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "const x = 1;";
+    }
+    SourceBuffer source = SourceBuffer::fromFile(path);
+    std::remove(path.c_str());
+
+    REQUIRE(source.isMapped());
+    REQUIRE(source.view() == "const x = 1;");
+    Lexer lexer(source);
+    auto tokens = tokenize(&lexer);
+    REQUIRE(tokens.size() == 6);
+    REQUIRE(tokens[0].type == TokenType::Const);
+    REQUIRE(tokens[1].getValue<std::string>() == "x");
+}
+
+TEST_CASE("Source buffer handles empty input and missing files", "[lexer][source]")
+{
+    SourceBuffer source = SourceBuffer::fromString("");
+    Lexer lexer(source);
+    auto tokens = tokenize(&lexer);
+    REQUIRE(tokens.size() == 1);
+    REQUIRE(tokens[0].type == TokenType::EndOfFile);
+
+    REQUIRE_THROWS_AS(SourceBuffer::fromFile("no/such/file.txt"), std::runtime_error);
+}
+
+TEST_CASE("Identifiers are interned", "[lexer][symbol]")
+{
+    std::istringstream input("alpha beta alpha int");
+    Lexer lexer(input);
+    auto tokens = tokenize(&lexer);
+
+    SymbolId alpha = tokens[0].getValue<SymbolId>();
+    REQUIRE(alpha == tokens[2].getValue<SymbolId>());
+    REQUIRE(alpha != tokens[1].getValue<SymbolId>());
+    REQUIRE(alpha == intern("alpha"));
+    REQUIRE(symbolName(alpha) == "alpha");
+    REQUIRE(tokens[3].getValue<SymbolId>() == intern("int"));
+}
+
+TEST_CASE("Symbol table hands out stable ids", "[lexer][symbol]")
+{
+    SymbolTable table;
+    SymbolId first = table.intern("first");
+    SymbolId second = table.intern("second");
+
+    REQUIRE(first != second);
+    REQUIRE(table.intern(std::string("first")) == first);
+    REQUIRE(table.name(second) == "second");
+    REQUIRE(table.size() == 2);
+}
+
+TEST_CASE("Symbol table names can be read while others are interned", "[lexer][symbol]")
+{
+    SymbolTable table;
+    const std::string& first = table.name(table.intern("name0"));
+    constexpr std::size_t COUNT = 5000;
+    std::thread writer(
+        [&]
+        {
+            for (std::size_t i = 1; i < COUNT; ++i) table.intern("name" + std::to_string(i));
+        });
+    bool matched = true;
+    for (std::size_t size = table.size(); size < COUNT; size = table.size())
+        matched = matched && table.name(SymbolId(size - 1)) == "name" + std::to_string(size - 1);
+    writer.join();
+
+    REQUIRE(matched);
+    REQUIRE(&table.name(SymbolId(0)) == &first);
+    for (std::size_t i = 0; i < COUNT; ++i)
+        REQUIRE(table.name(SymbolId(i)) == "name" + std::to_string(i));
+}
+
+TEST_CASE("Scan kernels agree with the scalar path", "[lexer][simd]")
+{
+    std::string text;
+    for (int i = 0; i < 600; ++i)
+    {
+        const char alphabet[] = " \t\r\n\v\fazAZ_09\"\\/.;@`[{\x80\xff";
+        text += alphabet[(i * 7 + i / 13) % (sizeof(alphabet) - 1)];
+        if (i % 50 < 40) text += (i % 3 == 0) ? ' ' : 'q';
+    }
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+
+    using Scanner = const char* (*)(const char*, const char*);
+    const Scanner scanners[] = {skipBlanks, skipIdentifierChars, findLineEnd, findStringStop,
+                                skipAscii};
+    ScanKernel original = activeScanKernel();
+
+    std::vector<std::vector<const char*>> expected;
+    useScanKernel(ScanKernel::Scalar);
+    for (Scanner scan : scanners)
+    {
+        expected.emplace_back();
+        for (const char* p = begin; p <= end; ++p) expected.back().push_back(scan(p, end));
+    }
+
+    for (ScanKernel kernel : {ScanKernel::Sse2, ScanKernel::Avx2})
+    {
+        if (!scanKernelSupported(kernel)) continue;
+        useScanKernel(kernel);
+        REQUIRE(activeScanKernel() == kernel);
+        for (size_t s = 0; s < std::size(scanners); ++s)
+            for (const char* p = begin; p <= end; ++p)
+                REQUIRE(scanners[s](p, end) == expected[s][p - begin]);
+    }
+    useScanKernel(original);
+}
+
+TEST_CASE("Buffer lexing with every scan kernel matches stream lexing", "[lexer][simd]")
+{
+    const std::string program =
+        "fun a_rather_long_function_name_over_32_chars(var x)   \t [\n"
+        "    // a comment that is long enough to span several vector blocks\n"
+        "    var s = \"a string literal long enough for two blocks\\n\\t \\\"q\\\" \\\\ tail\";\n"
+        "    var m = \"multi\n line\";\n"
+        "        \r\n  return s + m;\n]";
+    std::istringstream input(program);
+    Lexer streamLexer(input);
+    auto expected = tokenize(&streamLexer);
+
+    ScanKernel original = activeScanKernel();
+    for (ScanKernel kernel : {ScanKernel::Scalar, ScanKernel::Sse2, ScanKernel::Avx2})
+    {
+        useScanKernel(kernel);
+        SourceBuffer source = SourceBuffer::fromString(program);
+        Lexer lexer(source);
+        auto tokens = tokenize(&lexer);
+
+        REQUIRE(tokens.size() == expected.size());
+        for (size_t i = 0; i < tokens.size(); ++i)
+        {
+            REQUIRE(tokens[i].type == expected[i].type);
+            REQUIRE(sameValue(tokens[i], expected[i]));
+            REQUIRE(tokens[i].offset == expected[i].offset);
+        }
+    }
+    useScanKernel(original);
+}
+
+TEST_CASE("Too long identifier in a source buffer", "[lexer][simd]")
+{
+    SourceBuffer source = SourceBuffer::fromString("var " + std::string(60, 'x') + ";");
+    Lexer lexer(source);
+
+    try
+    {
+        auto tokens = tokenize(&lexer);
+        FAIL("Expected InterpreterException not thrown");
+    }
+    catch (const InterpreterException& ex)
+    {
+        REQUIRE(ex.error.message == MessageId::IdentifierTooLong);
+        REQUIRE(ex.error.position() == Position(1, 5));
+    }
+}
+
+TEST_CASE("Keyword table recognises exactly the keywords", "[lexer][keyword]")
+{
+    std::istringstream input(
+        "int float string var const fun return if else while as "
+        "in floats strin Var constant fu returns iff els whil a s_ _as");
+    Lexer lexer(input);
+    auto tokens = tokenize(&lexer);
+
+    const TokenType keywords[] = {TokenType::Type,  TokenType::Type,  TokenType::Type,
+                                  TokenType::Var,   TokenType::Const, TokenType::Fun,
+                                  TokenType::Return, TokenType::If,   TokenType::Else,
+                                  TokenType::While, TokenType::As};
+    for (size_t i = 0; i < std::size(keywords); ++i) REQUIRE(tokens[i].type == keywords[i]);
+    for (size_t i = std::size(keywords); i + 1 < tokens.size(); ++i)
+        REQUIRE(tokens[i].type == TokenType::Identifier);
+    REQUIRE(tokens.size() == std::size(keywords) + 14);
+}
+
+TEST_CASE("Lone symbol prefixes are unknown tokens", "[lexer][symbol]")
+{
+    std::istringstream input("!x @y &z");
+    Lexer lexer(input);
+    auto tokens = tokenize(&lexer);
+
+    REQUIRE(tokens.size() == 7);
+    REQUIRE(tokens[0].type == TokenType::Unknown);
+    REQUIRE(tokens[0].getValue<std::string>() == "!");
+    REQUIRE(tokens[1].getValue<std::string>() == "x");
+    REQUIRE(tokens[2].getValue<std::string>() == "@");
+    REQUIRE(lexer.lineIndex()->position(tokens[2].offset) == Position(1, 4));
+    REQUIRE(tokens[4].getValue<std::string>() == "&");
+    REQUIRE(tokens[5].getValue<std::string>() == "z");
+}
+
+TEST_CASE("Number parsing edge cases", "[lexer][number]")
+{
+    std::istringstream input("1. 21474836481 2147483647 7.250");
+    Lexer lexer(input);
+    auto tokens = tokenize(&lexer);
+
+    REQUIRE(tokens[0].getValue<float>() == 1.0f);
+    REQUIRE(tokens[1].getValue<int>() == 2147483641);
+    REQUIRE(tokens[2].getValue<int>() == 2147483647);
+    REQUIRE(tokens[3].getValue<float>() == 7.25f);
+}
+
+namespace
+{
+void requireSameTokens(const TokenBuffer& tokens, const TokenBuffer& expected)
+{
+    REQUIRE(tokens.size() == expected.size());
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        Token token = tokens.token(i);
+        Token wanted = expected.token(i);
+        REQUIRE(token.type == wanted.type);
+        REQUIRE(token.value == wanted.value);
+        REQUIRE(token.offset == wanted.offset);
+        REQUIRE(tokens.position(i) == expected.position(i));
+    }
+    REQUIRE(tokens.lexicalError().has_value() == expected.lexicalError().has_value());
+    if (expected.lexicalError())
+        REQUIRE(tokens.lexicalError()->toString() == expected.lexicalError()->toString());
+}
+
+void requireParallelMatchesSequential(const std::string& program)
+{
+    SourceBuffer source = SourceBuffer::fromString(program);
+    Lexer lexer(source);
+    TokenBuffer expected = TokenBuffer::tokenize(lexer);
+    for (unsigned threads : {2u, 3u, 8u})
+        for (std::size_t minChunk : {std::size_t(1), std::size_t(7), std::size_t(40)})
+            requireSameTokens(tokenizeParallel(source, threads, minChunk), expected);
+}
+}  // namespace
+
+TEST_CASE("Lexer can start inside a buffer", "[lexer][parallel]")
+{
+    SourceBuffer source = SourceBuffer::fromString("var x;\n  y = 2;");
+    Lexer lexer(source, 7);
+    auto tokens = tokenize(&lexer);
+    REQUIRE(tokens.size() == 5);
+    REQUIRE(tokens[0].getValue<std::string>() == "y");
+    REQUIRE(tokens[0].offset == 9);
+    REQUIRE(tokens[2].offset == 13);
+}
+
+TEST_CASE("Parallel lexing matches sequential lexing", "[lexer][parallel]")
+{
+    requireParallelMatchesSequential(
+        "fun a(var x)\n[\n    var s = \"one\n    var t = 2; // not code\n\";\n"
+        "    // comment with \" quote\n    var u = \"esc \\\" x = 1;\n y\";\n"
+        "    while (x >= 10 && x != 3) [ x = x - 1.5; ]\n]\n\n\n"
+        "fun b() [ return \"\n\n\n\"; ]\n   \n");
+    requireParallelMatchesSequential("");
+    requireParallelMatchesSequential("\n\n\n");
+    requireParallelMatchesSequential("var x = 1;");
+}
+
+TEST_CASE("Parallel lexing reports the first lexical error", "[lexer][parallel]")
+{
+    requireParallelMatchesSequential("var a = 1;\nvar b = 2;\nvar c = \"open\nvar d = 4;\n");
+    requireParallelMatchesSequential(
+        "var a = 1;\nvar b = 1.5.;\nvar c = 3;\n"
+        "var this_identifier_is_certainly_longer_than_fifty_characters_in_total = 1;\n");
+    requireParallelMatchesSequential("var s = \"\nvar b = 1.5.;\n\";\nvar c = 1.5.;\n");
+}
+
+TEST_CASE("Parallel lexing of a large generated program", "[lexer][parallel]")
+{
+    std::string program;
+    for (int i = 0; i < 300; ++i)
+    {
+        std::string id = std::to_string(i);
+        program += "// function " + id + "\nfun f" + id + "(var x) [\n";
+        program += "    var s = \"line one\n line \\\"two\\\" " + id + "\";\n";
+        program += "    return x * " + id + ".5;\n]\n";
+    }
+    SourceBuffer source = SourceBuffer::fromString(program);
+    Lexer lexer(source);
+    TokenBuffer expected = TokenBuffer::tokenize(lexer);
+    for (unsigned threads : {2u, 5u, 16u})
+        requireSameTokens(tokenizeParallel(source, threads, 64), expected);
+}
+
+TEST_CASE("Chunked reader lexing matches buffer lexing", "[lexer][reader]")
+{
+    const std::string program =
+        "fun a_rather_long_function_name(var x) [\n"
+        "    // a comment crossing chunk borders\n"
+        "    var s = \"escapes \\n \\\" \\\\ and\n a newline\";\n"
+        "    var f = 1234567.890 + 0.5 + 99999999999;\n"
+        "    if (x >= 10 && x != 3 || x == 1) [ x = x @@ y | z; ]\n"
+        "    return s as string;\n] // trailing";
+    SourceBuffer source = SourceBuffer::fromString(program);
+    Lexer bufferLexer(source);
+    auto expected = tokenize(&bufferLexer);
+
+    for (std::size_t chunk : {1, 2, 3, 7, 64, 4096})
+    {
+        std::istringstream input(program);
+        SourceReader reader = SourceReader::fromStream(input, chunk);
+        Lexer lexer(reader);
+        auto tokens = tokenize(&lexer);
+
+        REQUIRE(tokens.size() == expected.size());
+        for (size_t i = 0; i < tokens.size(); ++i)
+        {
+            REQUIRE(tokens[i].type == expected[i].type);
+            REQUIRE(sameValue(tokens[i], expected[i]));
+            REQUIRE(tokens[i].offset == expected[i].offset);
+        }
+    }
+}
+
+TEST_CASE("Chunked reader reports errors across chunk borders", "[lexer][reader]")
+{
+    for (std::size_t chunk : {1, 5, 64})
+    {
+        std::istringstream longIdentifier(
+            "var " + std::string(60, 'a') + " = 1;");
+        SourceReader reader = SourceReader::fromStream(longIdentifier, chunk);
+        Lexer lexer(reader);
+        lexer.scanToken();
+        REQUIRE_THROWS_WITH(lexer.scanToken(), "LexicalError at 1:5 → Identifier is too long");
+
+        std::istringstream badFloat("x = 12.25.;");
+        SourceReader floatReader = SourceReader::fromStream(badFloat, chunk);
+        Lexer floatLexer(floatReader);
+        floatLexer.scanToken();
+        floatLexer.scanToken();
+        REQUIRE_THROWS_WITH(floatLexer.scanToken(), "SyntaxError at 1:5 → Invalid float");
+    }
+}
+
+TEST_CASE("Chunked reader reads from a pipe", "[lexer][reader]")
+{
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    const std::string program = "var x = \"piped\";\nx = x + 1;";
+    REQUIRE(::write(fds[1], program.data(), program.size()) ==
+            static_cast<ssize_t>(program.size()));
+    ::close(fds[1]);
+
+    SourceReader reader = SourceReader::fromDescriptor(fds[0], 4);
+    Lexer lexer(reader);
+    auto tokens = tokenize(&lexer);
+    ::close(fds[0]);
+
+    REQUIRE(tokens.size() == 12);
+    REQUIRE(tokens[3].getValue<std::string>() == "piped");
+    REQUIRE(lexer.lineIndex()->position(tokens[5].offset) == Position(2, 1));
+    REQUIRE(tokens[5].offset == 17);
+    REQUIRE(tokens.back().type == TokenType::EndOfFile);
+}
+
+TEST_CASE("Line index resolves offsets to line and column", "[lexer][position]")
+{
+    SourceBuffer source = SourceBuffer::fromString("a\r\n\n  bc\nd");
+    Lexer lexer(source);
+    auto tokens = tokenize(&lexer);
+    auto lines = lexer.lineIndex();
+
+    REQUIRE(lines->lineCount() == 4);
+    REQUIRE(lines->position(0) == Position(1, 1));
+    REQUIRE(lines->position(1) == Position(1, 2));
+    REQUIRE(lines->position(3) == Position(2, 1));
+    REQUIRE(lines->position(tokens[1].offset) == Position(3, 3));
+    REQUIRE(lines->position(tokens[2].offset) == Position(4, 1));
+    REQUIRE(lines->position(tokens.back().offset) == Position(4, 2));
+}
+
+TEST_CASE("Errors without a line index report the offset as a column", "[lexer][position]")
+{
+    Error error{ErrorType::Runtime, MessageId::InvalidFloat, 6, nullptr, {}};
+    REQUIRE(error.toString() == "RuntimeError at 1:7 → Invalid float");
+    error.lines = std::make_shared<LineIndex>(std::vector<SourceOffset>{0, 4});
+    REQUIRE(error.toString() == "RuntimeError at 2:3 → Invalid float");
+}
+
+namespace
+{
+std::optional<SourceOffset> validate(const std::string& text)
+{
+    Utf8Validator validator;
+    std::vector<SourceOffset> continuations;
+    if (auto invalid = validator.feed(text.data(), text.data() + text.size(), 0, continuations))
+        return invalid;
+    return validator.finish();
+}
+
+std::string lexUntilError(Lexer& lexer)
+{
+    try
+    {
+        tokenize(&lexer);
+    }
+    catch (const InterpreterException& ex)
+    {
+        return ex.what();
+    }
+    return "";
+}
+}  // namespace
+
+TEST_CASE("UTF-8 validator accepts well-formed text", "[lexer][utf8]")
+{
+    REQUIRE_FALSE(validate(""));
+    REQUIRE_FALSE(validate("Cze\xC5\x9B\xC4\x87, \xE2\x82\xAC \xF0\x9F\x98\x80 \xF4\x8F\xBF\xBF"));
+    REQUIRE_FALSE(validate(std::string(100, 'a') + "\xC5\xBC" + std::string(100, 'b')));
+
+    Utf8Validator validator;
+    std::vector<SourceOffset> continuations;
+    const std::string text = "a\xC5\x9B b\xE2\x82\xAC";
+    for (std::size_t i = 0; i < text.size(); ++i)
+        REQUIRE_FALSE(validator.feed(&text[i], &text[i] + 1, i, continuations));
+    REQUIRE_FALSE(validator.finish());
+    REQUIRE(continuations == std::vector<SourceOffset>{2, 6, 7});
+}
+
+TEST_CASE("UTF-8 validator rejects malformed text", "[lexer][utf8]")
+{
+    REQUIRE(validate("ab\x80") == 2u);
+    REQUIRE(validate("a\xC0\x80") == 1u);                   // overlong
+    REQUIRE(validate("a\xE0\x80\x80") == 1u);               // overlong
+    REQUIRE(validate("\xED\xA0\x80") == 0u);                // surrogate
+    REQUIRE(validate("\xF4\x90\x80\x80") == 0u);            // past U+10FFFF
+    REQUIRE(validate("\xF5\x80\x80\x80") == 0u);
+    REQUIRE(validate("x\xC5y") == 1u);
+    REQUIRE(validate(std::string(40, 'a') + "\xE2\x82") == 40u);  // cut short
+}
+
+TEST_CASE("Lexer reports invalid UTF-8 where it is passed", "[lexer][utf8]")
+{
+    const std::string program = "var a = 1;\nvar s = \"b\xC5\x9B\xFF\";\nvar c = 2;";
+    SourceBuffer source = SourceBuffer::fromString(program);
+    Lexer lexer(source);
+    for (int i = 0; i < 8; ++i) lexer.scanToken();
+    REQUIRE_THROWS_WITH(lexer.scanToken(), "LexicalError at 2:12 → Invalid UTF-8 sequence");
+
+    for (std::size_t chunk : {1, 3, 4096})
+    {
+        std::istringstream input(program);
+        SourceReader reader = SourceReader::fromStream(input, chunk);
+        Lexer chunked(reader);
+        REQUIRE(lexUntilError(chunked) == "LexicalError at 2:12 → Invalid UTF-8 sequence");
+    }
+
+    SourceBuffer comment = SourceBuffer::fromString("x = 1; // \xC5\x9B\xC5");
+    Lexer commentLexer(comment);
+    REQUIRE(lexUntilError(commentLexer) == "LexicalError at 1:12 → Invalid UTF-8 sequence");
+
+    requireParallelMatchesSequential(program);
+    requireParallelMatchesSequential(
+        "var a = \"\xC5\x9B\";\nvar b = 1;\n// \xE2\x82\nvar c = 3;\n");
+}
+
+TEST_CASE("Columns count code points", "[lexer][utf8][position]")
+{
+    const std::string program = "var s = \"Krzy\xC5\x9B \xE2\x82\xAC\"; x\nvar t = \"\xC5\xBC\"; y";
+    SourceBuffer source = SourceBuffer::fromString(program);
+    Lexer lexer(source);
+    auto tokens = tokenize(&lexer);
+    auto lines = lexer.lineIndex();
+    REQUIRE(lines->position(tokens[5].offset) == Position(1, 20));
+    REQUIRE(lines->position(tokens[11].offset) == Position(2, 14));
+    REQUIRE(lines->position(tokens[5].offset).offset == 22);
+
+    requireParallelMatchesSequential(program);
+
+    std::istringstream input(program);
+    SourceReader reader = SourceReader::fromStream(input, 2);
+    Lexer chunked(reader);
+    auto chunkedTokens = tokenize(&chunked);
+    REQUIRE(chunked.lineIndex()->position(chunkedTokens[11].offset) == Position(2, 14));
+}
+
+TEST_CASE("Non-ASCII characters outside strings are single unknown tokens", "[lexer][utf8]")
+{
+    std::istringstream input("a\xC5\x9B \xF0\x9F\x98\x80" "b");
+    Lexer lexer(input);
+    auto tokens = tokenize(&lexer);
+    REQUIRE(tokens.size() == 5);
+    REQUIRE(tokens[1].type == TokenType::Unknown);
+    REQUIRE(tokens[1].getValue<std::string>() == "\xC5\x9B");
+    REQUIRE(tokens[2].getValue<std::string>() == "\xF0\x9F\x98\x80");
+    REQUIRE(lexer.lineIndex()->position(tokens[3].offset) == Position(1, 5));
+}
+
+TEST_CASE("nextToken reports lexical errors without throwing", "[lexer][error]")
+{
+    SourceBuffer source = SourceBuffer::fromString("var x = 1.5.;\ny");
+    Lexer lexer(source);
+    REQUIRE(lexer.nextToken().type == TokenType::Var);
+    REQUIRE(lexer.nextToken().type == TokenType::Identifier);
+    REQUIRE(lexer.nextToken().type == TokenType::Assign);
+    REQUIRE_FALSE(lexer.lexicalError());
+
+    Token failed = lexer.nextToken();
+    REQUIRE(failed.type == TokenType::Error);
+    REQUIRE(failed.offset == 8);
+    REQUIRE(lexer.lexicalError()->type == ErrorType::Syntax);
+    REQUIRE(lexer.lexicalError()->message == MessageId::InvalidFloat);
+    REQUIRE(lexer.nextToken().type == TokenType::Error);
+    REQUIRE_THROWS_WITH(lexer.scanToken(), "SyntaxError at 1:9 → Invalid float");
+}